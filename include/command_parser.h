@@ -0,0 +1,102 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "topics.h"
+
+/*
+ * Zone command parsing
+ * ====================
+ * callback() routes home/sprinkler/zone/N/command messages through the ROUTES
+ * table in main.cpp (dispatcher.h), which captures the zone number from the
+ * '+' segment. The payload is then classified straight from the client
+ * buffer, without copying it:
+ *
+ * - parseZoneCommand() folds the payload (at most ZONE_VERB_MAX_LENGTH bytes,
+ *   ASCII letters case-insensitive) into one integer key in a single pass and
+ *   looks it up in the verb table. Adding a verb is one table entry in
+ *   command_parser.cpp.
+ *
+ * home/sprinkler/zones/set switches several zones from one message:
+ *
+ * - parseZoneBatch() accepts a zone bitmask ("5", "0x05": bit 0 is zone 1;
+ *   zones with a set bit go ON, every other zone OFF) or a JSON map of the
+ *   zones to change ({"1":"ON","3":"OFF"}, values as for a single zone). The
+ *   whole payload is checked before anything is returned, so a bad entry
+ *   rejects the batch instead of applying part of it.
+ * - formatZoneStates() writes every zone's state as the same JSON map, for
+ *   the single aggregated reply on home/sprinkler/zones/state.
+ *
+ * The payload is not NUL-terminated; only length bytes are read.
+ */
+
+// Longest verb (and so longest payload) that can match
+#define ZONE_VERB_MAX_LENGTH 7
+
+enum ZoneCommand : uint8_t {
+  ZONE_CMD_UNKNOWN,
+  ZONE_CMD_ON,   // "ON" (any case) or "1"
+  ZONE_CMD_OFF,  // "OFF" (any case) or "0"
+};
+
+/**
+ * Classify a zone command payload
+ *
+ * @param payload Raw payload bytes (not NUL-terminated)
+ * @param length Payload length
+ * @return The command, or ZONE_CMD_UNKNOWN
+ */
+ZoneCommand parseZoneCommand(const uint8_t* payload, unsigned int length);
+
+static_assert(NUM_ZONES <= 32, "zone batches use 32-bit masks");
+
+// Longest accepted payload on the zone batch topic; with the topic it must fit
+// in MQTT_CLIENT_BUFFER_SIZE (checked in main.cpp)
+#define ZONE_BATCH_MAX_LENGTH 192
+
+// formatZoneStates() output for all zones: {"1":"OFF",...} without terminator
+constexpr size_t ZONE_STATES_MAX_LENGTH = NUM_ZONES * (topics::digits(NUM_ZONES) + 9) + 1;
+
+// Zones a batch switches (mask) and their new states (on); bit i is zone i + 1
+struct ZoneBatch {
+  uint32_t mask;
+  uint32_t on;
+};
+
+/**
+ * Parse a zone batch payload (bitmask or JSON map, see above)
+ *
+ * @param payload Raw payload bytes (not NUL-terminated)
+ * @param length Payload length, at most ZONE_BATCH_MAX_LENGTH
+ * @param batch Receives the zones to switch; untouched on failure
+ * @return false if any part of the payload is invalid (unknown zone or verb,
+ *         duplicate zone, bad syntax, mask beyond NUM_ZONES)
+ */
+bool parseZoneBatch(const uint8_t* payload, unsigned int length, ZoneBatch& batch);
+
+/**
+ * Write the state of every zone as {"1":"ON","2":"OFF",...}
+ *
+ * @param buf Output buffer, at least ZONE_STATES_MAX_LENGTH + 1 bytes
+ * @param on Zone states, bit i is zone i + 1
+ * @return Length written, or 0 if buf is too small
+ */
+size_t formatZoneStates(char* buf, size_t size, uint32_t on);
+
+// Upper-case ASCII letters; every other byte is kept as is
+constexpr uint8_t foldCommandByte(uint8_t c) {
+  return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+// Lookup key: folded bytes, little endian, with the length in the top byte
+constexpr uint64_t commandKey(const char* word, unsigned int length) {
+  uint64_t key = (uint64_t)length << 56;
+  for (unsigned int i = 0; i < length; i++) {
+    key |= (uint64_t)foldCommandByte((uint8_t)word[i]) << (8 * i);
+  }
+  return key;
+}
+
+#endif // COMMAND_PARSER_H
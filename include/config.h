@@ -4,8 +4,11 @@
 // Software version
 #define SW_VERSION "2.0.0"
 
-// Debug configuration
+// Debug configuration (can be overridden with -DDEBUG=false in platformio.ini).
+// Also picks the default log level: trace with DEBUG, warn without (logging.h).
+#ifndef DEBUG
 #define DEBUG true  // Set to false to disable debug output
+#endif
 
 // WiFiManager AP settings
 #define AP_SSID "SprinklerSetup"
@@ -14,17 +17,37 @@
 // #define AP_PASSWORD "sprinklerconfig"  // DEPRECATED: No longer used
 
 // MQTT settings
-#define MQTT_CLIENT_ID "sprinkler_controller"
+#define MQTT_CLIENT_ID_FORMAT "sprinkler_%08X"  // chip ID: one broker session per controller
 #define MQTT_DEFAULT_PORT "1883"
+#ifndef MQTT_PERSISTENT_SESSION
+#define MQTT_PERSISTENT_SESSION true  // see mqtt_client.h
+#endif
+#ifndef MQTT_COMMAND_QOS
+#define MQTT_COMMAND_QOS 1  // command subscriptions, and the QoS Home Assistant sends with
+#endif
 
 // MQTT topics
 #define MQTT_TOPIC_PREFIX "home/sprinkler/"
 #define MQTT_ZONE_COMMAND "home/sprinkler/zone/+/command"
+#define MQTT_ZONES_SET "home/sprinkler/zones/set"
+#define MQTT_ZONES_STATE "home/sprinkler/zones/state"
 #define MQTT_STATUS "home/sprinkler/status"
+#define MQTT_STATUS_MSGPACK "home/sprinkler/status/msgpack"
+#define MQTT_TELEMETRY "home/sprinkler/telemetry"
+#define MQTT_EVENT "home/sprinkler/event"
+#define MQTT_PROFILE "home/sprinkler/profile"
+#define MQTT_PROFILE_COMMAND "home/sprinkler/profile/command"
+#define MQTT_LOG_LEVEL "home/sprinkler/log/level"
+#define MQTT_LOG_LEVEL_STATE "home/sprinkler/log/level/state"
+#define MQTT_DISCOVERY_FINGERPRINT "home/sprinkler/discovery/fingerprint"
+#define MQTT_RECONNECT_WINDOW "home/sprinkler/reconnect/window"
 
 // Timer intervals (milliseconds)
 #define RECONNECT_INTERVAL 5000
 #define STATUS_INTERVAL 60000
+#define MEMORY_SAMPLE_INTERVAL 1000  // heap/stack minimum tracking
+#define DISCOVERY_INTERVAL 50        // between two zones' discovery configs
+#define DISCOVERY_VERIFY_TIMEOUT 2000  // wait for the retained discovery fingerprints
 #define CONFIG_PORTAL_TIMEOUT 180  // Seconds
 
 // Safety: Maximum zone runtime (2 hours in milliseconds)
@@ -33,17 +56,22 @@
 // MQTT buffer sizes for stack allocation
 #define MQTT_TOPIC_BUFFER_SIZE 64
 #define MQTT_UNIQUE_ID_BUFFER_SIZE 32
-#define MQTT_PAYLOAD_BUFFER_SIZE 512
+#define MQTT_PAYLOAD_BUFFER_SIZE 640   // largest JSON payload published (streamed, not buffered)
+#define MQTT_CLIENT_BUFFER_SIZE 256    // PubSubClient packet buffer: inbound commands
+#define MQTT_STREAM_CHUNK_SIZE 128     // bytes per socket write when streaming a payload
 #define MQTT_MESSAGE_BUFFER_SIZE 8
 
+// Largest /config.json accepted by loadConfig() (read into a stack buffer)
+#define CONFIG_FILE_BUFFER_SIZE 256
+
 // Hardware configuration
 #define NUM_ZONES 7
 
 // Pin mapping for zones (ESP8266 GPIO pins)
 const int ZONE_PINS[NUM_ZONES] = {5, 4, 14, 12, 13, 15, 16};
 
-// Zone names
-const char* ZONE_NAMES[NUM_ZONES] = {
+// Zone names (const pointers keep the table internal to each translation unit)
+const char* const ZONE_NAMES[NUM_ZONES] = {
   "Front Lawn", 
   "Back Lawn", 
   "Garden", 
@@ -53,15 +81,4 @@ const char* ZONE_NAMES[NUM_ZONES] = {
   "Extra Zone"
 };
 
-// Debug macros
-#if DEBUG
-  #define DEBUG_PRINT(x) Serial.print(x)
-  #define DEBUG_PRINTLN(x) Serial.println(x)
-  #define DEBUG_PRINTF(x, ...) Serial.printf(x, __VA_ARGS__)
-#else
-  #define DEBUG_PRINT(x)
-  #define DEBUG_PRINTLN(x)
-  #define DEBUG_PRINTF(x, ...)
-#endif
-
 #endif // CONFIG_H
@@ -0,0 +1,96 @@
+#ifndef CONNACK_CLIENT_H
+#define CONNACK_CLIENT_H
+
+/*
+ * CONNACK session-present flag for PubSubClient
+ * =============================================
+ * PubSubClient 2.8 reads the CONNACK but keeps its flags byte to itself, so
+ * MqttClient hands the library a ConnackClient instead of the socket: every
+ * call goes through to the hal::NetClient unchanged, and the bytes read after
+ * expectConnack() are watched for the CONNACK (0x20, length 2, flags, return
+ * code). sessionPresent() is bit 0 of its flags: the broker kept the session
+ * of an earlier connection.
+ *
+ * Native builds have no byte stream under the PubSubClient stand-in; there the
+ * flag is the one the broker stand-in accepted the connect with
+ * (hal::native::MqttSession::sessionPresent).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+
+#ifdef NATIVE_BUILD
+
+class ConnackClient : public hal::NetClient {
+ public:
+  explicit ConnackClient(hal::NetClient& net) { (void)net; }
+
+  void expectConnack() {}
+  bool sessionPresent() const { return hal::native::device().mqtt.sessionPresent; }
+};
+
+#else
+
+class ConnackClient : public Client {
+ public:
+  explicit ConnackClient(hal::NetClient& net) : net_(net) {}
+
+  // The next bytes read are the CONNACK of a CONNECT about to be sent
+  void expectConnack() {
+    connackRead_ = 0;
+    flags_ = 0;
+  }
+  bool sessionPresent() const { return connackRead_ == CONNACK_LENGTH && (flags_ & 0x01); }
+
+  int connect(IPAddress ip, uint16_t port) override { return net_.connect(ip, port); }
+  int connect(const char* host, uint16_t port) override { return net_.connect(host, port); }
+  size_t write(uint8_t b) override { return net_.write(b); }
+  size_t write(const uint8_t* buf, size_t size) override { return net_.write(buf, size); }
+  int available() override { return net_.available(); }
+  int read() override {
+    int c = net_.read();
+    if (c >= 0) {
+      watch(static_cast<uint8_t>(c));
+    }
+    return c;
+  }
+  int read(uint8_t* buf, size_t size) override {
+    int n = net_.read(buf, size);
+    for (int i = 0; i < n; i++) {
+      watch(buf[i]);
+    }
+    return n;
+  }
+  int peek() override { return net_.peek(); }
+  void flush() override { net_.flush(); }
+  void stop() override { net_.stop(); }
+  uint8_t connected() override { return net_.connected(); }
+  operator bool() override { return static_cast<bool>(net_); }
+
+ private:
+  static const uint8_t CONNACK_LENGTH = 4;  // fixed header, length, flags, code
+
+  void watch(uint8_t b) {
+    if (connackRead_ >= CONNACK_LENGTH) {
+      return;
+    }
+    // Anything but a CONNACK header ends the watch with no flag
+    if (connackRead_ == 0 && b != 0x20) {
+      connackRead_ = CONNACK_LENGTH + 1;
+      return;
+    }
+    if (connackRead_ == 2) {
+      flags_ = b;
+    }
+    connackRead_++;
+  }
+
+  hal::NetClient& net_;
+  uint8_t connackRead_ = CONNACK_LENGTH + 1;  // bytes of the CONNACK seen so far
+  uint8_t flags_ = 0;
+};
+
+#endif  // NATIVE_BUILD
+
+#endif  // CONNACK_CLIENT_H
@@ -0,0 +1,49 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <stdint.h>
+#include "config.h"
+#include "telemetry.h"
+#include "publish_queue.h"
+#include "discovery.h"
+#include "status_report.h"
+#include "mqtt_connect.h"
+#include "offline_log.h"
+
+/*
+ * Mutable runtime state of one controller, kept in a single struct so host
+ * tools can run many controllers through the same firmware code by swapping
+ * it in and out (see tools/fleet_sim.cpp). Must stay trivially copyable.
+ */
+struct ControllerState {
+  // Timing variables
+  uint32_t lastStatusReport;
+
+  // Progress of the MQTT connect sequence (see mqtt_connect.h)
+  ConnectState connect;
+
+  // Zone runtime tracking for safety limits
+  uint32_t zone_on_time[NUM_ZONES];
+
+  // Loop cycle-time histogram, published with the status (see telemetry.h)
+  LoopTelemetry telemetry;
+
+  // Heap/stack minimums since boot, reported in the status (see telemetry.h)
+  MemoryStats memory;
+
+  // State publishes waiting for loop() (see publish_queue.h)
+  PublishQueue publishQueue;
+
+  // Events and zone states waiting for the broker (see offline_log.h)
+  OfflineLog offline;
+
+  // Home Assistant discovery configs to publish (see discovery.h)
+  DiscoveryState discovery;
+
+  // Values the last status reports carried (see status_report.h)
+  StatusReport status;
+};
+
+extern ControllerState controller;
+
+#endif // CONTROLLER_H
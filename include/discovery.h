@@ -0,0 +1,129 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+/*
+ * Home Assistant discovery passes
+ * ===============================
+ * Decides which zones' discovery configs a connection has to publish. Each
+ * zone's config payload is fingerprinted once at boot (FNV-1a, see
+ * publishMeasure()) and a config is only published when the broker is not
+ * known to hold that exact payload:
+ *
+ * - The fingerprints the broker was last left holding are kept in flash
+ *   (DISCOVERY_FINGERPRINT_FILE). Zones whose payload differs from them (new
+ *   firmware, renamed zone, first boot) are published straight away.
+ * - After each pass the same fingerprints are published, retained, on
+ *   MQTT_DISCOVERY_FINGERPRINT. The controller subscribes to that topic, so on
+ *   connect the broker hands back the fingerprints of the configs it holds;
+ *   zones that match are skipped, the others published.
+ * - Zones the broker has not confirmed within DISCOVERY_VERIFY_TIMEOUT (broker
+ *   restarted without persistence, record deleted) are published.
+ *
+ * The retained configs themselves are not read back: at ~475 bytes they do
+ * not fit in the client buffer (MQTT_CLIENT_BUFFER_SIZE), the 62-byte record
+ * does. A config deleted on the broker while its record stays is therefore
+ * only restored when the record goes too or the payload changes.
+ *
+ * Record format (topic and file): NUM_ZONES fingerprints as 8 lowercase hex
+ * digits, comma separated, zone 1 first.
+ */
+
+#define DISCOVERY_FINGERPRINT_FILE "/discovery.txt"
+
+constexpr size_t DISCOVERY_RECORD_LENGTH = NUM_ZONES * 9 - 1;
+constexpr size_t DISCOVERY_JSON_CAPACITY = JSON_OBJECT_SIZE(12) + JSON_OBJECT_SIZE(5) + 400;
+
+struct DiscoveryState {
+  uint32_t fingerprint[NUM_ZONES];  // current config payloads
+  uint32_t held[NUM_ZONES];         // payloads the broker is believed to hold
+
+  // Bit i: zone i + 1
+  uint32_t pending;     // to publish in this pass
+  uint32_t unverified;  // believed held, waiting for the broker's record
+  uint32_t published;   // published in this pass
+
+  uint32_t verifyStartMs;
+  uint32_t lastPublishMs;
+  bool active;          // a pass is running (survives reconnects)
+  bool recordSeen;      // the broker's record arrived during this pass
+};
+
+/**
+ * Set up at boot
+ *
+ * @param current Fingerprint of each zone's config payload
+ * @param stored Record read from flash, or nullptr if there is none
+ */
+void discoveryInit(DiscoveryState& state, const uint32_t* current, const uint32_t* stored);
+
+/**
+ * Start a pass on a new connection
+ *
+ * Zones not believed held become pending, the others wait for the broker's
+ * record. A pass a lost connection interrupted resumes with what it had left.
+ */
+void discoveryStart(DiscoveryState& state, uint32_t nowMs);
+
+// Whether a record from the broker would still change anything
+bool discoveryVerifying(const DiscoveryState& state);
+
+/**
+ * Apply the record the broker holds
+ *
+ * Zones not yet published in this pass are skipped if it matches their
+ * payload and published otherwise.
+ */
+void discoveryVerify(DiscoveryState& state, const uint32_t* broker);
+
+/**
+ * Zone to publish now, or 0
+ *
+ * One zone per DISCOVERY_INTERVAL. Zones still unverified
+ * DISCOVERY_VERIFY_TIMEOUT after the pass started are published too.
+ */
+int discoveryNext(DiscoveryState& state, uint32_t nowMs);
+
+/**
+ * Take a zone off the pass
+ *
+ * @param sent Whether the broker got the config (false: given up on; it is
+ *             published again in the next pass)
+ */
+void discoveryDone(DiscoveryState& state, int zone, bool sent);
+
+/**
+ * End the pass once nothing is left
+ *
+ * Returns true once per pass; the caller then stores state.held and, if
+ * discoveryRecordStale(), publishes it.
+ */
+bool discoveryPassComplete(DiscoveryState& state);
+
+// Whether the broker's record no longer matches state.held
+bool discoveryRecordStale(const DiscoveryState& state);
+
+/**
+ * Fill in the Home Assistant config of one zone
+ *
+ * Switch configuration, MQTT topics (commands sent at MQTT_COMMAND_QOS, so
+ * the broker queues them for the persistent session), and device information
+ * (chip ID, model, manufacturer, software version) that groups all zones
+ * under a single device in the HA UI.
+ *
+ * @param json Document to fill (cleared first), DISCOVERY_JSON_CAPACITY or more
+ * @return false if the document overflowed
+ */
+bool buildDiscoveryConfig(JsonDocument& json, int zoneNum, uint32_t chipId);
+
+// Write a record (NUL terminated); returns its length, 0 if size is too small
+size_t formatDiscoveryRecord(char* buf, size_t size, const uint32_t* fingerprints);
+
+// Read a record; false (fingerprints untouched) if it is malformed
+bool parseDiscoveryRecord(const uint8_t* text, size_t length, uint32_t* fingerprints);
+
+#endif // DISCOVERY_H
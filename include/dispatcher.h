@@ -0,0 +1,521 @@
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Topic dispatcher
+ * ================
+ * Routes are a static table of MQTT topic patterns and handlers:
+ *
+ *   static constexpr TopicRoute ROUTES[] = {
+ *     {"home/sprinkler/zone/+/command", handleZoneRoute},
+ *     {"home/sprinkler/profile/command", handleProfileRoute},
+ *   };
+ *   static constexpr TopicDispatcher<topicNodeBound(ROUTES), topicIndexSize(ROUTES)>
+ *       dispatcher(ROUTES, sizeof(ROUTES) / sizeof(ROUTES[0]));
+ *   static_assert(dispatcher.valid, "bad route table");
+ *
+ * The compiler turns the patterns into a segment trie (chains of single
+ * literal children folded into one edge) whose children are found through one
+ * open-addressing hash table keyed by (parent node, segment). dispatch()
+ * probes the table once per edge and verifies the hit with one strncmp(), so
+ * routing cost depends on the topic's depth, not on how many routes exist.
+ *
+ * Patterns use MQTT wildcards: '+' matches one segment and '#' (last segment
+ * only) matches the rest of the topic, including nothing. Wildcard segments are
+ * captured for the handler in order. Literal segments win over '+', and '+'
+ * over '#'.
+ *
+ * Fast routes: up to MAX_FAST_ROUTES routes marked fast are tried before the
+ * trie with two string compares (the literal text before their '+', then the
+ * rest after it), which is cheaper than one probe per edge for the topic the
+ * firmware sees most (zone commands). A fast pattern has exactly one '+' and
+ * no '#', and no literal segment may sit beside its '+' in the trie, so the
+ * fast match is always the one the trie would have picked.
+ *
+ * Everything is constexpr: the trie sits in .rodata and an invalid table
+ * (duplicate pattern, '#' not last, too many captures, a fast route that does
+ * not qualify) clears valid, which the static_assert turns into a build error.
+ */
+
+#define MAX_TOPIC_CAPTURES 4
+#define MAX_FAST_ROUTES 2
+
+struct TopicMatch {
+  uint8_t count;
+  const char* capture[MAX_TOPIC_CAPTURES];   // not NUL-terminated
+  uint8_t length[MAX_TOPIC_CAPTURES];
+
+  // Decimal value of a capture (at most 3 digits), -1 if it is not a number
+  int captureInt(int i) const {
+    if (i < 0 || i >= count || length[i] == 0 || length[i] > 3) {
+      return -1;
+    }
+    int value = 0;
+    for (uint8_t k = 0; k < length[i]; k++) {
+      char c = capture[i][k];
+      if (c < '0' || c > '9') {
+        return -1;
+      }
+      value = value * 10 + (c - '0');
+    }
+    return value;
+  }
+};
+
+typedef void (*TopicHandler)(const TopicMatch& match, const uint8_t* payload, unsigned int length);
+
+struct TopicRoute {
+  const char* pattern;
+  TopicHandler handler;
+  // Subscription options; routing ignores them
+  uint8_t qos = 0;
+  bool retained = false;  // carries a retained message to read on every connect
+  bool fast = false;      // matched before the trie (see above)
+};
+
+struct TopicNode {
+  const char* segment;     // literal segment inside the pattern
+  uint8_t segmentLength;
+  uint8_t literals;        // literal children (0: skip the index probe)
+  int16_t parent;
+  int16_t wildcard;        // '+' child, -1 if none
+  int8_t route;            // route whose pattern ends here, -1 if none
+  int8_t multiRoute;       // route with a '#' below this node, -1 if none
+};
+
+struct TopicFastRoute {
+  int8_t route;
+  uint8_t prefixLength;    // pattern bytes before the '+'
+  const char* suffix;      // pattern after the '+': "" or "/..."
+};
+
+struct TopicIndexSlot {
+  uint32_t key;
+  int16_t node;            // -1: empty
+};
+
+namespace dispatch {
+
+constexpr bool isSegmentEnd(char c) {
+  return c == '\0' || c == '/';
+}
+
+// Index key of a topic segment below a parent node. Only the length and three
+// of its bytes are hashed: every hit is verified in full anyway.
+constexpr uint32_t slotKey(const char* segment, size_t length, int parent) {
+  uint32_t h = (uint32_t)length;
+  if (length) {
+    h = h * 33 ^ (uint8_t)segment[0];
+    h = h * 33 ^ (uint8_t)segment[length / 2];
+    h = h * 33 ^ (uint8_t)segment[length - 1];
+  }
+  return ((h + (uint32_t)(parent + 1) * 0x9E3779B1u) * 0x85EBCA6Bu) >> 8;
+}
+
+constexpr size_t segmentLength(const char* p) {
+  size_t n = 0;
+  while (!isSegmentEnd(p[n])) {
+    n++;
+  }
+  return n;
+}
+
+constexpr size_t segmentCount(const char* pattern) {
+  size_t n = 1;
+  for (const char* p = pattern; *p; p++) {
+    n += (*p == '/');
+  }
+  return n;
+}
+
+constexpr size_t nextPowerOfTwo(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+}  // namespace dispatch
+
+// Node capacity for a route table (root plus every segment, before sharing)
+template <size_t N>
+constexpr size_t topicNodeBound(const TopicRoute (&routes)[N]) {
+  size_t n = 1;
+  for (size_t i = 0; i < N; i++) {
+    n += dispatch::segmentCount(routes[i].pattern);
+  }
+  return n;
+}
+
+// Index size: a power of two above the node bound. Shared prefixes, folded
+// edges and wildcards are not indexed, so the table is usually under half full.
+template <size_t N>
+constexpr size_t topicIndexSize(const TopicRoute (&routes)[N]) {
+  return dispatch::nextPowerOfTwo(topicNodeBound(routes) + 1);
+}
+
+template <size_t NumNodes, size_t IndexSize>
+struct TopicDispatcher {
+  static_assert((IndexSize & (IndexSize - 1)) == 0, "IndexSize must be a power of two");
+  static_assert(IndexSize >= NumNodes, "IndexSize must hold every node");
+
+  const TopicRoute* routes;
+  size_t routeCount;
+  TopicNode nodes[NumNodes];
+  size_t nodeCount;
+  TopicIndexSlot index[IndexSize];
+  TopicFastRoute fast[MAX_FAST_ROUTES];
+  uint8_t fastCount;
+  bool valid;
+
+  constexpr TopicDispatcher(const TopicRoute* table, size_t count)
+      : routes(table), routeCount(count), nodes{}, nodeCount(1), index{}, fast{}, fastCount(0),
+        valid(count < 128) {
+    for (size_t i = 0; i < IndexSize; i++) {
+      index[i].node = -1;
+    }
+    nodes[0] = TopicNode{nullptr, 0, 0, -1, -1, -1, -1};
+    for (size_t i = 0; i < count && valid; i++) {
+      valid = addRoute((int)i);
+    }
+    if (valid) {
+      valid = addFastRoutes();  // before compress(): one node per segment
+    }
+    if (valid) {
+      compress();
+      valid = buildIndex();
+    }
+  }
+
+  /**
+   * Route a message to its handler
+   *
+   * @param topic NUL-terminated topic
+   * @return true if a route matched (and its handler ran)
+   */
+  bool dispatch(const char* topic, const uint8_t* payload, unsigned int length) const {
+    TopicMatch match = {};
+    int route = matchTopic(topic, match);
+    if (route < 0) {
+      return false;
+    }
+    routes[route].handler(match, payload, length);
+    return true;
+  }
+
+  // Route index for a topic, -1 if none (for tests and benchmarks)
+  int find(const char* topic, TopicMatch& match) const {
+    match = TopicMatch{};
+    return matchTopic(topic, match);
+  }
+
+ private:
+  static constexpr int16_t MERGED = -2;  // parent of a node folded into its parent
+
+  static constexpr bool isWildcard(const TopicNode& node) {
+    return node.segmentLength == 1 && node.segment[0] == '+';
+  }
+
+  // Build time: literal child of parent matching a pattern segment, -1 if none
+  // (a linear scan; the index is built once the trie is final)
+  constexpr int findChild(int parent, const char* segment, size_t length) const {
+    for (size_t id = 1; id < nodeCount; id++) {
+      const TopicNode& node = nodes[id];
+      if (node.parent == parent && node.segmentLength == length && !isWildcard(node)) {
+        size_t i = 0;
+        while (i < length && node.segment[i] == segment[i]) {
+          i++;
+        }
+        if (i == length) {
+          return (int)id;
+        }
+      }
+    }
+    return -1;
+  }
+
+  // Fold every literal node whose only way on is one literal child into that
+  // child's edge ("home" + "sprinkler" -> "home/sprinkler"), so common
+  // prefixes cost one probe instead of one per segment
+  constexpr void compress() {
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t id = 1; id < nodeCount; id++) {
+        TopicNode& node = nodes[id];
+        if (node.parent == MERGED || isWildcard(node) || node.route >= 0 ||
+            node.wildcard >= 0 || node.multiRoute >= 0) {
+          continue;
+        }
+        int only = -1;
+        int children = 0;
+        for (size_t c = 1; c < nodeCount; c++) {
+          if (nodes[c].parent == (int)id) {
+            only = (int)c;
+            children++;
+          }
+        }
+        if (children != 1 || isWildcard(nodes[only])) {
+          continue;
+        }
+        TopicNode& child = nodes[only];
+        // Both segments must be adjacent in one pattern to share an edge
+        if (child.segment != node.segment + node.segmentLength + 1 ||
+            node.segmentLength + 1 + child.segmentLength > 255) {
+          continue;
+        }
+        node.segmentLength = (uint8_t)(node.segmentLength + 1 + child.segmentLength);
+        node.route = child.route;
+        node.wildcard = child.wildcard;
+        node.multiRoute = child.multiRoute;
+        for (size_t c = 1; c < nodeCount; c++) {
+          if (nodes[c].parent == only) {
+            nodes[c].parent = (int16_t)id;
+          }
+        }
+        child.parent = MERGED;
+        changed = true;
+      }
+    }
+  }
+
+  constexpr bool addFastRoutes() {
+    for (size_t r = 0; r < routeCount; r++) {
+      if (!routes[r].fast) {
+        continue;
+      }
+      if (fastCount >= MAX_FAST_ROUTES) {
+        return false;
+      }
+      // Literal segments up to the '+' (addRoute() made a node for each)
+      const char* pattern = routes[r].pattern;
+      const char* p = pattern;
+      int node = 0;
+      while (!(p[0] == '+' && dispatch::isSegmentEnd(p[1]))) {
+        size_t length = dispatch::segmentLength(p);
+        if (p[length] == '\0' || (length == 1 && p[0] == '#')) {
+          return false;  // no '+'
+        }
+        node = findChild(node, p, length);
+        p += length + 1;
+      }
+      // A literal beside the '+' would win over it in the trie
+      for (size_t id = 1; id < nodeCount; id++) {
+        if (nodes[id].parent == node && !isWildcard(nodes[id])) {
+          return false;
+        }
+      }
+      const char* suffix = p + 1;
+      for (const char* s = suffix; *s; s++) {
+        if (*s == '+' || *s == '#') {
+          return false;
+        }
+      }
+      if (p - pattern > 255) {
+        return false;
+      }
+      fast[fastCount++] = TopicFastRoute{(int8_t)r, (uint8_t)(p - pattern), suffix};
+    }
+    return true;
+  }
+
+  constexpr bool buildIndex() {
+    for (size_t id = 1; id < nodeCount; id++) {
+      const TopicNode& node = nodes[id];
+      if (node.parent == MERGED || isWildcard(node)) {
+        continue;
+      }
+      // Folded edges are keyed by their first segment, the one a lookup sees
+      size_t first = dispatch::segmentLength(node.segment);
+      if (!insert(dispatch::slotKey(node.segment, first, node.parent), (int)id)) {
+        return false;
+      }
+      nodes[node.parent].literals++;
+    }
+    return true;
+  }
+
+  // Run time: node for the topic segment [p, p + length) below parent (and
+  // the segments after it, for a folded edge), -1 if none
+  int lookup(int parent, const char* p, size_t length) const {
+    uint32_t key = dispatch::slotKey(p, length, parent);
+    for (size_t probe = 0; probe < IndexSize; probe++) {
+      const TopicIndexSlot& slot = index[(key + probe) & (IndexSize - 1)];
+      if (slot.node < 0) {
+        return -1;
+      }
+      const TopicNode& node = nodes[slot.node];
+      // strncmp() stops at the topic's NUL, so p[length] is in bounds on a match
+      if (slot.key == key && node.parent == parent &&
+          strncmp(node.segment, p, node.segmentLength) == 0 &&
+          dispatch::isSegmentEnd(p[node.segmentLength])) {
+        return slot.node;
+      }
+    }
+    return -1;
+  }
+
+  constexpr int newNode(int parent, const char* segment, size_t length) {
+    if (nodeCount >= NumNodes || length > 255) {
+      return -1;
+    }
+    int id = (int)nodeCount++;
+    nodes[id] = TopicNode{segment, (uint8_t)length, 0, (int16_t)parent, -1, -1, -1};
+    return id;
+  }
+
+  constexpr bool addRoute(int route) {
+    const char* p = routes[route].pattern;
+    int node = 0;
+    int captures = 0;
+    while (true) {
+      const char* start = p;
+      while (*p && *p != '/') {
+        p++;
+      }
+      size_t length = p - start;
+      bool last = (*p == '\0');
+
+      if (length == 1 && start[0] == '#') {
+        // Multi-level wildcard: last segment only, one route per node
+        if (!last || nodes[node].multiRoute >= 0 || ++captures > MAX_TOPIC_CAPTURES) {
+          return false;
+        }
+        nodes[node].multiRoute = (int8_t)route;
+        return true;
+      }
+
+      int child = -1;
+      if (length == 1 && start[0] == '+') {
+        if (++captures > MAX_TOPIC_CAPTURES) {
+          return false;
+        }
+        child = nodes[node].wildcard;
+        if (child < 0) {
+          child = newNode(node, start, length);
+          if (child < 0) {
+            return false;
+          }
+          nodes[node].wildcard = (int16_t)child;
+        }
+      } else {
+        child = findChild(node, start, length);
+        if (child < 0) {
+          child = newNode(node, start, length);
+          if (child < 0) {
+            return false;
+          }
+        }
+      }
+      node = child;
+
+      if (last) {
+        if (nodes[node].route >= 0) {
+          return false;  // duplicate pattern
+        }
+        nodes[node].route = (int8_t)route;
+        return true;
+      }
+      p++;  // skip '/'
+    }
+  }
+
+  constexpr bool insert(uint32_t key, int node) {
+    for (size_t probe = 0; probe < IndexSize; probe++) {
+      TopicIndexSlot& slot = index[(key + probe) & (IndexSize - 1)];
+      if (slot.node < 0) {
+        slot.key = key;
+        slot.node = (int16_t)node;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Fast routes first, then the trie
+  int matchTopic(const char* topic, TopicMatch& match) const {
+    for (uint8_t i = 0; i < fastCount; i++) {
+      const TopicFastRoute& route = fast[i];
+      if (strncmp(topic, routes[route.route].pattern, route.prefixLength) == 0) {
+        const char* p = topic + route.prefixLength;
+        const char* end = p + dispatch::segmentLength(p);
+        if (strcmp(end, route.suffix) == 0) {
+          match.capture[0] = p;
+          match.length[0] = captureLength(end - p);
+          match.count = 1;
+          return route.route;
+        }
+      }
+    }
+    return matchFrom(0, topic, match);
+  }
+
+  // Match the rest of the topic (starting at a segment) below node
+  int matchFrom(int node, const char* p, TopicMatch& match) const {
+    const TopicNode& current = nodes[node];
+    const char* end = p + dispatch::segmentLength(p);
+
+    // Literal segment first
+    int child = current.literals ? lookup(node, p, end - p) : -1;
+    if (child >= 0) {
+      int route = matchChild(child, p + nodes[child].segmentLength, match);
+      if (route >= 0) {
+        return route;
+      }
+    }
+
+    // Then a single-level wildcard, captured
+    if (match.count >= MAX_TOPIC_CAPTURES) {
+      return -1;
+    }
+    if (current.wildcard >= 0) {
+      uint8_t saved = match.count;
+      match.capture[saved] = p;
+      match.length[saved] = captureLength(end - p);
+      match.count = saved + 1;
+      int route = matchChild(current.wildcard, end, match);
+      if (route >= 0) {
+        return route;
+      }
+      match.count = saved;
+    }
+
+    // Finally '#': captures everything from this segment on
+    if (current.multiRoute >= 0) {
+      match.capture[match.count] = p;
+      match.length[match.count] = captureLength(end - p + strlen(end));
+      match.count++;
+      return current.multiRoute;
+    }
+    return -1;
+  }
+
+  static uint8_t captureLength(size_t length) {
+    return (uint8_t)(length < 255 ? length : 255);
+  }
+
+  // Continue below child; end is where its segment ended in the topic
+  int matchChild(int child, const char* end, TopicMatch& match) const {
+    if (*end == '/') {
+      return matchFrom(child, end + 1, match);
+    }
+    if (nodes[child].route >= 0) {
+      return nodes[child].route;
+    }
+    // "a/#" also matches "a"
+    if (nodes[child].multiRoute >= 0 && match.count < MAX_TOPIC_CAPTURES) {
+      match.capture[match.count] = end;
+      match.length[match.count] = 0;
+      match.count++;
+      return nodes[child].multiRoute;
+    }
+    return -1;
+  }
+};
+
+#endif // DISPATCHER_H
@@ -0,0 +1,91 @@
+#ifndef HAL_H
+#define HAL_H
+
+/*
+ * Hardware abstraction layer
+ * ==========================
+ * The firmware logic in main.cpp talks to the board only through this header:
+ * GPIO, the millisecond clock, chip/system information, the SPIFFS config
+ * filesystem and the network client underneath PubSubClient (plus the DNS and
+ * TCP steps that open it without blocking loop() for long).
+ *
+ * - ESP8266 builds: every call is an inline wrapper around the Arduino core,
+ *   so the HAL costs nothing on the device.
+ * - Native builds (NATIVE_BUILD, see [env:native] in platformio.ini): the same
+ *   calls are implemented in src/native/hal_native.cpp on top of simulated
+ *   pins, a real or virtual clock, in-memory files and a broker stand-in.
+ *   Host-only controls live in include/native/hal_native.h.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef NATIVE_BUILD
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+// Console used by the LOG_* macros in logging.h
+#define HAL_CONSOLE Serial
+
+namespace hal {
+
+// Network client that PubSubClient runs on top of
+typedef WiFiClient NetClient;
+
+// GPIO
+inline void gpioOutput(int pin) { pinMode(pin, OUTPUT); }
+inline void gpioWrite(int pin, bool high) { digitalWrite(pin, high ? HIGH : LOW); }
+inline bool gpioRead(int pin) { return digitalRead(pin) == HIGH; }
+
+// Clock (32-bit, wraps after ~49.7 days like the Arduino core)
+inline uint32_t millis() { return ::millis(); }
+inline void delay(uint32_t ms) { ::delay(ms); }
+
+// CPU cycle counter (CCOUNT register; wraps every ~53 s at 80 MHz)
+inline uint32_t cycleCount() { return ESP.getCycleCount(); }
+inline uint32_t cpuMhz() { return ESP.getCpuFreqMHz(); }
+
+// System information
+inline void consoleBegin(unsigned long baud) { Serial.begin(baud); }
+// Raw console output that never blocks: write at most consoleWritable() bytes
+inline size_t consoleWritable() { return Serial.availableForWrite(); }
+inline void consoleWrite(const uint8_t* data, size_t len) { Serial.write(data, len); }
+inline uint32_t chipId() { return ESP.getChipId(); }
+inline uint32_t freeHeap() { return ESP.getFreeHeap(); }
+inline int32_t wifiRssi() { return WiFi.RSSI(); }
+
+// Heap and stack health. The core paints the loop() (cont) stack at boot;
+// freeStack() scans for the paint, so it reports the high-water mark.
+// stackPaint() repaints the unused part to restart the measurement.
+inline uint32_t maxFreeBlock() { return ESP.getMaxFreeBlockSize(); }
+inline uint8_t heapFragmentation() { return ESP.getHeapFragmentation(); }
+inline uint32_t freeStack() { return ESP.getFreeContStack(); }
+inline void stackPaint() { ESP.resetFreeContStack(); }
+
+// Network steps of the MQTT connect (see mqtt_connect.h). DNS is asynchronous:
+// start it, then poll. Addresses are IPv4 in lwIP (network) byte order.
+// netConnect() blocks for at most timeoutMs.
+enum NetResult { NET_PENDING, NET_OK, NET_FAILED };
+bool netResolveStart(const char* host);
+NetResult netResolvePoll(uint32_t* ip);
+bool netConnect(NetClient& client, uint32_t ip, uint16_t port, uint32_t timeoutMs);
+inline bool netConnected(NetClient& client) { return client.connected(); }
+inline void netClose(NetClient& client) { client.stop(); }
+
+// Filesystem (SPIFFS)
+bool fsBegin();
+bool fsExists(const char* path);
+size_t fsSize(const char* path);
+size_t fsRead(const char* path, char* buf, size_t len);
+bool fsWrite(const char* path, const char* data, size_t len);
+
+}  // namespace hal
+
+#else  // NATIVE_BUILD
+
+#include "native/hal_native.h"
+
+#endif  // NATIVE_BUILD
+
+#endif  // HAL_H
@@ -0,0 +1,136 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "token_log.h"
+
+/*
+ * Per-module log levels
+ * =====================
+ * LOG_ERROR/LOG_WARN/LOG_INFO/LOG_TRACE(module, "format", args...) log for one
+ * of the modules below. Each module has a compile-time level; a call above it
+ * is a constant-false branch, so its format string and argument evaluation are
+ * compiled out entirely. Calls at or below it check a one-byte runtime level,
+ * which can be lowered (and raised again, up to the compile-time level) over
+ * MQTT:
+ *
+ *   home/sprinkler/log/level  <-  "warn"              every module
+ *                             <-  "mqtt=trace"        one module
+ *                             <-  "zones=info,ota=off"
+ *                             <-  "reset"             back to the build levels
+ *
+ * The resulting levels are echoed on home/sprinkler/log/level/state.
+ *
+ * Compile-time levels (numbers so they can be set with -D):
+ *   LOG_LEVEL              default for every module; trace with DEBUG, warn
+ *                          without
+ *   LOG_LEVEL_WIFI, LOG_LEVEL_MQTT, LOG_LEVEL_ZONES, LOG_LEVEL_OTA,
+ *   LOG_LEVEL_CONFIG       per-module override
+ *
+ * Output goes through the tokenized ring or plain printf (see token_log.h).
+ */
+
+#define LOG_LEVEL_OFF 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_TRACE 4
+
+#ifndef LOG_LEVEL
+  #if DEBUG
+    #define LOG_LEVEL LOG_LEVEL_TRACE
+  #else
+    #define LOG_LEVEL LOG_LEVEL_WARN
+  #endif
+#endif
+
+#ifndef LOG_LEVEL_WIFI
+#define LOG_LEVEL_WIFI LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_MQTT
+#define LOG_LEVEL_MQTT LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_ZONES
+#define LOG_LEVEL_ZONES LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_OTA
+#define LOG_LEVEL_OTA LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_CONFIG
+#define LOG_LEVEL_CONFIG LOG_LEVEL
+#endif
+
+// Longest accepted payload on the log level topic
+#define LOG_COMMAND_BUFFER_SIZE 64
+
+enum LogModule {
+  LOG_WIFI,
+  LOG_MQTT,
+  LOG_ZONES,
+  LOG_OTA,
+  LOG_CONFIG,
+  NUM_LOG_MODULES
+};
+
+constexpr uint8_t logCompiledLevel(LogModule module) {
+  return module == LOG_WIFI     ? LOG_LEVEL_WIFI
+         : module == LOG_MQTT   ? LOG_LEVEL_MQTT
+         : module == LOG_ZONES  ? LOG_LEVEL_ZONES
+         : module == LOG_OTA    ? LOG_LEVEL_OTA
+         : module == LOG_CONFIG ? LOG_LEVEL_CONFIG
+                                : LOG_LEVEL_OFF;
+}
+
+// Resolved per call site at compile time
+template <LogModule Module, uint8_t Level>
+struct LogEnabled {
+  static constexpr bool value = Level != LOG_LEVEL_OFF && Level <= logCompiledLevel(Module);
+};
+
+// Runtime levels, indexed by LogModule (start at the compile-time levels)
+extern uint8_t logLevels[NUM_LOG_MODULES];
+
+inline bool logRuntimeEnabled(LogModule module, uint8_t level) {
+  return level <= logLevels[module];
+}
+
+const char* logModuleName(int module);
+const char* logLevelName(int level);
+
+// Name lookups; return -1 for unknown names
+int logModuleFromName(const char* name, size_t length);
+int logLevelFromName(const char* name, size_t length);
+
+// Set a runtime level, capped at the compile-time level; returns the level set
+uint8_t logSetLevel(LogModule module, uint8_t level);
+
+// Restore the compile-time levels
+void logResetLevels();
+
+// Apply a command from the log level topic (format above); returns false and
+// leaves the levels unchanged if any part of it is not understood
+bool logApplyCommand(const char* command, size_t length);
+
+// Write "wifi=warn,mqtt=trace,..." into buf; returns the length written
+size_t logFormatLevels(char* buf, size_t size);
+
+// True if a message at this level would be logged; for work that only
+// serves a log call (e.g. making a printable copy of a payload)
+#define LOG_ENABLED(module, level) \
+  (LogEnabled<module, level>::value && logRuntimeEnabled(module, level))
+
+#define LOG_AT(module, level, fmt, ...)   \
+  do {                                    \
+    if (LOG_ENABLED(module, level)) {     \
+      LOG_EMIT(fmt, ##__VA_ARGS__);       \
+    }                                     \
+  } while (0)
+
+#define LOG_ERROR(module, fmt, ...) LOG_AT(module, LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_WARN(module, fmt, ...) LOG_AT(module, LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_INFO(module, fmt, ...) LOG_AT(module, LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_TRACE(module, fmt, ...) LOG_AT(module, LOG_LEVEL_TRACE, fmt, ##__VA_ARGS__)
+
+#endif // LOGGING_H
@@ -0,0 +1,157 @@
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "hal.h"
+
+/*
+ * MQTT client backends
+ * ====================
+ * The firmware talks to the broker only through MqttClient; MQTT_BACKEND picks
+ * the library underneath at build time:
+ *
+ * - MQTT_BACKEND_PUBSUBCLIENT (default): knolleary/PubSubClient on the
+ *   hal::NetClient socket. Every publish is QoS 0 and written synchronously,
+ *   so a full socket send buffer blocks loop() until the broker reads.
+ * - MQTT_BACKEND_ASYNC: marvinroger/AsyncMqttClient on ESPAsyncTCP
+ *   ([env:nodemcuv2_async]). Packets are handed to the TCP stack and the
+ *   library reports back through callbacks, so loop() never waits on the
+ *   network: the connect is started by open() and polled by finishConnect(),
+ *   and streamed publishes go out at MQTT_PUBLISH_QOS with up to
+ *   MQTT_INFLIGHT_WINDOW of them awaiting their PUBACK. publishReady() is
+ *   false while the window is full, and until the next loop() after the TCP
+ *   stack had no room for a publish; the publish queue holds the rest.
+ *
+ * Short publish() calls are QoS 0 on both backends. Inbound messages larger
+ * than MQTT_CLIENT_BUFFER_SIZE are dropped on both.
+ *
+ * Persistent session (MQTT_PERSISTENT_SESSION): the controller connects with
+ * cleanSession=false and subscribes to its command topics at MQTT_COMMAND_QOS,
+ * so the broker keeps the subscriptions across connections and queues QoS 1
+ * commands sent while the controller is offline (delivered after the next
+ * CONNECT; MAX_ZONE_RUNTIME still bounds a zone a late command turns on).
+ * When the CONNACK says the session is still there the connect skips its
+ * SUBSCRIBE round trip (see connectNeedsSubscribe()). Both backends report
+ * that flag; PubSubClient reads it through a ConnackClient (connack_client.h).
+ *
+ * tools/bench_mqtt_backend.cpp compares the two ([env:bench_mqtt_pubsub],
+ * [env:bench_mqtt_async]).
+ */
+
+#define MQTT_BACKEND_PUBSUBCLIENT 1
+#define MQTT_BACKEND_ASYNC 2
+
+#ifndef MQTT_BACKEND
+#define MQTT_BACKEND MQTT_BACKEND_PUBSUBCLIENT
+#endif
+
+static_assert(MQTT_BACKEND == MQTT_BACKEND_PUBSUBCLIENT || MQTT_BACKEND == MQTT_BACKEND_ASYNC,
+              "MQTT_BACKEND: MQTT_BACKEND_PUBSUBCLIENT or MQTT_BACKEND_ASYNC");
+
+#ifndef MQTT_PUBLISH_QOS
+#define MQTT_PUBLISH_QOS 1       // QoS of streamed publishes (asynchronous backend)
+#endif
+#ifndef MQTT_INFLIGHT_WINDOW
+#define MQTT_INFLIGHT_WINDOW 4   // QoS 1 publishes awaiting PUBACK at once
+#endif
+
+static_assert(MQTT_PUBLISH_QOS <= 1, "MQTT_PUBLISH_QOS: 0 or 1");
+static_assert(MQTT_COMMAND_QOS <= 1, "MQTT_COMMAND_QOS: 0 or 1");
+static_assert(MQTT_INFLIGHT_WINDOW >= 1 && MQTT_INFLIGHT_WINDOW <= 32,
+              "MQTT_INFLIGHT_WINDOW: 1 to 32");
+
+#if MQTT_BACKEND == MQTT_BACKEND_PUBSUBCLIENT
+#include <PubSubClient.h>
+#include "connack_client.h"
+#else
+#include <AsyncMqttClient.h>
+#ifndef MQTT_MAX_HEADER_SIZE
+#define MQTT_MAX_HEADER_SIZE 5   // fixed header + remaining length, as PubSubClient
+#endif
+#endif
+
+typedef void (*MqttMessageHandler)(char* topic, uint8_t* payload, unsigned int length);
+
+// CONNECT parameters; the strings must outlive the connection
+struct MqttConnectOptions {
+  const char* clientId;
+  const char* user;
+  const char* password;
+  const char* willTopic;
+  const char* willMessage;
+  bool willRetain;
+  bool cleanSession;
+};
+
+class MqttClient {
+ public:
+  explicit MqttClient(hal::NetClient& net);
+
+  // Once at boot: inbound messages go to handler
+  void begin(MqttMessageHandler handler);
+
+  // Connect stage TCP: open the transport to the broker (see mqtt_connect.h)
+  bool open(uint32_t ip, uint16_t port, const MqttConnectOptions& options);
+  // Connect stage MQTT: CONNECT/CONNACK; NET_PENDING while the broker has
+  // not answered yet (asynchronous backend only)
+  hal::NetResult finishConnect();
+  // Drop the transport without a DISCONNECT (failed attempt, lost connection)
+  void close();
+  // Orderly DISCONNECT
+  void disconnect();
+
+  bool connected();
+  // CONNACK: the broker kept the session of an earlier connection
+  bool sessionPresent();
+  int state();  // PubSubClient::state() code, for logs
+  // Inbound messages, acknowledgements; call every loop() while connected
+  void loop();
+
+  bool subscribe(const char* topic, uint8_t qos);
+  bool publish(const char* topic, const char* payload, bool retained);
+
+  // Streamed publish of a payload of known length. publishReady(): whether
+  // beginPublish() can start one now
+  bool publishReady();
+  bool beginPublish(const char* topic, size_t length, bool retained);
+  size_t write(const uint8_t* data, size_t length);
+  bool endPublish();
+
+  // Streamed publishes sent but not acknowledged yet (0 with PubSubClient)
+  uint8_t inflight() const;
+  // Narrow the in-flight window (1..MQTT_INFLIGHT_WINDOW), for benchmarks
+  void setInflightWindow(uint8_t window);
+
+ private:
+#if MQTT_BACKEND == MQTT_BACKEND_PUBSUBCLIENT
+  hal::NetClient& net_;
+  ConnackClient connack_;  // between client_ and net_
+  PubSubClient client_;
+  const MqttConnectOptions* options_ = nullptr;
+#else
+  enum Session : uint8_t { SESSION_IDLE, SESSION_CONNECTING, SESSION_UP, SESSION_FAILED };
+
+  void acknowledged(uint16_t packetId);
+
+  AsyncMqttClient client_;
+  MqttMessageHandler handler_ = nullptr;
+  volatile uint8_t session_ = SESSION_IDLE;
+  volatile bool sessionPresent_ = false;
+  int8_t reason_ = -1;  // last AsyncMqttClientDisconnectReason, -1: none
+  // Packet ids awaiting PUBACK
+  uint16_t unacked_[MQTT_INFLIGHT_WINDOW];
+  volatile uint8_t unackedCount_ = 0;
+  uint8_t window_ = MQTT_INFLIGHT_WINDOW;
+  bool refused_ = false;  // the library had no TCP space; cleared by loop()
+  // The library takes a publish in one piece: streamed payloads are staged
+  const char* stagedTopic_ = nullptr;
+  bool stagedRetained_ = false;
+  size_t stagedLength_ = 0;  // announced by beginPublish()
+  size_t stagedUsed_ = 0;
+  char staged_[MQTT_PAYLOAD_BUFFER_SIZE];
+#endif
+};
+
+#endif // MQTT_CLIENT_H
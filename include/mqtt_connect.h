@@ -0,0 +1,160 @@
+#ifndef MQTT_CONNECT_H
+#define MQTT_CONNECT_H
+
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Non-blocking MQTT connect
+ * =========================
+ * The connect sequence is a state machine that loop() advances on each call
+ * (continueMqttConnect()), so OTA, the zone runtime limits and the memory
+ * sampling keep running while the broker is slow or down:
+ *
+ *   IDLE -> RESOLVE -> TCP -> MQTT -> SUBSCRIBE -> ANNOUNCE -> UP
+ *
+ * - RESOLVE    DNS lookup of the broker name, polled; gives up after
+ *              MQTT_DNS_TIMEOUT
+ * - TCP        socket connect, blocks for at most MQTT_TCP_TIMEOUT
+ * - MQTT       CONNECT/CONNACK over that socket, blocks for at most
+ *              MQTT_CONNACK_TIMEOUT seconds (PubSubClient's socket timeout)
+ *
+ *              With the asynchronous client backend (mqtt_client.h) TCP only
+ *              starts the connect and MQTT polls for its outcome, giving up
+ *              after MQTT_TCP_TIMEOUT + MQTT_CONNACK_TIMEOUT; neither blocks.
+ * - SUBSCRIBE  every ROUTES pattern (SUBSCRIBE packets, no SUBACK wait); only
+ *              the retained ones when the broker kept the persistent session
+ *              and this boot subscribed to all before (mqtt_client.h)
+ * - ANNOUNCE   "online", the zone states and the discovery pass
+ *
+ * Stages that are ready run back to back, but a call runs at most one of the
+ * two that block, so none takes longer than MQTT_CONNECT_MAX_BLOCK_MS.
+ *
+ * A failed stage closes the socket and returns to IDLE. The first attempt
+ * after boot starts RECONNECT_INTERVAL later; after that, with
+ * MQTT_RECONNECT_BACKOFF:
+ *
+ * - a failed attempt is followed by one a random time after it started,
+ *   between RECONNECT_INTERVAL and three times the previous wait, at most
+ *   MQTT_RECONNECT_MAX_MS ("decorrelated jitter")
+ * - a lost connection is retried at a random point of the reconnect window:
+ *   MQTT_RECONNECT_WINDOW_MS, or the milliseconds the broker advertises on
+ *   the retained MQTT_RECONNECT_WINDOW topic (connectSetWindow())
+ *
+ * The client id is MQTT_CLIENT_ID_FORMAT with the chip id: the broker keys
+ * the persistent session by it, and a second controller connecting with the
+ * same id would take that session over. The random numbers are seeded with
+ * the chip id as well, so a fleet that lost its
+ * broker at the same moment does not come back in lockstep. Without
+ * MQTT_RECONNECT_BACKOFF attempts are RECONNECT_INTERVAL apart and a lost
+ * connection is retried straight away.
+ */
+
+#ifndef MQTT_DNS_TIMEOUT
+#define MQTT_DNS_TIMEOUT 3000      // ms for the broker name to resolve
+#endif
+#ifndef MQTT_TCP_TIMEOUT
+#define MQTT_TCP_TIMEOUT 1000      // ms for the TCP handshake
+#endif
+#ifndef MQTT_CONNACK_TIMEOUT
+#define MQTT_CONNACK_TIMEOUT 1     // s for the broker's CONNACK
+#endif
+
+#ifndef MQTT_RECONNECT_BACKOFF
+#define MQTT_RECONNECT_BACKOFF true
+#endif
+#ifndef MQTT_RECONNECT_MAX_MS
+#define MQTT_RECONNECT_MAX_MS 60000UL       // longest wait between two attempts
+#endif
+#ifndef MQTT_RECONNECT_WINDOW_MS
+#define MQTT_RECONNECT_WINDOW_MS RECONNECT_INTERVAL  // until the broker advertises one
+#endif
+#ifndef MQTT_RECONNECT_WINDOW_MAX_MS
+#define MQTT_RECONNECT_WINDOW_MAX_MS 600000UL  // longest window accepted from the broker
+#endif
+
+static_assert(MQTT_RECONNECT_MAX_MS >= RECONNECT_INTERVAL,
+              "MQTT_RECONNECT_MAX_MS: at least RECONNECT_INTERVAL");
+static_assert(MQTT_RECONNECT_WINDOW_MS <= MQTT_RECONNECT_WINDOW_MAX_MS,
+              "MQTT_RECONNECT_WINDOW_MS: at most MQTT_RECONNECT_WINDOW_MAX_MS");
+
+constexpr uint32_t MQTT_CONNECT_MAX_BLOCK_MS =
+    MQTT_TCP_TIMEOUT > MQTT_CONNACK_TIMEOUT * 1000UL ? MQTT_TCP_TIMEOUT
+                                                     : MQTT_CONNACK_TIMEOUT * 1000UL;
+
+enum ConnectStage : uint8_t {
+  CONNECT_IDLE,
+  CONNECT_RESOLVE,
+  CONNECT_TCP,
+  CONNECT_MQTT,
+  CONNECT_SUBSCRIBE,
+  CONNECT_ANNOUNCE,
+  CONNECT_UP,
+  NUM_CONNECT_STAGES
+};
+
+struct ConnectState {
+  uint32_t lastAttemptMs;  // start of the last attempt, or when the connection was lost
+  uint32_t retryDelayMs;   // the next attempt starts this long after lastAttemptMs
+  uint32_t windowMs;       // reconnect window
+  uint32_t random;         // jitter generator state (xorshift32)
+  char clientId[24];       // MQTT_CLIENT_ID_FORMAT
+  uint32_t stageStartMs;
+  uint32_t ip;             // broker address from RESOLVE
+  uint16_t port;
+  uint8_t stage;           // ConnectStage
+  bool subscribed;         // every route subscribed since boot
+};
+
+// Name of a stage for logs ("resolve", ...)
+const char* connectStageName(int stage);
+
+// Whether a stage waits on the network (TCP, MQTT)
+bool connectStageBlocks(int stage);
+
+// Set up at boot: idle, first attempt after RECONNECT_INTERVAL; the chip id
+// makes the client id and seeds the reconnect jitter
+void connectInit(ConnectState& state, uint32_t chipId);
+
+// Whether an idle connection should start an attempt now
+bool connectDue(const ConnectState& state, uint32_t nowMs);
+
+// Start an attempt at RESOLVE and draw the wait before the next one
+void connectBegin(ConnectState& state, uint16_t port, uint32_t nowMs);
+
+// Move on to the next stage
+void connectAdvance(ConnectState& state, ConnectStage next, uint32_t nowMs);
+
+// Whether the current stage ran out of time (RESOLVE, and MQTT when the
+// client backend connects asynchronously, wait across steps)
+bool connectTimedOut(const ConnectState& state, uint32_t nowMs);
+
+// Give up on the attempt: back to IDLE
+void connectFailed(ConnectState& state);
+
+// The session is up; the backoff starts over
+void connectUp(ConnectState& state);
+
+// The connection was lost: back to IDLE, next attempt within the reconnect
+// window
+void connectLost(ConnectState& state, uint32_t nowMs);
+
+/**
+ * Reconnect window from the retained MQTT_RECONNECT_WINDOW message
+ *
+ * @param payload Milliseconds as decimal text (at most
+ *                MQTT_RECONNECT_WINDOW_MAX_MS); empty (retained message
+ *                deleted) restores MQTT_RECONNECT_WINDOW_MS
+ * @return false, window unchanged, if the payload is invalid
+ */
+bool connectSetWindow(ConnectState& state, const uint8_t* payload, unsigned int length);
+
+// Whether SUBSCRIBE has to cover every route: not when the broker kept the
+// session and this boot already subscribed (an earlier firmware's session
+// may lack newer routes)
+bool connectNeedsSubscribe(const ConnectState& state, bool sessionPresent);
+
+// Every route was subscribed on this connection
+void connectSubscribed(ConnectState& state);
+
+#endif // MQTT_CONNECT_H
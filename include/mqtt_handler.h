@@ -1,12 +1,12 @@
 #ifndef MQTT_HANDLER_H
 #define MQTT_HANDLER_H
 
-#include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include "config.h"
+#include "mqtt_client.h"
 
 // External MQTT client and parameters
-extern PubSubClient mqtt;
+extern MqttClient mqtt;
 extern char mqtt_server[40];
 extern char mqtt_port[6];
 extern char mqtt_user[24];
@@ -14,8 +14,19 @@ extern char mqtt_password[24];
 
 // Forward declarations
 void callback(char* topic, byte* payload, unsigned int length);
-bool reconnectMqtt();
+bool continueMqttConnect();
 void publishHomeAssistantConfig();
+void continueDiscovery();
 void publishStatus();
+void publishTelemetry();
+void publishProfile();
+void handleProfileCommand(const char* command, unsigned int length);
+void handleLogLevelCommand(const char* command, unsigned int length);
+void handleZoneCommand(int zone, const uint8_t* payload, unsigned int length);
+void handleZoneBatch(const uint8_t* payload, unsigned int length);
+void publishZoneStates();
+void replayOfflineLog();
+void drainPublishQueue();
+void enforceZoneRuntimeLimits();
 
 #endif // MQTT_HANDLER_H
@@ -0,0 +1,98 @@
+#ifndef NATIVE_ASYNCMQTTCLIENT_H
+#define NATIVE_ASYNCMQTTCLIENT_H
+
+/*
+ * Host stand-in for marvinroger/AsyncMqttClient 0.9
+ * =================================================
+ * Implements the subset of the AsyncMqttClient API used by src/mqtt_client.cpp
+ * so the asynchronous backend (-DMQTT_BACKEND=2) compiles in [env:native]. Like
+ * the PubSubClient stand-in, the connection lives on hal::native::device().mqtt.
+ *
+ * On the device the callbacks run from the network task as packets arrive.
+ * Here they run from poll() (host only), which MqttClient calls from loop()
+ * and while waiting for CONNACK:
+ *
+ * - connect() asks the BrokerLink straight away but does not charge the
+ *   caller for it: onConnect()/onDisconnect() fire once the virtual time the
+ *   link took has passed
+ * - a QoS 1 publish gets its onPublish() BrokerLink::pubackDelayMs() later
+ * - messages from hal::native::deliver() go to onMessage() in one piece
+ * - a connection dropped underneath (dropConnection()) reports onDisconnect()
+ */
+
+#include <functional>
+#include "../hal.h"
+
+// ESP8266 core's IPAddress, reduced to what setServer() needs
+class IPAddress {
+ public:
+  explicit IPAddress(uint32_t address) : address_(address) {}
+  uint32_t v4() const { return address_; }
+
+ private:
+  uint32_t address_;
+};
+
+enum class AsyncMqttClientDisconnectReason : uint8_t {
+  TCP_DISCONNECTED = 0,
+  MQTT_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+  MQTT_IDENTIFIER_REJECTED = 2,
+  MQTT_SERVER_UNAVAILABLE = 3,
+  MQTT_MALFORMED_CREDENTIALS = 4,
+  MQTT_NOT_AUTHORIZED = 5,
+};
+
+struct AsyncMqttClientMessageProperties {
+  uint8_t qos;
+  bool dup;
+  bool retain;
+};
+
+class AsyncMqttClient {
+ public:
+  typedef std::function<void(bool sessionPresent)> OnConnectUserCallback;
+  typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectUserCallback;
+  typedef std::function<void(char* topic, char* payload, AsyncMqttClientMessageProperties properties,
+                             size_t len, size_t index, size_t total)>
+      OnMessageUserCallback;
+  typedef std::function<void(uint16_t packetId)> OnPublishUserCallback;
+
+  AsyncMqttClient& onConnect(OnConnectUserCallback callback);
+  AsyncMqttClient& onDisconnect(OnDisconnectUserCallback callback);
+  AsyncMqttClient& onMessage(OnMessageUserCallback callback);
+  AsyncMqttClient& onPublish(OnPublishUserCallback callback);
+
+  AsyncMqttClient& setServer(IPAddress ip, uint16_t port);
+  AsyncMqttClient& setClientId(const char* clientId);
+  AsyncMqttClient& setCredentials(const char* username, const char* password = nullptr);
+  AsyncMqttClient& setWill(const char* topic, uint8_t qos, bool retain,
+                           const char* payload = nullptr, size_t length = 0);
+  AsyncMqttClient& setCleanSession(bool cleanSession);
+  AsyncMqttClient& setKeepAlive(uint16_t keepAlive) { (void)keepAlive; return *this; }
+
+  bool connected() const;
+  void connect();
+  void disconnect(bool force = false);
+  uint16_t subscribe(const char* topic, uint8_t qos);
+  uint16_t publish(const char* topic, uint8_t qos, bool retain, const char* payload = nullptr,
+                   size_t length = 0, bool dup = false, uint16_t message_id = 0);
+
+  // Host only: run the callbacks that are due (see above)
+  void poll();
+
+ private:
+  OnConnectUserCallback onConnect_;
+  OnDisconnectUserCallback onDisconnect_;
+  OnMessageUserCallback onMessage_;
+  OnPublishUserCallback onPublish_;
+  const char* clientId_ = "";
+  const char* username_ = nullptr;
+  const char* password_ = nullptr;
+  const char* willTopic_ = nullptr;
+  const char* willPayload_ = nullptr;
+  uint8_t willQos_ = 0;
+  bool willRetain_ = false;
+  bool cleanSession_ = true;
+};
+
+#endif  // NATIVE_ASYNCMQTTCLIENT_H
@@ -0,0 +1,66 @@
+#ifndef NATIVE_PUBSUBCLIENT_H
+#define NATIVE_PUBSUBCLIENT_H
+
+/*
+ * Host stand-in for knolleary/PubSubClient 2.8
+ * ============================================
+ * Implements the subset of the PubSubClient API used by the firmware so
+ * main.cpp compiles unchanged in [env:native]. The object holds no state of
+ * its own: every call operates on hal::native::device().mqtt, so simulators can
+ * run several controllers through one global client by switching devices.
+ *
+ * Size limits mirror the real library: publish() and subscribe() fail when the
+ * packet would not fit in setBufferSize(), beginPublish() streams around it.
+ */
+
+#include "../hal.h"
+
+#define MQTT_MAX_HEADER_SIZE 5
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+// Subset of PubSubClient::state() codes
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+
+class PubSubClient {
+ public:
+  explicit PubSubClient(hal::NetClient& client) { (void)client; }
+
+  PubSubClient& setServer(const char* domain, uint16_t port);
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient& setKeepAlive(uint16_t keepAlive) { (void)keepAlive; return *this; }
+  PubSubClient& setSocketTimeout(uint16_t timeout) { (void)timeout; return *this; }
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize();
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* user, const char* pass);
+  bool connect(const char* id, const char* user, const char* pass, const char* willTopic,
+               uint8_t willQos, bool willRetain, const char* willMessage);
+  bool connect(const char* id, const char* user, const char* pass, const char* willTopic,
+               uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession);
+  void disconnect();
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int plength);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int plength, bool retained);
+
+  bool beginPublish(const char* topic, unsigned int plength, bool retained);
+  int endPublish();
+  size_t write(uint8_t b);
+  size_t write(const uint8_t* buffer, size_t size);
+
+  bool subscribe(const char* topic);
+  bool subscribe(const char* topic, uint8_t qos);
+  bool unsubscribe(const char* topic);
+
+  bool loop();
+  bool connected();
+  int state();
+};
+
+#endif  // NATIVE_PUBSUBCLIENT_H
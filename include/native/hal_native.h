@@ -0,0 +1,227 @@
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+/*
+ * Native (host) side of the hardware abstraction layer
+ * ====================================================
+ * Included through hal.h when NATIVE_BUILD is defined. Provides the same hal::
+ * calls as the ESP8266 build plus host-only controls used by tests, benchmarks
+ * and simulators:
+ *
+ * - hal::native::Device     simulated board: pin levels, chip info, files and
+ *                           the MQTT session behind the PubSubClient stand-in
+ * - hal::native::BrokerLink broker stand-in interface that receives the DNS
+ *                           lookup, TCP connect, CONNECT, PUBLISH and SUBSCRIBE
+ *                           from the firmware
+ * - virtual clock           millis() can be driven by the caller instead of the
+ *                           host steady clock
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// Arduino's byte type, used by the MQTT callback signature
+typedef uint8_t byte;
+
+// glibc only gained strlcpy in 2.38; the firmware relies on it for config fields
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+// Console used by the LOG_* macros in logging.h
+#define HAL_CONSOLE hal::native::console
+
+namespace hal {
+
+// Placeholder for WiFiClient; the PubSubClient stand-in never touches it
+struct NetClient {};
+
+// GPIO
+void gpioOutput(int pin);
+void gpioWrite(int pin, bool high);
+bool gpioRead(int pin);
+
+// Clock (32-bit, wraps after ~49.7 days like the Arduino core)
+uint32_t millis();
+void delay(uint32_t ms);
+
+// CPU cycle counter of a simulated 80 MHz ESP8266, derived from the clock in
+// use: host time on the real clock, millis() x 80000 on the virtual clock (so
+// blocking calls that advance virtual time show up as cycles)
+uint32_t cycleCount();
+uint32_t cpuMhz();
+
+// System information
+void consoleBegin(unsigned long baud);
+size_t consoleWritable();
+void consoleWrite(const uint8_t* data, size_t len);
+uint32_t chipId();
+uint32_t freeHeap();
+int32_t wifiRssi();
+
+// Heap and stack health (values come from the simulated Device)
+uint32_t maxFreeBlock();
+uint8_t heapFragmentation();
+uint32_t freeStack();
+void stackPaint();
+
+// Network steps of the MQTT connect; the broker stand-in decides how they go
+// (BrokerLink::resolve() and open()). Lookups answer at once.
+enum NetResult { NET_PENDING, NET_OK, NET_FAILED };
+bool netResolveStart(const char* host);
+NetResult netResolvePoll(uint32_t* ip);
+bool netConnect(NetClient& client, uint32_t ip, uint16_t port, uint32_t timeoutMs);
+bool netConnected(NetClient& client);
+void netClose(NetClient& client);
+
+// Filesystem (in-memory, per simulated device)
+bool fsBegin();
+bool fsExists(const char* path);
+size_t fsSize(const char* path);
+size_t fsRead(const char* path, char* buf, size_t len);
+bool fsWrite(const char* path, const char* data, size_t len);
+
+namespace native {
+
+// Highest GPIO number on the ESP8266 is 16
+const int kNumPins = 17;
+
+// Serial stand-in; set enabled = false to silence benchmarks
+class HostConsole {
+ public:
+  bool enabled = true;
+
+  void print(const char* s) { if (enabled) fputs(s, stdout); }
+  void print(char c) { if (enabled) fputc(c, stdout); }
+  void print(int v) { if (enabled) printf("%d", v); }
+  void print(unsigned int v) { if (enabled) printf("%u", v); }
+  void print(long v) { if (enabled) printf("%ld", v); }
+  void print(unsigned long v) { if (enabled) printf("%lu", v); }
+  void println() { print("\n"); }
+  template <typename T>
+  void println(T v) { print(v); println(); }
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HostConsole console;
+
+// Destination of hal::consoleWrite() (binary log records); nullptr discards
+void setBinaryConsole(FILE* out);
+
+// Parameters of a CONNECT packet as seen by the broker stand-in
+struct ConnectOptions {
+  const char* clientId;
+  const char* user;
+  const char* password;
+  const char* willTopic;
+  uint8_t willQos;
+  bool willRetain;
+  const char* willMessage;
+  bool cleanSession;
+  const char* host;
+  uint16_t port;
+};
+
+// Broker stand-in. Implementations may advance the virtual clock to model
+// blocking network calls (e.g. a connect timeout while the broker is down).
+class BrokerLink {
+ public:
+  virtual ~BrokerLink() {}
+  // DNS lookup of the broker name; false: it does not resolve
+  virtual bool resolve(const char* host) { (void)host; return true; }
+  // TCP connect, before connect(). Stand-ins modelling a blocking connect
+  // advance the virtual clock by at most timeoutMs (UINT32_MAX when
+  // PubSubClient::connect() opens the socket itself, without a bound).
+  virtual bool open(uint32_t timeoutMs) { (void)timeoutMs; return true; }
+  // CONNECT/CONNACK over the open socket
+  virtual bool connect(const ConnectOptions& options) = 0;
+  // CONNACK session-present flag of the last accepted connect()
+  virtual bool sessionPresent() { return false; }
+  virtual void disconnect() {}
+  virtual bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) = 0;
+  // QoS 1 publish just accepted (AsyncMqttClient stand-in): ms until its
+  // PUBACK is back at the client
+  virtual uint32_t pubackDelayMs() { return 0; }
+  virtual bool subscribe(const char* topic, uint8_t qos) { (void)topic; (void)qos; return true; }
+  virtual bool unsubscribe(const char* topic) { (void)topic; return true; }
+};
+
+struct InboundMessage {
+  std::string topic;
+  std::string payload;
+};
+
+// State behind the PubSubClient stand-in (see include/native/PubSubClient.h)
+struct MqttSession {
+  BrokerLink* link = nullptr;  // nullptr: connects succeed, publishes are dropped
+  bool tcpOpen = false;        // socket under the session (netConnect())
+  bool connected = false;
+  int state = -1;              // PubSubClient::state() code
+  NetResult resolveResult = NET_FAILED;
+  void (*callback)(char*, uint8_t*, unsigned int) = nullptr;
+  std::string host;
+  uint16_t port = 0;
+  bool sessionPresent = false; // CONNACK flag of the last connect() (ConnackClient)
+  uint16_t bufferSize = 256;   // PubSubClient MQTT_MAX_PACKET_SIZE default
+  std::vector<uint8_t> buffer; // mirrors the library's packet buffer
+  std::deque<InboundMessage> inbox;  // delivered to callback from loop()
+  // beginPublish()/write()/endPublish() staging
+  std::string streamTopic;
+  std::string streamPayload;
+  size_t streamLength = 0;     // length promised to beginPublish()
+  bool streamRetained = false;
+  // AsyncMqttClient stand-in (see include/native/AsyncMqttClient.h)
+  int asyncConnect = 0;        // outcome of connect() to report: 1 up, -1 refused
+  uint32_t asyncConnectAtMs = 0;
+  bool asyncUp = false;        // onConnect() reported, onDisconnect() not yet
+  bool asyncSessionPresent = false;
+  uint16_t nextPacketId = 1;
+  std::vector<std::pair<uint16_t, uint32_t> > pubacks;  // packet id, due ms
+};
+
+// One simulated controller board
+struct Device {
+  uint8_t pinLevel[kNumPins] = {0};
+  bool pinIsOutput[kNumPins] = {false};
+  uint32_t chipId = 0x00C0FFEE;
+  uint32_t freeHeap = 40000;
+  uint32_t maxFreeBlock = 30000;
+  uint8_t heapFragmentation = 10;   // percent
+  uint32_t freeStack = 2800;        // unused bytes of the 4 KB loop() stack
+  int32_t rssi = -60;
+  bool fsMounted = false;
+  std::map<std::string, std::string> files;
+  MqttSession mqtt;
+};
+
+// Device the hal:: calls operate on. selectDevice(nullptr) restores the
+// built-in default device.
+Device& device();
+void selectDevice(Device* dev);
+
+// Clock control. The real clock counts host milliseconds since start-up; the
+// virtual clock only moves through setClock()/advanceClock() and hal::delay().
+void useRealClock();
+void useVirtualClock(uint32_t startMs = 0);
+bool virtualClock();
+void setClock(uint32_t nowMs);
+void advanceClock(uint32_t ms);
+
+// Queue an incoming message on the current device; the firmware callback runs
+// on the next mqtt.loop(). Returns false if the session is not connected.
+bool deliver(const char* topic, const void* payload, size_t length);
+
+// Drop the current device's connection as if the TCP session died
+void dropConnection();
+
+}  // namespace native
+}  // namespace hal
+
+#endif  // HAL_NATIVE_H
@@ -0,0 +1,90 @@
+#ifndef OFFLINE_LOG_H
+#define OFFLINE_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Offline outbound log
+ * ====================
+ * A fixed ring of what happened while the controller could not publish, sent
+ * in order once it can again:
+ *
+ *   offlineLogRecord(log, OFFLINE_SAFETY_OFF, 3, hal::millis());
+ *
+ * Despite the name, events go through the log online too: it is the only
+ * path that publishes them (replayOfflineLog() in main.cpp sends what is
+ * waiting on the next loop() while connected), so an event keeps its time
+ * and its place in the order whether or not the broker was reachable. Only
+ * zone states are logged just while offline; online they go straight to the
+ * publish queue.
+ *
+ * - Events (OFFLINE_SAFETY_OFF) are history: each one is kept and replayed
+ *   with the time it happened, so subscribers see every one of them even if
+ *   the broker was unreachable at the time.
+ * - Zone state changes (OFFLINE_ZONE_STATE) coalesce: recording a zone that
+ *   already has a state waiting removes the older record, and the zone goes
+ *   out at its place in the order of the newer one. A record holds no state:
+ *   the replay publishes the zone as it is then, since the retained state
+ *   topic only ever needs the latest value.
+ * - When all OFFLINE_LOG_CAPACITY records are waiting, the oldest is dropped
+ *   (counted in stats.dropped) and the log is no longer complete: the next
+ *   connect has to republish every zone.
+ *
+ * complete: the broker had every zone's state when the log started
+ * (offlineLogSynced()) and no record has been dropped since, so replaying the
+ * log brings the broker's retained zone states up to date by itself. False
+ * after boot.
+ *
+ * The log lives in RAM only: it is there for connection drops and broker
+ * restarts, not for a power cycle, after which every zone starts OFF anyway.
+ */
+
+#ifndef OFFLINE_LOG_CAPACITY
+#define OFFLINE_LOG_CAPACITY 32
+#endif
+
+static_assert(OFFLINE_LOG_CAPACITY >= 1 && OFFLINE_LOG_CAPACITY <= 255,
+              "OFFLINE_LOG_CAPACITY: 1 to 255");
+
+enum OfflineKind : uint8_t {
+  OFFLINE_ZONE_STATE,  // a zone switched; replayed with its current state
+  OFFLINE_SAFETY_OFF,  // MAX_ZONE_RUNTIME forced a zone off
+};
+
+struct OfflineRecord {
+  uint32_t atMs;
+  uint8_t kind;        // OfflineKind
+  uint8_t zone;        // 1..NUM_ZONES
+};
+
+struct OfflineLogStats {
+  uint32_t recorded;
+  uint32_t coalesced;  // zone states replaced by a newer one before replay
+  uint32_t dropped;    // oldest record lost to a full log
+};
+
+struct OfflineLog {
+  OfflineRecord records[OFFLINE_LOG_CAPACITY];
+  uint8_t head;        // oldest record
+  uint8_t count;
+  bool complete;
+  OfflineLogStats stats;
+};
+
+// Empty the log; not complete until offlineLogSynced(), stats are kept
+void offlineLogReset(OfflineLog& log);
+
+// The broker has just been sent every zone's state: the log is complete
+void offlineLogSynced(OfflineLog& log);
+
+// Append a record (coalescing zone states, dropping the oldest when full)
+void offlineLogRecord(OfflineLog& log, uint8_t kind, int zone, uint32_t nowMs);
+
+// Oldest waiting record, nullptr if the log is empty
+const OfflineRecord* offlineLogOldest(const OfflineLog& log);
+
+// Remove the oldest record once it has been replayed
+void offlineLogPop(OfflineLog& log);
+
+#endif // OFFLINE_LOG_H
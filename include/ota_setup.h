@@ -1,11 +1,10 @@
 #ifndef OTA_SETUP_H
 #define OTA_SETUP_H
 
-#include <ESP8266mDNS.h>
-#include <ArduinoOTA.h>
 #include "config.h"
 
 // Forward declarations
-void setupOTA();
+void setupOTA();         // src/ota_setup.cpp (ESP8266), src/native/setup_native.cpp (host)
+void handleOTA();
 
 #endif // OTA_SETUP_H
@@ -0,0 +1,106 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include "hal.h"
+#ifdef NATIVE_BUILD
+#include <chrono>
+#endif
+
+/*
+ * Scoped cycle-counter profiler
+ * =============================
+ * PROFILE_SCOPE("name") at the top of a block measures the block in CPU cycles
+ * (ESP.getCycleCount() on the device, std::chrono on the host) and folds
+ * count/min/max/total into a fixed static table. Each probe site registers
+ * itself once on first use; there is no heap use and the per-call cost is two
+ * cycle counter reads.
+ *
+ * The table is dumped on demand: publishing to home/sprinkler/profile/command
+ * ("dump" or "reset") sends it to home/sprinkler/profile and the console.
+ *
+ * Build with -DPROFILING=false to compile every probe out.
+ */
+
+#ifndef PROFILING
+#define PROFILING true
+#endif
+
+// Probe sites beyond this are ignored (see profilerDropped())
+#define MAX_PROFILE_PROBES 12
+
+struct ProfileProbe {
+  const char* name;
+  uint32_t count;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+};
+
+// Table access for dumps
+int profilerProbeCount();
+const ProfileProbe* profilerProbe(int index);
+uint32_t profilerDropped();
+
+// Register a probe site; returns nullptr when the table is full
+ProfileProbe* profilerRegister(const char* name);
+
+// Clear all counters (probe sites stay registered)
+void profilerReset();
+
+// Print the table on the console (Serial / stdout); nothing with
+// TOKENIZED_LOGGING, whose console carries binary log records
+void profilerPrint();
+
+// Cycle source: the CPU cycle counter on the device. Native builds always use
+// host time (std::chrono) scaled to hal::cpuMhz(), even under the virtual
+// clock, so host profiles show real cost rather than simulated time.
+#ifdef NATIVE_BUILD
+inline uint32_t profilerCycles() {
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  return static_cast<uint32_t>(ns * hal::cpuMhz() / 1000);
+}
+#else
+inline uint32_t profilerCycles() { return hal::cycleCount(); }
+#endif
+
+inline void profilerRecord(ProfileProbe* probe, uint32_t cycles) {
+  if (!probe) {
+    return;
+  }
+  if (probe->count == 0 || cycles < probe->minCycles) {
+    probe->minCycles = cycles;
+  }
+  if (cycles > probe->maxCycles) {
+    probe->maxCycles = cycles;
+  }
+  probe->count++;
+  probe->totalCycles += cycles;
+}
+
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfileProbe* probe) : probe_(probe), start_(profilerCycles()) {}
+  ~ProfileScope() { profilerRecord(probe_, profilerCycles() - start_); }
+
+ private:
+  ProfileScope(const ProfileScope&);
+  ProfileScope& operator=(const ProfileScope&);
+
+  ProfileProbe* probe_;
+  uint32_t start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if PROFILING
+  #define PROFILE_SCOPE(name) \
+    static ProfileProbe* const PROFILE_CONCAT(profileProbe_, __LINE__) = profilerRegister(name); \
+    ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileProbe_, __LINE__))
+#else
+  #define PROFILE_SCOPE(name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,134 @@
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Outbound publish queue
+ * ======================
+ * State publishes are queued by topic instead of written to the socket where
+ * they happen; loop() drains the queue at PUBLISH_DRAIN_RATE:
+ *
+ *   publishQueueEnqueue(queue, zoneTopic(ZONE_STATE, 3), renderZoneState, 3, true);
+ *
+ * - An entry holds no payload, only a render function and its argument. The
+ *   payload is rendered when the entry is sent, so it is always the current
+ *   state, and queueing a topic that is already waiting just keeps the one
+ *   entry (a newer value replaces the unsent older one).
+ * - Rendering writes to a PublishWriter, never to a buffer: the queue renders
+ *   once to measure and hash the payload, then the send function renders it
+ *   again straight into the MQTT stream (beginPublish()/write()/endPublish()).
+ *   A render function must therefore write the same bytes every time it is
+ *   called for the same state.
+ * - Each topic remembers a hash of the last payload sent. A retained payload
+ *   identical to it is dropped instead of sent, unless PUBLISH_DEDUP_REFRESH
+ *   has passed since (so a broker that lost its retained messages is healed
+ *   eventually).
+ * - Sending is a token bucket: PUBLISH_DRAIN_RATE messages per second with
+ *   bursts of up to PUBLISH_DRAIN_BURST. Dropped duplicates cost nothing.
+ *
+ * Topics must be constant strings (the topic tables and MQTT_* literals); the
+ * queue keeps the pointer. When all PUBLISH_QUEUE_CAPACITY slots are waiting,
+ * enqueue fails and the caller publishes directly.
+ */
+
+#ifndef PUBLISH_QUEUE_CAPACITY
+#define PUBLISH_QUEUE_CAPACITY 24
+#endif
+
+#ifndef PUBLISH_DRAIN_RATE
+#define PUBLISH_DRAIN_RATE 20        // messages per second
+#endif
+
+#ifndef PUBLISH_DRAIN_BURST
+#define PUBLISH_DRAIN_BURST 8        // messages sent back to back at most
+#endif
+
+#ifndef PUBLISH_DEDUP_REFRESH
+#define PUBLISH_DEDUP_REFRESH 3600000UL  // ms before an identical retained value is re-sent
+#endif
+
+/**
+ * Destination of a rendered payload
+ *
+ * Also an ArduinoJson custom writer: serializeJson(doc, writer) streams into it.
+ */
+class PublishWriter {
+ public:
+  virtual size_t write(const uint8_t* data, size_t length) = 0;
+
+  // ArduinoJson writes most of a document one byte at a time
+  virtual size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+
+  size_t write(const char* text) {
+    return write(reinterpret_cast<const uint8_t*>(text), strlen(text));
+  }
+};
+
+// Write the payload for arg to out; writing nothing sends nothing
+typedef void (*PublishRender)(int arg, PublishWriter& out);
+
+/**
+ * Send one message by rendering it into the MQTT stream
+ *
+ * @param length Payload length measured by the queue
+ * @return false to keep the entry queued and stop draining
+ */
+typedef bool (*PublishSend)(const char* topic, PublishRender render, int arg, size_t length,
+                            bool retained);
+
+struct PublishSlot {
+  const char* topic;       // nullptr: free
+  PublishRender render;
+  int16_t arg;
+  bool retained;
+  bool pending;            // waiting to be sent
+  bool sent;               // sentHash/sentMs are valid
+  uint16_t order;          // enqueue sequence; the oldest pending entry goes first
+  uint32_t sentHash;
+  uint32_t sentMs;
+};
+
+struct PublishQueueStats {
+  uint32_t sent;
+  uint32_t coalesced;      // enqueued while the topic was already waiting
+  uint32_t deduplicated;   // retained payload identical to the last one sent
+  uint32_t overflows;      // enqueue failed, published directly
+};
+
+struct PublishQueue {
+  PublishSlot slots[PUBLISH_QUEUE_CAPACITY];
+  uint16_t nextOrder;
+  uint16_t pending;
+  uint32_t tokens;         // thousandths of a message
+  uint32_t lastRefillMs;
+  PublishQueueStats stats;
+};
+
+// Empty the queue and forget what was sent; the bucket starts full, stats are kept
+void publishQueueReset(PublishQueue& queue, uint32_t nowMs);
+
+/**
+ * Queue a publish for topic, or refresh the entry already waiting for it
+ *
+ * @return false if every slot is waiting (counted in stats.overflows)
+ */
+bool publishQueueEnqueue(PublishQueue& queue, const char* topic, PublishRender render, int arg,
+                         bool retained);
+
+/**
+ * Send waiting entries, oldest first, as far as the token bucket allows
+ *
+ * @return Number of messages sent
+ */
+size_t publishQueueDrain(PublishQueue& queue, uint32_t nowMs, PublishSend send);
+
+// Length of the payload render(arg, ...) writes, without storing it; also
+// its FNV-1a hash if hash is given
+size_t publishMeasure(PublishRender render, int arg, uint32_t* hash = nullptr);
+
+#endif // PUBLISH_QUEUE_H
@@ -0,0 +1,109 @@
+#ifndef STATUS_REPORT_H
+#define STATUS_REPORT_H
+
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Delta status reports
+ * ====================
+ * publishStatus() runs every STATUS_INTERVAL but only sends the full status
+ * (identity, zone names, every metric) once per STATUS_FULL_INTERVAL, retained
+ * so late subscribers get it. The reports in between are deltas, not retained:
+ * the uptime plus the metrics that moved at least their threshold since they
+ * were last sent, and the zones whose state changed:
+ *
+ *   {"uptime":3600,"wifi_rssi":-67,"zones":[{"zone":3,"state":"ON"}]}
+ *
+ * A metric is compared with the value last sent, not the last sample, so slow
+ * drift is reported once it adds up to the threshold. The first report after
+ * boot or a reconnect is always full.
+ *
+ * -DSTATUS_FULL_INTERVAL=0 turns deltas off (every report is full).
+ *
+ * STATUS_ENCODING selects the encodings each report is published in: JSON on
+ * MQTT_STATUS, MessagePack (same document, ~25% smaller, see
+ * tools/status_decode.py) on MQTT_STATUS_MSGPACK, or both.
+ */
+
+#define STATUS_ENCODING_JSON 1
+#define STATUS_ENCODING_MSGPACK 2
+
+#ifndef STATUS_ENCODING
+#define STATUS_ENCODING STATUS_ENCODING_JSON
+#endif
+
+static_assert(STATUS_ENCODING >= 1 && STATUS_ENCODING <= 3,
+              "STATUS_ENCODING: STATUS_ENCODING_JSON and/or STATUS_ENCODING_MSGPACK");
+
+#ifndef STATUS_FULL_INTERVAL
+#define STATUS_FULL_INTERVAL 600000UL  // ms between full status reports
+#endif
+
+// Smallest change reported in a delta, per metric kind
+#ifndef STATUS_DELTA_HEAP
+#define STATUS_DELTA_HEAP 1024   // bytes: free heap, largest free block
+#endif
+#ifndef STATUS_DELTA_FRAG
+#define STATUS_DELTA_FRAG 5      // percentage points of heap fragmentation
+#endif
+#ifndef STATUS_DELTA_STACK
+#define STATUS_DELTA_STACK 128   // bytes of unused loop() stack
+#endif
+#ifndef STATUS_DELTA_RSSI
+#define STATUS_DELTA_RSSI 3      // dB
+#endif
+
+// Metrics of the status payload; the MIN/MAX ones go under "since_boot"
+enum StatusField {
+  STATUS_FREE_HEAP,
+  STATUS_MAX_FREE_BLOCK,
+  STATUS_HEAP_FRAG,
+  STATUS_FREE_STACK,
+  STATUS_WIFI_RSSI,
+  STATUS_MIN_FREE_HEAP,
+  STATUS_MIN_MAX_FREE_BLOCK,
+  STATUS_MAX_HEAP_FRAG,
+  STATUS_MIN_FREE_STACK,
+  NUM_STATUS_FIELDS
+};
+
+#define STATUS_FIRST_SINCE_BOOT STATUS_MIN_FREE_HEAP
+#define STATUS_ALL_FIELDS ((1u << NUM_STATUS_FIELDS) - 1)
+
+struct StatusSample {
+  int32_t value[NUM_STATUS_FIELDS];
+  uint32_t zonesOn;  // bit i: zone i + 1
+};
+
+struct StatusReport {
+  StatusSample sent;  // last value sent of each metric
+  uint32_t lastFullMs;
+  bool haveFull;      // a full report went out on this connection
+};
+
+// JSON key of a metric ("free_heap", ...)
+const char* statusFieldName(int field);
+
+// Make the next report a full one (boot, reconnect)
+void statusReportReset(StatusReport& report);
+
+// Whether the report due now has to be a full one
+bool statusFullDue(const StatusReport& report, uint32_t nowMs);
+
+// Metrics (bit per StatusField) that moved at least their threshold
+uint32_t statusChangedFields(const StatusReport& report, const StatusSample& sample);
+
+// Zones whose state differs from the one last sent
+uint32_t statusChangedZones(const StatusReport& report, const StatusSample& sample);
+
+/**
+ * Record a report that was published
+ *
+ * @param fields Metrics it contained (STATUS_ALL_FIELDS for a full report)
+ * @param zones Zones it contained
+ */
+void statusReported(StatusReport& report, const StatusSample& sample, uint32_t fields,
+                    uint32_t zones, bool full, uint32_t nowMs);
+
+#endif // STATUS_REPORT_H
@@ -0,0 +1,88 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+/*
+ * Loop cycle-time and memory telemetry
+ * ====================================
+ * loop() is split into phases timed with hal::cycleCount(). Each iteration's
+ * duration goes into a log2 histogram, and the phase that took longest in the
+ * slowest iteration is remembered, so a blocking mqtt.connect() (which stalls
+ * valve supervision) is visible from the published telemetry.
+ *
+ * Data covers one window (normally one STATUS_INTERVAL) and is reset after
+ * each publish; maxUsSinceBoot survives the reset.
+ *
+ * MemoryStats keeps the worst heap and stack readings since boot for the status
+ * payload; loop() samples them once per MEMORY_SAMPLE_INTERVAL.
+ *
+ * Cycle deltas are 32-bit, so a single phase longer than ~53 s at 80 MHz
+ * (~26 s at 160 MHz) wraps and is under-reported.
+ */
+
+enum LoopPhase {
+  PHASE_OTA,       // handleOTA()
+  PHASE_CONNECT,   // reconnect attempt while MQTT is down
+  PHASE_MQTT,      // mqtt.loop(), including command callbacks
+  PHASE_SAFETY,    // zone runtime safety scan
+  PHASE_PUBLISH,   // periodic status/telemetry publish
+  PHASE_LOG,       // draining tokenized log records to the UART
+  NUM_LOOP_PHASES
+};
+
+// Bucket 0 counts iterations under 2 us, bucket k those in [2^k, 2^(k+1)) us;
+// the last bucket also takes everything longer (>= ~8.4 s)
+#define LOOP_HISTOGRAM_BUCKETS 24
+
+struct LoopTelemetry {
+  // Current window
+  uint32_t buckets[LOOP_HISTOGRAM_BUCKETS];
+  uint32_t loops;
+  uint32_t windowStartMs;
+  uint32_t maxUs;                        // slowest iteration
+  uint8_t worstPhase;                    // longest phase of that iteration
+  uint32_t worstPhaseUs;
+  uint32_t phaseMaxUs[NUM_LOOP_PHASES];  // longest single run of each phase
+
+  uint32_t maxUsSinceBoot;
+
+  // Iteration in progress
+  uint32_t loopStart;
+  uint32_t phaseStart;
+  uint32_t phaseCycles[NUM_LOOP_PHASES];
+};
+
+// Worst heap/stack values seen since boot. Free heap alone hides the real
+// ESP8266 failure mode, fragmentation: a 512-byte allocation can fail with
+// plenty of free heap if no single block is large enough.
+struct MemoryStats {
+  uint32_t minFreeHeap;
+  uint32_t minMaxFreeBlock;
+  uint8_t maxHeapFragmentation;  // percent
+  uint32_t minFreeStack;         // bytes of loop() stack never touched
+  uint32_t lastSampleMs;
+};
+
+// Short name used in the telemetry JSON ("ota", "connect", ...)
+const char* loopPhaseName(int phase);
+
+// Histogram bucket for a duration in microseconds
+uint8_t loopHistogramBucket(uint32_t us);
+
+// Per-iteration hooks, called from loop(): begin, then end each phase that
+// ran (phases that did not run can be skipped), then end the iteration
+void telemetryBeginLoop(LoopTelemetry& t);
+void telemetryEndPhase(LoopTelemetry& t, LoopPhase phase);
+void telemetryEndLoop(LoopTelemetry& t);
+
+// Start a new window after the current one has been published
+void telemetryResetWindow(LoopTelemetry& t, uint32_t nowMs);
+
+// Start tracking from the current values (call once at boot)
+void memoryStatsReset(MemoryStats& m, uint32_t nowMs);
+
+// Fold the current heap/stack readings into the since-boot extremes
+void memoryStatsSample(MemoryStats& m, uint32_t nowMs);
+
+#endif // TELEMETRY_H
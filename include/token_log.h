@@ -0,0 +1,164 @@
+#ifndef TOKEN_LOG_H
+#define TOKEN_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "hal.h"
+#include "config.h"
+
+/*
+ * Tokenized deferred logging
+ * ==========================
+ * LOG_EMIT("format", args...) is the output step behind the LOG_ERROR..
+ * LOG_TRACE macros (see logging.h). What it does depends on TOKENIZED_LOGGING:
+ *
+ * - false (default): formatted with printf and written synchronously.
+ * - true: the call site stores a record in a RAM ring buffer: a token
+ *   identifying the format string plus the raw argument values. No formatting
+ *   happens on the device. loop() drains the ring to the serial port only as
+ *   fast as the UART accepts bytes without blocking, so logging can stay on in
+ *   production builds.
+ *
+ * The token is the offset of the format string from logTokenBase. Format
+ * strings live in flash (PSTR) and are never read on the device;
+ * tools/log_decode.py reads them back from the firmware ELF and rebuilds the
+ * text:
+ *
+ *   python3 tools/log_decode.py .pio/build/production/firmware.elf capture.bin
+ *
+ * Record layout (little endian):
+ *   0xA5 sync, length (bytes after this field), int32 token, uint32 millis,
+ *   then one tagged value per argument:
+ *   'i' int32 | 'u' uint32 | 'f' float32 | 's' uint8 length + bytes (strings
+ *   are copied, truncated to LOG_MAX_STRING bytes)
+ * A record with token LOG_TOKEN_DROPPED and one 'u' value reports how many
+ * records were lost because the ring was full.
+ */
+
+#ifndef TOKENIZED_LOGGING
+#define TOKENIZED_LOGGING false
+#endif
+
+#define LOG_RING_SIZE 1024
+#define LOG_MAX_STRING 48
+#define LOG_RECORD_SYNC 0xA5
+#define LOG_TOKEN_DROPPED 0x7FFFFFFF
+
+// Reference point for tokens; resolved by name from the ELF symbol table
+extern "C" const char logTokenBase[];
+
+namespace tokenlog {
+
+// Fixed-size ring of encoded records (single producer, single consumer)
+struct Ring {
+  uint8_t data[LOG_RING_SIZE];
+  uint16_t head;      // next byte to write
+  uint16_t tail;      // next byte to drain
+  uint16_t used;
+  uint32_t dropped;   // records lost since the last drop report
+};
+
+extern Ring ring;
+
+// Append a fully encoded record; returns false (and counts a drop) if full
+bool push(const uint8_t* record, size_t length);
+
+// Copy up to max bytes of pending output into out; returns bytes copied
+size_t take(uint8_t* out, size_t max);
+
+// Write pending records to the console without blocking (called from loop())
+void drain();
+
+// Write everything pending, blocking; for use right before a restart
+void flush();
+
+void reset();
+
+inline void putU32(uint8_t* buf, uint32_t v) {
+  buf[0] = v & 0xFF;
+  buf[1] = (v >> 8) & 0xFF;
+  buf[2] = (v >> 16) & 0xFF;
+  buf[3] = (v >> 24) & 0xFF;
+}
+
+// Argument encoding: tag + value. Every integer type is mapped onto int32 or
+// uint32, floating point onto float32 and strings are copied.
+inline size_t encode(uint8_t* buf, int32_t v) { buf[0] = 'i'; putU32(buf + 1, (uint32_t)v); return 5; }
+inline size_t encode(uint8_t* buf, uint32_t v) { buf[0] = 'u'; putU32(buf + 1, v); return 5; }
+inline size_t encode(uint8_t* buf, double v) {
+  float f = (float)v;
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  buf[0] = 'f';
+  putU32(buf + 1, bits);
+  return 5;
+}
+inline size_t encode(uint8_t* buf, const char* s) {
+  size_t n = s ? strlen(s) : 0;
+  if (n > LOG_MAX_STRING) {
+    n = LOG_MAX_STRING;
+  }
+  buf[0] = 's';
+  buf[1] = (uint8_t)n;
+  if (n) {
+    memcpy(buf + 2, s, n);
+  }
+  return 2 + n;
+}
+
+inline int32_t normalize(int v) { return v; }
+inline int32_t normalize(long v) { return (int32_t)v; }
+inline int32_t normalize(short v) { return v; }
+inline int32_t normalize(signed char v) { return v; }
+inline int32_t normalize(char v) { return v; }
+inline int32_t normalize(long long v) { return (int32_t)v; }
+inline uint32_t normalize(unsigned int v) { return v; }
+inline uint32_t normalize(unsigned long v) { return (uint32_t)v; }
+inline uint32_t normalize(unsigned short v) { return v; }
+inline uint32_t normalize(unsigned char v) { return v; }
+inline uint32_t normalize(unsigned long long v) { return (uint32_t)v; }
+inline uint32_t normalize(bool v) { return v ? 1 : 0; }
+inline double normalize(float v) { return v; }
+inline double normalize(double v) { return v; }
+inline const char* normalize(const char* v) { return v; }
+
+inline size_t encodeArgs(uint8_t*) { return 0; }
+template <typename T, typename... Rest>
+size_t encodeArgs(uint8_t* buf, const T& first, const Rest&... rest) {
+  size_t n = encode(buf, normalize(first));
+  return n + encodeArgs(buf + n, rest...);
+}
+
+// sync, length, token, millis
+const size_t kHeaderSize = 10;
+
+// Encode one record into a stack buffer and append it to the ring
+template <typename... Args>
+void record(const char* format, const Args&... args) {
+  static_assert(sizeof...(Args) <= 4, "LOGF takes at most 4 arguments");
+  uint8_t buf[kHeaderSize + sizeof...(Args) * (2 + LOG_MAX_STRING)];
+  size_t length = kHeaderSize + encodeArgs(buf + kHeaderSize, args...);
+  buf[0] = LOG_RECORD_SYNC;
+  buf[1] = (uint8_t)(length - 2);
+  putU32(buf + 2, (uint32_t)((intptr_t)format - (intptr_t)logTokenBase));
+  putU32(buf + 6, hal::millis());
+  push(buf, length);
+}
+
+}  // namespace tokenlog
+
+// Format strings stay out of RAM on the device
+#ifdef NATIVE_BUILD
+  #define LOG_FORMAT(fmt) (fmt)
+#else
+  #define LOG_FORMAT(fmt) PSTR(fmt)
+#endif
+
+#if TOKENIZED_LOGGING
+  #define LOG_EMIT(fmt, ...) tokenlog::record(LOG_FORMAT(fmt), ##__VA_ARGS__)
+#else
+  #define LOG_EMIT(fmt, ...) HAL_CONSOLE.printf(fmt, ##__VA_ARGS__)
+#endif
+
+#endif // TOKEN_LOG_H
@@ -0,0 +1,149 @@
+#ifndef TOPICS_H
+#define TOPICS_H
+
+#include <stddef.h>
+#include "config.h"
+
+/*
+ * Per-zone topic table
+ * ====================
+ * Every per-zone topic string (state, command, Home Assistant discovery config
+ * and unique id) for zones 1..NUM_ZONES is generated from MQTT_TOPIC_PREFIX by
+ * the compiler, so publishing to a zone topic is a pointer fetch rather than
+ * an snprintf into a stack buffer:
+ *
+ *   mqtt.publish(zoneTopic(ZONE_STATE, zone), "ON", true);
+ *
+ * The table is constant data (.rodata), not PROGMEM: PubSubClient reads the
+ * topic with ordinary byte loads, which flash-mapped memory on the ESP8266
+ * does not allow, so a PROGMEM table would need a copy per publish again.
+ * It takes roughly 120 bytes per zone.
+ *
+ * Sizes are checked at compile time against MQTT_TOPIC_BUFFER_SIZE and
+ * MQTT_UNIQUE_ID_BUFFER_SIZE (the limits subscribers and test_buffers expect).
+ */
+
+enum ZoneTopic {
+  ZONE_STATE,      // home/sprinkler/zone/N/state
+  ZONE_COMMAND,    // home/sprinkler/zone/N/command
+  ZONE_DISCOVERY,  // homeassistant/switch/sprinkler_zoneN/config
+  ZONE_UNIQUE_ID,  // sprinkler_zoneN
+  NUM_ZONE_TOPICS
+};
+
+namespace topics {
+
+struct Pattern {
+  const char* prefix;
+  const char* suffix;
+};
+
+constexpr Pattern PATTERNS[NUM_ZONE_TOPICS] = {
+  {MQTT_TOPIC_PREFIX "zone/", "/state"},
+  {MQTT_TOPIC_PREFIX "zone/", "/command"},
+  {"homeassistant/switch/sprinkler_zone", "/config"},
+  {"sprinkler_zone", ""},
+};
+
+constexpr size_t length(const char* s) {
+  size_t n = 0;
+  while (s[n]) {
+    n++;
+  }
+  return n;
+}
+
+constexpr size_t digits(int n) {
+  size_t d = 1;
+  while (n >= 10) {
+    n /= 10;
+    d++;
+  }
+  return d;
+}
+
+// Longest string of a kind, without the terminator (the highest zone number)
+constexpr size_t maxLength(ZoneTopic kind) {
+  return length(PATTERNS[kind].prefix) + digits(NUM_ZONES) + length(PATTERNS[kind].suffix);
+}
+
+constexpr bool equal(const char* a, const char* b) {
+  while (*a && *a == *b) {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+// prefix + decimal zone number + suffix
+constexpr void build(char* out, const Pattern& pattern, int zone) {
+  size_t n = 0;
+  for (const char* p = pattern.prefix; *p; p++) {
+    out[n++] = *p;
+  }
+  char number[8] = {};
+  size_t d = digits(zone);
+  for (size_t i = d; i > 0; i--) {
+    number[i - 1] = '0' + zone % 10;
+    zone /= 10;
+  }
+  for (size_t i = 0; i < d; i++) {
+    out[n++] = number[i];
+  }
+  for (const char* s = pattern.suffix; *s; s++) {
+    out[n++] = *s;
+  }
+  out[n] = '\0';
+}
+
+// All zones for one kind, each slot sized for the longest zone number
+template <ZoneTopic Kind>
+struct ZoneTable {
+  static constexpr size_t SLOT_SIZE = maxLength(Kind) + 1;
+  char strings[NUM_ZONES][SLOT_SIZE];
+
+  constexpr ZoneTable() : strings{} {
+    for (int zone = 1; zone <= NUM_ZONES; zone++) {
+      build(strings[zone - 1], PATTERNS[Kind], zone);
+    }
+  }
+};
+
+inline constexpr ZoneTable<ZONE_STATE> STATE_TOPICS{};
+inline constexpr ZoneTable<ZONE_COMMAND> COMMAND_TOPICS{};
+inline constexpr ZoneTable<ZONE_DISCOVERY> DISCOVERY_TOPICS{};
+inline constexpr ZoneTable<ZONE_UNIQUE_ID> UNIQUE_IDS{};
+
+static_assert(maxLength(ZONE_STATE) < MQTT_TOPIC_BUFFER_SIZE, "state topic too long");
+static_assert(maxLength(ZONE_COMMAND) < MQTT_TOPIC_BUFFER_SIZE, "command topic too long");
+static_assert(maxLength(ZONE_DISCOVERY) < MQTT_TOPIC_BUFFER_SIZE, "discovery topic too long");
+static_assert(maxLength(ZONE_UNIQUE_ID) < MQTT_UNIQUE_ID_BUFFER_SIZE, "unique id too long");
+
+}  // namespace topics
+
+/**
+ * Look up a per-zone topic
+ *
+ * @param kind Which topic
+ * @param zone Zone number, 1..NUM_ZONES
+ * @return Pointer into the constant table, or nullptr for an invalid zone/kind
+ */
+constexpr const char* zoneTopic(ZoneTopic kind, int zone) {
+  if (zone < 1 || zone > NUM_ZONES) {
+    return nullptr;
+  }
+  switch (kind) {
+    case ZONE_STATE:
+      return topics::STATE_TOPICS.strings[zone - 1];
+    case ZONE_COMMAND:
+      return topics::COMMAND_TOPICS.strings[zone - 1];
+    case ZONE_DISCOVERY:
+      return topics::DISCOVERY_TOPICS.strings[zone - 1];
+    case ZONE_UNIQUE_ID:
+      return topics::UNIQUE_IDS.strings[zone - 1];
+    default:
+      return nullptr;
+  }
+}
+
+#endif // TOPICS_H
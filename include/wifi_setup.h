@@ -1,10 +1,6 @@
 #ifndef WIFI_SETUP_H
 #define WIFI_SETUP_H
 
-#include <ESP8266WiFi.h>
-#include <WiFiManager.h>
-#include <FS.h>
-#include <ArduinoJson.h>
 #include "config.h"
 
 // External MQTT parameter storage
@@ -15,8 +11,8 @@ extern char mqtt_password[24];
 extern bool shouldSaveConfig;
 
 // Forward declarations
-void setupWifi();
+void setupWifi();        // src/wifi_setup.cpp (ESP8266), src/native/setup_native.cpp (host)
 void saveConfigCallback();
-void loadConfig();
+void loadConfig();       // src/main.cpp, portable through hal.h
 
 #endif // WIFI_SETUP_H
@@ -0,0 +1,210 @@
+/*
+ * Zone command parsing (see command_parser.h)
+ */
+
+#include "command_parser.h"
+
+struct CommandVerb {
+  uint64_t key;
+  ZoneCommand command;
+};
+
+#define COMMAND_VERB(word, command) {commandKey(word, sizeof(word) - 1), command}
+
+static constexpr CommandVerb VERBS[] = {
+  COMMAND_VERB("ON", ZONE_CMD_ON),
+  COMMAND_VERB("OFF", ZONE_CMD_OFF),
+  COMMAND_VERB("1", ZONE_CMD_ON),
+  COMMAND_VERB("0", ZONE_CMD_OFF),
+};
+
+static_assert(ZONE_VERB_MAX_LENGTH < 8, "the key holds 7 bytes plus the length");
+static_assert(NUM_ZONES < 100, "formatZoneStates() writes at most two digits");
+
+ZoneCommand parseZoneCommand(const uint8_t* payload, unsigned int length) {
+  if (length == 0 || length > ZONE_VERB_MAX_LENGTH) {
+    return ZONE_CMD_UNKNOWN;
+  }
+  uint64_t key = (uint64_t)length << 56;
+  for (unsigned int i = 0; i < length; i++) {
+    key |= (uint64_t)foldCommandByte(payload[i]) << (8 * i);
+  }
+  for (const CommandVerb& verb : VERBS) {
+    if (verb.key == key) {
+      return verb.command;
+    }
+  }
+  return ZONE_CMD_UNKNOWN;
+}
+
+static bool isBatchSpace(uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Cursor over a non-terminated payload
+struct BatchReader {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  void skipSpace() {
+    while (p < end && isBatchSpace(*p)) {
+      p++;
+    }
+  }
+
+  bool accept(uint8_t c) {
+    skipSpace();
+    if (p < end && *p == c) {
+      p++;
+      return true;
+    }
+    return false;
+  }
+};
+
+static bool isHexDigit(uint8_t c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static unsigned int hexValue(uint8_t c) {
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+// "5" or "0x05": every zone is set, ON where its bit is set
+static bool parseZoneMask(BatchReader& in, ZoneBatch& batch) {
+  uint64_t value = 0;
+  int digits = 0;
+  if (in.end - in.p > 2 && in.p[0] == '0' && (in.p[1] | 0x20) == 'x') {
+    in.p += 2;
+    while (in.p < in.end && isHexDigit(*in.p) && digits < 9) {
+      value = value << 4 | hexValue(*in.p++);
+      digits++;
+    }
+  } else {
+    while (in.p < in.end && *in.p >= '0' && *in.p <= '9' && digits < 11) {
+      value = value * 10 + (*in.p++ - '0');
+      digits++;
+    }
+  }
+  in.skipSpace();
+  if (digits == 0 || in.p != in.end || value >> NUM_ZONES) {
+    return false;
+  }
+  batch.mask = (uint32_t)((1ull << NUM_ZONES) - 1);
+  batch.on = (uint32_t)value;
+  return true;
+}
+
+// {"1":"ON","3":"OFF"}: only the listed zones are set
+static bool parseZoneMap(BatchReader& in, ZoneBatch& batch) {
+  ZoneBatch result = {0, 0};
+  if (!in.accept('{')) {
+    return false;
+  }
+  if (!in.accept('}')) {
+    do {
+      // Key: quoted zone number
+      if (!in.accept('"')) {
+        return false;
+      }
+      int zone = 0;
+      int digits = 0;
+      while (in.p < in.end && *in.p >= '0' && *in.p <= '9' && digits < 3) {
+        zone = zone * 10 + (*in.p++ - '0');
+        digits++;
+      }
+      if (digits == 0 || in.p >= in.end || *in.p++ != '"' || zone < 1 || zone > NUM_ZONES) {
+        return false;
+      }
+      uint32_t bit = 1u << (zone - 1);
+      if (result.mask & bit) {
+        return false;  // listed twice: ambiguous
+      }
+      if (!in.accept(':')) {
+        return false;
+      }
+
+      // Value: quoted or bare verb, as on the single zone topic
+      in.skipSpace();
+      const uint8_t* verb = in.p;
+      bool quoted = in.p < in.end && *in.p == '"';
+      if (quoted) {
+        verb = ++in.p;
+        while (in.p < in.end && *in.p != '"') {
+          in.p++;
+        }
+        if (in.p >= in.end) {
+          return false;
+        }
+      } else {
+        while (in.p < in.end && *in.p != ',' && *in.p != '}' && !isBatchSpace(*in.p)) {
+          in.p++;
+        }
+      }
+      ZoneCommand command = parseZoneCommand(verb, (unsigned int)(in.p - verb));
+      if (command == ZONE_CMD_UNKNOWN) {
+        return false;
+      }
+      in.p += quoted;
+      result.mask |= bit;
+      if (command == ZONE_CMD_ON) {
+        result.on |= bit;
+      }
+    } while (in.accept(','));
+
+    if (!in.accept('}')) {
+      return false;
+    }
+  }
+  in.skipSpace();
+  if (in.p != in.end) {
+    return false;
+  }
+  batch = result;
+  return true;
+}
+
+bool parseZoneBatch(const uint8_t* payload, unsigned int length, ZoneBatch& batch) {
+  if (length > ZONE_BATCH_MAX_LENGTH) {
+    return false;
+  }
+  BatchReader in = {payload, payload + length};
+  in.skipSpace();
+  if (in.p < in.end && *in.p == '{') {
+    return parseZoneMap(in, batch);
+  }
+  return parseZoneMask(in, batch);
+}
+
+static size_t appendText(char* out, const char* text) {
+  size_t n = 0;
+  while (text[n]) {
+    out[n] = text[n];
+    n++;
+  }
+  return n;
+}
+
+size_t formatZoneStates(char* buf, size_t size, uint32_t on) {
+  if (size <= ZONE_STATES_MAX_LENGTH) {
+    return 0;
+  }
+  // Written by hand: this runs after every zone change, and snprintf() per
+  // zone costs several times the rest of the command path
+  size_t n = 0;
+  buf[n++] = '{';
+  for (int zone = 1; zone <= NUM_ZONES; zone++) {
+    if (zone > 1) {
+      buf[n++] = ',';
+    }
+    buf[n++] = '"';
+    if (zone >= 10) {
+      buf[n++] = '0' + zone / 10;
+    }
+    buf[n++] = '0' + zone % 10;
+    n += appendText(buf + n, (on >> (zone - 1)) & 1 ? "\":\"ON\"" : "\":\"OFF\"");
+  }
+  buf[n++] = '}';
+  buf[n] = '\0';
+  return n;
+}
@@ -0,0 +1,182 @@
+/*
+ * Home Assistant discovery passes (see discovery.h)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "discovery.h"
+#include "topics.h"
+
+static_assert(NUM_ZONES <= 32, "zone sets are 32-bit masks");
+
+static const uint32_t ALL_ZONES = (uint32_t)((1ull << NUM_ZONES) - 1);
+
+void discoveryInit(DiscoveryState& state, const uint32_t* current, const uint32_t* stored) {
+  memset(&state, 0, sizeof(state));
+  for (int i = 0; i < NUM_ZONES; i++) {
+    state.fingerprint[i] = current[i];
+    // Without a record nothing counts as held: the complement never matches
+    state.held[i] = stored ? stored[i] : ~current[i];
+  }
+}
+
+void discoveryStart(DiscoveryState& state, uint32_t nowMs) {
+  state.verifyStartMs = nowMs;
+  state.recordSeen = false;
+  if (state.active) {
+    return;  // resume; the new session delivers the record again
+  }
+  state.active = true;
+  state.published = 0;
+  state.pending = 0;
+  for (int i = 0; i < NUM_ZONES; i++) {
+    if (state.held[i] != state.fingerprint[i]) {
+      state.pending |= 1u << i;
+    }
+  }
+  state.unverified = ALL_ZONES & ~state.pending;
+}
+
+bool discoveryVerifying(const DiscoveryState& state) {
+  return state.active && !state.recordSeen;
+}
+
+void discoveryVerify(DiscoveryState& state, const uint32_t* broker) {
+  state.recordSeen = true;
+  uint32_t open = state.pending | state.unverified;
+  for (int i = 0; i < NUM_ZONES; i++) {
+    uint32_t bit = 1u << i;
+    if (!(open & bit)) {
+      continue;
+    }
+    state.held[i] = broker[i];
+    if (broker[i] == state.fingerprint[i]) {
+      state.pending &= ~bit;
+    } else {
+      state.pending |= bit;
+    }
+  }
+  state.unverified = 0;
+}
+
+int discoveryNext(DiscoveryState& state, uint32_t nowMs) {
+  if (state.unverified && nowMs - state.verifyStartMs >= DISCOVERY_VERIFY_TIMEOUT) {
+    state.pending |= state.unverified;
+    state.unverified = 0;
+  }
+  if (state.pending == 0 || nowMs - state.lastPublishMs < DISCOVERY_INTERVAL) {
+    return 0;
+  }
+  state.lastPublishMs = nowMs;
+  int zone = 1;
+  while (!(state.pending & (1u << (zone - 1)))) {
+    zone++;
+  }
+  return zone;
+}
+
+void discoveryDone(DiscoveryState& state, int zone, bool sent) {
+  if (zone < 1 || zone > NUM_ZONES) {
+    return;
+  }
+  uint32_t bit = 1u << (zone - 1);
+  state.pending &= ~bit;
+  if (sent) {
+    state.held[zone - 1] = state.fingerprint[zone - 1];
+    state.published |= bit;
+  }
+}
+
+bool discoveryPassComplete(DiscoveryState& state) {
+  if (!state.active || state.pending || state.unverified) {
+    return false;
+  }
+  state.active = false;
+  return true;
+}
+
+bool discoveryRecordStale(const DiscoveryState& state) {
+  return state.published != 0 || !state.recordSeen;
+}
+
+size_t formatDiscoveryRecord(char* buf, size_t size, const uint32_t* fingerprints) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  if (size < DISCOVERY_RECORD_LENGTH + 1) {
+    return 0;
+  }
+  char* p = buf;
+  for (int i = 0; i < NUM_ZONES; i++) {
+    if (i > 0) {
+      *p++ = ',';
+    }
+    for (int shift = 28; shift >= 0; shift -= 4) {
+      *p++ = HEX_DIGITS[(fingerprints[i] >> shift) & 0xF];
+    }
+  }
+  *p = '\0';
+  return DISCOVERY_RECORD_LENGTH;
+}
+
+static int hexValue(uint8_t c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;  // fold to lower case
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+bool parseDiscoveryRecord(const uint8_t* text, size_t length, uint32_t* fingerprints) {
+  if (length != DISCOVERY_RECORD_LENGTH) {
+    return false;
+  }
+  uint32_t parsed[NUM_ZONES];
+  const uint8_t* p = text;
+  for (int i = 0; i < NUM_ZONES; i++) {
+    if (i > 0 && *p++ != ',') {
+      return false;
+    }
+    uint32_t value = 0;
+    for (int digit = 0; digit < 8; digit++) {
+      int nibble = hexValue(*p++);
+      if (nibble < 0) {
+        return false;
+      }
+      value = (value << 4) | (uint32_t)nibble;
+    }
+    parsed[i] = value;
+  }
+  memcpy(fingerprints, parsed, sizeof(parsed));
+  return true;
+}
+
+bool buildDiscoveryConfig(JsonDocument& json, int zoneNum, uint32_t chipId) {
+  char deviceId[16];
+  snprintf(deviceId, sizeof(deviceId), "%08X", (unsigned int)chipId);
+
+  json.clear();
+  json["name"] = ZONE_NAMES[zoneNum - 1];
+  json["unique_id"] = zoneTopic(ZONE_UNIQUE_ID, zoneNum);
+  json["command_topic"] = zoneTopic(ZONE_COMMAND, zoneNum);
+  json["state_topic"] = zoneTopic(ZONE_STATE, zoneNum);
+  json["availability_topic"] = MQTT_STATUS;
+  json["payload_on"] = "ON";
+  json["payload_off"] = "OFF";
+  json["state_on"] = "ON";
+  json["state_off"] = "OFF";
+  json["optimistic"] = false;
+  json["qos"] = MQTT_COMMAND_QOS;
+  json["retain"] = true;
+
+  // Add device information for Home Assistant
+  JsonObject device = json.createNestedObject("device");
+  device["name"] = "Sprinkler Controller";
+  device["identifiers"] = deviceId;
+  device["model"] = "ESP8266 NodeMCU";
+  device["manufacturer"] = "DIY";
+  device["sw_version"] = SW_VERSION;
+
+  return !json.overflowed();
+}
@@ -0,0 +1,108 @@
+/*
+ * ESP8266 implementation of the HAL filesystem (SPIFFS) and network connect
+ * calls. The GPIO, clock and system calls are inline wrappers in hal.h.
+ * Excluded from native builds.
+ */
+
+#include <FS.h>
+#include <lwip/dns.h>
+#include "hal.h"
+
+namespace hal {
+
+namespace {
+
+// Lookup in flight. lwIP calls back from the network stack, possibly after
+// the caller gave up and started another lookup, so each one carries its
+// generation and stale answers are ignored.
+volatile NetResult resolveResult = NET_FAILED;
+volatile uint32_t resolvedIp = 0;
+uint32_t resolveGeneration = 0;
+
+void onResolved(const char* name, const ip_addr_t* addr, void* arg) {
+  (void)name;
+  if (reinterpret_cast<uintptr_t>(arg) != resolveGeneration) {
+    return;
+  }
+  if (addr) {
+    resolvedIp = ip_addr_get_ip4_u32(addr);
+    resolveResult = NET_OK;
+  } else {
+    resolveResult = NET_FAILED;
+  }
+}
+
+}  // namespace
+
+bool netResolveStart(const char* host) {
+  resolveGeneration++;
+  ip_addr_t addr;
+  // Answers at once for IP literals and cached names
+  err_t err = dns_gethostbyname(host, &addr, onResolved,
+                                reinterpret_cast<void*>(static_cast<uintptr_t>(resolveGeneration)));
+  if (err == ERR_OK) {
+    resolvedIp = ip_addr_get_ip4_u32(&addr);
+    resolveResult = NET_OK;
+  } else {
+    resolveResult = (err == ERR_INPROGRESS) ? NET_PENDING : NET_FAILED;
+  }
+  return resolveResult != NET_FAILED;
+}
+
+NetResult netResolvePoll(uint32_t* ip) {
+  NetResult result = resolveResult;
+  if (result == NET_OK) {
+    *ip = resolvedIp;
+  }
+  return result;
+}
+
+bool netConnect(NetClient& client, uint32_t ip, uint16_t port, uint32_t timeoutMs) {
+  // WiFiClient::connect() waits for the handshake up to the stream timeout,
+  // which also bounds later writes; only shorten it for the connect
+  unsigned long previous = client.getTimeout();
+  client.setTimeout(timeoutMs);
+  bool connected = client.connect(IPAddress(ip), port) == 1;
+  client.setTimeout(previous);
+  return connected;
+}
+
+bool fsBegin() {
+  return SPIFFS.begin();
+}
+
+bool fsExists(const char* path) {
+  return SPIFFS.exists(path);
+}
+
+size_t fsSize(const char* path) {
+  File file = SPIFFS.open(path, "r");
+  if (!file) {
+    return 0;
+  }
+  size_t size = file.size();
+  file.close();
+  return size;
+}
+
+size_t fsRead(const char* path, char* buf, size_t len) {
+  File file = SPIFFS.open(path, "r");
+  if (!file) {
+    return 0;
+  }
+  size_t n = file.readBytes(buf, len);
+  file.close();
+  return n;
+}
+
+bool fsWrite(const char* path, const char* data, size_t len) {
+  File file = SPIFFS.open(path, "w");
+  if (!file) {
+    return false;
+  }
+  size_t n = file.write(reinterpret_cast<const uint8_t*>(data), len);
+  file.close();
+  return n == len;
+}
+
+}  // namespace hal
@@ -0,0 +1,124 @@
+/*
+ * Per-module log levels (see logging.h)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "logging.h"
+
+uint8_t logLevels[NUM_LOG_MODULES] = {
+  logCompiledLevel(LOG_WIFI),
+  logCompiledLevel(LOG_MQTT),
+  logCompiledLevel(LOG_ZONES),
+  logCompiledLevel(LOG_OTA),
+  logCompiledLevel(LOG_CONFIG),
+};
+
+static const char* const MODULE_NAMES[NUM_LOG_MODULES] = {
+  "wifi", "mqtt", "zones", "ota", "config"
+};
+
+static const char* const LEVEL_NAMES[] = {
+  "off", "error", "warn", "info", "trace"
+};
+static const int NUM_LOG_LEVELS = sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]);
+
+const char* logModuleName(int module) {
+  if (module < 0 || module >= NUM_LOG_MODULES) {
+    return "unknown";
+  }
+  return MODULE_NAMES[module];
+}
+
+const char* logLevelName(int level) {
+  if (level < 0 || level >= NUM_LOG_LEVELS) {
+    return "unknown";
+  }
+  return LEVEL_NAMES[level];
+}
+
+static int findName(const char* const* names, int count, const char* name, size_t length) {
+  for (int i = 0; i < count; i++) {
+    if (strlen(names[i]) == length && strncmp(names[i], name, length) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int logModuleFromName(const char* name, size_t length) {
+  return findName(MODULE_NAMES, NUM_LOG_MODULES, name, length);
+}
+
+int logLevelFromName(const char* name, size_t length) {
+  return findName(LEVEL_NAMES, NUM_LOG_LEVELS, name, length);
+}
+
+uint8_t logSetLevel(LogModule module, uint8_t level) {
+  uint8_t compiled = logCompiledLevel(module);
+  logLevels[module] = level < compiled ? level : compiled;
+  return logLevels[module];
+}
+
+void logResetLevels() {
+  for (int i = 0; i < NUM_LOG_MODULES; i++) {
+    logLevels[i] = logCompiledLevel((LogModule)i);
+  }
+}
+
+bool logApplyCommand(const char* command, size_t length) {
+  if (length == 5 && strncmp(command, "reset", 5) == 0) {
+    logResetLevels();
+    return true;
+  }
+
+  // Parse everything before changing anything
+  uint8_t levels[NUM_LOG_MODULES];
+  memcpy(levels, logLevels, sizeof(levels));
+
+  size_t pos = 0;
+  while (pos < length) {
+    size_t end = pos;
+    while (end < length && command[end] != ',') {
+      end++;
+    }
+    const char* item = command + pos;
+    size_t itemLength = end - pos;
+    const char* eq = (const char*)memchr(item, '=', itemLength);
+
+    if (eq) {
+      int module = logModuleFromName(item, eq - item);
+      int level = logLevelFromName(eq + 1, itemLength - (eq + 1 - item));
+      if (module < 0 || level < 0) {
+        return false;
+      }
+      levels[module] = level;
+    } else {
+      int level = logLevelFromName(item, itemLength);
+      if (level < 0) {
+        return false;
+      }
+      memset(levels, level, sizeof(levels));
+    }
+    pos = end + 1;
+  }
+
+  for (int i = 0; i < NUM_LOG_MODULES; i++) {
+    logSetLevel((LogModule)i, levels[i]);
+  }
+  return true;
+}
+
+size_t logFormatLevels(char* buf, size_t size) {
+  size_t used = 0;
+  buf[0] = '\0';
+  for (int i = 0; i < NUM_LOG_MODULES && used < size; i++) {
+    int n = snprintf(buf + used, size - used, "%s%s=%s", i ? "," : "", MODULE_NAMES[i],
+                     LEVEL_NAMES[logLevels[i]]);
+    if (n < 0) {
+      break;
+    }
+    used += n;
+  }
+  return used < size ? used : size - 1;
+}
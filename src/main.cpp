@@ -17,12 +17,28 @@
  * - Regular security audits
  */
 
-#include <Arduino.h>
-#include <FS.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ArduinoJson.h>
+#include "hal.h"
 #include "config.h"
 #include "wifi_setup.h"
 #include "mqtt_handler.h"
 #include "ota_setup.h"
+#include "controller.h"
+#include "telemetry.h"
+#include "profiler.h"
+#include "logging.h"
+#include "topics.h"
+#include "command_parser.h"
+#include "dispatcher.h"
+#include "publish_queue.h"
+#include "discovery.h"
+#include "status_report.h"
+#include "mqtt_connect.h"
+#include "mqtt_client.h"
+#include "offline_log.h"
 
 // MQTT connection parameters
 char mqtt_server[40] = "";
@@ -31,82 +47,345 @@ char mqtt_user[24] = "";
 char mqtt_password[24] = "";
 
 // Client objects
-WiFiClient espClient;
-PubSubClient mqtt(espClient);
-
-// Timing variables
-unsigned long lastReconnectAttempt = 0;
-unsigned long lastStatusReport = 0;
+hal::NetClient espClient;
+MqttClient mqtt(espClient);
 
 // Flag for WiFiManager reset
 bool shouldSaveConfig = false;
 
-// Zone runtime tracking for safety limits
-unsigned long zone_on_time[NUM_ZONES] = {0};
+// Timers and zone runtime tracking (see controller.h)
+ControllerState controller = {};
+
+// CONNECT parameters: the client id made from the chip id (connectInit()), an
+// "offline" last will on the status topic, and a persistent session unless
+// MQTT_PERSISTENT_SESSION is false
+static const MqttConnectOptions MQTT_SESSION = {
+  controller.connect.clientId, mqtt_user, mqtt_password, MQTT_STATUS, "offline", true,
+  !MQTT_PERSISTENT_SESSION,
+};
+
+static constexpr size_t max2(size_t a, size_t b) {
+  return a > b ? a : b;
+}
+static constexpr size_t max4(size_t a, size_t b, size_t c, size_t d) {
+  return max2(max2(a, b), max2(c, d));
+}
+
+// JSON document shared by publishStatus(), publishTelemetry(), publishProfile()
+// and publishHomeAssistantConfig().
+// Statically allocated so the publish paths never touch the heap; none of them
+// is re-entrant, so one document serves all of them (sized for the largest).
+const size_t STATUS_JSON_CAPACITY = JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(4) +
+                                    JSON_ARRAY_SIZE(NUM_ZONES) +
+                                    NUM_ZONES * JSON_OBJECT_SIZE(3) + 300;
+const size_t TELEMETRY_JSON_CAPACITY = JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(NUM_LOOP_PHASES) +
+                                       JSON_ARRAY_SIZE(LOOP_HISTOGRAM_BUCKETS) + JSON_OBJECT_SIZE(4) +
+                                       JSON_OBJECT_SIZE(3);
+const size_t PROFILE_JSON_CAPACITY = JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(MAX_PROFILE_PROBES) +
+                                     MAX_PROFILE_PROBES * JSON_ARRAY_SIZE(6);
+const size_t PUBLISH_JSON_CAPACITY = max4(STATUS_JSON_CAPACITY, DISCOVERY_JSON_CAPACITY,
+                                          TELEMETRY_JSON_CAPACITY, PROFILE_JSON_CAPACITY);
+static StaticJsonDocument<PUBLISH_JSON_CAPACITY> publishJson;
 
 /**
- * MQTT message callback - handles incoming zone control commands
+ * Payload writer into the MQTT client's beginPublish()/write()/endPublish()
  *
- * @param topic The MQTT topic the message was received on
- * @param payload Raw byte array containing the message payload
+ * JSON and queued payloads are streamed to the socket instead of serialized
+ * into a buffer first, so no publish needs a payload-sized buffer and the
+ * client buffer only has to hold inbound commands (MQTT_CLIENT_BUFFER_SIZE).
+ * Writes are collected into MQTT_STREAM_CHUNK_SIZE pieces; ArduinoJson writes
+ * a few bytes at a time and each client write is a TCP write.
+ */
+class MqttStream : public PublishWriter {
+ public:
+  using PublishWriter::write;
+
+  // Start a message of exactly length payload bytes
+  bool begin(const char* topic, size_t length, bool retained) {
+    used = 0;
+    failed = false;
+    return mqtt.beginPublish(topic, length, retained);
+  }
+
+  size_t write(const uint8_t* data, size_t length) override {
+    size_t left = length;
+    while (left > 0) {
+      size_t n = left < sizeof(chunk) - used ? left : sizeof(chunk) - used;
+      memcpy(chunk + used, data, n);
+      used += n;
+      data += n;
+      left -= n;
+      if (used == sizeof(chunk)) {
+        flush();
+      }
+    }
+    return length;
+  }
+
+  size_t write(uint8_t c) override {
+    chunk[used++] = c;
+    if (used == sizeof(chunk)) {
+      flush();
+    }
+    return 1;
+  }
+
+  // Finish the message; false if any part of it was not written
+  bool end() {
+    flush();
+    return mqtt.endPublish() && !failed;
+  }
+
+ private:
+  void flush() {
+    if (used > 0 && mqtt.write(chunk, used) != used) {
+      failed = true;
+    }
+    used = 0;
+  }
+
+  uint8_t chunk[MQTT_STREAM_CHUNK_SIZE];
+  size_t used = 0;
+  bool failed = false;
+};
+
+static MqttStream mqttStream;
+
+// Publish render(arg, ...) by streaming it; length comes from publishMeasure()
+static bool streamPublish(const char* topic, PublishRender render, int arg, size_t length,
+                          bool retained) {
+  if (!mqttStream.begin(topic, length, retained)) {
+    return false;
+  }
+  render(arg, mqttStream);
+  return mqttStream.end();
+}
+
+// Publish the shared JSON document by streaming it
+static bool streamJson(const char* topic, bool retained) {
+  if (publishJson.overflowed()) {
+    LOG_WARN(LOG_MQTT, "%s payload incomplete, not published\n", topic);
+    return false;
+  }
+  if (!mqttStream.begin(topic, measureJson(publishJson), retained)) {
+    return false;
+  }
+  serializeJson(publishJson, mqttStream);
+  return mqttStream.end();
+}
+
+// Publish the shared document as MessagePack (same data as streamJson())
+static bool streamMsgPack(const char* topic, bool retained) {
+  if (publishJson.overflowed()) {
+    LOG_WARN(LOG_MQTT, "%s payload incomplete, not published\n", topic);
+    return false;
+  }
+  if (!mqttStream.begin(topic, measureMsgPack(publishJson), retained)) {
+    return false;
+  }
+  serializeMsgPack(publishJson, mqttStream);
+  return mqttStream.end();
+}
+
+/**
+ * Queue a state publish (see publish_queue.h)
+ *
+ * The payload is rendered by render(arg, ...) when loop() sends it. If the
+ * queue is full it is rendered and published right away instead.
+ */
+static void queuePublish(const char* topic, PublishRender render, int arg, bool retained) {
+  if (!publishQueueEnqueue(controller.publishQueue, topic, render, arg, retained)) {
+    LOG_WARN(LOG_MQTT, "Publish queue full, publishing %s directly\n", topic);
+    size_t length = publishMeasure(render, arg);
+    if (length > 0) {
+      streamPublish(topic, render, arg, length, retained);
+    }
+  }
+}
+
+// Whether a state queued now reaches the broker: connected and announced
+// (ANNOUNCE may restart the queue). Otherwise it goes to the offline log.
+static bool publishingOnline() {
+  return controller.connect.stage == CONNECT_UP && mqtt.connected();
+}
+
+// Payload of home/sprinkler/zone/N/state
+static void renderZoneState(int zone, PublishWriter& out) {
+  out.write(hal::gpioRead(ZONE_PINS[zone - 1]) ? "ON" : "OFF");
+}
+
+/**
+ * Switch a zone from a message on its command topic
+ *
+ * @param zone Zone number from the topic (ignored unless 1..NUM_ZONES)
+ * @param payload Raw payload, parsed in place (see command_parser.h)
  * @param length Number of bytes in the payload
  *
  * Side effects:
- * - Parses zone number from topic (expects format: home/sprinkler/zone/N/command)
  * - Controls GPIO pins to turn zones ON/OFF based on payload ("ON", "OFF", "1", "0")
- * - Publishes state confirmation back to MQTT state topic
+ * - Queues the state confirmation for the zone's state topic and the
+ *   aggregated zone states (see publishZoneStates()); loop() sends them, so
+ *   the callback never waits on the socket
  */
-void callback(char* topic, byte* payload, unsigned int length) {
-  // Use stack buffer for message (longest valid message is "OFF" = 3 chars)
-  char message[MQTT_MESSAGE_BUFFER_SIZE];
-  if (length >= sizeof(message)) {
-    DEBUG_PRINTLN("Warning: Message too long, truncating");
-    length = sizeof(message) - 1;
-  }
-  memcpy(message, payload, length);
-  message[length] = '\0';
-
-  DEBUG_PRINT("Message arrived [");
-  DEBUG_PRINT(topic);
-  DEBUG_PRINT("] ");
-  DEBUG_PRINTLN(message);
-
-  // Extract zone number using C string functions (no String objects)
-  const char* zonePrefix = "/zone/";
-  const char* zonePrefixPos = strstr(topic, zonePrefix);
-  const char* commandSuffix = strstr(topic, "/command");
-
-  if (zonePrefixPos && commandSuffix && commandSuffix > zonePrefixPos) {
-    const char* zoneNumStart = zonePrefixPos + strlen(zonePrefix);
-    int zone = atoi(zoneNumStart);  // Stops at first non-digit (the '/')
-
-    if (zone > 0 && zone <= NUM_ZONES) {
-      int zoneIndex = zone - 1;
-
-      // Build state topic using stack buffer
-      char stateTopic[MQTT_TOPIC_BUFFER_SIZE];
-      snprintf(stateTopic, sizeof(stateTopic), "%szone/%d/state", MQTT_TOPIC_PREFIX, zone);
-
-      // Case-insensitive comparison without String
-      char upperMessage[MQTT_MESSAGE_BUFFER_SIZE];
-      for (unsigned int i = 0; message[i] && i < sizeof(upperMessage) - 1; i++) {
-        upperMessage[i] = toupper(message[i]);
-      }
-      upperMessage[length] = '\0';
-
-      if (strcmp(upperMessage, "ON") == 0 || strcmp(message, "1") == 0) {
-        digitalWrite(ZONE_PINS[zoneIndex], HIGH);
-        mqtt.publish(stateTopic, "ON", true);
-        DEBUG_PRINT("Turning ON zone ");
-        DEBUG_PRINTLN(zone);
-      } else if (strcmp(upperMessage, "OFF") == 0 || strcmp(message, "0") == 0) {
-        digitalWrite(ZONE_PINS[zoneIndex], LOW);
-        mqtt.publish(stateTopic, "OFF", true);
-        DEBUG_PRINT("Turning OFF zone ");
-        DEBUG_PRINTLN(zone);
+void handleZoneCommand(int zone, const uint8_t* payload, unsigned int length) {
+  if (zone < 1 || zone > NUM_ZONES) {
+    return;
+  }
+  int zoneIndex = zone - 1;
+  const char* stateTopic = zoneTopic(ZONE_STATE, zone);
+
+  switch (parseZoneCommand(payload, length)) {
+    case ZONE_CMD_ON:
+      hal::gpioWrite(ZONE_PINS[zoneIndex], true);
+      queuePublish(stateTopic, renderZoneState, zone, true);
+      publishZoneStates();
+      LOG_INFO(LOG_ZONES, "Turning ON zone %d\n", zone);
+      break;
+    case ZONE_CMD_OFF:
+      hal::gpioWrite(ZONE_PINS[zoneIndex], false);
+      queuePublish(stateTopic, renderZoneState, zone, true);
+      publishZoneStates();
+      LOG_INFO(LOG_ZONES, "Turning OFF zone %d\n", zone);
+      break;
+    default:
+      if (length > ZONE_VERB_MAX_LENGTH) {
+        LOG_WARN(LOG_MQTT, "Message too long, ignoring\n");
       }
+      break;
+  }
+}
+
+/**
+ * Switch several zones from one message on home/sprinkler/zones/set
+ *
+ * @param payload Zone bitmask or JSON map (format in command_parser.h)
+ * @param length Number of bytes in the payload
+ *
+ * Side effects:
+ * - Rejects the whole batch if any part of it is invalid
+ * - Writes every listed zone's output in one pass, with nothing published
+ *   in between
+ * - Queues the state confirmation of every listed zone and one aggregated
+ *   reply on home/sprinkler/zones/state
+ */
+void handleZoneBatch(const uint8_t* payload, unsigned int length) {
+  ZoneBatch batch;
+  if (!parseZoneBatch(payload, length, batch)) {
+    LOG_WARN(LOG_MQTT, "Invalid zone batch, ignoring\n");
+    return;
+  }
+  for (int i = 0; i < NUM_ZONES; i++) {
+    uint32_t bit = 1u << i;
+    if (batch.mask & bit) {
+      hal::gpioWrite(ZONE_PINS[i], (batch.on & bit) != 0);
+      queuePublish(zoneTopic(ZONE_STATE, i + 1), renderZoneState, i + 1, true);
     }
   }
+  LOG_INFO(LOG_ZONES, "Zone batch: set %02X, on %02X\n", (unsigned int)batch.mask, (unsigned int)batch.on);
+  publishZoneStates();
+}
+
+// Route handlers (see ROUTES): unpack the topic captures for the command handlers
+static void routeZoneCommand(const TopicMatch& match, const uint8_t* payload, unsigned int length) {
+  handleZoneCommand(match.captureInt(0), payload, length);
+}
+
+static void routeZoneBatch(const TopicMatch&, const uint8_t* payload, unsigned int length) {
+  handleZoneBatch(payload, length);
+}
+
+static void routeProfileCommand(const TopicMatch&, const uint8_t* payload, unsigned int length) {
+  handleProfileCommand((const char*)payload, length);
+}
+
+static void routeLogLevel(const TopicMatch&, const uint8_t* payload, unsigned int length) {
+  handleLogLevelCommand((const char*)payload, length);
+}
+
+// Retained record of the discovery configs the broker holds (see discovery.h).
+// Only read at the start of a pass; later copies are our own publishes.
+static void routeDiscoveryRecord(const TopicMatch&, const uint8_t* payload, unsigned int length) {
+  if (!discoveryVerifying(controller.discovery)) {
+    return;
+  }
+  uint32_t broker[NUM_ZONES];
+  if (!parseDiscoveryRecord(payload, length, broker)) {
+    LOG_WARN(LOG_MQTT, "Malformed discovery record ignored\n");
+    return;
+  }
+  discoveryVerify(controller.discovery, broker);
+  LOG_TRACE(LOG_MQTT, "Discovery record received, %d configs to publish\n",
+            __builtin_popcount(controller.discovery.pending));
+}
+
+// Retained reconnect window set by the broker's operator (see mqtt_connect.h)
+static void routeReconnectWindow(const TopicMatch&, const uint8_t* payload, unsigned int length) {
+  if (!connectSetWindow(controller.connect, payload, length)) {
+    LOG_WARN(LOG_MQTT, "Invalid reconnect window ignored\n");
+    return;
+  }
+  LOG_TRACE(LOG_MQTT, "Reconnect window %lu ms\n", (unsigned long)controller.connect.windowMs);
+}
+
+// Every topic the controller subscribes to and its handler (see dispatcher.h).
+// continueMqttConnect() subscribes to each pattern; callback() routes through the
+// trie the compiler builds from this table. Commands are subscribed at
+// MQTT_COMMAND_QOS so a persistent session queues them while offline. Zone
+// commands, the most frequent, take the fast route past the trie.
+static constexpr TopicRoute ROUTES[] = {
+  {MQTT_ZONE_COMMAND, routeZoneCommand, MQTT_COMMAND_QOS, false, true},
+  {MQTT_ZONES_SET, routeZoneBatch, MQTT_COMMAND_QOS},
+  {MQTT_PROFILE_COMMAND, routeProfileCommand, MQTT_COMMAND_QOS},
+  {MQTT_LOG_LEVEL, routeLogLevel, MQTT_COMMAND_QOS},
+  {MQTT_DISCOVERY_FINGERPRINT, routeDiscoveryRecord, 0, true},
+  {MQTT_RECONNECT_WINDOW, routeReconnectWindow, 0, true},
+};
+static constexpr size_t NUM_ROUTES = sizeof(ROUTES) / sizeof(ROUTES[0]);
+static constexpr TopicDispatcher<topicNodeBound(ROUTES), topicIndexSize(ROUTES)>
+    topicRoutes(ROUTES, NUM_ROUTES);
+static_assert(topicRoutes.valid, "invalid MQTT route table");
+
+// Inbound messages are delivered only if they fit in the client buffer
+static_assert(MQTT_MAX_HEADER_SIZE + 2 + topics::length(MQTT_ZONES_SET) + ZONE_BATCH_MAX_LENGTH <=
+                  MQTT_CLIENT_BUFFER_SIZE,
+              "largest zone batch must fit in MQTT_CLIENT_BUFFER_SIZE");
+static_assert(MQTT_MAX_HEADER_SIZE + 2 + topics::length(MQTT_LOG_LEVEL) + LOG_COMMAND_BUFFER_SIZE <=
+                  MQTT_CLIENT_BUFFER_SIZE,
+              "largest log level command must fit in MQTT_CLIENT_BUFFER_SIZE");
+static_assert(MQTT_MAX_HEADER_SIZE + 2 + topics::length(MQTT_DISCOVERY_FINGERPRINT) +
+                  DISCOVERY_RECORD_LENGTH <= MQTT_CLIENT_BUFFER_SIZE,
+              "discovery record must fit in MQTT_CLIENT_BUFFER_SIZE");
+
+/**
+ * MQTT message callback - routes incoming messages to their handlers
+ *
+ * @param topic The MQTT topic the message was received on
+ * @param payload Raw byte array containing the message payload
+ * @param length Number of bytes in the payload
+ *
+ * Side effects:
+ * - Looks the topic up in ROUTES (cost independent of the number of routes)
+ *   and runs the matching handler with the payload in place, without copies:
+ *   zone commands on home/sprinkler/zone/N/command, zone batches on
+ *   home/sprinkler/zones/set, log level changes on
+ *   home/sprinkler/log/level (see logging.h) and profiler requests on
+ *   home/sprinkler/profile/command (see profiler.h)
+ */
+void callback(char* topic, byte* payload, unsigned int length) {
+  PROFILE_SCOPE("callback");
+
+  if (LOG_ENABLED(LOG_MQTT, LOG_LEVEL_TRACE)) {
+    // The payload is not NUL-terminated; copy it only for the log line
+    char message[LOG_MAX_STRING + 1];
+    unsigned int shown = length < sizeof(message) ? length : sizeof(message) - 1;
+    memcpy(message, payload, shown);
+    message[shown] = '\0';
+    LOG_TRACE(LOG_MQTT, "Message arrived [%s] %s\n", topic, message);
+  }
+
+  if (!topicRoutes.dispatch(topic, payload, length)) {
+    LOG_TRACE(LOG_MQTT, "No route for %s\n", topic);
+  }
 }
 
 /**
@@ -119,44 +398,45 @@ void callback(char* topic, byte* payload, unsigned int length) {
  * - Mounts SPIFFS filesystem (retries up to 3 times)
  * - Reads and parses /config.json if it exists
  * - Updates global MQTT configuration variables
- * - Outputs debug messages via Serial
+ * - Logs progress and errors for the config module (see logging.h)
  */
 void loadConfig() {
-  DEBUG_PRINTLN("Mounting file system...");
+  LOG_INFO(LOG_CONFIG, "Mounting file system...\n");
 
   // Try mounting SPIFFS with retry for transient errors
   bool mounted = false;
   int retries = 3;
   while (!mounted && retries > 0) {
-    mounted = SPIFFS.begin();
+    mounted = hal::fsBegin();
     if (!mounted) {
-      DEBUG_PRINTF("SPIFFS mount failed, retrying... (%d attempts left)\n", retries);
-      delay(500);
+      LOG_WARN(LOG_CONFIG, "SPIFFS mount failed, retrying... (%d attempts left)\n", retries);
+      hal::delay(500);
       retries--;
     }
   }
 
   if (mounted) {
-    DEBUG_PRINTLN("Mounted file system");
-    if (SPIFFS.exists("/config.json")) {
+    LOG_INFO(LOG_CONFIG, "Mounted file system\n");
+    if (hal::fsExists("/config.json")) {
       // File exists, reading and loading
-      DEBUG_PRINTLN("Reading config file");
-      File configFile = SPIFFS.open("/config.json", "r");
-      if (configFile) {
-        DEBUG_PRINTLN("Opened config file");
-        size_t size = configFile.size();
-        // Allocate a buffer to store contents of the file.
-        std::unique_ptr<char[]> buf(new char[size]);
+      LOG_TRACE(LOG_CONFIG, "Reading config file\n");
+      size_t size = hal::fsSize("/config.json");
+      if (size >= CONFIG_FILE_BUFFER_SIZE) {
+        LOG_ERROR(LOG_CONFIG, "Config file too large - ignoring it\n");
+      } else if (size > 0) {
+        LOG_TRACE(LOG_CONFIG, "Opened config file\n");
+        // Stack buffer for the file contents (no heap allocation at boot)
+        char buf[CONFIG_FILE_BUFFER_SIZE];
 
-        configFile.readBytes(buf.get(), size);
+        size = hal::fsRead("/config.json", buf, size);
 
         // Calculate buffer size with ArduinoJson Assistant
         const size_t capacity = JSON_OBJECT_SIZE(4) + 100;
-        DynamicJsonDocument json(capacity);
-        DeserializationError error = deserializeJson(json, buf.get());
+        StaticJsonDocument<capacity> json;
+        DeserializationError error = deserializeJson(json, buf, size);
         
         if (!error) {
-          DEBUG_PRINTLN("Parsed json");
+          LOG_TRACE(LOG_CONFIG, "Parsed json\n");
           strlcpy(mqtt_server, json["mqtt_server"] | "", sizeof(mqtt_server));
           strlcpy(mqtt_port, json["mqtt_port"] | "1883", sizeof(mqtt_port));
           strlcpy(mqtt_user, json["mqtt_user"] | "", sizeof(mqtt_user));
@@ -169,443 +449,819 @@ void loadConfig() {
                               atoi(mqtt_port) <= 65535);
 
           if (!config_valid) {
-            DEBUG_PRINTLN("Config validation failed - will force reconfiguration on next WiFi setup");
+            LOG_ERROR(LOG_CONFIG, "Config validation failed - will force reconfiguration on next WiFi setup\n");
             // Clear invalid config
             mqtt_server[0] = '\0';
           }
         } else {
-          DEBUG_PRINTLN("Failed to load json config");
+          LOG_ERROR(LOG_CONFIG, "Failed to load json config\n");
         }
-        configFile.close();
       }
     } else {
-      DEBUG_PRINTLN("Config file not found - first boot or reset");
+      LOG_INFO(LOG_CONFIG, "Config file not found - first boot or reset\n");
     }
   } else {
-    DEBUG_PRINTLN("Failed to mount file system after retries - filesystem may be corrupted");
+    LOG_ERROR(LOG_CONFIG, "Failed to mount file system after retries - filesystem may be corrupted\n");
   }
 }
 
-/**
- * Callback to flag that WiFiManager configuration needs to be saved
- *
- * Called by WiFiManager when user submits new configuration via web portal.
- *
- * Side effects:
- * - Sets shouldSaveConfig global flag to true
- */
-void saveConfigCallback() {
-  DEBUG_PRINTLN("Should save config");
-  shouldSaveConfig = true;
+// Abandon the current connect attempt (see connectStep())
+static bool connectStepFailed() {
+  LOG_WARN(LOG_MQTT, "MQTT connect failed at %s (state %d)\n",
+           connectStageName(controller.connect.stage), mqtt.state());
+  mqtt.close();
+  connectFailed(controller.connect);
+  return false;
 }
 
 /**
- * Setup WiFi connection and configure MQTT parameters via WiFiManager
+ * Run the current stage of the MQTT connect sequence (see mqtt_connect.h)
  *
- * Implements a captive portal for WiFi and MQTT configuration. Loads existing
- * config from SPIFFS, presents web UI for changes, saves updated config back to
- * filesystem. Forces configuration portal if no valid MQTT server is configured.
+ * A failed stage closes the socket; the next attempt starts after
+ * RECONNECT_INTERVAL or, with MQTT_RECONNECT_BACKOFF, a growing random wait.
  *
- * Side effects:
- * - Calls loadConfig() to read saved configuration
- * - Starts WiFiManager captive portal (SSID: "SprinklerSetup")
- * - Connects to WiFi network
- * - Updates global MQTT configuration variables
- * - Saves configuration to /config.json if changed
- * - Restarts ESP8266 if connection fails or times out
+ * @return true once connected, subscribed and announced
+ *
+ * Side effects, by stage:
+ * - UP: notices a lost connection and falls back to IDLE, with the next
+ *   attempt somewhere in the reconnect window
+ * - IDLE: validates the MQTT port (default 1883) and starts the DNS lookup of
+ *   mqtt_server when an attempt is due (backoff with jitter, mqtt_connect.h)
+ * - TCP: opens the connection to the resolved address (mqtt_client.h)
+ * - MQTT: connects with an "offline" last will on the status topic
+ * - SUBSCRIBE: subscribes to every pattern in ROUTES
+ *   ("home/sprinkler/zone/+/command", the zone batch topic, the profiler
+ *   command topic, the log level topic, the retained discovery record and the
+ *   retained reconnect window); only to the retained ones when the broker
+ *   kept the session
+ * - ANNOUNCE:
+ *   - Publishes "online" to status topic
+ *   - Restarts the publish queue: the broker may have lost its retained
+ *     messages, so nothing counts as already sent
+ *   - Queues the current state of all zones, per zone and aggregated
+ *   - Skips both when the broker kept the session and the offline log holds
+ *     every state change since the last time it did them (offline_log.h):
+ *     replaying the log is enough then
+ *   - Makes the next status report a full one
+ *   - Starts or resumes publishing the Home Assistant discovery configs
+ *     (publishHomeAssistantConfig())
  */
-void setupWifi() {
-  delay(10);
-  DEBUG_PRINTLN();
-  // Load saved configuration first
-  loadConfig();
+static bool connectStep() {
+  ConnectState& state = controller.connect;
+  uint32_t now = hal::millis();
 
-  DEBUG_PRINTLN("Setting up WiFi and MQTT params...");
-
-  // The extra parameters to be configured
-  WiFiManagerParameter custom_mqtt_server("server", "MQTT Server", mqtt_server, 40);
-  WiFiManagerParameter custom_mqtt_port("port", "MQTT Port", mqtt_port, 6);
-  WiFiManagerParameter custom_mqtt_user("user", "MQTT User", mqtt_user, 24);
-  WiFiManagerParameter custom_mqtt_password("password", "MQTT Password", mqtt_password, 24, "password");
-
-  // WiFiManager
-  WiFiManager wifiManager;
+  switch (state.stage) {
+    case CONNECT_UP:
+      if (mqtt.connected()) {
+        return true;
+      }
+      LOG_WARN(LOG_MQTT, "MQTT connection lost (state %d)\n", mqtt.state());
+      mqtt.close();
+      connectLost(state, now);
+      // retry within the reconnect window, possibly straight away
+      // fall through
+    case CONNECT_IDLE: {
+      if (!connectDue(state, now)) {
+        return false;
+      }
+      // Validate and convert port number, use default if invalid
+      int mqtt_port_int = (mqtt_port[0] != '\0') ? atoi(mqtt_port) : 1883;
+      if (mqtt_port_int <= 0 || mqtt_port_int > 65535) {
+        mqtt_port_int = 1883;  // Fallback to default MQTT port
+        LOG_WARN(LOG_CONFIG, "Invalid MQTT port, using default 1883\n");
+      }
+      connectBegin(state, static_cast<uint16_t>(mqtt_port_int), now);
+      if (!hal::netResolveStart(mqtt_server)) {
+        return connectStepFailed();
+      }
+      return false;
+    }
 
-  // Generate unique AP password from chip ID for security
-  char ap_password[32];
-  snprintf(ap_password, sizeof(ap_password), "sprinkler-%08X", ESP.getChipId());
+    case CONNECT_RESOLVE:
+      switch (hal::netResolvePoll(&state.ip)) {
+        case hal::NET_PENDING:
+          return connectTimedOut(state, now) ? connectStepFailed() : false;
+        case hal::NET_FAILED:
+          return connectStepFailed();
+        case hal::NET_OK:
+          break;
+      }
+      connectAdvance(state, CONNECT_TCP, now);
+      return false;
 
-  DEBUG_PRINTLN("=================================");
-  DEBUG_PRINT("Configuration Portal Password: ");
-  DEBUG_PRINTLN(ap_password);
-  DEBUG_PRINTLN("=================================");
+    case CONNECT_TCP: {
+      PROFILE_SCOPE("connect_tcp");
+      if (!mqtt.open(state.ip, state.port, MQTT_SESSION)) {
+        return connectStepFailed();
+      }
+      connectAdvance(state, CONNECT_MQTT, hal::millis());
+      return false;
+    }
 
-  // Check if we have valid configuration - force portal if empty
-  if (mqtt_server[0] == '\0') {
-    DEBUG_PRINTLN("No valid config found, forcing configuration portal");
-    wifiManager.resetSettings();
-  }
+    case CONNECT_MQTT: {
+      PROFILE_SCOPE("connect_mqtt");
+      switch (mqtt.finishConnect()) {
+        case hal::NET_PENDING:
+          return connectTimedOut(state, now) ? connectStepFailed() : false;
+        case hal::NET_FAILED:
+          return connectStepFailed();
+        case hal::NET_OK:
+          break;
+      }
+      LOG_INFO(LOG_MQTT, "MQTT connected\n");
+      connectAdvance(state, CONNECT_SUBSCRIBE, hal::millis());
+      return false;
+    }
 
-  // Set callback for saving configuration
-  wifiManager.setSaveConfigCallback(saveConfigCallback);
+    case CONNECT_SUBSCRIBE: {
+      // Subscribe to every routed topic, or only re-read the retained ones
+      // when the broker kept the session
+      bool all = connectNeedsSubscribe(state, mqtt.sessionPresent());
+      bool subscribed = true;
+      for (const TopicRoute& route : ROUTES) {
+        if (!all && !route.retained) {
+          continue;
+        }
+        if (!mqtt.subscribe(route.pattern, route.qos)) {
+          LOG_WARN(LOG_MQTT, "Subscribe to %s failed\n", route.pattern);
+          subscribed = false;
+        }
+      }
+      if (!mqtt.connected()) {
+        return connectStepFailed();
+      }
+      if (all && subscribed) {
+        connectSubscribed(state);
+      }
+      LOG_TRACE(LOG_MQTT, "Session %s\n", all ? "subscribed" : "resumed");
+      connectAdvance(state, CONNECT_ANNOUNCE, now);
+      return false;
+    }
 
-  // Add all your parameters here
-  wifiManager.addParameter(&custom_mqtt_server);
-  wifiManager.addParameter(&custom_mqtt_port);
-  wifiManager.addParameter(&custom_mqtt_user);
-  wifiManager.addParameter(&custom_mqtt_password);
+    case CONNECT_ANNOUNCE: {
+      if (!mqtt.connected()) {
+        return connectStepFailed();
+      }
+      PROFILE_SCOPE("reconnect");
 
-  // Set timeout for the configuration portal
-  wifiManager.setConfigPortalTimeout(CONFIG_PORTAL_TIMEOUT);
+      // Publish that we're online
+      mqtt.publish(MQTT_STATUS, "online", true);
 
-  // Reset saved settings - uncomment to test
-  //wifiManager.resetSettings();
+      statusReportReset(controller.status);
+      if (mqtt.sessionPresent() && controller.offline.complete) {
+        // The broker kept our session, retained states included: the offline
+        // log and the entries still queued bring it up to date
+        LOG_TRACE(LOG_MQTT, "Replaying %d offline records\n", (int)controller.offline.count);
+      } else {
+        // Queue current state of all zones; loop() sends them at PUBLISH_DRAIN_RATE
+        publishQueueReset(controller.publishQueue, now);
+        for (int i = 0; i < NUM_ZONES; i++) {
+          queuePublish(zoneTopic(ZONE_STATE, i + 1), renderZoneState, i + 1, true);
+        }
+        publishZoneStates();
+        offlineLogSynced(controller.offline);
+      }
 
-  // Set custom AP name with unique password (not hardcoded)
-  bool connected = wifiManager.autoConnect(AP_SSID, ap_password);
-  
-  if (!connected) {
-    DEBUG_PRINTLN("Failed to connect and hit timeout");
-    // Reset and try again
-    ESP.restart();
-  }
-  
-  // Read updated parameters
-  strlcpy(mqtt_server, custom_mqtt_server.getValue(), sizeof(mqtt_server));
-  strlcpy(mqtt_port, custom_mqtt_port.getValue(), sizeof(mqtt_port));
-  strlcpy(mqtt_user, custom_mqtt_user.getValue(), sizeof(mqtt_user));
-  strlcpy(mqtt_password, custom_mqtt_password.getValue(), sizeof(mqtt_password));
-  
-  DEBUG_PRINTLN("WiFi connected");
-  DEBUG_PRINT("IP address: ");
-  DEBUG_PRINTLN(WiFi.localIP());
-  
-  // Save the custom parameters to file system
-  if (shouldSaveConfig) {
-    DEBUG_PRINTLN("Saving config to /config.json");
-    
-    // Calculate buffer size with ArduinoJson Assistant
-    const size_t capacity = JSON_OBJECT_SIZE(4) + 100;
-    DynamicJsonDocument json(capacity);
-    
-    json["mqtt_server"] = mqtt_server;
-    json["mqtt_port"] = mqtt_port;
-    json["mqtt_user"] = mqtt_user;
-    json["mqtt_password"] = mqtt_password;
-
-    File configFile = SPIFFS.open("/config.json", "w");
-    if (!configFile) {
-      DEBUG_PRINTLN("Failed to open config file for writing");
-    } else {
-      serializeJson(json, configFile);
-      configFile.close();
-      DEBUG_PRINTLN("Config saved successfully");
+      // Publish zone configurations for Home Assistant auto-discovery
+      publishHomeAssistantConfig();
+      connectUp(state);
+      return true;
     }
   }
+  return false;
 }
 
 /**
- * Configure Over-The-Air (OTA) firmware update functionality
+ * Advance the MQTT connect sequence as far as it goes without blocking twice
  *
- * Sets up ArduinoOTA with hostname "sprinkler-controller" on port 8266.
- * Registers callbacks for update progress and error reporting.
+ * Called from loop() on every iteration. Runs the stages that are ready back
+ * to back, but at most one of TCP and MQTT, so it returns within
+ * MQTT_CONNECT_MAX_BLOCK_MS.
  *
- * Side effects:
- * - Configures OTA hostname and port
- * - Registers event handlers for OTA updates
- * - Calls ArduinoOTA.begin()
+ * @return true while connected, subscribed and announced
  */
-void setupOTA() {
-  // Port defaults to 8266
-  ArduinoOTA.setPort(8266);
-
-  // Hostname defaults to esp8266-[ChipID]
-  ArduinoOTA.setHostname("sprinkler-controller");
-
-  // Generate unique OTA password from chip ID for security
-  char ota_password[16];
-  snprintf(ota_password, sizeof(ota_password), "%08X", ESP.getChipId());
-  ArduinoOTA.setPassword(ota_password);
-  DEBUG_PRINTLN("=================================");
-  DEBUG_PRINT("OTA Password: ");
-  DEBUG_PRINTLN(ota_password);
-  DEBUG_PRINTLN("=================================");
-
-  ArduinoOTA.onStart([]() {
-    // Use stack buffer instead of String to avoid heap allocation
-    const char* type;
-    if (ArduinoOTA.getCommand() == U_FLASH) {
-      type = "sketch";
-    } else { // U_FS
-      type = "filesystem";
+bool continueMqttConnect() {
+  bool blocked = false;
+  for (;;) {
+    uint8_t stage = controller.connect.stage;
+    if (connectStageBlocks(stage)) {
+      if (blocked) {
+        return false;
+      }
+      blocked = true;
     }
-    DEBUG_PRINT("Start updating ");
-    DEBUG_PRINTLN(type);
-  });
-  
-  ArduinoOTA.onEnd([]() {
-    DEBUG_PRINTLN("\nEnd");
-  });
-  
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    DEBUG_PRINTF("Progress: %u%%\r", (progress / (total / 100)));
-  });
-  
-  ArduinoOTA.onError([](ota_error_t error) {
-    DEBUG_PRINTF("Error[%u]: ", error);
-    if (error == OTA_AUTH_ERROR) {
-      DEBUG_PRINTLN("Auth Failed");
-    } else if (error == OTA_BEGIN_ERROR) {
-      DEBUG_PRINTLN("Begin Failed");
-    } else if (error == OTA_CONNECT_ERROR) {
-      DEBUG_PRINTLN("Connect Failed");
-    } else if (error == OTA_RECEIVE_ERROR) {
-      DEBUG_PRINTLN("Receive Failed");
-    } else if (error == OTA_END_ERROR) {
-      DEBUG_PRINTLN("End Failed");
+    if (connectStep()) {
+      return true;
     }
-  });
-  
-  ArduinoOTA.begin();
+    if (controller.connect.stage == stage || controller.connect.stage == CONNECT_IDLE) {
+      return false;  // waiting, or failed
+    }
+  }
 }
 
 /**
- * Attempt to connect/reconnect to MQTT broker
+ * Render the Home Assistant MQTT auto-discovery config of one zone
  *
- * Validates and parses MQTT port, establishes connection with last will testament,
- * subscribes to zone command topics, and publishes current state of all zones.
+ * Payload built by buildDiscoveryConfig() (discovery.h). Writes nothing (so
+ * nothing is published) if the document overflows.
+ */
+static void renderDiscovery(int zoneNum, PublishWriter& out) {
+  // Shared static document
+  StaticJsonDocument<PUBLISH_JSON_CAPACITY>& json = publishJson;
+  if (!buildDiscoveryConfig(json, zoneNum, hal::chipId())) {
+    LOG_WARN(LOG_MQTT, "Home Assistant config payload incomplete\n");
+    return;
+  }
+  serializeJson(json, out);
+}
+
+/**
+ * Fingerprint the discovery configs and read the record kept in flash
  *
- * @return true if connected to MQTT broker, false otherwise
+ * Called once from setup(), after the file system is mounted. The payloads
+ * only depend on the chip ID, the zone names and SW_VERSION, so the
+ * fingerprints hold until the next boot.
+ */
+static void loadDiscoveryRecord() {
+  uint32_t current[NUM_ZONES];
+  for (int i = 0; i < NUM_ZONES; i++) {
+    publishMeasure(renderDiscovery, i + 1, &current[i]);
+  }
+
+  uint32_t stored[NUM_ZONES];
+  bool haveStored = false;
+  if (hal::fsSize(DISCOVERY_FINGERPRINT_FILE) == DISCOVERY_RECORD_LENGTH) {
+    char record[DISCOVERY_RECORD_LENGTH];
+    size_t length = hal::fsRead(DISCOVERY_FINGERPRINT_FILE, record, sizeof(record));
+    haveStored = parseDiscoveryRecord((const uint8_t*)record, length, stored);
+  }
+  if (!haveStored) {
+    LOG_INFO(LOG_CONFIG, "No discovery record - publishing all configs\n");
+  }
+  discoveryInit(controller.discovery, current, haveStored ? stored : nullptr);
+}
+
+// Payload of the retained discovery record (see discovery.h)
+static void renderDiscoveryRecord(int, PublishWriter& out) {
+  char record[DISCOVERY_RECORD_LENGTH + 1];
+  out.write(reinterpret_cast<const uint8_t*>(record),
+            formatDiscoveryRecord(record, sizeof(record), controller.discovery.held));
+}
+
+/**
+ * Record what the broker holds after a discovery pass
  *
  * Side effects:
- * - Configures MQTT server and port
- * - Connects to MQTT broker with "offline" last will on status topic
- * - Subscribes to "home/sprinkler/zone/+/command"
- * - Publishes "online" to status topic
- * - Publishes current state of all zones
- * - Calls publishHomeAssistantConfig() for auto-discovery
+ * - Queues the retained record if this pass changed it (or the broker did not
+ *   send one)
+ * - Rewrites DISCOVERY_FINGERPRINT_FILE if it differs (flash wear)
  */
-bool reconnectMqtt() {
-  // Validate and convert port number, use default if invalid
-  int mqtt_port_int = (mqtt_port[0] != '\0') ? atoi(mqtt_port) : 1883;
-  if (mqtt_port_int <= 0 || mqtt_port_int > 65535) {
-    mqtt_port_int = 1883;  // Fallback to default MQTT port
-    DEBUG_PRINTLN("Invalid MQTT port, using default 1883");
+static void finishDiscoveryPass() {
+  const DiscoveryState& discovery = controller.discovery;
+  LOG_INFO(LOG_MQTT, "Home Assistant discovery done, %d of %d configs published\n",
+           __builtin_popcount(discovery.published), NUM_ZONES);
+  if (discoveryRecordStale(discovery)) {
+    queuePublish(MQTT_DISCOVERY_FINGERPRINT, renderDiscoveryRecord, 0, true);
   }
 
-  // Configure MQTT buffer size for large payloads (Home Assistant discovery)
-  mqtt.setBufferSize(512);
-  mqtt.setServer(mqtt_server, mqtt_port_int);
-  
-  if (mqtt.connect(MQTT_CLIENT_ID, mqtt_user, mqtt_password, MQTT_STATUS, 0, true, "offline")) {
-    DEBUG_PRINTLN("MQTT connected");
-    
-    // Subscribe to zone commands
-    mqtt.subscribe(MQTT_ZONE_COMMAND);
-    
-    // Publish that we're online
-    mqtt.publish(MQTT_STATUS, "online", true);
-    
-    // Publish current state of all zones
-    char stateTopic[64];
-    for (int i = 0; i < NUM_ZONES; i++) {
-      snprintf(stateTopic, sizeof(stateTopic), "%szone/%d/state", MQTT_TOPIC_PREFIX, i+1);
-      mqtt.publish(stateTopic, digitalRead(ZONE_PINS[i]) == HIGH ? "ON" : "OFF", true);
-    }
-    
-    // Publish zone configurations for Home Assistant auto-discovery
-    publishHomeAssistantConfig();
+  char record[DISCOVERY_RECORD_LENGTH + 1];
+  size_t length = formatDiscoveryRecord(record, sizeof(record), discovery.held);
+  char stored[DISCOVERY_RECORD_LENGTH];
+  if (hal::fsSize(DISCOVERY_FINGERPRINT_FILE) == length &&
+      hal::fsRead(DISCOVERY_FINGERPRINT_FILE, stored, length) == length &&
+      memcmp(stored, record, length) == 0) {
+    return;
+  }
+  if (!hal::fsWrite(DISCOVERY_FINGERPRINT_FILE, record, length)) {
+    LOG_WARN(LOG_CONFIG, "Failed to store the discovery record\n");
   }
-  return mqtt.connected();
 }
 
 /**
  * Publish Home Assistant MQTT auto-discovery configurations for all zones
  *
  * Sends discovery messages for each zone switch to enable automatic integration
- * with Home Assistant. Includes device information for grouping all zones under
- * a single device in the HA UI.
+ * with Home Assistant (payload in renderDiscovery()). Only starts a pass;
+ * continueDiscovery() sends the configs from loop(), one zone at a time, and
+ * only those the broker does not already hold (see discovery.h).
  *
  * Side effects:
- * - Publishes 7 discovery messages to homeassistant/switch/sprinkler_zoneN/config
- * - Each message contains switch configuration, MQTT topics, and device metadata
- * - Device information includes chip ID, model, manufacturer, and software version
+ * - Starts a pass over all zones, or resumes a pass that a lost connection
+ *   interrupted where it stopped
  */
 void publishHomeAssistantConfig() {
-  // Calculate buffer size with ArduinoJson Assistant (includes device object)
-  const size_t capacity = JSON_OBJECT_SIZE(12) + JSON_OBJECT_SIZE(5) + 400;
+  discoveryStart(controller.discovery, hal::millis());
+}
 
-  // Stack buffers for topic construction
-  char configTopic[64];
-  char uniqueId[32];
-  char commandTopic[64];
-  char stateTopic[64];
-  char payload[512];  // Buffer for serialized JSON
-  char deviceId[16];
+/**
+ * Publish the next pending discovery config
+ *
+ * Called from every loop() iteration while connected. Sends at most one zone
+ * per call and DISCOVERY_INTERVAL apart, and only when no queued state is
+ * waiting, so neither the safety scan nor state replies wait for a burst of
+ * ~475-byte retained messages. Zones waiting for the broker's discovery
+ * record are sent once DISCOVERY_VERIFY_TIMEOUT has passed without it.
+ *
+ * Side effects:
+ * - Publishes homeassistant/switch/sprinkler_zoneN/config for the lowest
+ *   pending zone and takes it off the pass once sent
+ * - Stores and publishes the discovery record when the pass is over
+ */
+void continueDiscovery() {
+  DiscoveryState& discovery = controller.discovery;
+  if (!discovery.active || controller.publishQueue.pending > 0 || !mqtt.publishReady()) {
+    return;
+  }
+  if (discoveryPassComplete(discovery)) {
+    finishDiscoveryPass();
+    return;
+  }
+  int zone = discoveryNext(discovery, hal::millis());
+  if (zone == 0) {
+    return;
+  }
+  PROFILE_SCOPE("ha_discovery");
 
-  // Generate device ID once for all zones
-  snprintf(deviceId, sizeof(deviceId), "%08X", ESP.getChipId());
+  size_t length = publishMeasure(renderDiscovery, zone);
+  bool sent = length > 0 && streamPublish(zoneTopic(ZONE_DISCOVERY, zone), renderDiscovery,
+                                          zone, length, true);
+  if (!sent) {
+    if (!mqtt.publishReady()) {
+      return;  // still pending: resumed when the client takes it
+    }
+    LOG_WARN(LOG_MQTT, "Home Assistant config for zone %d not published\n", zone);
+  }
+  discoveryDone(discovery, zone, sent);
+}
 
+/**
+ * Publish the state of every zone in one retained message
+ *
+ * Side effects:
+ * - Queues {"1":"ON","2":"OFF",...} for home/sprinkler/zones/state,
+ *   rendered when sent, so several changes before then go out as one message
+ */
+static void renderZoneStates(int, PublishWriter& out) {
+  uint32_t on = 0;
   for (int i = 0; i < NUM_ZONES; i++) {
-    int zoneNum = i + 1;
-
-    // Build all topic strings using stack buffers
-    snprintf(configTopic, sizeof(configTopic), "homeassistant/switch/sprinkler_zone%d/config", zoneNum);
-    snprintf(uniqueId, sizeof(uniqueId), "sprinkler_zone%d", zoneNum);
-    snprintf(commandTopic, sizeof(commandTopic), "%szone/%d/command", MQTT_TOPIC_PREFIX, zoneNum);
-    snprintf(stateTopic, sizeof(stateTopic), "%szone/%d/state", MQTT_TOPIC_PREFIX, zoneNum);
-
-    // Create discovery payload using ArduinoJson
-    DynamicJsonDocument json(capacity);
-
-    json["name"] = ZONE_NAMES[i];
-    json["unique_id"] = uniqueId;
-    json["command_topic"] = commandTopic;
-    json["state_topic"] = stateTopic;
-    json["availability_topic"] = MQTT_STATUS;
-    json["payload_on"] = "ON";
-    json["payload_off"] = "OFF";
-    json["state_on"] = "ON";
-    json["state_off"] = "OFF";
-    json["optimistic"] = false;
-    json["qos"] = 0;
-    json["retain"] = true;
-
-    // Add device information for Home Assistant
-    JsonObject device = json.createNestedObject("device");
-    device["name"] = "Sprinkler Controller";
-    device["identifiers"] = deviceId;
-    device["model"] = "ESP8266 NodeMCU";
-    device["manufacturer"] = "DIY";
-    device["sw_version"] = SW_VERSION;
-
-    // Serialize json to buffer and publish
-    size_t len = serializeJson(json, payload, sizeof(payload));
-    if (len < sizeof(payload)) {
-      mqtt.publish(configTopic, payload, true);
-    } else {
-      DEBUG_PRINTLN("Warning: Home Assistant config payload truncated");
+    if (hal::gpioRead(ZONE_PINS[i])) {
+      on |= 1u << i;
     }
   }
+  char payload[ZONE_STATES_MAX_LENGTH + 1];
+  out.write(reinterpret_cast<const uint8_t*>(payload), formatZoneStates(payload, sizeof(payload), on));
+}
+
+void publishZoneStates() {
+  queuePublish(MQTT_ZONES_STATE, renderZoneStates, 0, true);
 }
 
 /**
  * Publish comprehensive status information to MQTT
  *
  * Sends a JSON payload containing system health metrics (uptime, free memory,
- * WiFi signal strength, chip ID) and current state of all zones.
+ * heap fragmentation, stack high-water mark, WiFi signal strength, chip ID) and
+ * current state of all zones; between full reports only what changed (see
+ * status_report.h).
  *
  * Side effects:
- * - Publishes JSON status message to home/sprinkler/status topic
- * - Message includes: status, uptime, free_heap, wifi_rssi, chip_id, zones array
+ * - Publishes JSON status message to home/sprinkler/status topic and/or the
+ *   same document as MessagePack to home/sprinkler/status/msgpack
+ *   (STATUS_ENCODING)
+ * - Full report (retained, every STATUS_FULL_INTERVAL and after connecting):
+ *   status, uptime, free_heap, max_free_block, heap_frag, free_stack,
+ *   wifi_rssi, chip_id, since_boot object, zones array
+ * - since_boot holds the worst values seen since boot: min_free_heap,
+ *   min_max_free_block, max_heap_frag, min_free_stack
  * - Each zone in array includes: zone number, name, and current state (ON/OFF)
+ * - Delta report (not retained): uptime, the metrics that moved at least
+ *   their STATUS_DELTA_* threshold and, without names, the zones that changed
  */
 void publishStatus() {
-  // Calculate buffer size with ArduinoJson Assistant
-  const size_t capacity = JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(NUM_ZONES) + NUM_ZONES * JSON_OBJECT_SIZE(3) + 300;
-  DynamicJsonDocument json(capacity);
+  PROFILE_SCOPE("status");
+
+  uint32_t now = hal::millis();
+  MemoryStats& memory = controller.memory;
+  memoryStatsSample(memory, now);
+
+  StatusSample sample;
+  sample.value[STATUS_FREE_HEAP] = (int32_t)hal::freeHeap();
+  sample.value[STATUS_MAX_FREE_BLOCK] = (int32_t)hal::maxFreeBlock();
+  sample.value[STATUS_HEAP_FRAG] = hal::heapFragmentation();  // percent
+  sample.value[STATUS_FREE_STACK] = (int32_t)hal::freeStack();  // loop() stack high-water mark
+  sample.value[STATUS_WIFI_RSSI] = hal::wifiRssi();
+  // Worst values seen since boot
+  sample.value[STATUS_MIN_FREE_HEAP] = (int32_t)memory.minFreeHeap;
+  sample.value[STATUS_MIN_MAX_FREE_BLOCK] = (int32_t)memory.minMaxFreeBlock;
+  sample.value[STATUS_MAX_HEAP_FRAG] = memory.maxHeapFragmentation;
+  sample.value[STATUS_MIN_FREE_STACK] = (int32_t)memory.minFreeStack;
+  sample.zonesOn = 0;
+  for (int i = 0; i < NUM_ZONES; i++) {
+    if (hal::gpioRead(ZONE_PINS[i])) {
+      sample.zonesOn |= 1u << i;
+    }
+  }
+
+  StatusReport& report = controller.status;
+  bool full = statusFullDue(report, now);
+  uint32_t fields = full ? STATUS_ALL_FIELDS : statusChangedFields(report, sample);
+  uint32_t zonesChanged = full ? (uint32_t)((1ull << NUM_ZONES) - 1) : statusChangedZones(report, sample);
+
+  // Shared static document, sized with ArduinoJson Assistant (see top of file)
+  StaticJsonDocument<PUBLISH_JSON_CAPACITY>& json = publishJson;
+  json.clear();
 
-  json["status"] = "online";
-  json["uptime"] = millis() / 1000;  // seconds
-  json["free_heap"] = ESP.getFreeHeap();
-  json["wifi_rssi"] = WiFi.RSSI();
-  char chipId[16];
-  snprintf(chipId, sizeof(chipId), "%08X", ESP.getChipId());
-  json["chip_id"] = chipId;
+  if (full) {
+    json["status"] = "online";
+  }
+  json["uptime"] = now / 1000;  // seconds
+  for (int field = 0; field < STATUS_FIRST_SINCE_BOOT; field++) {
+    if (fields & (1u << field)) {
+      json[statusFieldName(field)] = sample.value[field];
+    }
+  }
+  if (full) {
+    char chipId[16];
+    snprintf(chipId, sizeof(chipId), "%08X", (unsigned int)hal::chipId());
+    json["chip_id"] = chipId;
+  }
+  if (fields >> STATUS_FIRST_SINCE_BOOT) {
+    JsonObject minimums = json.createNestedObject("since_boot");
+    for (int field = STATUS_FIRST_SINCE_BOOT; field < NUM_STATUS_FIELDS; field++) {
+      if (fields & (1u << field)) {
+        minimums[statusFieldName(field)] = sample.value[field];
+      }
+    }
+  }
 
-  JsonArray zones = json.createNestedArray("zones");
+  if (zonesChanged) {
+    JsonArray zones = json.createNestedArray("zones");
+    for (int i = 0; i < NUM_ZONES; i++) {
+      if (!(zonesChanged & (1u << i))) {
+        continue;
+      }
+      JsonObject zone = zones.createNestedObject();
+      zone["zone"] = i + 1;
+      if (full) {
+        zone["name"] = ZONE_NAMES[i];
+      }
+      zone["state"] = (sample.zonesOn & (1u << i)) ? "ON" : "OFF";
+    }
+  }
+
+  bool sent = false;
+  if (STATUS_ENCODING & STATUS_ENCODING_JSON) {
+    sent |= streamJson(MQTT_STATUS, full);
+  }
+  if (STATUS_ENCODING & STATUS_ENCODING_MSGPACK) {
+    sent |= streamMsgPack(MQTT_STATUS_MSGPACK, full);
+  }
+  if (sent) {
+    statusReported(report, sample, fields, zonesChanged, full, now);
+  }
+}
+
+/**
+ * Enforce MAX_ZONE_RUNTIME on every zone
+ *
+ * Called from every loop() iteration regardless of the MQTT connection, so a
+ * zone left ON is shut off even while the broker is unreachable.
+ *
+ * Side effects:
+ * - Records when each zone was first seen ON in controller.zone_on_time
+ * - Forces zones OFF once they exceed MAX_ZONE_RUNTIME
+ * - Logs a safety_off event for each zone forced off (see offline_log.h;
+ *   replayOfflineLog() publishes it)
+ * - Queues the zone state when a zone is forced off, then the aggregated
+ *   zone states once; while offline the zone state goes to the offline log
+ *   instead
+ */
+void enforceZoneRuntimeLimits() {
+  PROFILE_SCOPE("safety_scan");
 
+  bool forcedOff = false;
+  bool online = publishingOnline();
   for (int i = 0; i < NUM_ZONES; i++) {
-    JsonObject zone = zones.createNestedObject();
-    zone["zone"] = i + 1;
-    zone["name"] = ZONE_NAMES[i];
-    zone["state"] = digitalRead(ZONE_PINS[i]) == HIGH ? "ON" : "OFF";
+    if (hal::gpioRead(ZONE_PINS[i])) {
+      if (controller.zone_on_time[i] == 0) {
+        controller.zone_on_time[i] = hal::millis();
+      } else if (hal::millis() - controller.zone_on_time[i] > MAX_ZONE_RUNTIME) {
+        hal::gpioWrite(ZONE_PINS[i], false);
+        LOG_WARN(LOG_ZONES, "Zone %d safety timeout - forced OFF after %d seconds\n",
+                 i+1, MAX_ZONE_RUNTIME/1000);
+        controller.zone_on_time[i] = 0;
+        offlineLogRecord(controller.offline, OFFLINE_SAFETY_OFF, i + 1, hal::millis());
+        if (online) {
+          // Queue state update
+          queuePublish(zoneTopic(ZONE_STATE, i + 1), renderZoneState, i + 1, true);
+          forcedOff = true;
+        } else {
+          offlineLogRecord(controller.offline, OFFLINE_ZONE_STATE, i + 1, hal::millis());
+        }
+      }
+    } else {
+      controller.zone_on_time[i] = 0;  // Reset timer when zone is off
+    }
+  }
+  if (forcedOff) {
+    publishZoneStates();
   }
+}
+
+/**
+ * Publish loop cycle-time telemetry to MQTT and start a new window
+ *
+ * Sends the log2 histogram of loop() durations collected since the last call
+ * (see telemetry.h), the slowest iteration and the phase that dominated it.
+ * hist[k] counts iterations of [2^k, 2^(k+1)) microseconds (hist[0]: < 2 us);
+ * trailing empty buckets are omitted.
+ *
+ * Side effects:
+ * - Publishes JSON to home/sprinkler/telemetry (not retained)
+ * - Resets the telemetry window
+ */
+void publishTelemetry() {
+  PROFILE_SCOPE("telemetry");
+
+  LoopTelemetry& t = controller.telemetry;
+  uint32_t now = hal::millis();
+
+  StaticJsonDocument<PUBLISH_JSON_CAPACITY>& json = publishJson;
+  json.clear();
 
-  // Serialize json to buffer and publish
-  char statusBuffer[512];
-  size_t len = serializeJson(json, statusBuffer, sizeof(statusBuffer));
-  if (len < sizeof(statusBuffer)) {
-    mqtt.publish(MQTT_STATUS, statusBuffer, true);
+  json["window_s"] = (now - t.windowStartMs) / 1000;
+  json["loops"] = t.loops;
+  json["max_us"] = t.maxUs;
+  json["max_us_boot"] = t.maxUsSinceBoot;
+  json["worst_phase"] = loopPhaseName(t.worstPhase);
+  json["worst_phase_us"] = t.worstPhaseUs;
+
+  JsonObject phases = json.createNestedObject("phase_max_us");
+  for (int i = 0; i < NUM_LOOP_PHASES; i++) {
+    phases[loopPhaseName(i)] = t.phaseMaxUs[i];
+  }
+
+  int used = LOOP_HISTOGRAM_BUCKETS;
+  while (used > 0 && t.buckets[used - 1] == 0) {
+    used--;
+  }
+  JsonArray hist = json.createNestedArray("hist");
+  for (int i = 0; i < used; i++) {
+    hist.add(t.buckets[i]);
+  }
+
+  // Publish queue counters since boot
+  const PublishQueueStats& q = controller.publishQueue.stats;
+  JsonObject queue = json.createNestedObject("queue");
+  queue["sent"] = q.sent;
+  queue["coalesced"] = q.coalesced;
+  queue["deduplicated"] = q.deduplicated;
+  queue["overflows"] = q.overflows;
+
+  // Offline log counters since boot
+  const OfflineLogStats& o = controller.offline.stats;
+  JsonObject offline = json.createNestedObject("offline");
+  offline["recorded"] = o.recorded;
+  offline["coalesced"] = o.coalesced;
+  offline["dropped"] = o.dropped;
+
+  streamJson(MQTT_TELEMETRY, false);
+
+  telemetryResetWindow(t, now);
+}
+
+/**
+ * Publish the profiler table (see profiler.h) to MQTT
+ *
+ * One array per probe: [name, count, min, avg, max, total_ms]; min/avg/max
+ * are CPU cycles at cpu_mhz.
+ *
+ * Side effects:
+ * - Publishes JSON to home/sprinkler/profile (not retained)
+ */
+void publishProfile() {
+  StaticJsonDocument<PUBLISH_JSON_CAPACITY>& json = publishJson;
+  json.clear();
+
+  uint32_t mhz = hal::cpuMhz();
+  json["cpu_mhz"] = mhz;
+  json["dropped"] = profilerDropped();
+  JsonArray probes = json.createNestedArray("probes");
+  for (int i = 0; i < profilerProbeCount(); i++) {
+    const ProfileProbe* p = profilerProbe(i);
+    JsonArray row = probes.createNestedArray();
+    row.add(p->name);
+    row.add(p->count);
+    row.add(p->minCycles);
+    row.add(p->count ? (uint32_t)(p->totalCycles / p->count) : 0);
+    row.add(p->maxCycles);
+    row.add(mhz ? (uint32_t)(p->totalCycles / (mhz * 1000)) : 0);
+  }
+
+  streamJson(MQTT_PROFILE, false);
+}
+
+/**
+ * Handle a message on the profiler command topic
+ *
+ * @param command "reset" clears the counters; anything else ("dump") prints the
+ *                table on the console (not with TOKENIZED_LOGGING) and
+ *                publishes it to MQTT
+ * @param length Payload length (command is not NUL-terminated)
+ */
+void handleProfileCommand(const char* command, unsigned int length) {
+  if (length == 5 && memcmp(command, "reset", 5) == 0) {
+    profilerReset();
+    LOG_INFO(LOG_MQTT, "Profiler reset\n");
   } else {
-    DEBUG_PRINTLN("Warning: Status payload truncated");
+    profilerPrint();
+    publishProfile();
   }
 }
 
+/**
+ * Handle a message on the log level topic
+ *
+ * @param command Level command, not NUL-terminated (format in logging.h)
+ * @param length Payload length; longer than LOG_COMMAND_BUFFER_SIZE is rejected
+ *
+ * Side effects:
+ * - Changes the runtime log levels
+ * - Queues the resulting levels for home/sprinkler/log/level/state
+ */
+static void renderLogLevels(int, PublishWriter& out) {
+  char levels[LOG_COMMAND_BUFFER_SIZE];
+  out.write(reinterpret_cast<const uint8_t*>(levels), logFormatLevels(levels, sizeof(levels)));
+}
+
+void handleLogLevelCommand(const char* command, unsigned int length) {
+  if (length >= LOG_COMMAND_BUFFER_SIZE || !logApplyCommand(command, length)) {
+    LOG_WARN(LOG_MQTT, "Invalid log level command\n");
+  }
+  queuePublish(MQTT_LOG_LEVEL_STATE, renderLogLevels, 0, false);
+}
+
+// Hand one queued message to the client (see drainPublishQueue())
+static bool sendQueued(const char* topic, PublishRender render, int arg, size_t length,
+                       bool retained) {
+  if (!mqtt.publishReady()) {
+    return false;  // not connected or no room (mqtt_client.h): keep it
+  }
+  if (streamPublish(topic, render, arg, length, retained)) {
+    return true;
+  }
+  if (!mqtt.publishReady()) {
+    return false;  // lost or refused: keep it for later
+  }
+  LOG_WARN(LOG_MQTT, "Publish to %s failed, dropped\n", topic);
+  return true;
+}
+
+/**
+ * Replay the offline log (see offline_log.h), oldest first
+ *
+ * Called from loop() while connected, before the publish queue drains; at
+ * most PUBLISH_DRAIN_BURST records per call.
+ *
+ * Side effects:
+ * - Publishes each event to home/sprinkler/event (not retained), with the
+ *   uptime it happened at and its age when sent:
+ *   {"event":"safety_off","zone":3,"uptime":7260,"age_s":42}
+ * - Queues the state of each logged zone, then the aggregated zone states
+ *   once
+ */
+void replayOfflineLog() {
+  OfflineLog& offline = controller.offline;
+  if (offline.count == 0) {
+    return;
+  }
+  PROFILE_SCOPE("offline_log");
+  uint32_t now = hal::millis();
+  bool zonesChanged = false;
+  for (int n = 0; n < PUBLISH_DRAIN_BURST && offline.count > 0; n++) {
+    const OfflineRecord& record = *offlineLogOldest(offline);
+    if (record.kind == OFFLINE_ZONE_STATE) {
+      queuePublish(zoneTopic(ZONE_STATE, record.zone), renderZoneState, record.zone, true);
+      zonesChanged = true;
+    } else {
+      if (!mqtt.publishReady()) {
+        break;
+      }
+      char payload[96];
+      snprintf(payload, sizeof(payload),
+               "{\"event\":\"safety_off\",\"zone\":%u,\"uptime\":%lu,\"age_s\":%lu}",
+               (unsigned int)record.zone, (unsigned long)(record.atMs / 1000),
+               (unsigned long)((now - record.atMs) / 1000));
+      if (!mqtt.publish(MQTT_EVENT, payload, false)) {
+        if (!mqtt.publishReady()) {
+          break;  // lost or refused: replay it after the next connect
+        }
+        LOG_WARN(LOG_MQTT, "Publish to %s failed, dropped\n", MQTT_EVENT);
+      }
+    }
+    offlineLogPop(offline);
+  }
+  if (zonesChanged) {
+    publishZoneStates();
+  }
+}
+
+/**
+ * Send queued publishes as far as PUBLISH_DRAIN_RATE allows
+ *
+ * Called from loop() while connected; entries stay queued otherwise.
+ */
+void drainPublishQueue() {
+  if (controller.publishQueue.pending == 0) {
+    return;
+  }
+  PROFILE_SCOPE("publish_queue");
+  publishQueueDrain(controller.publishQueue, hal::millis(), sendQueued);
+}
+
 // Main setup function
 void setup() {
-  Serial.begin(115200);
-  DEBUG_PRINTLN("\nStarting Sprinkler Controller");
+  // Restart the loop() stack high-water mark from here (see hal.h)
+  hal::stackPaint();
+
+  hal::consoleBegin(115200);
+  LOG_INFO(LOG_CONFIG, "\nStarting Sprinkler Controller %s\n", SW_VERSION);
   
   // Initialize all zone pins as outputs and set to LOW (off)
   for (int i = 0; i < NUM_ZONES; i++) {
-    pinMode(ZONE_PINS[i], OUTPUT);
-    digitalWrite(ZONE_PINS[i], LOW);
-    DEBUG_PRINT("Initialized zone ");
-    DEBUG_PRINT(i+1);
-    DEBUG_PRINT(" (");
-    DEBUG_PRINT(ZONE_NAMES[i]);
-    DEBUG_PRINTLN(") as OFF");
+    hal::gpioOutput(ZONE_PINS[i]);
+    hal::gpioWrite(ZONE_PINS[i], false);
+    LOG_TRACE(LOG_ZONES, "Initialized zone %d (%s) as OFF\n", i + 1, ZONE_NAMES[i]);
   }
   
   setupWifi();
 
-  // Enable light sleep for power savings (~20mA reduction)
-  WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
-  DEBUG_PRINTLN("WiFi light sleep enabled");
+  // Needs the file system, mounted by loadConfig()
+  loadDiscoveryRecord();
 
   setupOTA();
 
   // Set up MQTT callback
-  mqtt.setCallback(callback);
+  mqtt.begin(callback);
   
-  lastReconnectAttempt = 0;
+  connectInit(controller.connect, hal::chipId());
+  telemetryResetWindow(controller.telemetry, hal::millis());
+  memoryStatsReset(controller.memory, hal::millis());
+  publishQueueReset(controller.publishQueue, hal::millis());
+  offlineLogReset(controller.offline);
+  statusReportReset(controller.status);
 }
 
 // Main loop function
 void loop() {
+  LoopTelemetry& telemetry = controller.telemetry;
+  telemetryBeginLoop(telemetry);
+
   // Handle OTA updates
-  ArduinoOTA.handle();
+  handleOTA();
+  telemetryEndPhase(telemetry, PHASE_OTA);
   
-  // Handle MQTT connection
-  if (!mqtt.connected()) {
-    unsigned long now = millis();
-    if (now - lastReconnectAttempt > RECONNECT_INTERVAL) {
-      lastReconnectAttempt = now;
-      // Attempt to reconnect
-      if (reconnectMqtt()) {
-        lastReconnectAttempt = 0;
-      }
-    }
+  // Handle MQTT connection: one step of the connect sequence at a time
+  bool connected = continueMqttConnect();
+  if (!connected) {
+    telemetryEndPhase(telemetry, PHASE_CONNECT);
   } else {
     // Client connected
     mqtt.loop();
+    telemetryEndPhase(telemetry, PHASE_MQTT);
+  }
 
-    // Safety check: enforce maximum zone runtime
-    for (int i = 0; i < NUM_ZONES; i++) {
-      if (digitalRead(ZONE_PINS[i]) == HIGH) {
-        if (zone_on_time[i] == 0) {
-          zone_on_time[i] = millis();
-        } else if (millis() - zone_on_time[i] > MAX_ZONE_RUNTIME) {
-          digitalWrite(ZONE_PINS[i], LOW);
-          DEBUG_PRINTF("Zone %d safety timeout - forced OFF after %d seconds\n",
-                       i+1, MAX_ZONE_RUNTIME/1000);
-          // Publish state update
-          char stateTopic[MQTT_TOPIC_BUFFER_SIZE];
-          snprintf(stateTopic, sizeof(stateTopic), "%szone/%d/state", MQTT_TOPIC_PREFIX, i+1);
-          mqtt.publish(stateTopic, "OFF", true);
-          zone_on_time[i] = 0;
-        }
-      } else {
-        zone_on_time[i] = 0;  // Reset timer when zone is off
-      }
-    }
+  // Safety check: enforce maximum zone runtime, whether or not MQTT is up
+  enforceZoneRuntimeLimits();
+  telemetryEndPhase(telemetry, PHASE_SAFETY);
 
-    // Publish status periodically
-    unsigned long now = millis();
-    if (now - lastStatusReport > STATUS_INTERVAL) {
-      lastStatusReport = now;
+  // Publish status periodically
+  if (connected && mqtt.connected()) {
+    uint32_t now = hal::millis();
+    if (now - controller.lastStatusReport > STATUS_INTERVAL && mqtt.publishReady()) {
+      controller.lastStatusReport = now;
       publishStatus();
+      publishTelemetry();
     }
+    // What happened while offline (see offline_log.h), queued state
+    // changes (see publish_queue.h), then discovery
+    replayOfflineLog();
+    drainPublishQueue();
+    continueDiscovery();
   }
+
+  // Track heap/stack minimums between status reports
+  uint32_t now = hal::millis();
+  if (now - controller.memory.lastSampleMs >= MEMORY_SAMPLE_INTERVAL) {
+    memoryStatsSample(controller.memory, now);
+  }
+  telemetryEndPhase(telemetry, PHASE_PUBLISH);
+
+  // Hand buffered log records to the UART (tokenized logging only)
+#if TOKENIZED_LOGGING
+  tokenlog::drain();
+  telemetryEndPhase(telemetry, PHASE_LOG);
+#endif
+
+  telemetryEndLoop(telemetry);
 }
@@ -0,0 +1,260 @@
+/*
+ * MQTT client backends (see mqtt_client.h)
+ */
+
+#include <string.h>
+#include "mqtt_client.h"
+#include "mqtt_connect.h"
+
+#if MQTT_BACKEND == MQTT_BACKEND_PUBSUBCLIENT
+
+MqttClient::MqttClient(hal::NetClient& net) : net_(net), connack_(net), client_(connack_) {}
+
+void MqttClient::begin(MqttMessageHandler handler) {
+  client_.setCallback(handler);
+  // Outbound payloads are streamed, so the client buffer only needs
+  // to hold inbound commands. Done once here: PubSubClient reallocates its
+  // buffer on every call.
+  client_.setBufferSize(MQTT_CLIENT_BUFFER_SIZE);
+  // Bounds the CONNACK wait of the MQTT connect stage
+  client_.setSocketTimeout(MQTT_CONNACK_TIMEOUT);
+}
+
+bool MqttClient::open(uint32_t ip, uint16_t port, const MqttConnectOptions& options) {
+  options_ = &options;
+  return hal::netConnect(net_, ip, port, MQTT_TCP_TIMEOUT);
+}
+
+hal::NetResult MqttClient::finishConnect() {
+  // Without the socket, connect() would open one itself with no time bound
+  if (!options_ || !hal::netConnected(net_)) {
+    return hal::NET_FAILED;
+  }
+  connack_.expectConnack();
+  bool accepted = client_.connect(options_->clientId, options_->user, options_->password,
+                                  options_->willTopic, 0, options_->willRetain,
+                                  options_->willMessage, options_->cleanSession);
+  return accepted ? hal::NET_OK : hal::NET_FAILED;
+}
+
+void MqttClient::close() {
+  hal::netClose(net_);
+}
+
+void MqttClient::disconnect() {
+  client_.disconnect();
+}
+
+bool MqttClient::connected() {
+  return client_.connected();
+}
+
+bool MqttClient::sessionPresent() {
+  return connack_.sessionPresent();
+}
+
+int MqttClient::state() {
+  return client_.state();
+}
+
+void MqttClient::loop() {
+  client_.loop();
+}
+
+bool MqttClient::subscribe(const char* topic, uint8_t qos) {
+  return client_.subscribe(topic, qos);
+}
+
+bool MqttClient::publish(const char* topic, const char* payload, bool retained) {
+  return client_.publish(topic, payload, retained);
+}
+
+bool MqttClient::publishReady() {
+  return client_.connected();
+}
+
+bool MqttClient::beginPublish(const char* topic, size_t length, bool retained) {
+  return client_.beginPublish(topic, length, retained);
+}
+
+size_t MqttClient::write(const uint8_t* data, size_t length) {
+  return client_.write(data, length);
+}
+
+bool MqttClient::endPublish() {
+  return client_.endPublish() == 1;
+}
+
+uint8_t MqttClient::inflight() const {
+  return 0;
+}
+
+void MqttClient::setInflightWindow(uint8_t window) {
+  (void)window;
+}
+
+#else  // MQTT_BACKEND_ASYNC
+
+MqttClient::MqttClient(hal::NetClient& net) {
+  (void)net;  // ESPAsyncTCP brings its own socket
+}
+
+void MqttClient::begin(MqttMessageHandler handler) {
+  handler_ = handler;
+  // The callbacks run on the network task, between two loop() iterations
+  client_.onConnect([this](bool sessionPresent) {
+    sessionPresent_ = sessionPresent;
+    session_ = SESSION_UP;
+  });
+  client_.onDisconnect([this](AsyncMqttClientDisconnectReason reason) {
+    reason_ = static_cast<int8_t>(reason);
+    session_ = session_ == SESSION_CONNECTING ? SESSION_FAILED : SESSION_IDLE;
+    unackedCount_ = 0;
+  });
+  client_.onPublish([this](uint16_t packetId) { acknowledged(packetId); });
+  client_.onMessage([this](char* topic, char* payload, AsyncMqttClientMessageProperties properties,
+                           size_t length, size_t index, size_t total) {
+    (void)properties;
+    // Same limit as PubSubClient: whole messages that fit the client buffer
+    if (index != 0 || length != total ||
+        MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + total > MQTT_CLIENT_BUFFER_SIZE) {
+      return;
+    }
+    handler_(topic, reinterpret_cast<uint8_t*>(payload), static_cast<unsigned int>(length));
+  });
+}
+
+bool MqttClient::open(uint32_t ip, uint16_t port, const MqttConnectOptions& options) {
+  client_.setServer(IPAddress(ip), port);
+  client_.setClientId(options.clientId);
+  if (options.user && options.user[0]) {
+    client_.setCredentials(options.user, options.password);
+  }
+  client_.setWill(options.willTopic, 0, options.willRetain, options.willMessage);
+  client_.setCleanSession(options.cleanSession);
+  sessionPresent_ = false;
+  unackedCount_ = 0;
+  refused_ = false;
+  session_ = SESSION_CONNECTING;
+  client_.connect();
+  return true;
+}
+
+hal::NetResult MqttClient::finishConnect() {
+#ifdef NATIVE_BUILD
+  client_.poll();
+#endif
+  switch (session_) {
+    case SESSION_UP:
+      return hal::NET_OK;
+    case SESSION_CONNECTING:
+      return hal::NET_PENDING;
+    default:
+      return hal::NET_FAILED;
+  }
+}
+
+void MqttClient::close() {
+  session_ = SESSION_IDLE;
+  unackedCount_ = 0;
+  client_.disconnect(true);
+}
+
+void MqttClient::disconnect() {
+  session_ = SESSION_IDLE;
+  unackedCount_ = 0;
+  client_.disconnect();
+}
+
+bool MqttClient::connected() {
+  return session_ == SESSION_UP && client_.connected();
+}
+
+bool MqttClient::sessionPresent() {
+  return sessionPresent_;
+}
+
+int MqttClient::state() {
+  if (connected()) {
+    return 0;
+  }
+  // PubSubClient's codes for the logs: refused CONNECT 1..5, lost -3, none -1
+  return reason_ > 0 ? reason_ : reason_ == 0 ? -3 : -1;
+}
+
+void MqttClient::loop() {
+#ifdef NATIVE_BUILD
+  client_.poll();
+#endif
+  refused_ = false;
+}
+
+bool MqttClient::subscribe(const char* topic, uint8_t qos) {
+  return connected() && client_.subscribe(topic, qos) != 0;
+}
+
+bool MqttClient::publish(const char* topic, const char* payload, bool retained) {
+  return connected() && client_.publish(topic, 0, retained, payload, strlen(payload)) != 0;
+}
+
+bool MqttClient::publishReady() {
+  return connected() && unackedCount_ < window_ && !refused_;
+}
+
+bool MqttClient::beginPublish(const char* topic, size_t length, bool retained) {
+  if (!publishReady() || length > sizeof(staged_)) {
+    return false;
+  }
+  stagedTopic_ = topic;
+  stagedRetained_ = retained;
+  stagedLength_ = length;
+  stagedUsed_ = 0;
+  return true;
+}
+
+size_t MqttClient::write(const uint8_t* data, size_t length) {
+  if (!stagedTopic_ || stagedUsed_ + length > stagedLength_) {
+    return 0;
+  }
+  memcpy(staged_ + stagedUsed_, data, length);
+  stagedUsed_ += length;
+  return length;
+}
+
+bool MqttClient::endPublish() {
+  const char* topic = stagedTopic_;
+  stagedTopic_ = nullptr;
+  if (!topic || stagedUsed_ != stagedLength_ || !publishReady()) {
+    return false;
+  }
+  uint16_t packetId =
+      client_.publish(topic, MQTT_PUBLISH_QOS, stagedRetained_, staged_, stagedUsed_);
+  if (packetId == 0) {
+    refused_ = true;
+    return false;
+  }
+  if (MQTT_PUBLISH_QOS > 0) {
+    unacked_[unackedCount_++] = packetId;
+  }
+  return true;
+}
+
+uint8_t MqttClient::inflight() const {
+  return unackedCount_;
+}
+
+void MqttClient::setInflightWindow(uint8_t window) {
+  window_ = window < 1 ? 1 : window > MQTT_INFLIGHT_WINDOW ? MQTT_INFLIGHT_WINDOW : window;
+}
+
+void MqttClient::acknowledged(uint16_t packetId) {
+  for (uint8_t i = 0; i < unackedCount_; i++) {
+    if (unacked_[i] == packetId) {
+      unacked_[i] = unacked_[unackedCount_ - 1];
+      unackedCount_--;
+      return;
+    }
+  }
+}
+
+#endif
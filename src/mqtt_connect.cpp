@@ -0,0 +1,140 @@
+/*
+ * Non-blocking MQTT connect (see mqtt_connect.h)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "mqtt_connect.h"
+
+static const char* const STAGE_NAMES[NUM_CONNECT_STAGES] = {
+  "idle", "resolve", "tcp", "mqtt", "subscribe", "announce", "up",
+};
+
+const char* connectStageName(int stage) {
+  if (stage < 0 || stage >= NUM_CONNECT_STAGES) {
+    return "unknown";
+  }
+  return STAGE_NAMES[stage];
+}
+
+bool connectStageBlocks(int stage) {
+  return stage == CONNECT_TCP || stage == CONNECT_MQTT;
+}
+
+#if MQTT_RECONNECT_BACKOFF
+// xorshift32
+static uint32_t nextRandom(ConnectState& state) {
+  uint32_t x = state.random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  state.random = x;
+  return x;
+}
+
+// Uniform enough in [low, high] for spreading reconnects
+static uint32_t randomBetween(ConnectState& state, uint32_t low, uint32_t high) {
+  if (high <= low) {
+    return low;
+  }
+  return low + nextRandom(state) % (high - low + 1);
+}
+#endif
+
+void connectInit(ConnectState& state, uint32_t chipId) {
+  memset(&state, 0, sizeof(state));
+  snprintf(state.clientId, sizeof(state.clientId), MQTT_CLIENT_ID_FORMAT, (unsigned int)chipId);
+  state.stage = CONNECT_IDLE;
+  state.retryDelayMs = RECONNECT_INTERVAL;
+  state.windowMs = MQTT_RECONNECT_WINDOW_MS;
+  // Mix the seed (MurmurHash3 finalizer): neighbouring chip ids would
+  // otherwise start from similar states
+  uint32_t seed = chipId;
+  seed ^= seed >> 16;
+  seed *= 0x85ebca6bu;
+  seed ^= seed >> 13;
+  seed *= 0xc2b2ae35u;
+  seed ^= seed >> 16;
+  state.random = seed ? seed : 1;  // xorshift never leaves 0
+}
+
+bool connectDue(const ConnectState& state, uint32_t nowMs) {
+  return state.stage == CONNECT_IDLE && nowMs - state.lastAttemptMs > state.retryDelayMs;
+}
+
+void connectBegin(ConnectState& state, uint16_t port, uint32_t nowMs) {
+  state.lastAttemptMs = nowMs;
+#if MQTT_RECONNECT_BACKOFF
+  uint32_t upper = state.retryDelayMs > MQTT_RECONNECT_MAX_MS / 3 ? MQTT_RECONNECT_MAX_MS
+                                                                  : state.retryDelayMs * 3;
+  state.retryDelayMs = randomBetween(state, RECONNECT_INTERVAL, upper);
+#else
+  state.retryDelayMs = RECONNECT_INTERVAL;
+#endif
+  state.port = port;
+  state.ip = 0;
+  connectAdvance(state, CONNECT_RESOLVE, nowMs);
+}
+
+void connectAdvance(ConnectState& state, ConnectStage next, uint32_t nowMs) {
+  state.stage = next;
+  state.stageStartMs = nowMs;
+}
+
+bool connectTimedOut(const ConnectState& state, uint32_t nowMs) {
+  uint32_t elapsed = nowMs - state.stageStartMs;
+  switch (state.stage) {
+    case CONNECT_RESOLVE:
+      return elapsed >= MQTT_DNS_TIMEOUT;
+    case CONNECT_MQTT:
+      return elapsed >= MQTT_TCP_TIMEOUT + MQTT_CONNACK_TIMEOUT * 1000UL;
+    default:
+      return false;
+  }
+}
+
+void connectFailed(ConnectState& state) {
+  state.stage = CONNECT_IDLE;
+}
+
+void connectUp(ConnectState& state) {
+  state.stage = CONNECT_UP;
+  state.retryDelayMs = RECONNECT_INTERVAL;
+}
+
+void connectLost(ConnectState& state, uint32_t nowMs) {
+  state.stage = CONNECT_IDLE;
+  state.lastAttemptMs = nowMs;
+#if MQTT_RECONNECT_BACKOFF
+  state.retryDelayMs = randomBetween(state, 0, state.windowMs);
+#else
+  state.retryDelayMs = 0;
+#endif
+}
+
+bool connectSetWindow(ConnectState& state, const uint8_t* payload, unsigned int length) {
+  if (length == 0) {
+    state.windowMs = MQTT_RECONNECT_WINDOW_MS;
+    return true;
+  }
+  uint32_t ms = 0;
+  for (unsigned int i = 0; i < length; i++) {
+    if (payload[i] < '0' || payload[i] > '9') {
+      return false;
+    }
+    ms = ms * 10 + (payload[i] - '0');
+    if (ms > MQTT_RECONNECT_WINDOW_MAX_MS) {
+      return false;
+    }
+  }
+  state.windowMs = ms;
+  return true;
+}
+
+bool connectNeedsSubscribe(const ConnectState& state, bool sessionPresent) {
+  return !sessionPresent || !state.subscribed;
+}
+
+void connectSubscribed(ConnectState& state) {
+  state.subscribed = true;
+}
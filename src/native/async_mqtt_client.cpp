@@ -0,0 +1,198 @@
+/*
+ * AsyncMqttClient stand-in for native builds (see include/native/AsyncMqttClient.h)
+ */
+
+#include <AsyncMqttClient.h>
+#include <PubSubClient.h>  // MqttSession::state codes
+
+using hal::native::MqttSession;
+
+static MqttSession& session() {
+  return hal::native::device().mqtt;
+}
+
+// Whether a point in (virtual) time has been reached, across wraparound
+static bool reached(uint32_t atMs) {
+  return static_cast<int32_t>(hal::millis() - atMs) >= 0;
+}
+
+// Packet ids run 1..65535
+static uint16_t takePacketId(MqttSession& s) {
+  if (s.nextPacketId == 0) {
+    s.nextPacketId = 1;
+  }
+  return s.nextPacketId++;
+}
+
+AsyncMqttClient& AsyncMqttClient::onConnect(OnConnectUserCallback callback) {
+  onConnect_ = callback;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::onDisconnect(OnDisconnectUserCallback callback) {
+  onDisconnect_ = callback;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::onMessage(OnMessageUserCallback callback) {
+  onMessage_ = callback;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::onPublish(OnPublishUserCallback callback) {
+  onPublish_ = callback;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setServer(IPAddress ip, uint16_t port) {
+  (void)ip;
+  session().port = port;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setClientId(const char* clientId) {
+  clientId_ = clientId;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setCredentials(const char* username, const char* password) {
+  username_ = username;
+  password_ = password;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setWill(const char* topic, uint8_t qos, bool retain,
+                                          const char* payload, size_t length) {
+  (void)length;
+  willTopic_ = topic;
+  willQos_ = qos;
+  willRetain_ = retain;
+  willPayload_ = payload;
+  return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setCleanSession(bool cleanSession) {
+  cleanSession_ = cleanSession;
+  return *this;
+}
+
+bool AsyncMqttClient::connected() const {
+  return session().connected;
+}
+
+void AsyncMqttClient::connect() {
+  MqttSession& s = session();
+  if (s.connected || s.asyncConnect != 0) {
+    return;
+  }
+  // Ask the link now, then put the clock back: the time it charged is spent
+  // by the network task, not by the caller
+  uint32_t startMs = hal::millis();
+  s.pubacks.reserve(64);  // once, so publishing does not show up in allocation counts
+  hal::native::ConnectOptions options = {clientId_, username_, password_, willTopic_,
+                                         willQos_, willRetain_, willPayload_, cleanSession_,
+                                         s.host.c_str(), s.port};
+  s.tcpOpen = s.link ? s.link->open(UINT32_MAX) : true;
+  bool accepted = s.tcpOpen && (s.link ? s.link->connect(options) : true);
+  s.asyncConnect = accepted ? 1 : -1;
+  s.asyncSessionPresent = accepted && s.link && s.link->sessionPresent();
+  s.asyncConnectAtMs = hal::millis();
+  if (hal::native::virtualClock()) {
+    hal::native::setClock(startMs);
+  }
+}
+
+void AsyncMqttClient::disconnect(bool force) {
+  (void)force;
+  MqttSession& s = session();
+  if (s.connected && s.link) {
+    s.link->disconnect();
+  }
+  s.tcpOpen = false;
+  s.connected = false;
+  s.state = MQTT_DISCONNECTED;
+  s.asyncConnect = 0;
+  s.pubacks.clear();
+  s.inbox.clear();
+  // onDisconnect() follows from poll(), as the network task would report it
+}
+
+uint16_t AsyncMqttClient::subscribe(const char* topic, uint8_t qos) {
+  MqttSession& s = session();
+  if (!s.connected || qos > 1) {
+    return 0;
+  }
+  if (s.link && !s.link->subscribe(topic, qos)) {
+    return 0;
+  }
+  return takePacketId(s);
+}
+
+uint16_t AsyncMqttClient::publish(const char* topic, uint8_t qos, bool retain, const char* payload,
+                                  size_t length, bool dup, uint16_t message_id) {
+  (void)dup;
+  (void)message_id;
+  MqttSession& s = session();
+  if (!s.connected || qos > 1) {
+    return 0;
+  }
+  if (payload && length == 0) {
+    length = strlen(payload);
+  }
+  if (s.link &&
+      !s.link->publish(topic, reinterpret_cast<const uint8_t*>(payload), length, retain)) {
+    return 0;
+  }
+  if (qos == 0) {
+    return 1;  // as the library: no packet id, but not a failure
+  }
+  uint16_t packetId = takePacketId(s);
+  uint32_t delayMs = s.link ? s.link->pubackDelayMs() : 0;
+  s.pubacks.push_back(std::make_pair(packetId, hal::millis() + delayMs));
+  return packetId;
+}
+
+void AsyncMqttClient::poll() {
+  MqttSession& s = session();
+  if (s.asyncConnect != 0 && reached(s.asyncConnectAtMs)) {
+    bool accepted = s.asyncConnect > 0;
+    s.asyncConnect = 0;
+    s.connected = accepted;
+    s.tcpOpen = accepted;
+    s.state = accepted ? MQTT_CONNECTED : MQTT_CONNECT_FAILED;
+    if (accepted) {
+      s.asyncUp = true;
+      if (onConnect_) {
+        onConnect_(s.asyncSessionPresent);
+      }
+    } else if (onDisconnect_) {
+      onDisconnect_(AsyncMqttClientDisconnectReason::MQTT_SERVER_UNAVAILABLE);
+    }
+  }
+  if (s.asyncUp && !s.connected) {
+    s.asyncUp = false;
+    s.pubacks.clear();
+    if (onDisconnect_) {
+      onDisconnect_(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+    }
+    return;
+  }
+  while (!s.pubacks.empty() && reached(s.pubacks.front().second)) {
+    uint16_t packetId = s.pubacks.front().first;
+    s.pubacks.erase(s.pubacks.begin());
+    if (onPublish_) {
+      onPublish_(packetId);
+    }
+  }
+  // Deliver everything queued so far; the callback may queue more
+  size_t pending = s.inbox.size();
+  while (pending-- > 0 && s.connected && !s.inbox.empty()) {
+    hal::native::InboundMessage message = std::move(s.inbox.front());
+    s.inbox.pop_front();
+    if (onMessage_) {
+      AsyncMqttClientMessageProperties properties = {0, false, false};
+      onMessage_(&message.topic[0], &message.payload[0], properties, message.payload.size(), 0,
+                 message.payload.size());
+    }
+  }
+}
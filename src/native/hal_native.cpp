@@ -0,0 +1,497 @@
+/*
+ * Native (host) implementation of the hardware abstraction layer and the
+ * PubSubClient stand-in. Only built in native environments; see hal.h.
+ */
+
+#include <chrono>
+#include <utility>
+#include "hal.h"
+#include <PubSubClient.h>
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = (len >= size) ? size - 1 : len;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+namespace hal {
+namespace native {
+
+HostConsole console;
+
+static FILE* binaryConsole = nullptr;
+
+void setBinaryConsole(FILE* out) {
+  binaryConsole = out;
+}
+
+void HostConsole::printf(const char* format, ...) {
+  if (!enabled) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+namespace {
+
+Device defaultDevice;
+Device* currentDevice = &defaultDevice;
+
+const uint32_t kCpuMhz = 80;  // default ESP8266 clock
+
+bool clockIsVirtual = false;
+uint32_t virtualNowMs = 0;
+const std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+
+bool validPin(int pin) {
+  return pin >= 0 && pin < kNumPins;
+}
+
+}  // namespace
+
+Device& device() {
+  return *currentDevice;
+}
+
+void selectDevice(Device* dev) {
+  currentDevice = dev ? dev : &defaultDevice;
+}
+
+void useRealClock() {
+  clockIsVirtual = false;
+}
+
+void useVirtualClock(uint32_t startMs) {
+  clockIsVirtual = true;
+  virtualNowMs = startMs;
+}
+
+bool virtualClock() {
+  return clockIsVirtual;
+}
+
+void setClock(uint32_t nowMs) {
+  virtualNowMs = nowMs;
+}
+
+void advanceClock(uint32_t ms) {
+  virtualNowMs += ms;
+}
+
+bool deliver(const char* topic, const void* payload, size_t length) {
+  MqttSession& session = device().mqtt;
+  if (!session.connected) {
+    return false;
+  }
+  InboundMessage message;
+  message.topic = topic;
+  message.payload.assign(static_cast<const char*>(payload), length);
+  session.inbox.push_back(message);
+  return true;
+}
+
+void dropConnection() {
+  MqttSession& session = device().mqtt;
+  session.tcpOpen = false;
+  session.connected = false;
+  session.state = MQTT_CONNECTION_LOST;
+  session.inbox.clear();
+}
+
+}  // namespace native
+
+using native::device;
+
+void gpioOutput(int pin) {
+  if (native::validPin(pin)) {
+    device().pinIsOutput[pin] = true;
+  }
+}
+
+void gpioWrite(int pin, bool high) {
+  if (native::validPin(pin)) {
+    device().pinLevel[pin] = high ? 1 : 0;
+  }
+}
+
+bool gpioRead(int pin) {
+  return native::validPin(pin) && device().pinLevel[pin] != 0;
+}
+
+uint32_t millis() {
+  if (native::clockIsVirtual) {
+    return native::virtualNowMs;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - native::clockStart;
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
+
+void delay(uint32_t ms) {
+  // Host runs never sleep; a virtual clock simply moves forward
+  if (native::clockIsVirtual) {
+    native::virtualNowMs += ms;
+  }
+}
+
+uint32_t cycleCount() {
+  if (native::clockIsVirtual) {
+    return native::virtualNowMs * (native::kCpuMhz * 1000);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - native::clockStart;
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  return static_cast<uint32_t>(ns * native::kCpuMhz / 1000);
+}
+
+uint32_t cpuMhz() {
+  return native::kCpuMhz;
+}
+
+void consoleBegin(unsigned long baud) {
+  (void)baud;
+}
+
+size_t consoleWritable() {
+  return 256;  // roughly a UART FIFO plus driver buffer
+}
+
+void consoleWrite(const uint8_t* data, size_t len) {
+  if (native::binaryConsole) {
+    fwrite(data, 1, len, native::binaryConsole);
+  }
+}
+
+uint32_t chipId() {
+  return device().chipId;
+}
+
+uint32_t freeHeap() {
+  return device().freeHeap;
+}
+
+int32_t wifiRssi() {
+  return device().rssi;
+}
+
+uint32_t maxFreeBlock() {
+  return device().maxFreeBlock;
+}
+
+uint8_t heapFragmentation() {
+  return device().heapFragmentation;
+}
+
+uint32_t freeStack() {
+  return device().freeStack;
+}
+
+void stackPaint() {
+  // Host stacks are not painted; Device::freeStack is set by the caller
+}
+
+bool netResolveStart(const char* host) {
+  native::MqttSession& s = device().mqtt;
+  s.resolveResult = (!s.link || s.link->resolve(host)) ? NET_OK : NET_FAILED;
+  return s.resolveResult != NET_FAILED;
+}
+
+NetResult netResolvePoll(uint32_t* ip) {
+  NetResult result = device().mqtt.resolveResult;
+  if (result == NET_OK) {
+    *ip = 0x0100007F;  // 127.0.0.1; the stand-in ignores it
+  }
+  return result;
+}
+
+bool netConnect(NetClient& client, uint32_t ip, uint16_t port, uint32_t timeoutMs) {
+  (void)client;
+  (void)ip;
+  (void)port;
+  native::MqttSession& s = device().mqtt;
+  s.tcpOpen = s.link ? s.link->open(timeoutMs) : true;
+  return s.tcpOpen;
+}
+
+bool netConnected(NetClient& client) {
+  (void)client;
+  return device().mqtt.tcpOpen;
+}
+
+void netClose(NetClient& client) {
+  (void)client;
+  native::MqttSession& s = device().mqtt;
+  if (s.connected && s.link) {
+    s.link->disconnect();
+  }
+  s.tcpOpen = false;
+  s.connected = false;
+  s.state = MQTT_DISCONNECTED;
+  s.inbox.clear();
+}
+
+bool fsBegin() {
+  device().fsMounted = true;
+  return true;
+}
+
+bool fsExists(const char* path) {
+  return device().fsMounted && device().files.count(path) != 0;
+}
+
+size_t fsSize(const char* path) {
+  if (!fsExists(path)) {
+    return 0;
+  }
+  return device().files[path].size();
+}
+
+size_t fsRead(const char* path, char* buf, size_t len) {
+  if (!fsExists(path)) {
+    return 0;
+  }
+  const std::string& contents = device().files[path];
+  size_t n = contents.size() < len ? contents.size() : len;
+  memcpy(buf, contents.data(), n);
+  return n;
+}
+
+bool fsWrite(const char* path, const char* data, size_t len) {
+  if (!device().fsMounted) {
+    return false;
+  }
+  device().files[path].assign(data, len);
+  return true;
+}
+
+}  // namespace hal
+
+// ---------------------------------------------------------------------------
+// PubSubClient stand-in
+// ---------------------------------------------------------------------------
+
+using hal::native::MqttSession;
+
+// Streamed payload staging reserved by setBufferSize()
+static const size_t kStreamReserve = 2048;
+
+static MqttSession& session() {
+  return hal::native::device().mqtt;
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  session().host = domain ? domain : "";
+  session().port = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  session().callback = callback;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) {
+    return false;
+  }
+  // PubSubClient reallocates its packet buffer on every call; do the same so
+  // host allocation counts match the device
+  std::vector<uint8_t>(size).swap(session().buffer);
+  session().bufferSize = size;
+  // The library streams beginPublish() payloads without allocating; reserve
+  // the staging strings here so streaming does not show up in allocation counts
+  session().streamTopic.reserve(size);
+  session().streamPayload.reserve(kStreamReserve);
+  return true;
+}
+
+uint16_t PubSubClient::getBufferSize() {
+  return session().bufferSize;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+  return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass,
+                           const char* willTopic, uint8_t willQos, bool willRetain,
+                           const char* willMessage) {
+  return connect(id, user, pass, willTopic, willQos, willRetain, willMessage, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass,
+                           const char* willTopic, uint8_t willQos, bool willRetain,
+                           const char* willMessage, bool cleanSession) {
+  MqttSession& s = session();
+  if (s.connected) {
+    return true;
+  }
+  if (!s.tcpOpen) {
+    // The library opens the socket itself, for as long as that takes
+    s.tcpOpen = s.link ? s.link->open(UINT32_MAX) : true;
+    if (!s.tcpOpen) {
+      s.state = MQTT_CONNECT_FAILED;
+      return false;
+    }
+  }
+  hal::native::ConnectOptions options = {id, user, pass, willTopic, willQos, willRetain,
+                                         willMessage, cleanSession, s.host.c_str(), s.port};
+  bool accepted = s.link ? s.link->connect(options) : true;
+  s.tcpOpen = accepted;  // the library closes the socket on a refused CONNECT
+  s.connected = accepted;
+  s.sessionPresent = accepted && s.link && s.link->sessionPresent();
+  s.state = accepted ? MQTT_CONNECTED : MQTT_CONNECT_FAILED;
+  return accepted;
+}
+
+void PubSubClient::disconnect() {
+  MqttSession& s = session();
+  if (s.connected && s.link) {
+    s.link->disconnect();
+  }
+  s.tcpOpen = false;
+  s.connected = false;
+  s.state = MQTT_DISCONNECTED;
+  s.inbox.clear();
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, reinterpret_cast<const uint8_t*>(payload),
+                 payload ? strlen(payload) : 0, false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  return publish(topic, reinterpret_cast<const uint8_t*>(payload),
+                 payload ? strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength) {
+  return publish(topic, payload, plength, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength,
+                           bool retained) {
+  MqttSession& s = session();
+  if (!s.connected) {
+    return false;
+  }
+  // Same size check as PubSubClient: the whole packet must fit in the buffer
+  if (s.bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + plength) {
+    return false;
+  }
+  return s.link ? s.link->publish(topic, payload, plength, retained) : true;
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int plength, bool retained) {
+  MqttSession& s = session();
+  if (!s.connected) {
+    return false;
+  }
+  // The fixed header and topic go through the packet buffer, the payload not
+  if (s.bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strlen(topic)) {
+    return false;
+  }
+  s.streamTopic = topic;
+  s.streamPayload.clear();
+  s.streamPayload.reserve(plength);
+  s.streamLength = plength;
+  s.streamRetained = retained;
+  return true;
+}
+
+size_t PubSubClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t PubSubClient::write(const uint8_t* buffer, size_t size) {
+  MqttSession& s = session();
+  if (!s.connected) {
+    return 0;
+  }
+  s.streamPayload.append(reinterpret_cast<const char*>(buffer), size);
+  return size;
+}
+
+int PubSubClient::endPublish() {
+  MqttSession& s = session();
+  if (!s.connected) {
+    return 0;
+  }
+  // On the device a payload shorter or longer than announced corrupts the
+  // connection; here the message is dropped so tests notice
+  if (s.streamPayload.size() != s.streamLength) {
+    return 0;
+  }
+  if (s.link) {
+    s.link->publish(s.streamTopic.c_str(),
+                    reinterpret_cast<const uint8_t*>(s.streamPayload.data()),
+                    s.streamPayload.size(), s.streamRetained);
+  }
+  return 1;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+  return subscribe(topic, 0);
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+  MqttSession& s = session();
+  if (!s.connected || qos > 1) {
+    return false;
+  }
+  if (s.bufferSize < 9 + strlen(topic)) {
+    return false;
+  }
+  return s.link ? s.link->subscribe(topic, qos) : true;
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+  MqttSession& s = session();
+  if (!s.connected) {
+    return false;
+  }
+  return s.link ? s.link->unsubscribe(topic) : true;
+}
+
+bool PubSubClient::loop() {
+  MqttSession& s = session();
+  if (!s.connected) {
+    return false;
+  }
+  // Deliver everything queued so far; the callback may queue more
+  size_t pending = s.inbox.size();
+  while (pending-- > 0 && s.connected && !s.inbox.empty()) {
+    // Moved out so delivery itself does not allocate
+    hal::native::InboundMessage message = std::move(s.inbox.front());
+    s.inbox.pop_front();
+    // PubSubClient drops messages that do not fit in its buffer
+    if (s.bufferSize < MQTT_MAX_HEADER_SIZE + 2 + message.topic.size() + message.payload.size()) {
+      continue;
+    }
+    if (s.callback) {
+      s.callback(&message.topic[0], reinterpret_cast<uint8_t*>(&message.payload[0]),
+                 static_cast<unsigned int>(message.payload.size()));
+    }
+  }
+  return s.connected;
+}
+
+bool PubSubClient::connected() {
+  return session().connected;
+}
+
+int PubSubClient::state() {
+  return session().state;
+}
@@ -0,0 +1,24 @@
+/*
+ * Entry point for running the firmware on the host ([env:native]).
+ *
+ * Runs setup() once and then loop() forever against the real host clock, like
+ * the Arduino core does on the device. Benchmarks and simulators exclude this
+ * file and drive setup()/loop() themselves; unit tests bring their own main().
+ */
+
+#ifndef PIO_UNIT_TESTING
+
+#include "hal.h"
+
+void setup();
+void loop();
+
+int main() {
+  setup();
+  for (;;) {
+    loop();
+  }
+  return 0;
+}
+
+#endif  // PIO_UNIT_TESTING
@@ -0,0 +1,27 @@
+/*
+ * Host stand-ins for the ESP8266-only setup code (src/wifi_setup.cpp and
+ * src/ota_setup.cpp). There is no captive portal or OTA service on the host:
+ * configuration comes from /config.json in the simulated device's filesystem.
+ */
+
+#include "hal.h"
+#include "wifi_setup.h"
+#include "ota_setup.h"
+#include "logging.h"
+
+void saveConfigCallback() {
+  LOG_TRACE(LOG_WIFI, "Should save config\n");
+  shouldSaveConfig = true;
+}
+
+void setupWifi() {
+  loadConfig();
+  LOG_INFO(LOG_WIFI, "WiFi connected (native)\n");
+}
+
+void setupOTA() {
+  LOG_INFO(LOG_OTA, "OTA disabled in native build\n");
+}
+
+void handleOTA() {
+}
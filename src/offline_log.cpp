@@ -0,0 +1,63 @@
+/*
+ * Offline outbound log (see offline_log.h)
+ */
+
+#include <string.h>
+#include "offline_log.h"
+
+static OfflineRecord& at(OfflineLog& log, uint8_t index) {
+  return log.records[(log.head + index) % OFFLINE_LOG_CAPACITY];
+}
+
+void offlineLogReset(OfflineLog& log) {
+  OfflineLogStats stats = log.stats;
+  memset(&log, 0, sizeof(log));
+  log.stats = stats;
+}
+
+void offlineLogSynced(OfflineLog& log) {
+  log.complete = true;
+}
+
+// Close the gap left by the record at index, keeping the order of the rest
+static void removeAt(OfflineLog& log, uint8_t index) {
+  for (uint8_t i = index; i + 1 < log.count; i++) {
+    at(log, i) = at(log, i + 1);
+  }
+  log.count--;
+}
+
+void offlineLogRecord(OfflineLog& log, uint8_t kind, int zone, uint32_t nowMs) {
+  log.stats.recorded++;
+  if (kind == OFFLINE_ZONE_STATE) {
+    for (uint8_t i = 0; i < log.count; i++) {
+      const OfflineRecord& waiting = at(log, i);
+      if (waiting.kind == OFFLINE_ZONE_STATE && waiting.zone == zone) {
+        removeAt(log, i);
+        log.stats.coalesced++;
+        break;  // there is never more than one per zone
+      }
+    }
+  }
+  if (log.count == OFFLINE_LOG_CAPACITY) {
+    offlineLogPop(log);
+    log.stats.dropped++;
+    log.complete = false;
+  }
+  OfflineRecord& record = at(log, log.count++);
+  record.atMs = nowMs;
+  record.kind = kind;
+  record.zone = (uint8_t)zone;
+}
+
+const OfflineRecord* offlineLogOldest(const OfflineLog& log) {
+  return log.count ? &log.records[log.head] : nullptr;
+}
+
+void offlineLogPop(OfflineLog& log) {
+  if (log.count == 0) {
+    return;
+  }
+  log.head = (uint8_t)((log.head + 1) % OFFLINE_LOG_CAPACITY);
+  log.count--;
+}
@@ -0,0 +1,80 @@
+/*
+ * Over-The-Air update setup (ESP8266 only). Native builds provide a stand-in
+ * in src/native/setup_native.cpp.
+ */
+
+#include <ESP8266mDNS.h>
+#include <ArduinoOTA.h>
+#include "hal.h"
+#include "ota_setup.h"
+#include "logging.h"
+
+/**
+ * Configure Over-The-Air (OTA) firmware update functionality
+ *
+ * Sets up ArduinoOTA with hostname "sprinkler-controller" on port 8266.
+ * Registers callbacks for update progress and error reporting.
+ *
+ * Side effects:
+ * - Configures OTA hostname and port
+ * - Registers event handlers for OTA updates
+ * - Calls ArduinoOTA.begin()
+ */
+void setupOTA() {
+  // Port defaults to 8266
+  ArduinoOTA.setPort(8266);
+
+  // Hostname defaults to esp8266-[ChipID]
+  ArduinoOTA.setHostname("sprinkler-controller");
+
+  // Generate unique OTA password from chip ID for security
+  char ota_password[16];
+  snprintf(ota_password, sizeof(ota_password), "%08X", ESP.getChipId());
+  ArduinoOTA.setPassword(ota_password);
+  LOG_INFO(LOG_OTA, "OTA Password: %s\n", ota_password);
+
+  ArduinoOTA.onStart([]() {
+    // Use stack buffer instead of String to avoid heap allocation
+    const char* type;
+    if (ArduinoOTA.getCommand() == U_FLASH) {
+      type = "sketch";
+    } else { // U_FS
+      type = "filesystem";
+    }
+    LOG_INFO(LOG_OTA, "Start updating %s\n", type);
+  });
+  
+  ArduinoOTA.onEnd([]() {
+    LOG_INFO(LOG_OTA, "End\n");
+    tokenlog::flush();
+  });
+  
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+    LOG_TRACE(LOG_OTA, "Progress: %u%%\n", (progress / (total / 100)));
+  });
+  
+  ArduinoOTA.onError([](ota_error_t error) {
+    const char* reason = "Unknown";
+    if (error == OTA_AUTH_ERROR) {
+      reason = "Auth Failed";
+    } else if (error == OTA_BEGIN_ERROR) {
+      reason = "Begin Failed";
+    } else if (error == OTA_CONNECT_ERROR) {
+      reason = "Connect Failed";
+    } else if (error == OTA_RECEIVE_ERROR) {
+      reason = "Receive Failed";
+    } else if (error == OTA_END_ERROR) {
+      reason = "End Failed";
+    }
+    LOG_ERROR(LOG_OTA, "Error[%u]: %s\n", (unsigned int)error, reason);
+  });
+  
+  ArduinoOTA.begin();
+}
+
+/**
+ * Service pending OTA requests; called once per loop() iteration
+ */
+void handleOTA() {
+  ArduinoOTA.handle();
+}
@@ -0,0 +1,69 @@
+/*
+ * Scoped cycle-counter profiler (see profiler.h)
+ */
+
+#include <string.h>
+#include "profiler.h"
+#include "token_log.h"
+
+static ProfileProbe probes[MAX_PROFILE_PROBES];
+static int probeCount = 0;
+static uint32_t droppedProbes = 0;
+
+int profilerProbeCount() {
+  return probeCount;
+}
+
+const ProfileProbe* profilerProbe(int index) {
+  if (index < 0 || index >= probeCount) {
+    return nullptr;
+  }
+  return &probes[index];
+}
+
+uint32_t profilerDropped() {
+  return droppedProbes;
+}
+
+ProfileProbe* profilerRegister(const char* name) {
+  if (probeCount >= MAX_PROFILE_PROBES) {
+    droppedProbes++;
+    return nullptr;
+  }
+  ProfileProbe* probe = &probes[probeCount++];
+  memset(probe, 0, sizeof(*probe));
+  probe->name = name;
+  return probe;
+}
+
+void profilerReset() {
+  for (int i = 0; i < probeCount; i++) {
+    const char* name = probes[i].name;
+    memset(&probes[i], 0, sizeof(probes[i]));
+    probes[i].name = name;
+  }
+}
+
+void profilerPrint() {
+#if TOKENIZED_LOGGING
+  // The console carries the binary log stream; text would corrupt it. The
+  // table goes out on MQTT only (publishProfile()).
+#else
+  uint32_t mhz = hal::cpuMhz();
+  HAL_CONSOLE.printf("Profile (%u MHz, cycles)\n", (unsigned int)mhz);
+  HAL_CONSOLE.printf("%-16s %10s %10s %10s %10s %12s\n", "probe", "count", "min", "avg", "max",
+                     "total ms");
+  for (int i = 0; i < probeCount; i++) {
+    const ProfileProbe& p = probes[i];
+    uint32_t avg = p.count ? (uint32_t)(p.totalCycles / p.count) : 0;
+    uint32_t totalMs = mhz ? (uint32_t)(p.totalCycles / (mhz * 1000)) : 0;
+    HAL_CONSOLE.printf("%-16s %10u %10u %10u %10u %12u\n", p.name, (unsigned int)p.count,
+                       (unsigned int)p.minCycles, (unsigned int)avg, (unsigned int)p.maxCycles,
+                       (unsigned int)totalMs);
+  }
+  if (droppedProbes > 0) {
+    HAL_CONSOLE.printf("%u probe sites dropped (MAX_PROFILE_PROBES)\n",
+                       (unsigned int)droppedProbes);
+  }
+#endif
+}
@@ -0,0 +1,166 @@
+/*
+ * Outbound publish queue (see publish_queue.h)
+ */
+
+#include <string.h>
+#include "publish_queue.h"
+
+static const uint32_t TOKEN = 1000;
+static const uint32_t BUCKET_SIZE = PUBLISH_DRAIN_BURST * TOKEN;
+
+static_assert(PUBLISH_DRAIN_RATE > 0 && PUBLISH_DRAIN_BURST > 0, "the queue must drain");
+
+// Counts and hashes (FNV-1a) a payload as it is rendered
+class MeasureWriter : public PublishWriter {
+ public:
+  using PublishWriter::write;
+
+  size_t length = 0;
+  uint32_t hash = 2166136261u;
+
+  size_t write(const uint8_t* data, size_t count) override {
+    for (size_t i = 0; i < count; i++) {
+      hash = (hash ^ data[i]) * 16777619u;
+    }
+    length += count;
+    return count;
+  }
+
+  size_t write(uint8_t c) override {
+    hash = (hash ^ c) * 16777619u;
+    length++;
+    return 1;
+  }
+};
+
+size_t publishMeasure(PublishRender render, int arg, uint32_t* hash) {
+  MeasureWriter measure;
+  render(arg, measure);
+  if (hash) {
+    *hash = measure.hash;
+  }
+  return measure.length;
+}
+
+static bool sameTopic(const char* a, const char* b) {
+  return a == b || strcmp(a, b) == 0;
+}
+
+// order a was queued before order b (sequence numbers wrap)
+static bool queuedBefore(uint16_t a, uint16_t b) {
+  return (int16_t)(a - b) < 0;
+}
+
+void publishQueueReset(PublishQueue& queue, uint32_t nowMs) {
+  PublishQueueStats stats = queue.stats;
+  memset(&queue, 0, sizeof(queue));
+  queue.stats = stats;
+  queue.tokens = BUCKET_SIZE;
+  queue.lastRefillMs = nowMs;
+}
+
+static PublishSlot* findSlot(PublishQueue& queue, const char* topic) {
+  PublishSlot* free = nullptr;
+  PublishSlot* idle = nullptr;  // sent, not waiting: holds only a dedup hash
+  for (PublishSlot& slot : queue.slots) {
+    if (!slot.topic) {
+      free = free ? free : &slot;
+    } else if (sameTopic(slot.topic, topic)) {
+      return &slot;
+    } else if (!slot.pending && (!idle || queuedBefore(slot.order, idle->order))) {
+      idle = &slot;
+    }
+  }
+  if (free) {
+    return free;
+  }
+  // Reuse the longest idle topic; all it loses is its dedup hash
+  if (idle) {
+    idle->topic = nullptr;
+    idle->sent = false;
+  }
+  return idle;
+}
+
+bool publishQueueEnqueue(PublishQueue& queue, const char* topic, PublishRender render, int arg,
+                         bool retained) {
+  PublishSlot* slot = findSlot(queue, topic);
+  if (!slot) {
+    queue.stats.overflows++;
+    return false;
+  }
+  if (slot->topic && slot->pending) {
+    queue.stats.coalesced++;
+  } else {
+    slot->topic = topic;
+    slot->pending = true;
+    slot->order = queue.nextOrder++;
+    queue.pending++;
+  }
+  slot->render = render;
+  slot->arg = (int16_t)arg;
+  slot->retained = retained;
+  return true;
+}
+
+static void refill(PublishQueue& queue, uint32_t nowMs) {
+  uint32_t elapsed = nowMs - queue.lastRefillMs;
+  queue.lastRefillMs = nowMs;
+  // Clamp first so elapsed * rate cannot overflow after a long pause
+  if (elapsed >= BUCKET_SIZE / PUBLISH_DRAIN_RATE) {
+    queue.tokens = BUCKET_SIZE;
+    return;
+  }
+  queue.tokens += elapsed * PUBLISH_DRAIN_RATE;
+  if (queue.tokens > BUCKET_SIZE) {
+    queue.tokens = BUCKET_SIZE;
+  }
+}
+
+static PublishSlot* oldestPending(PublishQueue& queue) {
+  PublishSlot* oldest = nullptr;
+  for (PublishSlot& slot : queue.slots) {
+    if (slot.pending && (!oldest || queuedBefore(slot.order, oldest->order))) {
+      oldest = &slot;
+    }
+  }
+  return oldest;
+}
+
+size_t publishQueueDrain(PublishQueue& queue, uint32_t nowMs, PublishSend send) {
+  refill(queue, nowMs);
+  size_t sent = 0;
+  while (queue.pending && queue.tokens >= TOKEN) {
+    PublishSlot* slot = oldestPending(queue);
+    MeasureWriter measure;
+    slot->render(slot->arg, measure);
+    size_t length = measure.length;
+    if (length == 0) {
+      slot->pending = false;
+      queue.pending--;
+      continue;
+    }
+
+    uint32_t hash = measure.hash ^ (uint32_t)length;
+    if (slot->retained && slot->sent && slot->sentHash == hash &&
+        nowMs - slot->sentMs < PUBLISH_DEDUP_REFRESH) {
+      slot->pending = false;
+      queue.pending--;
+      queue.stats.deduplicated++;
+      continue;
+    }
+
+    if (!send(slot->topic, slot->render, slot->arg, length, slot->retained)) {
+      break;
+    }
+    slot->pending = false;
+    queue.pending--;
+    slot->sent = true;
+    slot->sentHash = hash;
+    slot->sentMs = nowMs;
+    queue.tokens -= TOKEN;
+    queue.stats.sent++;
+    sent++;
+  }
+  return sent;
+}
@@ -0,0 +1,65 @@
+/*
+ * Delta status reports (see status_report.h)
+ */
+
+#include <string.h>
+#include "status_report.h"
+
+static_assert(NUM_STATUS_FIELDS <= 32, "field sets are 32-bit masks");
+
+static const char* const FIELD_NAMES[NUM_STATUS_FIELDS] = {
+  "free_heap", "max_free_block", "heap_frag", "free_stack", "wifi_rssi",
+  "min_free_heap", "min_max_free_block", "max_heap_frag", "min_free_stack",
+};
+
+static const int32_t THRESHOLDS[NUM_STATUS_FIELDS] = {
+  STATUS_DELTA_HEAP, STATUS_DELTA_HEAP, STATUS_DELTA_FRAG, STATUS_DELTA_STACK, STATUS_DELTA_RSSI,
+  STATUS_DELTA_HEAP, STATUS_DELTA_HEAP, STATUS_DELTA_FRAG, STATUS_DELTA_STACK,
+};
+
+const char* statusFieldName(int field) {
+  if (field < 0 || field >= NUM_STATUS_FIELDS) {
+    return "unknown";
+  }
+  return FIELD_NAMES[field];
+}
+
+void statusReportReset(StatusReport& report) {
+  memset(&report, 0, sizeof(report));
+}
+
+bool statusFullDue(const StatusReport& report, uint32_t nowMs) {
+  return !report.haveFull || nowMs - report.lastFullMs >= STATUS_FULL_INTERVAL;
+}
+
+uint32_t statusChangedFields(const StatusReport& report, const StatusSample& sample) {
+  uint32_t changed = 0;
+  for (int i = 0; i < NUM_STATUS_FIELDS; i++) {
+    int32_t diff = sample.value[i] - report.sent.value[i];
+    if (diff < 0) {
+      diff = -diff;
+    }
+    if (diff != 0 && diff >= THRESHOLDS[i]) {
+      changed |= 1u << i;
+    }
+  }
+  return changed;
+}
+
+uint32_t statusChangedZones(const StatusReport& report, const StatusSample& sample) {
+  return sample.zonesOn ^ report.sent.zonesOn;
+}
+
+void statusReported(StatusReport& report, const StatusSample& sample, uint32_t fields,
+                    uint32_t zones, bool full, uint32_t nowMs) {
+  for (int i = 0; i < NUM_STATUS_FIELDS; i++) {
+    if (fields & (1u << i)) {
+      report.sent.value[i] = sample.value[i];
+    }
+  }
+  report.sent.zonesOn = (report.sent.zonesOn & ~zones) | (sample.zonesOn & zones);
+  if (full) {
+    report.haveFull = true;
+    report.lastFullMs = nowMs;
+  }
+}
@@ -0,0 +1,111 @@
+/*
+ * Loop cycle-time and memory telemetry (see telemetry.h)
+ */
+
+#include <string.h>
+#include "hal.h"
+#include "telemetry.h"
+
+const char* loopPhaseName(int phase) {
+  static const char* const names[NUM_LOOP_PHASES] = {
+    "ota", "connect", "mqtt", "safety", "publish", "log"
+  };
+  if (phase < 0 || phase >= NUM_LOOP_PHASES) {
+    return "unknown";
+  }
+  return names[phase];
+}
+
+uint8_t loopHistogramBucket(uint32_t us) {
+  uint8_t bucket = 0;
+  while (us > 1 && bucket < LOOP_HISTOGRAM_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static uint32_t cyclesToUs(uint32_t cycles) {
+  uint32_t mhz = hal::cpuMhz();
+  return mhz ? cycles / mhz : cycles;
+}
+
+void telemetryBeginLoop(LoopTelemetry& t) {
+  t.loopStart = hal::cycleCount();
+  t.phaseStart = t.loopStart;
+  memset(t.phaseCycles, 0, sizeof(t.phaseCycles));
+}
+
+void telemetryEndPhase(LoopTelemetry& t, LoopPhase phase) {
+  uint32_t now = hal::cycleCount();
+  t.phaseCycles[phase] += now - t.phaseStart;
+  t.phaseStart = now;
+}
+
+void telemetryEndLoop(LoopTelemetry& t) {
+  uint32_t us = cyclesToUs(hal::cycleCount() - t.loopStart);
+  t.buckets[loopHistogramBucket(us)]++;
+  t.loops++;
+
+  // Longest phase of this iteration, and per-phase maxima
+  uint8_t longest = 0;
+  uint32_t longestUs = 0;
+  for (int i = 0; i < NUM_LOOP_PHASES; i++) {
+    uint32_t phaseUs = cyclesToUs(t.phaseCycles[i]);
+    if (phaseUs > t.phaseMaxUs[i]) {
+      t.phaseMaxUs[i] = phaseUs;
+    }
+    if (phaseUs > longestUs) {
+      longest = i;
+      longestUs = phaseUs;
+    }
+  }
+
+  if (us >= t.maxUs) {
+    t.maxUs = us;
+    t.worstPhase = longest;
+    t.worstPhaseUs = longestUs;
+  }
+  if (us > t.maxUsSinceBoot) {
+    t.maxUsSinceBoot = us;
+  }
+}
+
+void telemetryResetWindow(LoopTelemetry& t, uint32_t nowMs) {
+  memset(t.buckets, 0, sizeof(t.buckets));
+  memset(t.phaseMaxUs, 0, sizeof(t.phaseMaxUs));
+  t.loops = 0;
+  t.maxUs = 0;
+  t.worstPhase = 0;
+  t.worstPhaseUs = 0;
+  t.windowStartMs = nowMs;
+}
+
+void memoryStatsReset(MemoryStats& m, uint32_t nowMs) {
+  m.minFreeHeap = hal::freeHeap();
+  m.minMaxFreeBlock = hal::maxFreeBlock();
+  m.maxHeapFragmentation = hal::heapFragmentation();
+  m.minFreeStack = hal::freeStack();
+  m.lastSampleMs = nowMs;
+}
+
+void memoryStatsSample(MemoryStats& m, uint32_t nowMs) {
+  uint32_t freeHeap = hal::freeHeap();
+  uint32_t maxBlock = hal::maxFreeBlock();
+  uint8_t fragmentation = hal::heapFragmentation();
+  uint32_t freeStack = hal::freeStack();
+
+  if (freeHeap < m.minFreeHeap) {
+    m.minFreeHeap = freeHeap;
+  }
+  if (maxBlock < m.minMaxFreeBlock) {
+    m.minMaxFreeBlock = maxBlock;
+  }
+  if (fragmentation > m.maxHeapFragmentation) {
+    m.maxHeapFragmentation = fragmentation;
+  }
+  if (freeStack < m.minFreeStack) {
+    m.minFreeStack = freeStack;
+  }
+  m.lastSampleMs = nowMs;
+}
@@ -0,0 +1,94 @@
+/*
+ * Tokenized deferred logging (see token_log.h)
+ */
+
+#include "token_log.h"
+
+// Tokens are offsets from here. Kept in flash next to the PSTR format strings
+// on the device; tools/log_decode.py looks the symbol up in the ELF.
+#ifdef NATIVE_BUILD
+extern "C" const char logTokenBase[] = "sprinkler-log";
+#else
+extern "C" const char logTokenBase[] PROGMEM = "sprinkler-log";
+#endif
+
+namespace tokenlog {
+
+Ring ring;
+
+static size_t freeSpace() {
+  return (size_t)LOG_RING_SIZE - ring.used;
+}
+
+static bool write(const uint8_t* bytes, size_t length) {
+  if (length > freeSpace()) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    ring.data[ring.head] = bytes[i];
+    ring.head = (ring.head + 1) % LOG_RING_SIZE;
+  }
+  ring.used += length;
+  return true;
+}
+
+bool push(const uint8_t* record, size_t length) {
+  // Report earlier losses first, once there is room for both records
+  if (ring.dropped > 0) {
+    uint8_t report[kHeaderSize + 5];
+    report[0] = LOG_RECORD_SYNC;
+    report[1] = sizeof(report) - 2;
+    putU32(report + 2, LOG_TOKEN_DROPPED);
+    putU32(report + 6, hal::millis());
+    encode(report + kHeaderSize, ring.dropped);
+    if (sizeof(report) + length > freeSpace()) {
+      ring.dropped++;
+      return false;
+    }
+    write(report, sizeof(report));
+    ring.dropped = 0;
+  }
+  if (!write(record, length)) {
+    ring.dropped++;
+    return false;
+  }
+  return true;
+}
+
+size_t take(uint8_t* out, size_t max) {
+  size_t n = 0;
+  while (n < max && ring.used > 0) {
+    out[n++] = ring.data[ring.tail];
+    ring.tail = (ring.tail + 1) % LOG_RING_SIZE;
+    ring.used--;
+  }
+  return n;
+}
+
+void drain() {
+  // Only hand the UART what it can take without blocking
+  size_t room = hal::consoleWritable();
+  uint8_t chunk[64];
+  while (room > 0 && ring.used > 0) {
+    size_t n = take(chunk, room < sizeof(chunk) ? room : sizeof(chunk));
+    hal::consoleWrite(chunk, n);
+    room -= n;
+  }
+}
+
+void flush() {
+  uint8_t chunk[64];
+  while (ring.used > 0) {
+    size_t n = take(chunk, sizeof(chunk));
+    hal::consoleWrite(chunk, n);
+  }
+}
+
+void reset() {
+  ring.head = 0;
+  ring.tail = 0;
+  ring.used = 0;
+  ring.dropped = 0;
+}
+
+}  // namespace tokenlog
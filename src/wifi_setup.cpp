@@ -0,0 +1,132 @@
+/*
+ * WiFi and configuration portal setup (ESP8266 only).
+ *
+ * Uses WiFiManager for the captive portal and writes /config.json directly to
+ * SPIFFS. Native builds provide a stand-in in src/native/setup_native.cpp.
+ */
+
+#include <ESP8266WiFi.h>
+#include <WiFiManager.h>
+#include <FS.h>
+#include <ArduinoJson.h>
+#include "hal.h"
+#include "wifi_setup.h"
+#include "logging.h"
+
+/**
+ * Callback to flag that WiFiManager configuration needs to be saved
+ *
+ * Called by WiFiManager when user submits new configuration via web portal.
+ *
+ * Side effects:
+ * - Sets shouldSaveConfig global flag to true
+ */
+void saveConfigCallback() {
+  LOG_TRACE(LOG_WIFI, "Should save config\n");
+  shouldSaveConfig = true;
+}
+
+/**
+ * Setup WiFi connection and configure MQTT parameters via WiFiManager
+ *
+ * Implements a captive portal for WiFi and MQTT configuration. Loads existing
+ * config from SPIFFS, presents web UI for changes, saves updated config back to
+ * filesystem. Forces configuration portal if no valid MQTT server is configured.
+ *
+ * Side effects:
+ * - Calls loadConfig() to read saved configuration
+ * - Starts WiFiManager captive portal (SSID: "SprinklerSetup")
+ * - Connects to WiFi network
+ * - Updates global MQTT configuration variables
+ * - Saves configuration to /config.json if changed
+ * - Restarts ESP8266 if connection fails or times out
+ * - Enables WiFi light sleep
+ */
+void setupWifi() {
+  delay(10);
+  // Load saved configuration first
+  loadConfig();
+
+  LOG_INFO(LOG_WIFI, "Setting up WiFi and MQTT params...\n");
+
+  // The extra parameters to be configured
+  WiFiManagerParameter custom_mqtt_server("server", "MQTT Server", mqtt_server, 40);
+  WiFiManagerParameter custom_mqtt_port("port", "MQTT Port", mqtt_port, 6);
+  WiFiManagerParameter custom_mqtt_user("user", "MQTT User", mqtt_user, 24);
+  WiFiManagerParameter custom_mqtt_password("password", "MQTT Password", mqtt_password, 24, "password");
+
+  // WiFiManager
+  WiFiManager wifiManager;
+
+  // Generate unique AP password from chip ID for security
+  char ap_password[32];
+  snprintf(ap_password, sizeof(ap_password), "sprinkler-%08X", ESP.getChipId());
+
+  LOG_INFO(LOG_WIFI, "Configuration Portal Password: %s\n", ap_password);
+
+  // Check if we have valid configuration - force portal if empty
+  if (mqtt_server[0] == '\0') {
+    LOG_WARN(LOG_WIFI, "No valid config found, forcing configuration portal\n");
+    wifiManager.resetSettings();
+  }
+
+  // Set callback for saving configuration
+  wifiManager.setSaveConfigCallback(saveConfigCallback);
+
+  // Add all your parameters here
+  wifiManager.addParameter(&custom_mqtt_server);
+  wifiManager.addParameter(&custom_mqtt_port);
+  wifiManager.addParameter(&custom_mqtt_user);
+  wifiManager.addParameter(&custom_mqtt_password);
+
+  // Set timeout for the configuration portal
+  wifiManager.setConfigPortalTimeout(CONFIG_PORTAL_TIMEOUT);
+
+  // Reset saved settings - uncomment to test
+  //wifiManager.resetSettings();
+
+  // Set custom AP name with unique password (not hardcoded)
+  bool connected = wifiManager.autoConnect(AP_SSID, ap_password);
+  
+  if (!connected) {
+    LOG_ERROR(LOG_WIFI, "Failed to connect and hit timeout\n");
+    tokenlog::flush();
+    // Reset and try again
+    ESP.restart();
+  }
+  
+  // Read updated parameters
+  strlcpy(mqtt_server, custom_mqtt_server.getValue(), sizeof(mqtt_server));
+  strlcpy(mqtt_port, custom_mqtt_port.getValue(), sizeof(mqtt_port));
+  strlcpy(mqtt_user, custom_mqtt_user.getValue(), sizeof(mqtt_user));
+  strlcpy(mqtt_password, custom_mqtt_password.getValue(), sizeof(mqtt_password));
+  
+  LOG_INFO(LOG_WIFI, "WiFi connected, IP address: %s\n", WiFi.localIP().toString().c_str());
+  
+  // Save the custom parameters to file system
+  if (shouldSaveConfig) {
+    LOG_INFO(LOG_CONFIG, "Saving config to /config.json\n");
+    
+    // Calculate buffer size with ArduinoJson Assistant
+    const size_t capacity = JSON_OBJECT_SIZE(4) + 100;
+    DynamicJsonDocument json(capacity);
+    
+    json["mqtt_server"] = mqtt_server;
+    json["mqtt_port"] = mqtt_port;
+    json["mqtt_user"] = mqtt_user;
+    json["mqtt_password"] = mqtt_password;
+
+    File configFile = SPIFFS.open("/config.json", "w");
+    if (!configFile) {
+      LOG_ERROR(LOG_CONFIG, "Failed to open config file for writing\n");
+    } else {
+      serializeJson(json, configFile);
+      configFile.close();
+      LOG_INFO(LOG_CONFIG, "Config saved successfully\n");
+    }
+  }
+
+  // Enable light sleep for power savings (~20mA reduction)
+  WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
+  LOG_TRACE(LOG_WIFI, "WiFi light sleep enabled\n");
+}
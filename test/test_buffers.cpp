@@ -2,6 +2,32 @@
 #include <unity.h>
 #include <ArduinoJson.h>
 #include "../include/config.h"
+#include "../include/topics.h"
+
+// Topic and unique ID sizing is checked at compile time against the
+// generated table (see topics.h)
+static_assert(topics::maxLength(ZONE_STATE) + 1 <= MQTT_TOPIC_BUFFER_SIZE,
+              "State topic should fit in buffer with null terminator");
+static_assert(topics::maxLength(ZONE_COMMAND) + 1 <= MQTT_TOPIC_BUFFER_SIZE,
+              "Command topic should fit in buffer with null terminator");
+static_assert(topics::maxLength(ZONE_DISCOVERY) + 1 <= MQTT_TOPIC_BUFFER_SIZE,
+              "Config topic should fit in buffer with null terminator");
+static_assert(topics::length(MQTT_STATUS) + 1 <= MQTT_TOPIC_BUFFER_SIZE,
+              "Status topic should fit in buffer");
+static_assert(topics::maxLength(ZONE_UNIQUE_ID) + 1 <= MQTT_UNIQUE_ID_BUFFER_SIZE,
+              "Unique ID should fit in buffer");
+// Two-digit zones (if the system expands beyond 9 zones)
+static_assert(topics::length("sprinkler_zone") + topics::digits(10) + 1 <= MQTT_UNIQUE_ID_BUFFER_SIZE,
+              "Two-digit unique ID should fit in buffer");
+static_assert(topics::length("homeassistant/switch/sprinkler_zone/config") + topics::digits(99) + 1 <=
+                  MQTT_TOPIC_BUFFER_SIZE,
+              "Two-digit config topic should fit in buffer");
+
+// The longest topics are the ones for the highest zone
+static_assert(topics::equal(zoneTopic(ZONE_STATE, 7), "home/sprinkler/zone/7/state"),
+              "State topic for zone 7");
+static_assert(topics::equal(zoneTopic(ZONE_DISCOVERY, 7), "homeassistant/switch/sprinkler_zone7/config"),
+              "Config topic for zone 7");
 
 // Test snprintf truncation for topic buffers
 void test_snprintf_truncation() {
@@ -16,65 +42,6 @@ void test_snprintf_truncation() {
   written = snprintf(buffer, sizeof(buffer), "this is a very long string");
   TEST_ASSERT_GREATER_THAN(9, written);  // Returns what would have been written
   TEST_ASSERT_EQUAL(9, strlen(buffer));  // But buffer only holds 9 chars + null
-
-  // Test zone topic formatting with truncation protection
-  char stateTopic[MQTT_TOPIC_BUFFER_SIZE];
-  int zone = 5;
-
-  written = snprintf(stateTopic, sizeof(stateTopic), "%szone/%d/state", MQTT_TOPIC_PREFIX, zone);
-
-  // Should fit in buffer
-  TEST_ASSERT_LESS_THAN(MQTT_TOPIC_BUFFER_SIZE, written + 1);
-  TEST_ASSERT_LESS_THAN(MQTT_TOPIC_BUFFER_SIZE, strlen(stateTopic) + 1);
-}
-
-// Test that longest MQTT topics fit in buffers
-void test_topic_buffer_sizing() {
-  char buffer[MQTT_TOPIC_BUFFER_SIZE];
-
-  // Test state topic for max zone (zone 7)
-  snprintf(buffer, sizeof(buffer), "%szone/%d/state", MQTT_TOPIC_PREFIX, 7);
-  size_t stateTopicLen = strlen(buffer);
-  TEST_ASSERT_LESS_THAN_MESSAGE(MQTT_TOPIC_BUFFER_SIZE, stateTopicLen + 1,
-                                "State topic should fit in buffer with null terminator");
-
-  // Test command topic for max zone
-  snprintf(buffer, sizeof(buffer), "%szone/%d/command", MQTT_TOPIC_PREFIX, 7);
-  size_t commandTopicLen = strlen(buffer);
-  TEST_ASSERT_LESS_THAN_MESSAGE(MQTT_TOPIC_BUFFER_SIZE, commandTopicLen + 1,
-                                 "Command topic should fit in buffer with null terminator");
-
-  // Test Home Assistant config topic (longest topic)
-  snprintf(buffer, sizeof(buffer), "homeassistant/switch/sprinkler_zone%d/config", 7);
-  size_t configTopicLen = strlen(buffer);
-  TEST_ASSERT_LESS_THAN_MESSAGE(MQTT_TOPIC_BUFFER_SIZE, configTopicLen + 1,
-                                 "Config topic should fit in buffer with null terminator");
-
-  // Test status topic
-  size_t statusTopicLen = strlen(MQTT_STATUS);
-  TEST_ASSERT_LESS_THAN_MESSAGE(MQTT_TOPIC_BUFFER_SIZE, statusTopicLen + 1,
-                                 "Status topic should fit in buffer");
-}
-
-// Test unique ID buffer sizing
-void test_unique_id_buffer_sizing() {
-  char uniqueId[MQTT_UNIQUE_ID_BUFFER_SIZE];
-
-  // Test for all zones
-  for (int i = 1; i <= NUM_ZONES; i++) {
-    snprintf(uniqueId, sizeof(uniqueId), "sprinkler_zone%d", i);
-    size_t len = strlen(uniqueId);
-    TEST_ASSERT_LESS_THAN_MESSAGE(MQTT_UNIQUE_ID_BUFFER_SIZE, len + 1,
-                                   "Unique ID should fit in buffer");
-  }
-
-  // Test longest possible single-digit zone (future-proofing)
-  snprintf(uniqueId, sizeof(uniqueId), "sprinkler_zone%d", 9);
-  TEST_ASSERT_LESS_THAN(MQTT_UNIQUE_ID_BUFFER_SIZE, strlen(uniqueId) + 1);
-
-  // Test two-digit zone (if system expands beyond 9 zones)
-  snprintf(uniqueId, sizeof(uniqueId), "sprinkler_zone%d", 10);
-  TEST_ASSERT_LESS_THAN(MQTT_UNIQUE_ID_BUFFER_SIZE, strlen(uniqueId) + 1);
 }
 
 // Test Home Assistant config JSON payload sizing
@@ -83,29 +50,18 @@ void test_json_payload_sizing() {
   const size_t capacity = JSON_OBJECT_SIZE(12) + 300;
   DynamicJsonDocument json(capacity);
 
-  char configTopic[64];
-  char uniqueId[32];
-  char commandTopic[64];
-  char stateTopic[64];
-
-  // Build topics for zone 7 (longest)
-  snprintf(configTopic, sizeof(configTopic), "homeassistant/switch/sprinkler_zone%d/config", 7);
-  snprintf(uniqueId, sizeof(uniqueId), "sprinkler_zone%d", 7);
-  snprintf(commandTopic, sizeof(commandTopic), "%szone/%d/command", MQTT_TOPIC_PREFIX, 7);
-  snprintf(stateTopic, sizeof(stateTopic), "%szone/%d/state", MQTT_TOPIC_PREFIX, 7);
-
   // Create discovery payload (matches publishHomeAssistantConfig())
   json["name"] = ZONE_NAMES[6];  // Zone 7 is index 6
-  json["unique_id"] = uniqueId;
-  json["command_topic"] = commandTopic;
-  json["state_topic"] = stateTopic;
+  json["unique_id"] = zoneTopic(ZONE_UNIQUE_ID, 7);  // Zone 7 has the longest topics
+  json["command_topic"] = zoneTopic(ZONE_COMMAND, 7);
+  json["state_topic"] = zoneTopic(ZONE_STATE, 7);
   json["availability_topic"] = MQTT_STATUS;
   json["payload_on"] = "ON";
   json["payload_off"] = "OFF";
   json["state_on"] = "ON";
   json["state_off"] = "OFF";
   json["optimistic"] = false;
-  json["qos"] = 0;
+  json["qos"] = MQTT_COMMAND_QOS;
   json["retain"] = true;
 
   // Test that it doesn't overflow
@@ -128,11 +84,25 @@ void test_json_payload_sizing() {
 // Test status JSON payload sizing
 void test_status_json_sizing() {
   // Calculate buffer size (from publishStatus())
-  const size_t capacity = JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(NUM_ZONES) +
-                          NUM_ZONES * JSON_OBJECT_SIZE(3) + 200;
+  const size_t capacity = JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(4) +
+                          JSON_ARRAY_SIZE(NUM_ZONES) + NUM_ZONES * JSON_OBJECT_SIZE(3) + 300;
   DynamicJsonDocument json(capacity);
 
+  // Worst-case widths for the health metrics
   json["status"] = "online";
+  json["uptime"] = 4294967UL;  // millis() wrap, in seconds
+  json["free_heap"] = 81920UL;
+  json["max_free_block"] = 81920UL;
+  json["heap_frag"] = 100;
+  json["free_stack"] = 4096UL;
+  json["wifi_rssi"] = -100;
+  json["chip_id"] = "FFFFFFFF";
+  JsonObject minimums = json.createNestedObject("since_boot");
+  minimums["min_free_heap"] = 81920UL;
+  minimums["min_max_free_block"] = 81920UL;
+  minimums["max_heap_frag"] = 100;
+  minimums["min_free_stack"] = 4096UL;
+
   JsonArray zones = json.createNestedArray("zones");
 
   // Add all zones with longest name
@@ -147,10 +117,17 @@ void test_status_json_sizing() {
   TEST_ASSERT_FALSE_MESSAGE(json.overflowed(), "Status JSON should not overflow");
 
   // Serialize to buffer
-  char statusBuffer[512];  // From publishStatus()
+  char statusBuffer[MQTT_PAYLOAD_BUFFER_SIZE];  // From publishStatus()
   size_t len = serializeJson(json, statusBuffer, sizeof(statusBuffer));
 
-  TEST_ASSERT_LESS_THAN_MESSAGE(512, len, "Status payload should fit in 512-byte buffer");
+  TEST_ASSERT_LESS_THAN_MESSAGE(MQTT_PAYLOAD_BUFFER_SIZE, len,
+                                "Status payload should fit in status buffer");
+
+  // The status is streamed (beginPublish()), but the whole packet is still
+  // kept within the payload budget
+  size_t packet = 5 + 2 + strlen(MQTT_STATUS) + len;
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(MQTT_PAYLOAD_BUFFER_SIZE, packet,
+                                    "Status packet should fit in the payload budget");
   TEST_ASSERT_GREATER_THAN_MESSAGE(0, len, "Status should have content");
 
   // Verify it's valid JSON
@@ -199,44 +176,31 @@ void test_zone_name_lengths() {
   }
 }
 
-// Test combined buffer usage in publishHomeAssistantConfig
+// Test combined buffer usage in renderDiscovery
 void test_combined_buffer_usage() {
-  // Stack buffers used in publishHomeAssistantConfig()
-  char configTopic[64];
-  char uniqueId[32];
-  char commandTopic[64];
-  char stateTopic[64];
+  // Discovery payload budget: renderDiscovery() streams into the MQTT
+  // client, so no buffer limits it, but payloads are kept under 512. Topics
+  // come from the constant table and are sized by the static_asserts at the top
   char payload[512];
 
   // Test for zone 7 (typically longest)
   int zoneNum = 7;
 
-  snprintf(configTopic, sizeof(configTopic), "homeassistant/switch/sprinkler_zone%d/config", zoneNum);
-  snprintf(uniqueId, sizeof(uniqueId), "sprinkler_zone%d", zoneNum);
-  snprintf(commandTopic, sizeof(commandTopic), "%szone/%d/command", MQTT_TOPIC_PREFIX, zoneNum);
-  snprintf(stateTopic, sizeof(stateTopic), "%szone/%d/state", MQTT_TOPIC_PREFIX, zoneNum);
-
-  // Verify all fit
-  TEST_ASSERT_LESS_THAN(64, strlen(configTopic) + 1);
-  TEST_ASSERT_LESS_THAN(32, strlen(uniqueId) + 1);
-  TEST_ASSERT_LESS_THAN(64, strlen(commandTopic) + 1);
-  TEST_ASSERT_LESS_THAN(64, strlen(stateTopic) + 1);
-
   // Create JSON and serialize
   const size_t capacity = JSON_OBJECT_SIZE(12) + 300;
   DynamicJsonDocument json(capacity);
 
   json["name"] = ZONE_NAMES[zoneNum - 1];
-  json["unique_id"] = uniqueId;
-  json["command_topic"] = commandTopic;
-  json["state_topic"] = stateTopic;
+  json["unique_id"] = zoneTopic(ZONE_UNIQUE_ID, zoneNum);
+  json["command_topic"] = zoneTopic(ZONE_COMMAND, zoneNum);
+  json["state_topic"] = zoneTopic(ZONE_STATE, zoneNum);
   json["availability_topic"] = MQTT_STATUS;
   json["payload_on"] = "ON";
   json["payload_off"] = "OFF";
   json["state_on"] = "ON";
   json["state_off"] = "OFF";
   json["optimistic"] = false;
-  json["qos"] = 0;
+  json["qos"] = MQTT_COMMAND_QOS;
   json["retain"] = true;
 
   size_t len = serializeJson(json, payload, sizeof(payload));
@@ -284,8 +248,6 @@ void setup() {
 
   // Run all buffer safety tests
   RUN_TEST(test_snprintf_truncation);
-  RUN_TEST(test_topic_buffer_sizing);
-  RUN_TEST(test_unique_id_buffer_sizing);
   RUN_TEST(test_json_payload_sizing);
   RUN_TEST(test_status_json_sizing);
   RUN_TEST(test_mqtt_message_buffer);
@@ -0,0 +1,194 @@
+// Runs on the device (pio test -e test) and on the host (pio test -e native)
+#ifdef NATIVE_BUILD
+#include "hal.h"
+#else
+#include <Arduino.h>
+#endif
+#include <unity.h>
+#include <string.h>
+#include "../include/command_parser.h"
+#include "../src/command_parser.cpp"  // test env does not build src/
+
+static ZoneCommand parse(const char* payload) {
+  return parseZoneCommand((const uint8_t*)payload, strlen(payload));
+}
+
+// Keys are computed by the compiler
+static_assert(commandKey("on", 2) == commandKey("ON", 2), "letters are folded");
+static_assert(commandKey("0", 1) != commandKey("\x10", 1), "non-letters are not folded");
+static_assert(commandKey("ON", 2) != commandKey("ON\0", 3), "length is part of the key");
+
+// Test ON command variants (ON, on, On, oN, 1)
+void test_on_variants() {
+  TEST_ASSERT_EQUAL(ZONE_CMD_ON, parse("ON"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_ON, parse("on"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_ON, parse("On"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_ON, parse("oN"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_ON, parse("1"));
+}
+
+// Test OFF command variants (OFF, off, Off, 0)
+void test_off_variants() {
+  TEST_ASSERT_EQUAL(ZONE_CMD_OFF, parse("OFF"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_OFF, parse("off"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_OFF, parse("Off"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_OFF, parse("oFf"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_OFF, parse("0"));
+}
+
+// Test payloads that must not switch a zone
+void test_unknown_payloads() {
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse(""));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("O"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("of"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("ON "));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse(" ON"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("OFFF"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("2"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("TOGGLE"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("ONONONONONONONONONON"));
+
+  // Bytes that only match after a careless case fold ('0' is 0x30, 0x10 | 0x20)
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("\x10"));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parse("\x11"));
+}
+
+// Test that exactly length bytes are read from a non-terminated buffer
+void test_payload_not_terminated() {
+  const uint8_t buffer[] = {'O', 'N', 'X', 'X'};
+  TEST_ASSERT_EQUAL(ZONE_CMD_ON, parseZoneCommand(buffer, 2));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parseZoneCommand(buffer, 3));
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parseZoneCommand(buffer, 0));
+
+  // An embedded NUL is part of the payload, not its end
+  const uint8_t withNul[] = {'O', 'N', '\0', 'X'};
+  TEST_ASSERT_EQUAL(ZONE_CMD_UNKNOWN, parseZoneCommand(withNul, 4));
+}
+
+static bool batch(const char* payload, ZoneBatch& result) {
+  return parseZoneBatch((const uint8_t*)payload, strlen(payload), result);
+}
+
+static const uint32_t ALL_ZONES = (1u << NUM_ZONES) - 1;
+
+// Test bitmask batches: every zone is set, ON where its bit is
+void test_batch_mask() {
+  ZoneBatch result;
+  TEST_ASSERT_TRUE(batch("5", result));
+  TEST_ASSERT_EQUAL_HEX32(ALL_ZONES, result.mask);
+  TEST_ASSERT_EQUAL_HEX32(0x05, result.on);
+
+  TEST_ASSERT_TRUE(batch("0x12", result));
+  TEST_ASSERT_EQUAL_HEX32(0x12, result.on);
+  TEST_ASSERT_TRUE(batch(" 0X7f\n", result));
+  TEST_ASSERT_EQUAL_HEX32(0x7F, result.on);
+  TEST_ASSERT_TRUE(batch("0", result));
+  TEST_ASSERT_EQUAL_HEX32(ALL_ZONES, result.mask);
+  TEST_ASSERT_EQUAL_HEX32(0, result.on);
+
+  // Beyond NUM_ZONES, overflow, junk
+  TEST_ASSERT_FALSE(batch("128", result));
+  TEST_ASSERT_FALSE(batch("0x80", result));
+  TEST_ASSERT_FALSE(batch("99999999999999999999", result));
+  TEST_ASSERT_FALSE(batch("0x", result));
+  TEST_ASSERT_FALSE(batch("5x", result));
+  TEST_ASSERT_FALSE(batch("-1", result));
+  TEST_ASSERT_FALSE(batch("", result));
+}
+
+// Test JSON map batches: only the listed zones are set
+void test_batch_map() {
+  ZoneBatch result;
+  TEST_ASSERT_TRUE(batch("{\"1\":\"ON\",\"3\":\"OFF\"}", result));
+  TEST_ASSERT_EQUAL_HEX32(0x05, result.mask);
+  TEST_ASSERT_EQUAL_HEX32(0x01, result.on);
+
+  // Same verbs as a single zone, quoted or bare, with whitespace
+  TEST_ASSERT_TRUE(batch(" { \"7\" : \"on\" ,\"2\":1, \"4\": off }\r\n", result));
+  TEST_ASSERT_EQUAL_HEX32(0x4A, result.mask);
+  TEST_ASSERT_EQUAL_HEX32(0x42, result.on);
+
+  // An empty map changes nothing (and still gets the state reply)
+  TEST_ASSERT_TRUE(batch("{}", result));
+  TEST_ASSERT_EQUAL_HEX32(0, result.mask);
+}
+
+// Test that any bad entry rejects the whole batch
+void test_batch_rejects() {
+  ZoneBatch result = {0x11, 0x22};
+  TEST_ASSERT_FALSE(batch("{\"1\":\"ON\",\"8\":\"OFF\"}", result));  // no zone 8
+  TEST_ASSERT_FALSE(batch("{\"0\":\"ON\"}", result));
+  TEST_ASSERT_FALSE(batch("{\"1\":\"ON\",\"1\":\"OFF\"}", result));  // duplicate
+  TEST_ASSERT_FALSE(batch("{\"1\":\"TOGGLE\"}", result));
+  TEST_ASSERT_FALSE(batch("{\"1\":\"ON \"}", result));
+  TEST_ASSERT_FALSE(batch("{\"1\":\"ON\",}", result));
+  TEST_ASSERT_FALSE(batch("{\"1\":\"ON\"", result));
+  TEST_ASSERT_FALSE(batch("{\"1\":\"ON}", result));
+  TEST_ASSERT_FALSE(batch("{1:\"ON\"}", result));
+  TEST_ASSERT_FALSE(batch("{\"1\":\"ON\"} x", result));
+  TEST_ASSERT_FALSE(batch("{\"1x\":\"ON\"}", result));
+
+  // Oversized payloads are not scanned
+  char large[ZONE_BATCH_MAX_LENGTH + 2];
+  memset(large, ' ', sizeof(large) - 1);
+  large[0] = '5';
+  large[sizeof(large) - 1] = '\0';
+  TEST_ASSERT_FALSE(batch(large, result));
+
+  // Failure leaves the result untouched
+  TEST_ASSERT_EQUAL_HEX32(0x11, result.mask);
+  TEST_ASSERT_EQUAL_HEX32(0x22, result.on);
+}
+
+// Test the aggregated state reply
+void test_format_zone_states() {
+  char buf[ZONE_STATES_MAX_LENGTH + 1];
+  size_t len = formatZoneStates(buf, sizeof(buf), 0);
+  TEST_ASSERT_EQUAL(ZONE_STATES_MAX_LENGTH, len);
+  TEST_ASSERT_EQUAL(len, strlen(buf));
+
+  len = formatZoneStates(buf, sizeof(buf), 0x41);
+  TEST_ASSERT_EQUAL_STRING("{\"1\":\"ON\",\"2\":\"OFF\",\"3\":\"OFF\",\"4\":\"OFF\","
+                           "\"5\":\"OFF\",\"6\":\"OFF\",\"7\":\"ON\"}", buf);
+
+  // The reply is itself a valid batch that restores the same states
+  ZoneBatch result;
+  TEST_ASSERT_TRUE(parseZoneBatch((const uint8_t*)buf, len, result));
+  TEST_ASSERT_EQUAL_HEX32(ALL_ZONES, result.mask);
+  TEST_ASSERT_EQUAL_HEX32(0x41, result.on);
+
+  TEST_ASSERT_EQUAL(0, formatZoneStates(buf, ZONE_STATES_MAX_LENGTH, 0));
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_on_variants);
+  RUN_TEST(test_off_variants);
+  RUN_TEST(test_unknown_payloads);
+  RUN_TEST(test_payload_not_terminated);
+  RUN_TEST(test_batch_mask);
+  RUN_TEST(test_batch_map);
+  RUN_TEST(test_batch_rejects);
+  RUN_TEST(test_format_zone_states);
+
+  return UNITY_END();
+}
+
+#ifdef NATIVE_BUILD
+int main() {
+  return runUnityTests();
+}
+#else
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  runUnityTests();
+}
+
+void loop() {
+  // Nothing to do here
+}
+#endif
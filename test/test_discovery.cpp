@@ -0,0 +1,194 @@
+// Runs on the device (pio test -e test) and on the host (pio test -e native)
+#ifdef NATIVE_BUILD
+#include "hal.h"
+#else
+#include <Arduino.h>
+#endif
+#include <unity.h>
+#include <string.h>
+#include "../include/discovery.h"
+#include "../src/discovery.cpp"  // test env does not build src/
+
+static const uint32_t ALL = (1u << NUM_ZONES) - 1;
+static const uint32_t T0 = 1000;  // connect time (millis() is never 0 by then)
+
+static DiscoveryState state;
+static uint32_t current[NUM_ZONES];
+
+static void reset(const uint32_t* stored) {
+  for (int i = 0; i < NUM_ZONES; i++) {
+    current[i] = 0x1000u + i;
+  }
+  discoveryInit(state, current, stored);
+}
+
+// Zones returned by discoveryNext() until it returns 0, marked sent
+static uint32_t publishAll(uint32_t nowMs) {
+  uint32_t sent = 0;
+  for (int zone = discoveryNext(state, nowMs); zone != 0; zone = discoveryNext(state, nowMs)) {
+    sent |= 1u << (zone - 1);
+    discoveryDone(state, zone, true);
+    nowMs += DISCOVERY_INTERVAL;
+  }
+  return sent;
+}
+
+void test_first_boot_publishes_all() {
+  reset(nullptr);
+  discoveryStart(state, T0);
+  TEST_ASSERT_EQUAL_HEX32(ALL, state.pending);
+  TEST_ASSERT_EQUAL_HEX32(0, state.unverified);
+  TEST_ASSERT_EQUAL_HEX32(ALL, publishAll(T0));
+  TEST_ASSERT_TRUE(discoveryPassComplete(state));
+  TEST_ASSERT_FALSE(discoveryPassComplete(state));
+  TEST_ASSERT_TRUE(discoveryRecordStale(state));
+  TEST_ASSERT_EQUAL_UINT32_ARRAY(current, state.held, NUM_ZONES);
+}
+
+void test_stored_record_waits_for_broker() {
+  reset(nullptr);
+  discoveryInit(state, current, current);
+  discoveryStart(state, T0);
+  TEST_ASSERT_EQUAL_HEX32(0, state.pending);
+  TEST_ASSERT_EQUAL_HEX32(ALL, state.unverified);
+  TEST_ASSERT_TRUE(discoveryVerifying(state));
+  TEST_ASSERT_EQUAL(0, discoveryNext(state, T0 + DISCOVERY_VERIFY_TIMEOUT - 1));
+
+  // Matching record: nothing to publish, nothing to store
+  discoveryVerify(state, current);
+  TEST_ASSERT_FALSE(discoveryVerifying(state));
+  TEST_ASSERT_EQUAL(0, discoveryNext(state, 5000));
+  TEST_ASSERT_TRUE(discoveryPassComplete(state));
+  TEST_ASSERT_FALSE(discoveryRecordStale(state));
+}
+
+void test_verify_timeout_publishes_unverified() {
+  uint32_t stored[NUM_ZONES];
+  reset(nullptr);
+  memcpy(stored, current, sizeof(stored));
+  stored[2] ^= 1;  // zone 3 changed since the last pass
+  discoveryInit(state, current, stored);
+  discoveryStart(state, T0);
+  TEST_ASSERT_EQUAL_HEX32(1u << 2, state.pending);
+  TEST_ASSERT_EQUAL(3, discoveryNext(state, T0));
+  discoveryDone(state, 3, true);
+
+  // No record from the broker: the rest goes out after the timeout
+  TEST_ASSERT_EQUAL(0, discoveryNext(state, T0 + DISCOVERY_VERIFY_TIMEOUT - 1));
+  TEST_ASSERT_EQUAL_HEX32(ALL & ~(1u << 2), publishAll(T0 + DISCOVERY_VERIFY_TIMEOUT));
+  TEST_ASSERT_TRUE(discoveryPassComplete(state));
+  TEST_ASSERT_TRUE(discoveryRecordStale(state));
+}
+
+void test_broker_mismatch_and_resume() {
+  uint32_t broker[NUM_ZONES];
+  reset(nullptr);
+  discoveryInit(state, current, current);
+  memcpy(broker, current, sizeof(broker));
+  broker[0] = 0;
+  broker[4] = 0;
+  discoveryStart(state, T0);
+  discoveryVerify(state, broker);
+  TEST_ASSERT_EQUAL_HEX32((1u << 0) | (1u << 4), state.pending);
+  TEST_ASSERT_EQUAL_HEX32(0, state.held[0]);
+
+  // Connection lost after zone 1: the next connection resumes with zone 5,
+  // and a second copy of the record does not undo zone 1
+  TEST_ASSERT_EQUAL(1, discoveryNext(state, T0));
+  discoveryDone(state, 1, true);
+  discoveryStart(state, T0 + 100);
+  TEST_ASSERT_TRUE(discoveryVerifying(state));
+  discoveryVerify(state, broker);
+  TEST_ASSERT_EQUAL_HEX32(current[0], state.held[0]);
+  TEST_ASSERT_EQUAL_HEX32(1u << 4, publishAll(T0 + 100));
+  TEST_ASSERT_TRUE(discoveryPassComplete(state));
+  TEST_ASSERT_EQUAL_HEX32((1u << 0) | (1u << 4), state.published);
+}
+
+void test_interval_and_failed_publish() {
+  reset(nullptr);
+  discoveryStart(state, T0);
+  TEST_ASSERT_EQUAL(1, discoveryNext(state, T0));
+  // Refused: taken off this pass, but still not held
+  discoveryDone(state, 1, false);
+  TEST_ASSERT_EQUAL(0, discoveryNext(state, T0 + DISCOVERY_INTERVAL - 1));
+  TEST_ASSERT_EQUAL(2, discoveryNext(state, T0 + DISCOVERY_INTERVAL));
+  discoveryDone(state, 2, true);
+  publishAll(T0 + 2 * DISCOVERY_INTERVAL);
+  TEST_ASSERT_TRUE(discoveryPassComplete(state));
+  TEST_ASSERT_NOT_EQUAL(current[0], state.held[0]);
+
+  // The next pass tries it again
+  discoveryStart(state, 10000);
+  TEST_ASSERT_EQUAL_HEX32(1u << 0, state.pending);
+}
+
+void test_record_format() {
+  uint32_t fingerprints[NUM_ZONES];
+  uint32_t parsed[NUM_ZONES];
+  for (int i = 0; i < NUM_ZONES; i++) {
+    fingerprints[i] = 0x01234567u * (i + 1) ^ 0x89abcdefu;
+  }
+  char text[DISCOVERY_RECORD_LENGTH + 1];
+  TEST_ASSERT_EQUAL(0, formatDiscoveryRecord(text, sizeof(text) - 1, fingerprints));
+  TEST_ASSERT_EQUAL(DISCOVERY_RECORD_LENGTH, formatDiscoveryRecord(text, sizeof(text), fingerprints));
+  TEST_ASSERT_EQUAL(DISCOVERY_RECORD_LENGTH, strlen(text));
+  TEST_ASSERT_EQUAL(',', text[8]);
+  TEST_ASSERT_TRUE(parseDiscoveryRecord((const uint8_t*)text, strlen(text), parsed));
+  TEST_ASSERT_EQUAL_UINT32_ARRAY(fingerprints, parsed, NUM_ZONES);
+
+  // Malformed records leave the output untouched
+  memset(parsed, 0, sizeof(parsed));
+  TEST_ASSERT_FALSE(parseDiscoveryRecord((const uint8_t*)text, strlen(text) - 1, parsed));
+  text[8] = ';';
+  TEST_ASSERT_FALSE(parseDiscoveryRecord((const uint8_t*)text, strlen(text), parsed));
+  text[8] = ',';
+  text[3] = 'g';
+  TEST_ASSERT_FALSE(parseDiscoveryRecord((const uint8_t*)text, strlen(text), parsed));
+  TEST_ASSERT_EQUAL_HEX32(0, parsed[0]);
+}
+
+// Test that Home Assistant is told to send commands at the subscription QoS
+void test_config_payload() {
+  static StaticJsonDocument<DISCOVERY_JSON_CAPACITY> json;
+  TEST_ASSERT_TRUE(buildDiscoveryConfig(json, 2, 0x00ABCDEFu));
+
+  // QoS 0 commands are not queued for the persistent session while offline
+  TEST_ASSERT_EQUAL(MQTT_COMMAND_QOS, json["qos"].as<int>());
+  TEST_ASSERT_EQUAL_STRING(zoneTopic(ZONE_COMMAND, 2), json["command_topic"].as<const char*>());
+  TEST_ASSERT_EQUAL_STRING(zoneTopic(ZONE_STATE, 2), json["state_topic"].as<const char*>());
+  TEST_ASSERT_EQUAL_STRING(ZONE_NAMES[1], json["name"].as<const char*>());
+  TEST_ASSERT_EQUAL_STRING("00ABCDEF", json["device"]["identifiers"].as<const char*>());
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_first_boot_publishes_all);
+  RUN_TEST(test_stored_record_waits_for_broker);
+  RUN_TEST(test_verify_timeout_publishes_unverified);
+  RUN_TEST(test_broker_mismatch_and_resume);
+  RUN_TEST(test_interval_and_failed_publish);
+  RUN_TEST(test_record_format);
+  RUN_TEST(test_config_payload);
+
+  return UNITY_END();
+}
+
+#ifdef NATIVE_BUILD
+int main() {
+  return runUnityTests();
+}
+#else
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  runUnityTests();
+}
+
+void loop() {
+  // Nothing to do here
+}
+#endif
@@ -0,0 +1,252 @@
+// Runs on the device (pio test -e test) and on the host (pio test -e native)
+#ifdef NATIVE_BUILD
+#include "hal.h"
+#else
+#include <Arduino.h>
+#endif
+#include <unity.h>
+#include "../include/config.h"
+#include "../include/dispatcher.h"
+
+static int lastRoute;
+static TopicMatch lastMatch;
+static unsigned int lastLength;
+
+static void handlerA(const TopicMatch& match, const uint8_t*, unsigned int length) {
+  lastRoute = 0;
+  lastMatch = match;
+  lastLength = length;
+}
+
+static void handlerB(const TopicMatch& match, const uint8_t*, unsigned int length) {
+  lastRoute = 1;
+  lastMatch = match;
+  lastLength = length;
+}
+
+// The firmware's table shape
+static constexpr TopicRoute FIRMWARE_ROUTES[] = {
+  {MQTT_ZONE_COMMAND, handlerA, 0, false, true},
+  {MQTT_PROFILE_COMMAND, handlerB},
+  {MQTT_LOG_LEVEL, handlerB},
+};
+static constexpr TopicDispatcher<topicNodeBound(FIRMWARE_ROUTES), topicIndexSize(FIRMWARE_ROUTES)>
+    firmware(FIRMWARE_ROUTES, 3);
+static_assert(firmware.valid, "firmware route table");
+
+// Overlapping patterns: literal beats '+', '+' beats '#'
+static constexpr TopicRoute OVERLAP_ROUTES[] = {
+  {"a/b/c", handlerA},
+  {"a/+/d", handlerA},
+  {"a/+/+", handlerA},
+  {"a/#", handlerA},
+  {"x/+/y/+", handlerA},
+};
+static constexpr TopicDispatcher<topicNodeBound(OVERLAP_ROUTES), topicIndexSize(OVERLAP_ROUTES)>
+    overlap(OVERLAP_ROUTES, 5);
+static_assert(overlap.valid, "overlapping route table");
+
+// Fast routes, and the trie behind them for topics they do not match
+static constexpr TopicRoute FAST_ROUTES[] = {
+  {"a/+/c", handlerA, 0, false, true},
+  {"a/+/c/#", handlerA},
+  {"a/#", handlerA},
+  {"b/+", handlerA, 0, false, true},
+};
+static constexpr TopicDispatcher<topicNodeBound(FAST_ROUTES), topicIndexSize(FAST_ROUTES)>
+    fastRoutes(FAST_ROUTES, 4);
+static_assert(fastRoutes.valid && fastRoutes.fastCount == 2, "fast route table");
+
+// Invalid tables are rejected by the compiler
+static constexpr TopicRoute DUPLICATE[] = {{"a/+/b", handlerA}, {"a/+/b", handlerB}};
+static_assert(!TopicDispatcher<topicNodeBound(DUPLICATE), topicIndexSize(DUPLICATE)>(DUPLICATE, 2).valid,
+              "duplicate pattern");
+static constexpr TopicRoute HASH_NOT_LAST[] = {{"a/#/b", handlerA}};
+static_assert(!TopicDispatcher<topicNodeBound(HASH_NOT_LAST), topicIndexSize(HASH_NOT_LAST)>(HASH_NOT_LAST, 1).valid,
+              "'#' must be the last segment");
+static constexpr TopicRoute TOO_MANY_CAPTURES[] = {{"+/+/+/+/+", handlerA}};
+static_assert(!TopicDispatcher<topicNodeBound(TOO_MANY_CAPTURES), topicIndexSize(TOO_MANY_CAPTURES)>(TOO_MANY_CAPTURES, 1).valid,
+              "more wildcards than MAX_TOPIC_CAPTURES");
+
+static constexpr TopicRoute FAST_BESIDE_LITERAL[] = {{"a/+/b", handlerA, 0, false, true}, {"a/c/d", handlerB}};
+static_assert(!TopicDispatcher<topicNodeBound(FAST_BESIDE_LITERAL), topicIndexSize(FAST_BESIDE_LITERAL)>(FAST_BESIDE_LITERAL, 2).valid,
+              "a literal beside a fast route's '+' would win over it");
+static constexpr TopicRoute FAST_TWO_WILDCARDS[] = {{"a/+/+", handlerA, 0, false, true}};
+static_assert(!TopicDispatcher<topicNodeBound(FAST_TWO_WILDCARDS), topicIndexSize(FAST_TWO_WILDCARDS)>(FAST_TWO_WILDCARDS, 1).valid,
+              "fast routes have one '+'");
+static constexpr TopicRoute FAST_NO_WILDCARD[] = {{"a/b", handlerA, 0, false, true}};
+static_assert(!TopicDispatcher<topicNodeBound(FAST_NO_WILDCARD), topicIndexSize(FAST_NO_WILDCARD)>(FAST_NO_WILDCARD, 1).valid,
+              "fast routes have one '+'");
+static constexpr TopicRoute FAST_MULTI_LEVEL[] = {{"a/+/#", handlerA, 0, false, true}};
+static_assert(!TopicDispatcher<topicNodeBound(FAST_MULTI_LEVEL), topicIndexSize(FAST_MULTI_LEVEL)>(FAST_MULTI_LEVEL, 1).valid,
+              "fast routes have no '#'");
+static constexpr TopicRoute TOO_MANY_FAST[] = {
+  {"a/+", handlerA, 0, false, true}, {"b/+", handlerA, 0, false, true}, {"c/+", handlerA, 0, false, true}};
+static_assert(!TopicDispatcher<topicNodeBound(TOO_MANY_FAST), topicIndexSize(TOO_MANY_FAST)>(TOO_MANY_FAST, 3).valid,
+              "more fast routes than MAX_FAST_ROUTES");
+
+static int find(const char* topic) {
+  TopicMatch match;
+  return firmware.find(topic, match);
+}
+
+static int findOverlap(const char* topic, TopicMatch& match) {
+  return overlap.find(topic, match);
+}
+
+static bool captureIs(const TopicMatch& match, int i, const char* expected) {
+  return i < match.count && match.length[i] == strlen(expected) &&
+         memcmp(match.capture[i], expected, match.length[i]) == 0;
+}
+
+// Test the firmware routes and the zone number capture
+void test_firmware_routes() {
+  char topic[MQTT_TOPIC_BUFFER_SIZE];
+  for (int zone = 1; zone <= NUM_ZONES; zone++) {
+    snprintf(topic, sizeof(topic), "%szone/%d/command", MQTT_TOPIC_PREFIX, zone);
+    TopicMatch match;
+    TEST_ASSERT_EQUAL(0, firmware.find(topic, match));
+    TEST_ASSERT_EQUAL(1, match.count);
+    TEST_ASSERT_EQUAL(zone, match.captureInt(0));
+  }
+  TEST_ASSERT_EQUAL(1, find(MQTT_PROFILE_COMMAND));
+  TEST_ASSERT_EQUAL(2, find(MQTT_LOG_LEVEL));
+}
+
+// Test topics that must not match any route
+void test_no_match() {
+  TEST_ASSERT_EQUAL(-1, find(""));
+  TEST_ASSERT_EQUAL(-1, find("home"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler/"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinklerX/zone/3/command"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler/zone/3"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler/zone/3/state"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler/zone/3/command/x"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler/log/level/state"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler/log"));
+  TEST_ASSERT_EQUAL(-1, find("home/sprinkler/profile/commandx"));
+}
+
+// Test captureInt() on numbers, non-numbers and empty captures
+void test_capture_int() {
+  TopicMatch match;
+  TEST_ASSERT_EQUAL(0, firmware.find("home/sprinkler/zone/07/command", match));
+  TEST_ASSERT_EQUAL(7, match.captureInt(0));
+  TEST_ASSERT_EQUAL(0, firmware.find("home/sprinkler/zone/x/command", match));
+  TEST_ASSERT_EQUAL(-1, match.captureInt(0));
+  TEST_ASSERT_EQUAL(0, firmware.find("home/sprinkler/zone/1234/command", match));
+  TEST_ASSERT_EQUAL(-1, match.captureInt(0));
+  TEST_ASSERT_EQUAL(0, firmware.find("home/sprinkler/zone//command", match));
+  TEST_ASSERT_EQUAL(-1, match.captureInt(0));
+  TEST_ASSERT_EQUAL(-1, match.captureInt(1));
+}
+
+// Test precedence between literal, '+' and '#', with backtracking
+void test_wildcard_precedence() {
+  TopicMatch match;
+  TEST_ASSERT_EQUAL(0, findOverlap("a/b/c", match));
+  TEST_ASSERT_EQUAL(0, match.count);
+
+  // "b" matches literally first, then has to fall back to '+'
+  TEST_ASSERT_EQUAL(1, findOverlap("a/b/d", match));
+  TEST_ASSERT_EQUAL(1, match.count);
+  TEST_ASSERT_TRUE(captureIs(match, 0, "b"));
+
+  TEST_ASSERT_EQUAL(2, findOverlap("a/b/e", match));
+  TEST_ASSERT_EQUAL(2, match.count);
+  TEST_ASSERT_TRUE(captureIs(match, 0, "b"));
+  TEST_ASSERT_TRUE(captureIs(match, 1, "e"));
+
+  TEST_ASSERT_EQUAL(4, findOverlap("x/1/y/2", match));
+  TEST_ASSERT_TRUE(captureIs(match, 0, "1"));
+  TEST_ASSERT_TRUE(captureIs(match, 1, "2"));
+  TEST_ASSERT_EQUAL(-1, findOverlap("x/1/z/2", match));
+}
+
+// Test '#' captures the rest, including nothing
+void test_multi_level_wildcard() {
+  TopicMatch match;
+  TEST_ASSERT_EQUAL(3, findOverlap("a/b/c/d", match));
+  TEST_ASSERT_EQUAL(1, match.count);
+  TEST_ASSERT_TRUE(captureIs(match, 0, "b/c/d"));
+
+  TEST_ASSERT_EQUAL(3, findOverlap("a/q", match));
+  TEST_ASSERT_TRUE(captureIs(match, 0, "q"));
+
+  // "a/#" also matches "a" itself, with an empty capture
+  TEST_ASSERT_EQUAL(3, findOverlap("a", match));
+  TEST_ASSERT_TRUE(captureIs(match, 0, ""));
+
+  TEST_ASSERT_EQUAL(-1, findOverlap("ab", match));
+  TEST_ASSERT_EQUAL(-1, findOverlap("b/a", match));
+}
+
+// Test fast routes, and the fallback to the trie for topics they do not match
+void test_fast_routes() {
+  TopicMatch match;
+  TEST_ASSERT_EQUAL(0, fastRoutes.find("a/b/c", match));
+  TEST_ASSERT_EQUAL(1, match.count);
+  TEST_ASSERT_TRUE(captureIs(match, 0, "b"));
+  TEST_ASSERT_EQUAL(0, fastRoutes.find("a//c", match));
+  TEST_ASSERT_TRUE(captureIs(match, 0, ""));
+  TEST_ASSERT_EQUAL(3, fastRoutes.find("b/q", match));
+  TEST_ASSERT_TRUE(captureIs(match, 0, "q"));
+
+  // Longer or different topics go through the trie
+  TEST_ASSERT_EQUAL(1, fastRoutes.find("a/b/c/d", match));
+  TEST_ASSERT_EQUAL(2, match.count);
+  TEST_ASSERT_TRUE(captureIs(match, 0, "b"));
+  TEST_ASSERT_TRUE(captureIs(match, 1, "d"));
+  TEST_ASSERT_EQUAL(2, fastRoutes.find("a/b/cd", match));
+  TEST_ASSERT_TRUE(captureIs(match, 0, "b/cd"));
+  TEST_ASSERT_EQUAL(1, fastRoutes.find("a/b/c/", match));
+  TEST_ASSERT_TRUE(captureIs(match, 1, ""));
+  TEST_ASSERT_EQUAL(-1, fastRoutes.find("b/q/y", match));
+}
+
+// Test that dispatch() runs the handler with the payload length
+void test_dispatch_runs_handler() {
+  const uint8_t payload[] = {'d', 'u', 'm', 'p'};
+  lastRoute = -1;
+  TEST_ASSERT_TRUE(firmware.dispatch(MQTT_PROFILE_COMMAND, payload, sizeof(payload)));
+  TEST_ASSERT_EQUAL(1, lastRoute);
+  TEST_ASSERT_EQUAL(4, lastLength);
+  TEST_ASSERT_EQUAL(0, lastMatch.count);
+
+  lastRoute = -1;
+  TEST_ASSERT_FALSE(firmware.dispatch("home/sprinkler/zone/3/state", payload, sizeof(payload)));
+  TEST_ASSERT_EQUAL(-1, lastRoute);
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_firmware_routes);
+  RUN_TEST(test_no_match);
+  RUN_TEST(test_capture_int);
+  RUN_TEST(test_wildcard_precedence);
+  RUN_TEST(test_multi_level_wildcard);
+  RUN_TEST(test_fast_routes);
+  RUN_TEST(test_dispatch_runs_handler);
+
+  return UNITY_END();
+}
+
+#ifdef NATIVE_BUILD
+int main() {
+  return runUnityTests();
+}
+#else
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  runUnityTests();
+}
+
+void loop() {
+  // Nothing to do here
+}
+#endif
@@ -0,0 +1,104 @@
+#include <Arduino.h>
+#include <unity.h>
+
+// Cap one module at build time to test the compile-time limit
+#define LOG_LEVEL_OTA LOG_LEVEL_WARN
+
+#include "../include/logging.h"
+#include "../src/logging.cpp"  // test env does not build src/
+
+// Test that levels above the build level are resolved false at compile time
+void test_compile_time_levels() {
+  static_assert(LogEnabled<LOG_OTA, LOG_LEVEL_WARN>::value, "warn is built in");
+  static_assert(!LogEnabled<LOG_OTA, LOG_LEVEL_INFO>::value, "info is compiled out");
+  static_assert(!LogEnabled<LOG_MQTT, LOG_LEVEL_OFF>::value, "off never logs");
+  TEST_ASSERT_EQUAL(LOG_LEVEL_WARN, logCompiledLevel(LOG_OTA));
+  TEST_ASSERT_EQUAL(LOG_LEVEL, logCompiledLevel(LOG_MQTT));
+
+  // Arguments of a compiled-out call are never evaluated
+  int evaluated = 0;
+  LOG_INFO(LOG_OTA, "%d\n", ++evaluated);
+  TEST_ASSERT_EQUAL(0, evaluated);
+}
+
+// Test module and level name lookups
+void test_names() {
+  TEST_ASSERT_EQUAL_STRING("zones", logModuleName(LOG_ZONES));
+  TEST_ASSERT_EQUAL_STRING("unknown", logModuleName(NUM_LOG_MODULES));
+  TEST_ASSERT_EQUAL_STRING("trace", logLevelName(LOG_LEVEL_TRACE));
+  TEST_ASSERT_EQUAL_STRING("unknown", logLevelName(9));
+
+  TEST_ASSERT_EQUAL(LOG_CONFIG, logModuleFromName("config", 6));
+  TEST_ASSERT_EQUAL(LOG_LEVEL_ERROR, logLevelFromName("error", 5));
+  TEST_ASSERT_EQUAL(-1, logLevelFromName("err", 3));
+  TEST_ASSERT_EQUAL(-1, logModuleFromName("mqttx", 5));
+}
+
+// Test the commands accepted on home/sprinkler/log/level
+void test_apply_command() {
+  logResetLevels();
+
+  TEST_ASSERT_TRUE(logApplyCommand("error", 5));
+  for (int i = 0; i < NUM_LOG_MODULES; i++) {
+    TEST_ASSERT_EQUAL(LOG_LEVEL_ERROR, logLevels[i]);
+  }
+
+  TEST_ASSERT_TRUE(logApplyCommand("mqtt=trace,zones=off", 20));
+  TEST_ASSERT_EQUAL(logCompiledLevel(LOG_MQTT), logLevels[LOG_MQTT]);
+  TEST_ASSERT_EQUAL(LOG_LEVEL_OFF, logLevels[LOG_ZONES]);
+  TEST_ASSERT_EQUAL(LOG_LEVEL_ERROR, logLevels[LOG_WIFI]);
+
+  // A bad item rejects the whole command
+  TEST_ASSERT_FALSE(logApplyCommand("wifi=info,bogus=warn", 20));
+  TEST_ASSERT_FALSE(logApplyCommand("wifi=loud", 9));
+  TEST_ASSERT_EQUAL(LOG_LEVEL_ERROR, logLevels[LOG_WIFI]);
+
+  // Payloads are not NUL-terminated; only length bytes are read
+  TEST_ASSERT_TRUE(logApplyCommand("wifi=infoXXXX", 9));
+  TEST_ASSERT_EQUAL(LOG_LEVEL_INFO, logLevels[LOG_WIFI]);
+
+  TEST_ASSERT_TRUE(logApplyCommand("reset", 5));
+  TEST_ASSERT_EQUAL(logCompiledLevel(LOG_ZONES), logLevels[LOG_ZONES]);
+}
+
+// Test that runtime levels cannot exceed the build level
+void test_runtime_level_capped() {
+  logResetLevels();
+  TEST_ASSERT_EQUAL(LOG_LEVEL_WARN, logSetLevel(LOG_OTA, LOG_LEVEL_TRACE));
+  TEST_ASSERT_FALSE(logRuntimeEnabled(LOG_OTA, LOG_LEVEL_INFO));
+
+  logSetLevel(LOG_OTA, LOG_LEVEL_ERROR);
+  TEST_ASSERT_TRUE(logRuntimeEnabled(LOG_OTA, LOG_LEVEL_ERROR));
+  TEST_ASSERT_FALSE(logRuntimeEnabled(LOG_OTA, LOG_LEVEL_WARN));
+
+  char levels[LOG_COMMAND_BUFFER_SIZE];
+  size_t n = logFormatLevels(levels, sizeof(levels));
+  TEST_ASSERT_EQUAL(strlen(levels), n);
+  TEST_ASSERT_NOT_NULL(strstr(levels, "ota=error"));
+
+  // Truncated output stays NUL-terminated
+  char small[8];
+  n = logFormatLevels(small, sizeof(small));
+  TEST_ASSERT_EQUAL(sizeof(small) - 1, n);
+  TEST_ASSERT_EQUAL(sizeof(small) - 1, strlen(small));
+  logResetLevels();
+}
+
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  UNITY_BEGIN();
+
+  RUN_TEST(test_compile_time_levels);
+  RUN_TEST(test_names);
+  RUN_TEST(test_apply_command);
+  RUN_TEST(test_runtime_level_capped);
+
+  UNITY_END();
+}
+
+void loop() {
+  // Nothing to do here
+}
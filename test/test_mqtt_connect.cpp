@@ -0,0 +1,209 @@
+// Runs on the device (pio test -e test) and on the host (pio test -e native)
+#ifdef NATIVE_BUILD
+#include "hal.h"
+#else
+#include <Arduino.h>
+#endif
+#include <unity.h>
+#include <string.h>
+#include "../include/mqtt_connect.h"
+#include "../src/mqtt_connect.cpp"  // test env does not build src/
+
+static ConnectState state;
+
+static const uint32_t CHIP_ID = 0x00100000;
+
+// Whether the next attempt comes exactly retryDelayMs after the last one
+static void assertDueAfterDelay(const ConnectState& s) {
+  TEST_ASSERT_FALSE(connectDue(s, s.lastAttemptMs + s.retryDelayMs));
+  TEST_ASSERT_TRUE(connectDue(s, s.lastAttemptMs + s.retryDelayMs + 1));
+}
+
+void test_first_attempt_after_interval() {
+  connectInit(state, CHIP_ID);
+  TEST_ASSERT_EQUAL(CONNECT_IDLE, state.stage);
+  // One broker session per controller
+  TEST_ASSERT_EQUAL_STRING("sprinkler_00100000", state.clientId);
+  TEST_ASSERT_FALSE(connectDue(state, RECONNECT_INTERVAL));
+  TEST_ASSERT_TRUE(connectDue(state, RECONNECT_INTERVAL + 1));
+
+  connectBegin(state, 1883, RECONNECT_INTERVAL + 1);
+  TEST_ASSERT_EQUAL(CONNECT_RESOLVE, state.stage);
+  TEST_ASSERT_EQUAL(1883, state.port);
+  // Only idle connections start attempts
+  TEST_ASSERT_FALSE(connectDue(state, 10 * RECONNECT_INTERVAL));
+}
+
+// Test that failed attempts back off with decorrelated jitter up to the cap
+void test_failed_attempt_backs_off() {
+  connectInit(state, CHIP_ID);
+  uint32_t now = 10000;
+  uint32_t previous = RECONNECT_INTERVAL;
+  uint32_t longest = 0;
+  for (int i = 0; i < 50; i++) {
+    connectBegin(state, 1883, now);
+    connectAdvance(state, CONNECT_TCP, now + 10);
+    connectFailed(state);
+    TEST_ASSERT_EQUAL(CONNECT_IDLE, state.stage);
+    // Spaced from the start of the failed attempt, not its end
+    TEST_ASSERT_EQUAL_UINT32(now, state.lastAttemptMs);
+    assertDueAfterDelay(state);
+    uint32_t upper = previous * 3 < MQTT_RECONNECT_MAX_MS ? previous * 3 : MQTT_RECONNECT_MAX_MS;
+    TEST_ASSERT_UINT32_WITHIN((upper - RECONNECT_INTERVAL) / 2,
+                              RECONNECT_INTERVAL + (upper - RECONNECT_INTERVAL) / 2,
+                              state.retryDelayMs);
+    previous = state.retryDelayMs;
+    longest = previous > longest ? previous : longest;
+    now += previous + 1;
+  }
+  TEST_ASSERT_TRUE(longest > MQTT_RECONNECT_MAX_MS / 2);
+
+  // A connection that came up starts the backoff over
+  connectBegin(state, 1883, now);
+  connectUp(state);
+  TEST_ASSERT_EQUAL_UINT32(RECONNECT_INTERVAL, state.retryDelayMs);
+  connectBegin(state, 1883, now);
+  TEST_ASSERT_TRUE(state.retryDelayMs <= 3 * RECONNECT_INTERVAL);
+}
+
+// Test that a lost connection is retried within the reconnect window
+void test_lost_connection_retries_in_window() {
+  connectInit(state, CHIP_ID);
+  connectBegin(state, 1883, 100000);
+  connectUp(state);
+  TEST_ASSERT_EQUAL(CONNECT_UP, state.stage);
+  TEST_ASSERT_FALSE(connectDue(state, 200000));
+  connectLost(state, 200000);
+  TEST_ASSERT_EQUAL(CONNECT_IDLE, state.stage);
+  TEST_ASSERT_TRUE(state.retryDelayMs <= MQTT_RECONNECT_WINDOW_MS);
+  assertDueAfterDelay(state);
+
+  // Draws spread over the window the broker advertises
+  const char* window = "60000";
+  TEST_ASSERT_TRUE(connectSetWindow(state, (const uint8_t*)window, strlen(window)));
+  TEST_ASSERT_EQUAL_UINT32(60000, state.windowMs);
+  uint32_t shortest = UINT32_MAX, longest = 0;
+  for (int i = 0; i < 100; i++) {
+    connectUp(state);
+    connectLost(state, 200000);
+    TEST_ASSERT_TRUE(state.retryDelayMs <= 60000);
+    shortest = state.retryDelayMs < shortest ? state.retryDelayMs : shortest;
+    longest = state.retryDelayMs > longest ? state.retryDelayMs : longest;
+  }
+  TEST_ASSERT_TRUE(shortest < 10000);
+  TEST_ASSERT_TRUE(longest > 50000);
+}
+
+// Test the retained reconnect window payloads
+void test_reconnect_window() {
+  connectInit(state, CHIP_ID);
+  TEST_ASSERT_EQUAL_UINT32(MQTT_RECONNECT_WINDOW_MS, state.windowMs);
+
+  const char* zero = "0";
+  TEST_ASSERT_TRUE(connectSetWindow(state, (const uint8_t*)zero, 1));
+  TEST_ASSERT_EQUAL_UINT32(0, state.windowMs);
+
+  const char* invalid[] = {"-1", "1e3", "30 s", "600001", "99999999999"};
+  for (const char* payload : invalid) {
+    TEST_ASSERT_FALSE(connectSetWindow(state, (const uint8_t*)payload, strlen(payload)));
+    TEST_ASSERT_EQUAL_UINT32(0, state.windowMs);
+  }
+  const char* longest = "600000";
+  TEST_ASSERT_TRUE(connectSetWindow(state, (const uint8_t*)longest, strlen(longest)));
+  TEST_ASSERT_EQUAL_UINT32(MQTT_RECONNECT_WINDOW_MAX_MS, state.windowMs);
+
+  // Retained message deleted: back to the default
+  TEST_ASSERT_TRUE(connectSetWindow(state, nullptr, 0));
+  TEST_ASSERT_EQUAL_UINT32(MQTT_RECONNECT_WINDOW_MS, state.windowMs);
+}
+
+// Test that neighbouring chip ids draw different waits, the same chip id the same
+void test_jitter_per_chip() {
+  ConnectState a, b, c;
+  connectInit(a, CHIP_ID);
+  connectInit(b, CHIP_ID + 1);
+  connectInit(c, CHIP_ID);
+  int differ = 0;
+  for (int i = 0; i < 10; i++) {
+    connectBegin(a, 1883, 0);
+    connectBegin(b, 1883, 0);
+    connectBegin(c, 1883, 0);
+    TEST_ASSERT_EQUAL_UINT32(a.retryDelayMs, c.retryDelayMs);
+    differ += a.retryDelayMs != b.retryDelayMs;
+  }
+  TEST_ASSERT_TRUE(differ >= 9);
+}
+
+void test_resolve_timeout() {
+  connectInit(state, CHIP_ID);
+  connectBegin(state, 1883, 0xFFFFFF00u);  // across the millis() wrap
+  TEST_ASSERT_FALSE(connectTimedOut(state, 0xFFFFFF00u + MQTT_DNS_TIMEOUT - 1));
+  TEST_ASSERT_TRUE(connectTimedOut(state, 0xFFFFFF00u + MQTT_DNS_TIMEOUT));
+  // TCP bounds itself
+  connectAdvance(state, CONNECT_TCP, 0x100);
+  TEST_ASSERT_FALSE(connectTimedOut(state, 0x100 + 10 * MQTT_DNS_TIMEOUT));
+  // MQTT is polled with the asynchronous client backend
+  const uint32_t mqttTimeout = MQTT_TCP_TIMEOUT + MQTT_CONNACK_TIMEOUT * 1000UL;
+  connectAdvance(state, CONNECT_MQTT, 0x200);
+  TEST_ASSERT_FALSE(connectTimedOut(state, 0x200 + mqttTimeout - 1));
+  TEST_ASSERT_TRUE(connectTimedOut(state, 0x200 + mqttTimeout));
+}
+
+void test_session_reuse() {
+  ConnectState state;
+  connectInit(state, CHIP_ID);
+  // First connect after boot: the stored session may predate this firmware
+  TEST_ASSERT_TRUE(connectNeedsSubscribe(state, true));
+  TEST_ASSERT_TRUE(connectNeedsSubscribe(state, false));
+  connectSubscribed(state);
+  TEST_ASSERT_FALSE(connectNeedsSubscribe(state, true));
+  // The broker dropped the session
+  TEST_ASSERT_TRUE(connectNeedsSubscribe(state, false));
+  // Survives failed attempts
+  connectFailed(state);
+  TEST_ASSERT_FALSE(connectNeedsSubscribe(state, true));
+}
+
+void test_stages() {
+  TEST_ASSERT_FALSE(connectStageBlocks(CONNECT_RESOLVE));
+  TEST_ASSERT_TRUE(connectStageBlocks(CONNECT_TCP));
+  TEST_ASSERT_TRUE(connectStageBlocks(CONNECT_MQTT));
+  TEST_ASSERT_FALSE(connectStageBlocks(CONNECT_SUBSCRIBE));
+  TEST_ASSERT_EQUAL_STRING("resolve", connectStageName(CONNECT_RESOLVE));
+  TEST_ASSERT_EQUAL_STRING("up", connectStageName(CONNECT_UP));
+  TEST_ASSERT_EQUAL_STRING("unknown", connectStageName(NUM_CONNECT_STAGES));
+  TEST_ASSERT_EQUAL_STRING("unknown", connectStageName(-1));
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_first_attempt_after_interval);
+  RUN_TEST(test_failed_attempt_backs_off);
+  RUN_TEST(test_lost_connection_retries_in_window);
+  RUN_TEST(test_reconnect_window);
+  RUN_TEST(test_jitter_per_chip);
+  RUN_TEST(test_resolve_timeout);
+  RUN_TEST(test_session_reuse);
+  RUN_TEST(test_stages);
+
+  return UNITY_END();
+}
+
+#ifdef NATIVE_BUILD
+int main() {
+  return runUnityTests();
+}
+#else
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  runUnityTests();
+}
+
+void loop() {
+  // Nothing to do here
+}
+#endif
@@ -0,0 +1,151 @@
+// Runs on the device (pio test -e test) and on the host (pio test -e native)
+#ifdef NATIVE_BUILD
+#include "hal.h"
+#else
+#include <Arduino.h>
+#endif
+#include <unity.h>
+#include <string.h>
+#include "../include/offline_log.h"
+#include "../src/offline_log.cpp"  // test env does not build src/
+
+static OfflineLog offline;
+
+static void reset() {
+  memset(&offline, 0, sizeof(offline));
+  offlineLogReset(offline);
+}
+
+static void assertOldest(uint8_t kind, int zone, uint32_t atMs) {
+  const OfflineRecord* record = offlineLogOldest(offline);
+  TEST_ASSERT_NOT_NULL(record);
+  TEST_ASSERT_EQUAL(kind, record->kind);
+  TEST_ASSERT_EQUAL(zone, record->zone);
+  TEST_ASSERT_EQUAL_UINT32(atMs, record->atMs);
+  offlineLogPop(offline);
+}
+
+// Test that records come back oldest first
+void test_replays_in_order() {
+  reset();
+  TEST_ASSERT_NULL(offlineLogOldest(offline));
+  offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 2, 100);
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 2, 100);
+  offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 5, 900);
+
+  TEST_ASSERT_EQUAL(3, offline.count);
+  assertOldest(OFFLINE_SAFETY_OFF, 2, 100);
+  assertOldest(OFFLINE_ZONE_STATE, 2, 100);
+  assertOldest(OFFLINE_SAFETY_OFF, 5, 900);
+  TEST_ASSERT_NULL(offlineLogOldest(offline));
+
+  offlineLogPop(offline);  // empty: nothing happens
+  TEST_ASSERT_EQUAL(0, offline.count);
+}
+
+// Test that a newer zone state replaces the waiting one; events are all kept
+void test_zone_states_coalesce() {
+  reset();
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 1, 10);
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 2, 20);
+  offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 1, 30);
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 1, 30);
+  offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 1, 40);  // events never coalesce
+
+  // Zone 1's newer state replaced the older one and took its place in the order
+  TEST_ASSERT_EQUAL(4, offline.count);
+  TEST_ASSERT_EQUAL_UINT32(5, offline.stats.recorded);
+  TEST_ASSERT_EQUAL_UINT32(1, offline.stats.coalesced);
+  assertOldest(OFFLINE_ZONE_STATE, 2, 20);
+  assertOldest(OFFLINE_SAFETY_OFF, 1, 30);
+  assertOldest(OFFLINE_ZONE_STATE, 1, 30);
+  assertOldest(OFFLINE_SAFETY_OFF, 1, 40);
+}
+
+// Test that a full log drops its oldest record and is no longer complete
+void test_overflow_drops_oldest() {
+  reset();
+  offlineLogSynced(offline);
+  TEST_ASSERT_TRUE(offline.complete);
+
+  for (int i = 0; i < OFFLINE_LOG_CAPACITY; i++) {
+    offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 1, (uint32_t)i);
+  }
+  TEST_ASSERT_TRUE(offline.complete);
+  TEST_ASSERT_EQUAL_UINT32(0, offline.stats.dropped);
+
+  offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 1, OFFLINE_LOG_CAPACITY);
+  TEST_ASSERT_EQUAL(OFFLINE_LOG_CAPACITY, offline.count);
+  TEST_ASSERT_EQUAL_UINT32(1, offline.stats.dropped);
+  TEST_ASSERT_FALSE(offline.complete);
+
+  // Still in order across the wrap
+  for (int i = 1; i <= OFFLINE_LOG_CAPACITY; i++) {
+    assertOldest(OFFLINE_SAFETY_OFF, 1, (uint32_t)i);
+  }
+  TEST_ASSERT_EQUAL(0, offline.count);
+}
+
+// Test coalescing when the waiting records wrap around the array
+void test_coalesce_across_wrap() {
+  reset();
+  // Move the head so the records wrap around the end of the array
+  for (int i = 0; i < OFFLINE_LOG_CAPACITY - 1; i++) {
+    offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 1, 0);
+    offlineLogPop(offline);
+  }
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 3, 1);
+  offlineLogRecord(offline, OFFLINE_SAFETY_OFF, 4, 2);
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 4, 2);
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 3, 3);
+
+  TEST_ASSERT_EQUAL(3, offline.count);
+  assertOldest(OFFLINE_SAFETY_OFF, 4, 2);
+  assertOldest(OFFLINE_ZONE_STATE, 4, 2);
+  assertOldest(OFFLINE_ZONE_STATE, 3, 3);
+}
+
+// Test that reset empties the log but keeps the counters
+void test_reset_keeps_stats() {
+  reset();
+  offlineLogSynced(offline);
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 1, 10);
+  offlineLogRecord(offline, OFFLINE_ZONE_STATE, 1, 20);
+
+  offlineLogReset(offline);
+  TEST_ASSERT_EQUAL(0, offline.count);
+  TEST_ASSERT_NULL(offlineLogOldest(offline));
+  TEST_ASSERT_FALSE(offline.complete);
+  TEST_ASSERT_EQUAL_UINT32(2, offline.stats.recorded);
+  TEST_ASSERT_EQUAL_UINT32(1, offline.stats.coalesced);
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_replays_in_order);
+  RUN_TEST(test_zone_states_coalesce);
+  RUN_TEST(test_overflow_drops_oldest);
+  RUN_TEST(test_coalesce_across_wrap);
+  RUN_TEST(test_reset_keeps_stats);
+
+  return UNITY_END();
+}
+
+#ifdef NATIVE_BUILD
+int main() {
+  return runUnityTests();
+}
+#else
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  runUnityTests();
+}
+
+void loop() {
+  // Nothing to do here
+}
+#endif
@@ -0,0 +1,79 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "../include/profiler.h"
+#include "../src/profiler.cpp"  // test env does not build src/
+
+// Test count/min/max/total aggregation for one probe
+void test_probe_aggregation() {
+  ProfileProbe* probe = profilerRegister("probe_a");
+  TEST_ASSERT_NOT_NULL(probe);
+  TEST_ASSERT_EQUAL_STRING("probe_a", probe->name);
+
+  profilerRecord(probe, 300);
+  profilerRecord(probe, 100);
+  profilerRecord(probe, 200);
+
+  TEST_ASSERT_EQUAL(3, probe->count);
+  TEST_ASSERT_EQUAL(100, probe->minCycles);
+  TEST_ASSERT_EQUAL(300, probe->maxCycles);
+  TEST_ASSERT_EQUAL(600, (uint32_t)probe->totalCycles);
+
+  // Recording into a dropped probe is a no-op
+  profilerRecord(nullptr, 1000);
+}
+
+// Test that reset clears counters but keeps probe sites registered
+void test_reset_keeps_probes() {
+  int before = profilerProbeCount();
+  TEST_ASSERT_GREATER_THAN(0, before);
+
+  profilerReset();
+  TEST_ASSERT_EQUAL(before, profilerProbeCount());
+  const ProfileProbe* probe = profilerProbe(0);
+  TEST_ASSERT_EQUAL_STRING("probe_a", probe->name);
+  TEST_ASSERT_EQUAL(0, probe->count);
+  TEST_ASSERT_EQUAL(0, probe->maxCycles);
+  TEST_ASSERT_NULL(profilerProbe(before));
+}
+
+// Test PROFILE_SCOPE measures a block and registers its site only once
+void test_profile_scope() {
+  for (int i = 0; i < 3; i++) {
+    PROFILE_SCOPE("scoped");
+    delayMicroseconds(100);
+  }
+  const ProfileProbe* probe = profilerProbe(profilerProbeCount() - 1);
+  TEST_ASSERT_EQUAL_STRING("scoped", probe->name);
+  TEST_ASSERT_EQUAL(3, probe->count);
+  // At least 100 us at the CPU clock
+  TEST_ASSERT_GREATER_OR_EQUAL(100 * hal::cpuMhz(), probe->minCycles);
+}
+
+// Test that the static table does not overflow
+void test_table_full() {
+  while (profilerProbeCount() < MAX_PROFILE_PROBES) {
+    TEST_ASSERT_NOT_NULL(profilerRegister("filler"));
+  }
+  TEST_ASSERT_NULL(profilerRegister("one_too_many"));
+  TEST_ASSERT_EQUAL(1, profilerDropped());
+  TEST_ASSERT_EQUAL(MAX_PROFILE_PROBES, profilerProbeCount());
+}
+
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  UNITY_BEGIN();
+
+  RUN_TEST(test_probe_aggregation);
+  RUN_TEST(test_reset_keeps_probes);
+  RUN_TEST(test_profile_scope);
+  RUN_TEST(test_table_full);
+
+  UNITY_END();
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,223 @@
+// Runs on the device (pio test -e test) and on the host (pio test -e native)
+#ifdef NATIVE_BUILD
+#include "hal.h"
+#else
+#include <Arduino.h>
+#endif
+#include <unity.h>
+#include <string.h>
+#include "../include/publish_queue.h"
+#include "../src/publish_queue.cpp"  // test env does not build src/
+
+static PublishQueue queue;
+
+// Values the render function reads when the queue sends
+static int values[PUBLISH_QUEUE_CAPACITY + 1];
+
+static const char* TOPICS[PUBLISH_QUEUE_CAPACITY + 1] = {
+  "t/0", "t/1", "t/2", "t/3", "t/4", "t/5", "t/6", "t/7", "t/8", "t/9", "t/10", "t/11", "t/12",
+  "t/13", "t/14", "t/15", "t/16", "t/17", "t/18", "t/19", "t/20", "t/21", "t/22", "t/23", "t/24",
+};
+static_assert(PUBLISH_QUEUE_CAPACITY == 24, "TOPICS has one more entry than the queue");
+
+static void renderValue(int arg, PublishWriter& out) {
+  char text[12];
+  snprintf(text, sizeof(text), "%d", values[arg]);
+  out.write(text);
+}
+
+// Collects a streamed payload
+class StringWriter : public PublishWriter {
+ public:
+  using PublishWriter::write;
+
+  char text[8] = {};
+  size_t length = 0;
+
+  size_t write(const uint8_t* data, size_t count) override {
+    for (size_t i = 0; i < count && length < sizeof(text) - 1; i++) {
+      text[length++] = (char)data[i];
+    }
+    return count;
+  }
+};
+
+// What the queue sent, in order
+static int sentCount;
+static char sentTopics[8][8];
+static char sentPayloads[8][8];
+static bool sendAccepts;
+
+static bool record(const char* topic, PublishRender render, int arg, size_t length, bool) {
+  if (!sendAccepts) {
+    return false;
+  }
+  StringWriter payload;
+  render(arg, payload);
+  TEST_ASSERT_EQUAL(length, payload.length);
+  if (sentCount < 8) {
+    strncpy(sentTopics[sentCount], topic, sizeof(sentTopics[0]) - 1);
+    strcpy(sentPayloads[sentCount], payload.text);
+  }
+  sentCount++;
+  return true;
+}
+
+static size_t drain(uint32_t now) {
+  return publishQueueDrain(queue, now, record);
+}
+
+static void reset() {
+  memset(&queue, 0, sizeof(queue));
+  publishQueueReset(queue, 0);
+  memset(values, 0, sizeof(values));
+  memset(sentTopics, 0, sizeof(sentTopics));
+  sentCount = 0;
+  sendAccepts = true;
+}
+
+// Test that a newer value replaces the unsent older one
+void test_coalesces_pending_topic() {
+  reset();
+  values[1] = 1;
+  TEST_ASSERT_TRUE(publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true));
+  values[1] = 0;
+  TEST_ASSERT_TRUE(publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true));
+  values[1] = 1;
+  // Equal topic text at another address is the same topic
+  char copy[8];
+  strcpy(copy, TOPICS[1]);
+  TEST_ASSERT_TRUE(publishQueueEnqueue(queue, copy, renderValue, 1, true));
+
+  TEST_ASSERT_EQUAL(1, drain(0));
+  TEST_ASSERT_EQUAL_STRING("t/1", sentTopics[0]);
+  TEST_ASSERT_EQUAL_STRING("1", sentPayloads[0]);
+  TEST_ASSERT_EQUAL(2, queue.stats.coalesced);
+  TEST_ASSERT_EQUAL(0, queue.pending);
+}
+
+// Test that entries are sent in the order their topics were first queued
+void test_sends_oldest_first() {
+  reset();
+  publishQueueEnqueue(queue, TOPICS[3], renderValue, 3, true);
+  publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true);
+  publishQueueEnqueue(queue, TOPICS[3], renderValue, 3, true);
+  publishQueueEnqueue(queue, TOPICS[2], renderValue, 2, true);
+
+  TEST_ASSERT_EQUAL(3, drain(0));
+  TEST_ASSERT_EQUAL_STRING("t/3", sentTopics[0]);
+  TEST_ASSERT_EQUAL_STRING("t/1", sentTopics[1]);
+  TEST_ASSERT_EQUAL_STRING("t/2", sentTopics[2]);
+}
+
+// Test that an unchanged retained value is dropped until the refresh interval
+void test_deduplicates_retained() {
+  reset();
+  values[1] = 5;
+  publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true);
+  TEST_ASSERT_EQUAL(1, drain(0));
+
+  publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true);
+  TEST_ASSERT_EQUAL(0, drain(1000));
+  TEST_ASSERT_EQUAL(1, queue.stats.deduplicated);
+  TEST_ASSERT_EQUAL(0, queue.pending);
+
+  values[1] = 6;
+  publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true);
+  TEST_ASSERT_EQUAL(1, drain(2000));
+
+  // The same value again once PUBLISH_DEDUP_REFRESH has passed
+  publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true);
+  TEST_ASSERT_EQUAL(1, drain(2000 + PUBLISH_DEDUP_REFRESH));
+
+  // Not retained: always sent
+  publishQueueEnqueue(queue, TOPICS[2], renderValue, 2, false);
+  TEST_ASSERT_EQUAL(1, drain(3000 + PUBLISH_DEDUP_REFRESH));
+  publishQueueEnqueue(queue, TOPICS[2], renderValue, 2, false);
+  TEST_ASSERT_EQUAL(1, drain(4000 + PUBLISH_DEDUP_REFRESH));
+  TEST_ASSERT_EQUAL(1, queue.stats.deduplicated);
+}
+
+// Test the token bucket: a burst, then PUBLISH_DRAIN_RATE per second
+void test_drain_rate() {
+  reset();
+  for (int i = 0; i < PUBLISH_QUEUE_CAPACITY; i++) {
+    publishQueueEnqueue(queue, TOPICS[i], renderValue, i, true);
+  }
+  TEST_ASSERT_EQUAL(PUBLISH_DRAIN_BURST, drain(0));
+  TEST_ASSERT_EQUAL(0, drain(0));
+
+  const uint32_t interval = 1000 / PUBLISH_DRAIN_RATE;
+  TEST_ASSERT_EQUAL(0, drain(interval - 1));
+  TEST_ASSERT_EQUAL(1, drain(interval));
+  TEST_ASSERT_EQUAL(2, drain(3 * interval));
+
+  // A long pause refills the bucket to the burst size only
+  size_t expected = PUBLISH_QUEUE_CAPACITY - PUBLISH_DRAIN_BURST - 3;
+  if (expected > PUBLISH_DRAIN_BURST) {
+    expected = PUBLISH_DRAIN_BURST;
+  }
+  TEST_ASSERT_EQUAL(expected, drain(600000));
+}
+
+// Test that a refused send keeps the entry and stops the drain
+void test_send_failure_keeps_entry() {
+  reset();
+  publishQueueEnqueue(queue, TOPICS[1], renderValue, 1, true);
+  publishQueueEnqueue(queue, TOPICS[2], renderValue, 2, true);
+  sendAccepts = false;
+  TEST_ASSERT_EQUAL(0, drain(0));
+  TEST_ASSERT_EQUAL(2, queue.pending);
+
+  sendAccepts = true;
+  TEST_ASSERT_EQUAL(2, drain(0));
+  TEST_ASSERT_EQUAL_STRING("t/1", sentTopics[0]);
+}
+
+// Test overflow when every slot is waiting, and reuse of sent slots
+void test_overflow_and_slot_reuse() {
+  reset();
+  for (int i = 0; i < PUBLISH_QUEUE_CAPACITY; i++) {
+    TEST_ASSERT_TRUE(publishQueueEnqueue(queue, TOPICS[i], renderValue, i, true));
+  }
+  TEST_ASSERT_FALSE(publishQueueEnqueue(queue, TOPICS[PUBLISH_QUEUE_CAPACITY], renderValue,
+                                        PUBLISH_QUEUE_CAPACITY, true));
+  TEST_ASSERT_EQUAL(1, queue.stats.overflows);
+
+  // Once one entry has been sent its slot can hold another topic
+  TEST_ASSERT_EQUAL(PUBLISH_DRAIN_BURST, drain(0));
+  TEST_ASSERT_TRUE(publishQueueEnqueue(queue, TOPICS[PUBLISH_QUEUE_CAPACITY], renderValue,
+                                       PUBLISH_QUEUE_CAPACITY, true));
+  TEST_ASSERT_EQUAL(PUBLISH_QUEUE_CAPACITY - PUBLISH_DRAIN_BURST + 1, queue.pending);
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_coalesces_pending_topic);
+  RUN_TEST(test_sends_oldest_first);
+  RUN_TEST(test_deduplicates_retained);
+  RUN_TEST(test_drain_rate);
+  RUN_TEST(test_send_failure_keeps_entry);
+  RUN_TEST(test_overflow_and_slot_reuse);
+
+  return UNITY_END();
+}
+
+#ifdef NATIVE_BUILD
+int main() {
+  return runUnityTests();
+}
+#else
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  runUnityTests();
+}
+
+void loop() {
+  // Nothing to do here
+}
+#endif
@@ -0,0 +1,120 @@
+// Runs on the device (pio test -e test) and on the host (pio test -e native)
+#ifdef NATIVE_BUILD
+#include "hal.h"
+#else
+#include <Arduino.h>
+#endif
+#include <unity.h>
+#include <string.h>
+#include "../include/status_report.h"
+#include "../src/status_report.cpp"  // test env does not build src/
+
+static StatusReport report;
+static StatusSample sample;
+
+// Steady readings, sent in a full report at 1000 ms
+static void reset() {
+  statusReportReset(report);
+  memset(&sample, 0, sizeof(sample));
+  sample.value[STATUS_FREE_HEAP] = 40000;
+  sample.value[STATUS_WIFI_RSSI] = -60;
+  sample.value[STATUS_FREE_STACK] = 2800;
+  sample.zonesOn = 0x05;
+  statusReported(report, sample, STATUS_ALL_FIELDS, 0x7F, true, 1000);
+}
+
+void test_full_report_schedule() {
+  statusReportReset(report);
+  TEST_ASSERT_TRUE(statusFullDue(report, 0));
+  reset();
+  TEST_ASSERT_FALSE(statusFullDue(report, 1000 + STATUS_FULL_INTERVAL - 1));
+  TEST_ASSERT_TRUE(statusFullDue(report, 1000 + STATUS_FULL_INTERVAL));
+  // Survives the millis() wrap
+  statusReported(report, sample, STATUS_ALL_FIELDS, 0x7F, true, 0xFFFFF000u);
+  TEST_ASSERT_FALSE(statusFullDue(report, 0x100));
+  // Reconnect
+  statusReportReset(report);
+  TEST_ASSERT_TRUE(statusFullDue(report, 0x100));
+}
+
+void test_thresholds() {
+  reset();
+  TEST_ASSERT_EQUAL_HEX32(0, statusChangedFields(report, sample));
+
+  sample.value[STATUS_WIFI_RSSI] = -60 - (STATUS_DELTA_RSSI - 1);
+  sample.value[STATUS_FREE_HEAP] = 40000 + STATUS_DELTA_HEAP - 1;
+  TEST_ASSERT_EQUAL_HEX32(0, statusChangedFields(report, sample));
+
+  sample.value[STATUS_WIFI_RSSI] = -60 - STATUS_DELTA_RSSI;
+  sample.value[STATUS_FREE_HEAP] = 40000 - STATUS_DELTA_HEAP;
+  TEST_ASSERT_EQUAL_HEX32((1u << STATUS_WIFI_RSSI) | (1u << STATUS_FREE_HEAP),
+                          statusChangedFields(report, sample));
+}
+
+void test_drift_adds_up() {
+  reset();
+  // Each step is below the threshold, but the value last sent stays the reference
+  for (int step = 1; step < STATUS_DELTA_STACK; step++) {
+    sample.value[STATUS_FREE_STACK] = 2800 - step;
+    TEST_ASSERT_EQUAL_HEX32(0, statusChangedFields(report, sample));
+  }
+  sample.value[STATUS_FREE_STACK] = 2800 - STATUS_DELTA_STACK;
+  TEST_ASSERT_EQUAL_HEX32(1u << STATUS_FREE_STACK, statusChangedFields(report, sample));
+
+  // Only the fields a report carried become the new reference
+  sample.value[STATUS_WIFI_RSSI] = -62;
+  statusReported(report, sample, 1u << STATUS_FREE_STACK, 0, false, 2000);
+  TEST_ASSERT_EQUAL(2800 - STATUS_DELTA_STACK, report.sent.value[STATUS_FREE_STACK]);
+  TEST_ASSERT_EQUAL(-60, report.sent.value[STATUS_WIFI_RSSI]);
+  TEST_ASSERT_EQUAL_HEX32(0, statusChangedFields(report, sample));
+}
+
+void test_zone_changes() {
+  reset();
+  TEST_ASSERT_EQUAL_HEX32(0, statusChangedZones(report, sample));
+  sample.zonesOn = 0x06;  // zone 1 off, zone 2 on
+  TEST_ASSERT_EQUAL_HEX32(0x03, statusChangedZones(report, sample));
+
+  // A report that carried only zone 1 leaves zone 2 pending
+  statusReported(report, sample, 0, 0x01, false, 2000);
+  TEST_ASSERT_EQUAL_HEX32(0x02, statusChangedZones(report, sample));
+}
+
+void test_field_names() {
+  TEST_ASSERT_EQUAL_STRING("free_heap", statusFieldName(STATUS_FREE_HEAP));
+  TEST_ASSERT_EQUAL_STRING("wifi_rssi", statusFieldName(STATUS_WIFI_RSSI));
+  TEST_ASSERT_EQUAL_STRING("min_free_heap", statusFieldName(STATUS_FIRST_SINCE_BOOT));
+  TEST_ASSERT_EQUAL_STRING("min_free_stack", statusFieldName(NUM_STATUS_FIELDS - 1));
+  TEST_ASSERT_EQUAL_STRING("unknown", statusFieldName(NUM_STATUS_FIELDS));
+  TEST_ASSERT_EQUAL_STRING("unknown", statusFieldName(-1));
+}
+
+int runUnityTests() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_full_report_schedule);
+  RUN_TEST(test_thresholds);
+  RUN_TEST(test_drift_adds_up);
+  RUN_TEST(test_zone_changes);
+  RUN_TEST(test_field_names);
+
+  return UNITY_END();
+}
+
+#ifdef NATIVE_BUILD
+int main() {
+  return runUnityTests();
+}
+#else
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  runUnityTests();
+}
+
+void loop() {
+  // Nothing to do here
+}
+#endif
@@ -0,0 +1,113 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "../include/telemetry.h"
+#include "../src/telemetry.cpp"  // test env does not build src/
+
+// Test log2 bucket boundaries
+void test_histogram_buckets() {
+  TEST_ASSERT_EQUAL(0, loopHistogramBucket(0));
+  TEST_ASSERT_EQUAL(0, loopHistogramBucket(1));
+  TEST_ASSERT_EQUAL(1, loopHistogramBucket(2));
+  TEST_ASSERT_EQUAL(1, loopHistogramBucket(3));
+  TEST_ASSERT_EQUAL(2, loopHistogramBucket(4));
+  TEST_ASSERT_EQUAL(9, loopHistogramBucket(1023));
+  TEST_ASSERT_EQUAL(10, loopHistogramBucket(1024));
+
+  // 5 s blocking connect lands in bucket 22 (4.19 s .. 8.39 s)
+  TEST_ASSERT_EQUAL(22, loopHistogramBucket(5000000));
+
+  // Everything beyond the range goes to the last bucket
+  TEST_ASSERT_EQUAL(LOOP_HISTOGRAM_BUCKETS - 1, loopHistogramBucket(0xFFFFFFFF));
+}
+
+// Test phase names used as JSON keys
+void test_phase_names() {
+  TEST_ASSERT_EQUAL_STRING("ota", loopPhaseName(PHASE_OTA));
+  TEST_ASSERT_EQUAL_STRING("connect", loopPhaseName(PHASE_CONNECT));
+  TEST_ASSERT_EQUAL_STRING("mqtt", loopPhaseName(PHASE_MQTT));
+  TEST_ASSERT_EQUAL_STRING("safety", loopPhaseName(PHASE_SAFETY));
+  TEST_ASSERT_EQUAL_STRING("publish", loopPhaseName(PHASE_PUBLISH));
+  TEST_ASSERT_EQUAL_STRING("log", loopPhaseName(PHASE_LOG));
+  TEST_ASSERT_EQUAL_STRING("unknown", loopPhaseName(NUM_LOOP_PHASES));
+  TEST_ASSERT_EQUAL_STRING("unknown", loopPhaseName(-1));
+}
+
+// Test that a slow phase is recorded as the worst phase (uses the cycle counter)
+void test_worst_phase_recorded() {
+  LoopTelemetry t = {};
+  telemetryResetWindow(t, millis());
+
+  // Fast iteration
+  telemetryBeginLoop(t);
+  telemetryEndPhase(t, PHASE_OTA);
+  telemetryEndPhase(t, PHASE_MQTT);
+  telemetryEndLoop(t);
+
+  // Iteration stalled in the connect phase
+  telemetryBeginLoop(t);
+  telemetryEndPhase(t, PHASE_OTA);
+  delayMicroseconds(3000);
+  telemetryEndPhase(t, PHASE_CONNECT);
+  telemetryEndPhase(t, PHASE_SAFETY);
+  telemetryEndLoop(t);
+
+  TEST_ASSERT_EQUAL(2, t.loops);
+  TEST_ASSERT_EQUAL(PHASE_CONNECT, t.worstPhase);
+  TEST_ASSERT_GREATER_OR_EQUAL(3000, t.worstPhaseUs);
+  TEST_ASSERT_GREATER_OR_EQUAL(t.worstPhaseUs, t.maxUs);
+  TEST_ASSERT_EQUAL(1, t.buckets[loopHistogramBucket(t.maxUs)]);
+
+  // Reset keeps the since-boot maximum
+  uint32_t bootMax = t.maxUsSinceBoot;
+  telemetryResetWindow(t, millis());
+  TEST_ASSERT_EQUAL(0, t.loops);
+  TEST_ASSERT_EQUAL(0, t.maxUs);
+  TEST_ASSERT_EQUAL(bootMax, t.maxUsSinceBoot);
+}
+
+// Test that memory sampling keeps the worst values seen
+void test_memory_stats_track_extremes() {
+  MemoryStats m = {};
+  memoryStatsReset(m, millis());
+  TEST_ASSERT_GREATER_THAN(0, m.minFreeHeap);
+  TEST_ASSERT_LESS_OR_EQUAL(m.minFreeHeap, m.minMaxFreeBlock);
+  TEST_ASSERT_LESS_OR_EQUAL(100, m.maxHeapFragmentation);
+  TEST_ASSERT_GREATER_THAN(0, m.minFreeStack);
+
+  // Lower minimums / higher maximum than any real reading must survive
+  m.minFreeHeap = 1;
+  m.minMaxFreeBlock = 1;
+  m.maxHeapFragmentation = 100;
+  m.minFreeStack = 1;
+  memoryStatsSample(m, millis());
+  TEST_ASSERT_EQUAL(1, m.minFreeHeap);
+  TEST_ASSERT_EQUAL(1, m.minMaxFreeBlock);
+  TEST_ASSERT_EQUAL(100, m.maxHeapFragmentation);
+  TEST_ASSERT_EQUAL(1, m.minFreeStack);
+
+  // Higher minimums are pulled down to the current readings
+  m.minFreeHeap = 0xFFFFFFFF;
+  m.minFreeStack = 0xFFFFFFFF;
+  memoryStatsSample(m, millis());
+  TEST_ASSERT_LESS_THAN(0xFFFFFFFF, m.minFreeHeap);
+  TEST_ASSERT_LESS_THAN(0xFFFFFFFF, m.minFreeStack);
+}
+
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  UNITY_BEGIN();
+
+  RUN_TEST(test_histogram_buckets);
+  RUN_TEST(test_phase_names);
+  RUN_TEST(test_worst_phase_recorded);
+  RUN_TEST(test_memory_stats_track_extremes);
+
+  UNITY_END();
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,109 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "../include/token_log.h"
+#include "../src/token_log.cpp"  // test env does not build src/
+
+static uint32_t readU32(const uint8_t* buf) {
+  return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) |
+         ((uint32_t)buf[3] << 24);
+}
+
+// Test record framing and argument encoding
+void test_record_encoding() {
+  tokenlog::reset();
+  const char* format = LOG_FORMAT("zone %d %s %u\n");
+  tokenlog::record(format, 3, "ON", 42u);
+
+  uint8_t out[64];
+  size_t n = tokenlog::take(out, sizeof(out));
+  // header + 'i' int32 + 's' len "ON" + 'u' uint32
+  TEST_ASSERT_EQUAL(tokenlog::kHeaderSize + 5 + 4 + 5, n);
+  TEST_ASSERT_EQUAL_HEX8(LOG_RECORD_SYNC, out[0]);
+  TEST_ASSERT_EQUAL(n - 2, out[1]);
+  TEST_ASSERT_EQUAL((uint32_t)(format - logTokenBase), readU32(out + 2));
+
+  const uint8_t* args = out + tokenlog::kHeaderSize;
+  TEST_ASSERT_EQUAL('i', args[0]);
+  TEST_ASSERT_EQUAL(3, readU32(args + 1));
+  TEST_ASSERT_EQUAL('s', args[5]);
+  TEST_ASSERT_EQUAL(2, args[6]);
+  TEST_ASSERT_EQUAL_MEMORY("ON", args + 7, 2);
+  TEST_ASSERT_EQUAL('u', args[9]);
+  TEST_ASSERT_EQUAL(42, readU32(args + 10));
+
+  TEST_ASSERT_EQUAL(0, tokenlog::take(out, sizeof(out)));
+}
+
+// Test that long strings are truncated to LOG_MAX_STRING
+void test_string_truncation() {
+  tokenlog::reset();
+  char longString[LOG_MAX_STRING + 20];
+  memset(longString, 'a', sizeof(longString) - 1);
+  longString[sizeof(longString) - 1] = '\0';
+  tokenlog::record(LOG_FORMAT("%s"), (const char*)longString);
+
+  uint8_t out[128];
+  size_t n = tokenlog::take(out, sizeof(out));
+  TEST_ASSERT_EQUAL(tokenlog::kHeaderSize + 2 + LOG_MAX_STRING, n);
+  TEST_ASSERT_EQUAL(LOG_MAX_STRING, out[tokenlog::kHeaderSize + 1]);
+}
+
+// Test that a full ring drops records and reports the count once drained
+void test_ring_full_reports_drops() {
+  tokenlog::reset();
+  int pushed = 0;
+  while (tokenlog::ring.dropped == 0) {
+    tokenlog::record(LOG_FORMAT("fill %d\n"), pushed++);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(LOG_RING_SIZE, tokenlog::ring.used);
+  tokenlog::record(LOG_FORMAT("fill %d\n"), pushed++);
+  TEST_ASSERT_EQUAL(2, tokenlog::ring.dropped);
+
+  // Free the ring; the next record is preceded by the drop report
+  uint8_t out[LOG_RING_SIZE];
+  tokenlog::take(out, sizeof(out));
+  tokenlog::record(LOG_FORMAT("after\n"));
+  TEST_ASSERT_EQUAL(0, tokenlog::ring.dropped);
+
+  size_t n = tokenlog::take(out, sizeof(out));
+  TEST_ASSERT_EQUAL(tokenlog::kHeaderSize + 5 + tokenlog::kHeaderSize, n);
+  TEST_ASSERT_EQUAL(LOG_TOKEN_DROPPED, readU32(out + 2));
+  TEST_ASSERT_EQUAL('u', out[tokenlog::kHeaderSize]);
+  TEST_ASSERT_EQUAL(2, readU32(out + tokenlog::kHeaderSize + 1));
+}
+
+// Test that records wrap around the end of the ring intact
+void test_ring_wraparound() {
+  tokenlog::reset();
+  uint8_t out[LOG_RING_SIZE];
+  // Move head/tail close to the end of the buffer
+  for (int i = 0; i < (LOG_RING_SIZE / 15) - 1; i++) {
+    tokenlog::record(LOG_FORMAT("pad %d\n"), i);
+  }
+  tokenlog::take(out, sizeof(out));
+
+  tokenlog::record(LOG_FORMAT("wrap %u %d\n"), 0xDEADBEEFu, -1);
+  size_t n = tokenlog::take(out, sizeof(out));
+  TEST_ASSERT_EQUAL(tokenlog::kHeaderSize + 10, n);
+  TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, readU32(out + tokenlog::kHeaderSize + 1));
+  TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, readU32(out + tokenlog::kHeaderSize + 6));
+}
+
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  UNITY_BEGIN();
+
+  RUN_TEST(test_record_encoding);
+  RUN_TEST(test_string_truncation);
+  RUN_TEST(test_ring_full_reports_drops);
+  RUN_TEST(test_ring_wraparound);
+
+  UNITY_END();
+}
+
+void loop() {
+  // Nothing to do here
+}
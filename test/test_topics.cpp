@@ -0,0 +1,64 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "../include/config.h"
+#include "../include/topics.h"
+
+// The table is generated by the compiler
+static_assert(topics::equal(zoneTopic(ZONE_COMMAND, 1), "home/sprinkler/zone/1/command"),
+              "Command topic for zone 1");
+static_assert(topics::equal(zoneTopic(ZONE_UNIQUE_ID, 3), "sprinkler_zone3"), "Unique ID for zone 3");
+static_assert(zoneTopic(ZONE_STATE, 0) == nullptr, "Zone 0 does not exist");
+static_assert(topics::digits(7) == 1 && topics::digits(10) == 2 && topics::digits(123) == 3,
+              "Decimal digit count");
+
+// Test that every table entry matches the snprintf formats it replaces
+void test_table_matches_snprintf() {
+  char expected[MQTT_TOPIC_BUFFER_SIZE];
+  for (int zone = 1; zone <= NUM_ZONES; zone++) {
+    snprintf(expected, sizeof(expected), "%szone/%d/state", MQTT_TOPIC_PREFIX, zone);
+    TEST_ASSERT_EQUAL_STRING(expected, zoneTopic(ZONE_STATE, zone));
+
+    snprintf(expected, sizeof(expected), "%szone/%d/command", MQTT_TOPIC_PREFIX, zone);
+    TEST_ASSERT_EQUAL_STRING(expected, zoneTopic(ZONE_COMMAND, zone));
+
+    snprintf(expected, sizeof(expected), "homeassistant/switch/sprinkler_zone%d/config", zone);
+    TEST_ASSERT_EQUAL_STRING(expected, zoneTopic(ZONE_DISCOVERY, zone));
+
+    snprintf(expected, sizeof(expected), "sprinkler_zone%d", zone);
+    TEST_ASSERT_EQUAL_STRING(expected, zoneTopic(ZONE_UNIQUE_ID, zone));
+  }
+}
+
+// Test out-of-range lookups
+void test_invalid_lookups() {
+  TEST_ASSERT_NULL(zoneTopic(ZONE_STATE, 0));
+  TEST_ASSERT_NULL(zoneTopic(ZONE_STATE, NUM_ZONES + 1));
+  TEST_ASSERT_NULL(zoneTopic(ZONE_COMMAND, -1));
+  TEST_ASSERT_NULL(zoneTopic(NUM_ZONE_TOPICS, 1));
+}
+
+// Test that lookups return the same constant storage every time
+void test_lookup_is_stable() {
+  const char* first = zoneTopic(ZONE_STATE, 4);
+  TEST_ASSERT_EQUAL_PTR(first, zoneTopic(ZONE_STATE, 4));
+  TEST_ASSERT_EQUAL_PTR(topics::STATE_TOPICS.strings[3], first);
+  TEST_ASSERT_EQUAL(topics::maxLength(ZONE_STATE) + 1, sizeof(topics::STATE_TOPICS.strings[0]));
+}
+
+void setup() {
+  delay(2000);  // Allow board to settle
+
+  Serial.begin(115200);
+
+  UNITY_BEGIN();
+
+  RUN_TEST(test_table_matches_snprintf);
+  RUN_TEST(test_invalid_lookups);
+  RUN_TEST(test_lookup_is_stable);
+
+  UNITY_END();
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,225 @@
+/*
+ * Heap allocation tracer for loop() and the publish paths
+ * =======================================================
+ * Runs the real firmware on the host (virtual clock, RecordingBroker) with the
+ * malloc/operator new hooks from bench_common.cpp and reports:
+ *
+ * - per function: allocations, bytes and peak live heap per call for
+ *   loadConfig(), the MQTT connect sequence, publishHomeAssistantConfig(),
+ *   publishStatus() and callback()
+ * - per loop() iteration, split by what the iteration did (idle, command,
+ *   status publish, reconnect): iterations that allocated, worst allocation
+ *   count/bytes and peak live heap
+ *
+ * Exits with status 1 when a steady-state iteration (anything but reconnect)
+ * allocates more than --max-steady-allocs times, or a reconnect iteration more
+ * than --max-reconnect-allocs times, so it can gate changes in CI. Both default
+ * to 0: the steady-state loop must not touch the heap.
+ *
+ *   pio run -e alloc_trace && .pio/build/alloc_trace/program
+ *
+ * Options (--name=value, times in ms): --iterations, --step-ms, --calls,
+ * --command-every-ms, --drop-every-ms, --max-steady-allocs,
+ * --max-reconnect-allocs
+ *
+ * Only heap use by firmware code and the PubSubClient stand-in is visible;
+ * allocations inside the ESP8266 core, lwIP and the real PubSubClient are not.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+#include "config.h"
+#include "controller.h"
+#include "mqtt_handler.h"
+#include "wifi_setup.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const char kConfigJson[] =
+    "{\"mqtt_server\":\"broker.local\",\"mqtt_port\":\"1883\","
+    "\"mqtt_user\":\"sprinkler\",\"mqtt_password\":\"secret\"}";
+
+bench::RecordingBroker broker;
+
+struct Usage {
+  uint64_t calls = 0;
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+  uint64_t allocatingCalls = 0;
+  uint64_t maxAllocs = 0;
+  uint64_t maxBytes = 0;
+  int64_t maxPeak = 0;  // peak live heap above the level at entry
+
+  void add(const bench::AllocStats& d, int64_t peak) {
+    calls++;
+    allocs += d.count;
+    bytes += d.bytes;
+    if (d.count > 0) {
+      allocatingCalls++;
+    }
+    if (d.count > maxAllocs) {
+      maxAllocs = d.count;
+    }
+    if (d.bytes > maxBytes) {
+      maxBytes = d.bytes;
+    }
+    if (peak > maxPeak) {
+      maxPeak = peak;
+    }
+  }
+};
+
+// Measure one call of fn() and add it to usage
+template <typename Fn>
+void measure(Usage& usage, Fn fn) {
+  bench::resetAllocPeak();
+  bench::AllocStats before = bench::allocStats();
+  fn();
+  bench::AllocStats d = bench::allocStats() - before;
+  usage.add(d, d.peakBytes - before.liveBytes);
+}
+
+void printUsageHeader(const char* first) {
+  printf("  %-28s %10s %12s %12s %12s %10s\n", first, "calls", "allocating", "allocs/call",
+         "bytes/call", "peak heap");
+}
+
+void printUsage(const char* name, const Usage& u) {
+  double calls = u.calls ? static_cast<double>(u.calls) : 1.0;
+  printf("  %-28s %10" PRIu64 " %12" PRIu64 " %12.2f %12.1f %10" PRId64 "\n", name, u.calls,
+         u.allocatingCalls, u.allocs / calls, u.bytes / calls, u.maxPeak);
+}
+
+void toggleZone(int zone, bool on) {
+  char topic[MQTT_TOPIC_BUFFER_SIZE];
+  snprintf(topic, sizeof(topic), "%szone/%d/command", MQTT_TOPIC_PREFIX, zone);
+  const char* payload = on ? "ON" : "OFF";
+  callback(topic, reinterpret_cast<byte*>(const_cast<char*>(payload)),
+           static_cast<unsigned int>(strlen(payload)));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t iterations = bench::argValue(argc, argv, "iterations", 500000);
+  uint32_t stepMs = static_cast<uint32_t>(bench::argValue(argc, argv, "step-ms", 10));
+  uint64_t calls = bench::argValue(argc, argv, "calls", 1000);
+  uint64_t commandEvery = bench::argValue(argc, argv, "command-every-ms", 5000);
+  uint64_t dropEvery = bench::argValue(argc, argv, "drop-every-ms", 15 * 60 * 1000);
+  uint64_t maxSteady = bench::argValue(argc, argv, "max-steady-allocs", 0);
+  uint64_t maxReconnect = bench::argValue(argc, argv, "max-reconnect-allocs", 0);
+
+  hal::native::console.enabled = false;
+  // Past RECONNECT_INTERVAL, so connect attempts are due straight away
+  hal::native::useVirtualClock(RECONNECT_INTERVAL + 1000);
+  hal::native::device().files["/config.json"] = kConfigJson;
+  // An outdated discovery record, so the first pass rewrites it in place
+  // (the device's file system does not allocate from the heap either)
+  uint32_t outdated[NUM_ZONES] = {0};
+  char record[DISCOVERY_RECORD_LENGTH + 1];
+  formatDiscoveryRecord(record, sizeof(record), outdated);
+  hal::native::device().files[DISCOVERY_FINGERPRINT_FILE] = record;
+  hal::native::device().mqtt.link = &broker;
+
+  Usage boot;
+  measure(boot, [] { setup(); });
+
+  // Per-function usage; connect first so publishes reach the broker
+  Usage load, reconnect, discovery, status, command;
+  for (uint64_t i = 0; i < calls; i++) {
+    measure(load, [] { loadConfig(); });
+    mqtt.disconnect();
+    measure(reconnect, [] {
+      // The retry waits somewhere in the reconnect window (mqtt_connect.h)
+      while (!continueMqttConnect()) {
+        hal::native::advanceClock(1);
+      }
+    });
+    measure(discovery, [] { publishHomeAssistantConfig(); });
+    measure(status, [] { publishStatus(); });
+    int zone = static_cast<int>(i % NUM_ZONES) + 1;
+    measure(command, [zone, i] { toggleZone(zone, (i & 1) == 0); });
+  }
+
+  printf("Heap allocations per function (%" PRIu64 " calls each)\n", calls);
+  printUsageHeader("function");
+  printUsage("setup() (once)", boot);
+  printUsage("loadConfig()", load);
+  printUsage("connect (all steps)", reconnect);
+  printUsage("publishHomeAssistantConfig()", discovery);
+  printUsage("publishStatus()", status);
+  printUsage("callback() ON/OFF", command);
+
+  // loop() iterations on the virtual clock with commands and connection drops
+  enum Kind { kIdle, kCommand, kStatus, kReconnect, kKinds };
+  const char* kindNames[kKinds] = {"idle", "command", "status publish", "reconnect"};
+  Usage perKind[kKinds];
+
+  uint64_t nextCommand = commandEvery;
+  uint64_t nextDrop = dropEvery;
+  uint64_t elapsed = 0;
+  int commandCount = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    hal::native::advanceClock(stepMs);
+    elapsed += stepMs;
+    Kind kind = kIdle;
+    if (dropEvery > 0 && elapsed >= nextDrop) {
+      nextDrop += dropEvery;
+      hal::native::dropConnection();
+    }
+    // Queue inbound messages outside the measurement; delivery itself is
+    // part of mqtt.loop() and must not allocate
+    if (commandEvery > 0 && elapsed >= nextCommand) {
+      nextCommand += commandEvery;
+      char topic[MQTT_TOPIC_BUFFER_SIZE];
+      int zone = commandCount % NUM_ZONES + 1;
+      snprintf(topic, sizeof(topic), "%szone/%d/command", MQTT_TOPIC_PREFIX, zone);
+      const char* payload = (commandCount / NUM_ZONES) % 2 == 0 ? "ON" : "OFF";
+      if (hal::native::deliver(topic, payload, strlen(payload))) {
+        kind = kCommand;
+      }
+      commandCount++;
+    }
+
+    uint64_t connectsBefore = broker.connects;
+    uint32_t statusBefore = controller.lastStatusReport;
+    bench::resetAllocPeak();
+    bench::AllocStats before = bench::allocStats();
+    loop();
+    bench::AllocStats d = bench::allocStats() - before;
+
+    if (broker.connects != connectsBefore) {
+      kind = kReconnect;
+    } else if (controller.lastStatusReport != statusBefore) {
+      kind = kStatus;
+    }
+    perKind[kind].add(d, d.peakBytes - before.liveBytes);
+  }
+
+  printf("\nHeap allocations per loop() iteration (%" PRIu64 " iterations, %u ms steps)\n",
+         iterations, stepMs);
+  printUsageHeader("iteration kind");
+  for (int k = 0; k < kKinds; k++) {
+    printUsage(kindNames[k], perKind[k]);
+  }
+
+  bool failed = false;
+  for (int k = 0; k < kKinds; k++) {
+    uint64_t limit = (k == kReconnect) ? maxReconnect : maxSteady;
+    if (perKind[k].maxAllocs > limit) {
+      printf("\nFAIL: %s iteration made %" PRIu64 " allocations (limit %" PRIu64 ")\n",
+             kindNames[k], perKind[k].maxAllocs, limit);
+      failed = true;
+    }
+  }
+  if (!failed) {
+    printf("\nOK: steady-state <= %" PRIu64 ", reconnect <= %" PRIu64 " allocations per iteration\n",
+           maxSteady, maxReconnect);
+  }
+  return failed ? 1 : 0;
+}
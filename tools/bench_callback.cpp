@@ -0,0 +1,123 @@
+/*
+ * Microbenchmark for the MQTT command path: callback() in src/main.cpp
+ * =====================================================================
+ * Drives the real callback(char*, byte*, unsigned int) with synthetic
+ * home/sprinkler/zone/N/command messages on the host and reports, per message:
+ * wall time, instructions, branches, branch misses, heap allocations and
+ * MQTT publishes. mqtt.publish() goes to a RecordingBroker that only counts;
+ * state replies are queued (publish_queue.h) and sent from loop(), which this
+ * benchmark does not run, so the publish column should read 0.
+ *
+ *   pio run -e bench_callback && .pio/build/bench_callback/program [--messages=N]
+ *
+ * Branch/instruction counts need perf_event_open (Linux, perf_event_paranoid
+ * <= 2); they print as n/a otherwise.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+#include "config.h"
+#include "mqtt_handler.h"
+
+namespace {
+
+const size_t kTableSize = 64;  // power of two: message index is i & (kTableSize - 1)
+
+struct Message {
+  char topic[MQTT_TOPIC_BUFFER_SIZE];
+  byte payload[32];
+  unsigned int length;
+};
+
+struct Scenario {
+  const char* name;
+  const char* payloads[4];
+  int firstZone;   // zones cycle firstZone .. firstZone + zoneCount - 1
+  int zoneCount;
+};
+
+// Mix of what the controller sees in the field plus the rejection paths
+const Scenario kScenarios[] = {
+  {"on/off upper",       {"ON", "OFF", "ON", "OFF"},             1, NUM_ZONES},
+  {"on/off mixed case",  {"on", "Off", "oN", "off"},             1, NUM_ZONES},
+  {"numeric 1/0",        {"1", "0", "1", "0"},                   1, NUM_ZONES},
+  {"unknown payload",    {"TOGGLE", "", "2", "of"},              1, NUM_ZONES},
+  {"oversized payload",  {"ONONONONONONONONONON", "OFFOFFOFFOFFOFF", "1111111111", "ON "}, 1, NUM_ZONES},
+  {"invalid zone",       {"ON", "OFF", "ON", "OFF"},             NUM_ZONES + 1, 4},
+};
+
+Message table[kTableSize];
+bench::RecordingBroker broker;
+
+void buildTable(const Scenario& scenario) {
+  for (size_t i = 0; i < kTableSize; i++) {
+    Message& m = table[i];
+    int zone = scenario.firstZone + static_cast<int>(i % scenario.zoneCount);
+    snprintf(m.topic, sizeof(m.topic), "%szone/%d/command", MQTT_TOPIC_PREFIX, zone);
+    const char* payload = scenario.payloads[i % 4];
+    m.length = static_cast<unsigned int>(strlen(payload));
+    memcpy(m.payload, payload, m.length);
+  }
+}
+
+void runScenario(const Scenario& scenario, uint64_t messages, bench::PerfCounters& perf) {
+  buildTable(scenario);
+
+  // Warm up caches and branch predictors
+  for (uint64_t i = 0; i < messages / 10; i++) {
+    Message& m = table[i & (kTableSize - 1)];
+    callback(m.topic, m.payload, m.length);
+  }
+
+  broker.reset();
+  bench::AllocStats allocBefore = bench::allocStats();
+  bench::BenchTimer timer;
+  perf.start();
+  timer.start();
+  for (uint64_t i = 0; i < messages; i++) {
+    Message& m = table[i & (kTableSize - 1)];
+    callback(m.topic, m.payload, m.length);
+  }
+  uint64_t ns = timer.elapsedNs();
+  bench::PerfSample sample = perf.stop();
+  bench::AllocStats allocs = bench::allocStats() - allocBefore;
+
+  double n = static_cast<double>(messages);
+  printf("%-20s %9.1f", scenario.name, ns / n);
+  if (perf.available()) {
+    printf(" %9.1f %9.1f %9.3f", sample.instructions / n, sample.branches / n,
+           sample.branchMisses / n);
+  } else {
+    printf(" %9s %9s %9s", "n/a", "n/a", "n/a");
+  }
+  printf(" %9.3f %9.3f\n", allocs.count / n, broker.publishes / n);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t messages = bench::argValue(argc, argv, "messages", 5000000);
+
+  hal::native::console.enabled = false;
+  hal::native::useVirtualClock(RECONNECT_INTERVAL + 1000);
+  hal::native::device().mqtt.link = &broker;
+  for (int i = 0; i < NUM_ZONES; i++) {
+    hal::gpioOutput(ZONE_PINS[i]);
+  }
+  while (!continueMqttConnect()) {
+  }
+
+  bench::PerfCounters perf;
+  printf("callback() benchmark: %llu messages per scenario\n",
+         static_cast<unsigned long long>(messages));
+  printf("%-20s %9s %9s %9s %9s %9s %9s\n", "scenario", "ns/msg", "instr", "branches",
+         "br-miss", "allocs", "publish");
+  for (const Scenario& scenario : kScenarios) {
+    runScenario(scenario, messages, perf);
+  }
+  if (!perf.available()) {
+    printf("(hardware counters unavailable: perf_event_open denied)\n");
+  }
+  return 0;
+}
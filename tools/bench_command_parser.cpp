@@ -0,0 +1,246 @@
+/*
+ * Microbenchmark: zone command parsing, old callback() logic vs command_parser
+ * ============================================================================
+ * The "legacy" column is the parsing that callback() did before
+ * command_parser.h: copy the payload into message[MQTT_MESSAGE_BUFFER_SIZE],
+ * make an upper-case copy, strstr() for "/zone/" and "/command", atoi() and
+ * strcmp() per verb. The "parser" column is what callback() does now: the
+ * zone command route of a dispatcher (dispatcher.h), marked fast as in ROUTES,
+ * captures the zone, then parseZoneCommand() reads the raw payload. Both only
+ * classify; nothing is switched or published, so the numbers are the parsing
+ * cost alone.
+ *
+ * Host -O2 results (x86-64, noisy): zone command scenarios 14-18 ns against
+ * 27-45 ns for the legacy code (about 2x), other topics 19-21 ns against
+ * 19-31 ns.
+ *
+ * Before timing, every message of every scenario and a set of random
+ * topics/payloads are run through both and any disagreement is listed. The
+ * parser is stricter by design (exact topic layout, and a NUL byte inside the
+ * payload no longer ends it early); all other disagreements are bugs and make
+ * the program exit with status 1.
+ *
+ *   pio run -e bench_parser && .pio/build/bench_parser/program [--messages=N] [--fuzz=N]
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include "bench_common.h"
+#include "command_parser.h"
+#include "config.h"
+#include "dispatcher.h"
+
+namespace {
+
+const size_t kTableSize = 64;  // power of two: message index is i & (kTableSize - 1)
+
+struct Message {
+  char topic[MQTT_TOPIC_BUFFER_SIZE];
+  uint8_t payload[32];
+  unsigned int length;
+};
+
+struct Scenario {
+  const char* name;
+  const char* topicFormat;  // %d is the zone (%.0d with zone 0: no number)
+  const char* payloads[4];
+  int firstZone;
+  int zoneCount;
+};
+
+const Scenario kScenarios[] = {
+  {"on/off upper",      MQTT_TOPIC_PREFIX "zone/%d/command", {"ON", "OFF", "ON", "OFF"}, 1, NUM_ZONES},
+  {"on/off mixed case", MQTT_TOPIC_PREFIX "zone/%d/command", {"on", "Off", "oN", "off"}, 1, NUM_ZONES},
+  {"numeric 1/0",       MQTT_TOPIC_PREFIX "zone/%d/command", {"1", "0", "1", "0"}, 1, NUM_ZONES},
+  {"unknown payload",   MQTT_TOPIC_PREFIX "zone/%d/command", {"TOGGLE", "", "2", "of"}, 1, NUM_ZONES},
+  {"oversized payload", MQTT_TOPIC_PREFIX "zone/%d/command",
+   {"ONONONONONONONONONON", "OFFOFFOFFOFFOFF", "1111111111", "ON "}, 1, NUM_ZONES},
+  {"invalid zone",      MQTT_TOPIC_PREFIX "zone/%d/command", {"ON", "OFF", "ON", "OFF"}, NUM_ZONES + 1, 4},
+  {"other topic",       MQTT_TOPIC_PREFIX "profile/command%.0d", {"dump", "reset", "dump", "x"}, 0, 1},
+};
+
+struct Result {
+  int zone;
+  ZoneCommand command;
+};
+
+// What callback() decided before command_parser.h (zone 0: ignored)
+Result legacyParse(const char* topic, const uint8_t* payload, unsigned int length) {
+  Result result = {0, ZONE_CMD_UNKNOWN};
+  char message[MQTT_MESSAGE_BUFFER_SIZE];
+  if (length >= sizeof(message)) {
+    length = sizeof(message) - 1;
+  }
+  memcpy(message, payload, length);
+  message[length] = '\0';
+
+  const char* zonePrefix = "/zone/";
+  const char* zonePrefixPos = strstr(topic, zonePrefix);
+  const char* commandSuffix = strstr(topic, "/command");
+  if (zonePrefixPos && commandSuffix && commandSuffix > zonePrefixPos) {
+    int zone = atoi(zonePrefixPos + strlen(zonePrefix));
+    if (zone > 0 && zone <= NUM_ZONES) {
+      char upperMessage[MQTT_MESSAGE_BUFFER_SIZE];
+      for (unsigned int i = 0; message[i] && i < sizeof(upperMessage) - 1; i++) {
+        upperMessage[i] = toupper(message[i]);
+      }
+      upperMessage[length] = '\0';
+      result.zone = zone;
+      if (strcmp(upperMessage, "ON") == 0 || strcmp(message, "1") == 0) {
+        result.command = ZONE_CMD_ON;
+      } else if (strcmp(upperMessage, "OFF") == 0 || strcmp(message, "0") == 0) {
+        result.command = ZONE_CMD_OFF;
+      }
+    }
+  }
+  return result;
+}
+
+Result routed;
+
+// routeZoneCommand() and the zone check of handleZoneCommand() in main.cpp
+void classifyZoneCommand(const TopicMatch& match, const uint8_t* payload, unsigned int length) {
+  int zone = match.captureInt(0);
+  if (zone >= 1 && zone <= NUM_ZONES) {
+    routed.zone = zone;
+    routed.command = parseZoneCommand(payload, length);
+  }
+}
+
+constexpr TopicRoute ROUTES[] = {
+  {MQTT_ZONE_COMMAND, classifyZoneCommand, 0, false, true},  // fast, as in ROUTES
+};
+constexpr TopicDispatcher<topicNodeBound(ROUTES), topicIndexSize(ROUTES)> dispatcher(ROUTES, 1);
+static_assert(dispatcher.valid, "invalid benchmark route table");
+
+Result parserParse(const char* topic, const uint8_t* payload, unsigned int length) {
+  routed = {0, ZONE_CMD_UNKNOWN};
+  dispatcher.dispatch(topic, payload, length);
+  return routed;
+}
+
+// Differences that are intended: the parser does not stop at an embedded NUL
+// in the payload, and it only accepts the exact topic layout (the old
+// strstr/atoi accepted "/zone/" and "/command" anywhere in the topic)
+bool expectedDifference(const char* topic, const uint8_t* payload, unsigned int length) {
+  if (memchr(payload, '\0', length)) {
+    return true;
+  }
+  const char* prefix = MQTT_TOPIC_PREFIX "zone/";
+  if (strncmp(topic, prefix, strlen(prefix)) != 0) {
+    return true;
+  }
+  const char* p = topic + strlen(prefix);
+  if (!isdigit((unsigned char)*p)) {
+    return true;
+  }
+  while (isdigit((unsigned char)*p)) {
+    p++;
+  }
+  return strcmp(p, "/command") != 0;
+}
+
+Message table[kTableSize];
+
+void buildTable(const Scenario& scenario) {
+  for (size_t i = 0; i < kTableSize; i++) {
+    Message& m = table[i];
+    int zone = scenario.firstZone + static_cast<int>(i % scenario.zoneCount);
+    snprintf(m.topic, sizeof(m.topic), scenario.topicFormat, zone);
+    const char* payload = scenario.payloads[i % 4];
+    m.length = static_cast<unsigned int>(strlen(payload));
+    memcpy(m.payload, payload, m.length);
+  }
+}
+
+int compare(const char* topic, const uint8_t* payload, unsigned int length, int& expected) {
+  Result a = legacyParse(topic, payload, length);
+  Result b = parserParse(topic, payload, length);
+  if (a.zone == b.zone && a.command == b.command) {
+    return 0;
+  }
+  if (expectedDifference(topic, payload, length)) {
+    expected++;
+    return 0;
+  }
+  printf("  MISMATCH topic=\"%s\" payload=\"%.*s\" (%u bytes): legacy zone %d cmd %d, parser zone %d cmd %d\n",
+         topic, (int)length, (const char*)payload, length, a.zone, a.command, b.zone, b.command);
+  return 1;
+}
+
+int checkEquivalence(uint64_t fuzz) {
+  int mismatches = 0;
+  int expected = 0;
+  for (const Scenario& scenario : kScenarios) {
+    buildTable(scenario);
+    for (const Message& m : table) {
+      mismatches += compare(m.topic, m.payload, m.length, expected);
+    }
+  }
+
+  // Random payloads of verb-like bytes on valid and near-valid topics
+  std::mt19937 rng(12345);
+  const char alphabet[] = "oOnNfF01 \t2xX";
+  const char* topicForms[] = {
+    MQTT_TOPIC_PREFIX "zone/%d/command", MQTT_TOPIC_PREFIX "zone/%d/commandx",
+    MQTT_TOPIC_PREFIX "zone/0%d/command", "other/zone/%d/command", MQTT_TOPIC_PREFIX "zone/%d/state",
+  };
+  char topic[MQTT_TOPIC_BUFFER_SIZE];
+  uint8_t payload[12];
+  for (uint64_t i = 0; i < fuzz; i++) {
+    snprintf(topic, sizeof(topic), topicForms[rng() % 5], static_cast<int>(rng() % (NUM_ZONES + 2)));
+    unsigned int length = rng() % sizeof(payload);
+    for (unsigned int k = 0; k < length; k++) {
+      payload[k] = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+    mismatches += compare(topic, payload, length, expected);
+  }
+  printf("equivalence: %d unexpected mismatches, %d intended differences\n", mismatches, expected);
+  return mismatches;
+}
+
+volatile int sink;
+
+template <typename Parse>
+double timeParse(Parse parse, uint64_t messages) {
+  int acc = 0;
+  for (uint64_t i = 0; i < messages / 10; i++) {
+    const Message& m = table[i & (kTableSize - 1)];
+    Result r = parse(m.topic, m.payload, m.length);
+    acc += r.zone + r.command;
+  }
+  bench::BenchTimer timer;
+  timer.start();
+  for (uint64_t i = 0; i < messages; i++) {
+    const Message& m = table[i & (kTableSize - 1)];
+    Result r = parse(m.topic, m.payload, m.length);
+    acc += r.zone + r.command;
+  }
+  uint64_t ns = timer.elapsedNs();
+  sink = acc;
+  return static_cast<double>(ns) / messages;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t messages = bench::argValue(argc, argv, "messages", 5000000);
+  uint64_t fuzz = bench::argValue(argc, argv, "fuzz", 200000);
+
+  int mismatches = checkEquivalence(fuzz);
+
+  printf("zone command parsing: %llu messages per scenario\n"
+         "legacy: payload copies, strstr(), atoi(), strcmp(); parser: fast route + parseZoneCommand()\n",
+         static_cast<unsigned long long>(messages));
+  printf("%-20s %12s %12s %9s\n", "scenario", "legacy ns", "parser ns", "speedup");
+  for (const Scenario& scenario : kScenarios) {
+    buildTable(scenario);
+    double legacy = timeParse(legacyParse, messages);
+    double parser = timeParse(parserParse, messages);
+    printf("%-20s %12.1f %12.1f %8.1fx\n", scenario.name, legacy, parser, legacy / parser);
+  }
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * Implementation of the shared benchmark helpers (see bench_common.h).
+ */
+
+#include "bench_common.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace bench {
+
+// ---------------------------------------------------------------------------
+// Allocation hooks
+// ---------------------------------------------------------------------------
+
+namespace {
+
+std::atomic<uint64_t> allocCount(0);
+std::atomic<uint64_t> allocBytes(0);
+std::atomic<uint64_t> freeCount(0);
+std::atomic<int64_t> liveBytes(0);
+std::atomic<int64_t> peakBytes(0);
+
+void noteAlloc(void* p, size_t requested) {
+  if (!p) {
+    return;
+  }
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  allocBytes.fetch_add(requested, std::memory_order_relaxed);
+#if defined(__GLIBC__)
+  int64_t usable = static_cast<int64_t>(malloc_usable_size(p));
+  int64_t live = liveBytes.fetch_add(usable, std::memory_order_relaxed) + usable;
+  if (live > peakBytes.load(std::memory_order_relaxed)) {
+    peakBytes.store(live, std::memory_order_relaxed);
+  }
+#endif
+}
+
+void noteFree(void* p) {
+  if (!p) {
+    return;
+  }
+  freeCount.fetch_add(1, std::memory_order_relaxed);
+#if defined(__GLIBC__)
+  liveBytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+#endif
+}
+
+}  // namespace
+
+AllocStats allocStats() {
+  AllocStats s;
+  s.count = allocCount.load(std::memory_order_relaxed);
+  s.bytes = allocBytes.load(std::memory_order_relaxed);
+  s.frees = freeCount.load(std::memory_order_relaxed);
+  s.liveBytes = liveBytes.load(std::memory_order_relaxed);
+  s.peakBytes = peakBytes.load(std::memory_order_relaxed);
+  return s;
+}
+
+void resetAllocPeak() {
+  peakBytes.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Hardware performance counters
+// ---------------------------------------------------------------------------
+
+#if defined(__linux__)
+
+static int openCounter(uint64_t config, int groupFd) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.disabled = (groupFd == -1) ? 1 : 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+
+PerfCounters::PerfCounters() : available_(false) {
+  fds_[0] = openCounter(PERF_COUNT_HW_INSTRUCTIONS, -1);
+  fds_[1] = fds_[0] >= 0 ? openCounter(PERF_COUNT_HW_BRANCH_INSTRUCTIONS, fds_[0]) : -1;
+  fds_[2] = fds_[0] >= 0 ? openCounter(PERF_COUNT_HW_BRANCH_MISSES, fds_[0]) : -1;
+  available_ = fds_[0] >= 0 && fds_[1] >= 0 && fds_[2] >= 0;
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+void PerfCounters::start() {
+  if (!available_) {
+    return;
+  }
+  ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfSample PerfCounters::stop() {
+  PerfSample sample = {0, 0, 0};
+  if (!available_) {
+    return sample;
+  }
+  ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  uint64_t values[3] = {0, 0, 0};
+  for (int i = 0; i < 3; i++) {
+    if (read(fds_[i], &values[i], sizeof(values[i])) != sizeof(values[i])) {
+      values[i] = 0;
+    }
+  }
+  sample.instructions = values[0];
+  sample.branches = values[1];
+  sample.branchMisses = values[2];
+  return sample;
+}
+
+#else  // !__linux__
+
+PerfCounters::PerfCounters() : available_(false) {
+  fds_[0] = fds_[1] = fds_[2] = -1;
+}
+PerfCounters::~PerfCounters() {}
+void PerfCounters::start() {}
+PerfSample PerfCounters::stop() {
+  PerfSample sample = {0, 0, 0};
+  return sample;
+}
+
+#endif  // __linux__
+
+// ---------------------------------------------------------------------------
+// RecordingBroker
+// ---------------------------------------------------------------------------
+
+bool RecordingBroker::connect(const hal::native::ConnectOptions& options) {
+  (void)options;
+  connects++;
+  return true;
+}
+
+bool RecordingBroker::publish(const char* topic, const uint8_t* payload, size_t length,
+                              bool retained) {
+  publishes++;
+  if (retained) {
+    retainedPublishes++;
+  }
+  payloadBytes += length;
+  strncpy(lastTopic, topic, kTopicLen - 1);
+  lastTopic[kTopicLen - 1] = '\0';
+  size_t n = length < kPayloadLen - 1 ? length : kPayloadLen - 1;
+  memcpy(lastPayload, payload, n);
+  lastPayload[n] = '\0';
+  return true;
+}
+
+bool RecordingBroker::subscribe(const char* topic, uint8_t qos) {
+  (void)topic;
+  (void)qos;
+  subscribes++;
+  return true;
+}
+
+void RecordingBroker::reset() {
+  connects = publishes = retainedPublishes = subscribes = payloadBytes = 0;
+  lastTopic[0] = '\0';
+  lastPayload[0] = '\0';
+}
+
+uint64_t argValue(int argc, char** argv, const char* name, uint64_t fallback) {
+  size_t nameLen = strlen(name);
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--", 2) == 0 && strncmp(argv[i] + 2, name, nameLen) == 0 &&
+        argv[i][2 + nameLen] == '=') {
+      return strtoull(argv[i] + 3 + nameLen, nullptr, 10);
+    }
+  }
+  return fallback;
+}
+
+}  // namespace bench
+
+// ---------------------------------------------------------------------------
+// glibc malloc interposition (operator new goes through malloc)
+// ---------------------------------------------------------------------------
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) {
+  void* p = __libc_malloc(size);
+  bench::noteAlloc(p, size);
+  return p;
+}
+
+void* calloc(size_t n, size_t size) {
+  void* p = __libc_calloc(n, size);
+  bench::noteAlloc(p, n * size);
+  return p;
+}
+
+void* realloc(void* p, size_t size) {
+  bench::noteFree(p);
+  void* q = __libc_realloc(p, size);
+  bench::noteAlloc(q, size);
+  return q;
+}
+
+void free(void* p) {
+  bench::noteFree(p);
+  __libc_free(p);
+}
+}
+
+#endif  // __GLIBC__
@@ -0,0 +1,100 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+/*
+ * Shared helpers for the host benchmarks in tools/ (native environments only)
+ *
+ * - BenchTimer     wall-clock nanoseconds via std::chrono::steady_clock
+ * - PerfCounters   instructions/branches/branch-misses via perf_event_open
+ *                  (Linux; reports unavailable inside most containers/VMs)
+ * - AllocStats     global malloc/operator new counters; the hooks live in
+ *                  tools/bench_common.cpp and cost one atomic add per call
+ * - RecordingBroker  hal::native::BrokerLink that counts publishes without
+ *                  allocating, so it never shows up in the numbers
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include "hal.h"
+
+namespace bench {
+
+class BenchTimer {
+ public:
+  void start() { start_ = std::chrono::steady_clock::now(); }
+  uint64_t elapsedNs() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+struct PerfSample {
+  uint64_t instructions;
+  uint64_t branches;
+  uint64_t branchMisses;
+};
+
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters();
+  bool available() const { return available_; }
+  void start();
+  PerfSample stop();
+
+ private:
+  int fds_[3];
+  bool available_;
+};
+
+struct AllocStats {
+  uint64_t count;      // malloc/calloc/realloc/new calls
+  uint64_t bytes;      // bytes requested
+  uint64_t frees;      // free/delete calls
+  int64_t liveBytes;   // requested minus released (approximate for realloc)
+  int64_t peakBytes;   // high-water mark of liveBytes since resetAllocPeak()
+};
+
+AllocStats allocStats();
+void resetAllocPeak();
+
+// Difference between two snapshots (peak is taken from the later one)
+inline AllocStats operator-(const AllocStats& a, const AllocStats& b) {
+  AllocStats d;
+  d.count = a.count - b.count;
+  d.bytes = a.bytes - b.bytes;
+  d.frees = a.frees - b.frees;
+  d.liveBytes = a.liveBytes - b.liveBytes;
+  d.peakBytes = a.peakBytes;
+  return d;
+}
+
+class RecordingBroker : public hal::native::BrokerLink {
+ public:
+  static const size_t kTopicLen = 64;
+  static const size_t kPayloadLen = 64;
+
+  uint64_t connects = 0;
+  uint64_t publishes = 0;
+  uint64_t retainedPublishes = 0;
+  uint64_t subscribes = 0;
+  uint64_t payloadBytes = 0;
+  char lastTopic[kTopicLen] = "";
+  char lastPayload[kPayloadLen] = "";
+
+  bool connect(const hal::native::ConnectOptions& options) override;
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) override;
+  bool subscribe(const char* topic, uint8_t qos) override;
+  void reset();
+};
+
+// Parse "--name=value" style unsigned options; returns fallback if absent
+uint64_t argValue(int argc, char** argv, const char* name, uint64_t fallback);
+
+}  // namespace bench
+
+#endif  // BENCH_COMMON_H
@@ -0,0 +1,222 @@
+/*
+ * Microbenchmark: topic routing cost as routes are added (dispatcher.h)
+ * =====================================================================
+ * The firmware's three routes come first (zone commands on the fast route, as
+ * in ROUTES), followed by synthetic routes in groups of four shapes (deep
+ * literal under a shared node, a new first-level node with '+', a '#' route,
+ * a route outside home/sprinkler/). Each table size is routed two ways:
+ *
+ *   trie    TopicDispatcher built by the compiler (what callback() uses)
+ *   linear  every pattern tried in turn with a wildcard matcher, which is
+ *           what adding topics to a strcmp()/strstr() chain amounts to
+ *
+ * for the zone command topic (first route: best case for linear), the last
+ * route of the table and a topic no route matches (worst case for linear).
+ * The trie column should stay flat across table sizes.
+ *
+ * Before timing, every topic is routed both ways and the matched route and
+ * captures compared; any disagreement makes the program exit with status 1.
+ *
+ *   pio run -e bench_dispatcher && .pio/build/bench_dispatcher/program [--messages=N]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+#include "config.h"
+#include "dispatcher.h"
+
+namespace {
+
+volatile unsigned int sink;
+
+void count(const TopicMatch& match, const uint8_t*, unsigned int length) {
+  sink += match.count + length;
+}
+
+#define SYNTHETIC_ROUTES(n)                                    \
+  {MQTT_TOPIC_PREFIX "schedule/" #n "/set", count},            \
+  {MQTT_TOPIC_PREFIX "valve" #n "/+/command", count},          \
+  {MQTT_TOPIC_PREFIX "sensor/" #n "/#", count},                \
+  {"home/other" #n "/status", count}
+
+constexpr TopicRoute ROUTES[] = {
+  {MQTT_ZONE_COMMAND, count, 0, false, true},
+  {MQTT_PROFILE_COMMAND, count},
+  {MQTT_LOG_LEVEL, count},
+  SYNTHETIC_ROUTES(0), SYNTHETIC_ROUTES(1), SYNTHETIC_ROUTES(2), SYNTHETIC_ROUTES(3),
+  SYNTHETIC_ROUTES(4), SYNTHETIC_ROUTES(5), SYNTHETIC_ROUTES(6), SYNTHETIC_ROUTES(7),
+  SYNTHETIC_ROUTES(8), SYNTHETIC_ROUTES(9), SYNTHETIC_ROUTES(10), SYNTHETIC_ROUTES(11),
+  SYNTHETIC_ROUTES(12), SYNTHETIC_ROUTES(13), SYNTHETIC_ROUTES(14), SYNTHETIC_ROUTES(15),
+};
+constexpr size_t NUM_ROUTES = sizeof(ROUTES) / sizeof(ROUTES[0]);
+
+// One dispatcher per table size, over the first Count routes
+template <size_t Count>
+struct Table {
+  static constexpr TopicDispatcher<topicNodeBound(ROUTES), topicIndexSize(ROUTES)> trie{ROUTES, Count};
+  static_assert(trie.valid, "invalid benchmark route table");
+};
+
+// MQTT wildcard match of one pattern, capturing '+' and '#' like the trie
+bool patternMatches(const char* pattern, const char* topic, TopicMatch& match) {
+  match.count = 0;
+  while (true) {
+    if (pattern[0] == '#') {
+      match.capture[match.count] = topic;
+      match.length[match.count++] = static_cast<uint8_t>(strlen(topic));
+      return true;
+    }
+    const char* end = topic;
+    while (*end && *end != '/') {
+      end++;
+    }
+    size_t length = end - topic;
+    if (pattern[0] == '+') {
+      match.capture[match.count] = topic;
+      match.length[match.count++] = static_cast<uint8_t>(length);
+      pattern++;
+    } else {
+      if (strncmp(pattern, topic, length) != 0 || (pattern[length] && pattern[length] != '/')) {
+        return false;
+      }
+      pattern += length;
+    }
+    if (*end == '\0') {
+      // "a/#" also matches "a"
+      if (strcmp(pattern, "/#") == 0) {
+        match.capture[match.count] = end;
+        match.length[match.count++] = 0;
+        return true;
+      }
+      return *pattern == '\0';
+    }
+    if (*pattern != '/') {
+      return false;
+    }
+    pattern++;
+    topic = end + 1;
+  }
+}
+
+int linearFind(size_t routeCount, const char* topic, TopicMatch& match) {
+  for (size_t i = 0; i < routeCount; i++) {
+    if (patternMatches(ROUTES[i].pattern, topic, match)) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+bool linearDispatch(size_t routeCount, const char* topic, const uint8_t* payload, unsigned int length) {
+  TopicMatch match = {};
+  int route = linearFind(routeCount, topic, match);
+  if (route < 0) {
+    return false;
+  }
+  ROUTES[route].handler(match, payload, length);
+  return true;
+}
+
+// A topic that the route's pattern matches ('+' -> "3", '#' -> "a/b")
+void topicFor(const char* pattern, char* topic, size_t size) {
+  size_t n = 0;
+  for (const char* p = pattern; *p && n + 4 < size; p++) {
+    if (*p == '+') {
+      topic[n++] = '3';
+    } else if (*p == '#') {
+      memcpy(topic + n, "a/b", 3);
+      n += 3;
+    } else {
+      topic[n++] = *p;
+    }
+  }
+  topic[n] = '\0';
+}
+
+template <size_t Count>
+int checkTable() {
+  const auto& trie = Table<Count>::trie;
+  char topic[MQTT_TOPIC_BUFFER_SIZE];
+  int mismatches = 0;
+  for (size_t i = 0; i <= NUM_ROUTES + 3; i++) {
+    if (i < NUM_ROUTES) {
+      topicFor(ROUTES[i].pattern, topic, sizeof(topic));
+    } else {
+      const char* extra[] = {MQTT_TOPIC_PREFIX "zone/3", MQTT_TOPIC_PREFIX "sensor/1", "home", "home/sprinkler/"};
+      strcpy(topic, extra[i - NUM_ROUTES]);
+    }
+    TopicMatch a = {};
+    TopicMatch b = {};
+    int expected = linearFind(Count, topic, a);
+    int actual = trie.find(topic, b);
+    bool same = expected == actual && a.count == b.count;
+    for (uint8_t k = 0; same && k < a.count; k++) {
+      same = a.length[k] == b.length[k] && memcmp(a.capture[k], b.capture[k], a.length[k]) == 0;
+    }
+    if (!same) {
+      printf("  MISMATCH (%zu routes) topic=\"%s\": linear route %d, trie route %d\n",
+             Count, topic, expected, actual);
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+template <typename Dispatch>
+double timeDispatch(Dispatch dispatch, const char* topic, uint64_t messages) {
+  const uint8_t payload[] = {'O', 'N'};
+  for (uint64_t i = 0; i < messages / 10; i++) {
+    dispatch(topic, payload, sizeof(payload));
+  }
+  bench::BenchTimer timer;
+  timer.start();
+  for (uint64_t i = 0; i < messages; i++) {
+    dispatch(topic, payload, sizeof(payload));
+  }
+  return static_cast<double>(timer.elapsedNs()) / messages;
+}
+
+template <size_t Count>
+void timeTable(uint64_t messages) {
+  const auto& trie = Table<Count>::trie;
+  char zone[MQTT_TOPIC_BUFFER_SIZE];
+  char last[MQTT_TOPIC_BUFFER_SIZE];
+  topicFor(ROUTES[0].pattern, zone, sizeof(zone));
+  topicFor(ROUTES[Count - 1].pattern, last, sizeof(last));
+  const char* miss = MQTT_TOPIC_PREFIX "zone/3/state";
+  const char* topics[] = {zone, last, miss};
+
+  printf("%6zu", Count);
+  for (const char* topic : topics) {
+    double t = timeDispatch([&](const char* s, const uint8_t* p, unsigned int n) {
+      return trie.dispatch(s, p, n);
+    }, topic, messages);
+    double l = timeDispatch([&](const char* s, const uint8_t* p, unsigned int n) {
+      return linearDispatch(Count, s, p, n);
+    }, topic, messages);
+    printf(" %9.1f %9.1f", t, l);
+  }
+  printf("\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t messages = bench::argValue(argc, argv, "messages", 2000000);
+
+  int mismatches = checkTable<3>() + checkTable<7>() + checkTable<19>() + checkTable<35>() +
+                   checkTable<NUM_ROUTES>();
+  printf("equivalence: %d mismatches\n", mismatches);
+
+  printf("topic routing: %llu messages per cell, ns per message\n",
+         static_cast<unsigned long long>(messages));
+  printf("%6s %19s %19s %19s\n", "routes", "zone command", "last route", "no match");
+  printf("%6s %9s %9s %9s %9s %9s %9s\n", "", "trie", "linear", "trie", "linear", "trie", "linear");
+  timeTable<3>(messages);
+  timeTable<7>(messages);
+  timeTable<19>(messages);
+  timeTable<35>(messages);
+  timeTable<NUM_ROUTES>(messages);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * Benchmark: MQTT client backends over a slow link
+ * ================================================
+ * Runs the real setup()/loop() on the virtual clock against a broker stand-in
+ * that models the link to the broker: one-way latency, bandwidth and the lwIP
+ * socket send buffer (bytes stay in it until the broker's TCP ACK is back, a
+ * round trip after they went out). Built once per client backend
+ * (mqtt_client.h):
+ *
+ * - PubSubClient: a publish that does not fit the send buffer blocks; the
+ *   stand-in advances the clock until ACKs have made room
+ * - asynchronous: the publish is refused and the publish queue retries it.
+ *   A QoS 1 publish is acknowledged a round trip after it reached the broker;
+ *   the in-flight window is swept from 1 to MQTT_INFLIGHT_WINDOW
+ *
+ * Scenarios:
+ * - flood: a zone command every --flood-every-ms, more state changes than
+ *   the link can carry, so the client and the link set the pace
+ * - paced: a zone command every --command-every-ms
+ *
+ * Each reports the zone state messages per second reaching the broker, the
+ * share of commands answered by their own state message (the rest were
+ * coalesced by the publish queue into a later state), their command -> state
+ * latency (command delivered to the device until the broker holds the zone's
+ * new state, which is what Home Assistant waits for) and the longest loop()
+ * iteration.
+ *
+ *   pio run -e bench_mqtt_pubsub && .pio/build/bench_mqtt_pubsub/program
+ *   pio run -e bench_mqtt_async && .pio/build/bench_mqtt_async/program
+ *
+ * Options (all --name=value): --seconds (per scenario), --latency-ms (one
+ * way), --bandwidth (bytes per second), --sndbuf (bytes; lwIP's TCP_SND_BUF,
+ * 2 * 536 with the core's default lower-memory lwIP), --flood-every-ms,
+ * --command-every-ms, --step-ms
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "bench_common.h"
+#include "config.h"
+#include "controller.h"
+#include "mqtt_handler.h"
+#include "topics.h"
+
+void setup();
+void loop();
+
+namespace {
+
+struct Options {
+  uint64_t seconds;
+  uint64_t latencyMs;
+  uint64_t bandwidth;
+  uint64_t sndbuf;
+  uint64_t floodEveryMs;
+  uint64_t commandEveryMs;
+  uint64_t stepMs;
+};
+
+// Zone (1..NUM_ZONES) whose state topic this is, 0 for any other topic
+int stateTopicZone(const char* topic) {
+  for (int zone = 1; zone <= NUM_ZONES; zone++) {
+    if (strcmp(topic, zoneTopic(ZONE_STATE, zone)) == 0) {
+      return zone;
+    }
+  }
+  return 0;
+}
+
+// Broker at the far end of a slow link
+class LinkBroker : public hal::native::BrokerLink {
+ public:
+  void configure(const Options& options) {
+    latencyMs_ = static_cast<double>(options.latencyMs);
+    bytesPerMs_ = options.bandwidth / 1000.0;
+    sndbuf_ = options.sndbuf;
+  }
+
+  // Start measuring: zone commands from now on are timed
+  void resetStats() {
+    stateMessages = 0;
+    commands = 0;
+    refused = 0;
+    latencies.clear();
+    for (int zone = 0; zone <= NUM_ZONES; zone++) {
+      commandAt_[zone] = -1;
+    }
+  }
+
+  // A command for zone reached the device at atMs
+  void commandSent(int zone, bool on, uint32_t atMs) {
+    commands++;
+    commandAt_[zone] = static_cast<double>(atMs);
+    target_[zone] = on;
+  }
+
+  bool connect(const hal::native::ConnectOptions& options) override {
+    (void)options;
+    return true;
+  }
+
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) override {
+    (void)retained;
+    size_t remaining = 2 + strlen(topic) + length;
+#if MQTT_BACKEND == MQTT_BACKEND_ASYNC
+    remaining += 2;  // QoS 1 packet id
+#endif
+    size_t bytes = 1 + (remaining < 128 ? 1 : 2) + remaining;
+
+    double now = hal::millis();
+    release(now);
+    while (buffered_ > 0 && buffered_ + bytes > sndbuf_) {
+#if MQTT_BACKEND == MQTT_BACKEND_ASYNC
+      refused++;
+      return false;
+#else
+      // PubSubClient's write() waits for lwIP to free the buffer
+      uint32_t until = static_cast<uint32_t>(ceil(segments_.front().freedAt));
+      hal::native::setClock(until);
+      now = until;
+      release(now);
+#endif
+    }
+
+    double start = std::max(now, wireFreeAt_);
+    wireFreeAt_ = start + bytes / bytesPerMs_;
+    lastArrival_ = wireFreeAt_ + latencyMs_;
+    segments_.push_back({lastArrival_ + latencyMs_, bytes});
+    buffered_ += bytes;
+
+    int zone = stateTopicZone(topic);
+    if (zone > 0 || strcmp(topic, MQTT_ZONES_STATE) == 0) {
+      stateMessages++;
+    }
+    bool on = length == 2 && memcmp(payload, "ON", 2) == 0;
+    if (zone > 0 && commandAt_[zone] >= 0 && on == target_[zone]) {
+      latencies.push_back(lastArrival_ - commandAt_[zone]);
+      commandAt_[zone] = -1;
+    }
+    return true;
+  }
+
+  uint32_t pubackDelayMs() override {
+    double due = lastArrival_ + latencyMs_ - hal::millis();
+    return due > 0 ? static_cast<uint32_t>(ceil(due)) : 0;
+  }
+
+  uint64_t stateMessages = 0;
+  uint64_t commands = 0;
+  uint64_t refused = 0;
+  std::vector<double> latencies;  // ms, command -> state at the broker
+
+ private:
+  struct Segment {
+    double freedAt;  // the broker's TCP ACK is back
+    size_t bytes;
+  };
+
+  void release(double now) {
+    while (!segments_.empty() && segments_.front().freedAt <= now) {
+      buffered_ -= segments_.front().bytes;
+      segments_.pop_front();
+    }
+  }
+
+  double latencyMs_ = 0;
+  double bytesPerMs_ = 1;
+  size_t sndbuf_ = 0;
+  std::deque<Segment> segments_;
+  size_t buffered_ = 0;
+  double wireFreeAt_ = 0;  // the link is busy sending until then
+  double lastArrival_ = 0;
+  double commandAt_[NUM_ZONES + 1];
+  bool target_[NUM_ZONES + 1] = {false};
+};
+
+LinkBroker broker;
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+// loop() for ms of virtual time; returns the longest iteration
+uint32_t runLoop(const Options& options, uint64_t ms, uint64_t commandEveryMs) {
+  uint32_t worst = 0;
+  uint32_t startMs = hal::millis();
+  uint32_t nextCommandMs = startMs;
+  int zone = 0;
+  bool on[NUM_ZONES + 1] = {false};
+  while (hal::millis() - startMs < ms) {
+    // Commands that arrived while the last loop() ran wait in the inbox
+    while (commandEveryMs > 0 && static_cast<int32_t>(hal::millis() - nextCommandMs) >= 0) {
+      zone = zone % NUM_ZONES + 1;
+      on[zone] = !on[zone];
+      const char* payload = on[zone] ? "ON" : "OFF";
+      if (hal::native::deliver(zoneTopic(ZONE_COMMAND, zone), payload, strlen(payload))) {
+        broker.commandSent(zone, on[zone], nextCommandMs);
+      }
+      nextCommandMs += static_cast<uint32_t>(commandEveryMs);
+    }
+    uint32_t before = hal::millis();
+    loop();
+    worst = std::max(worst, hal::millis() - before);
+    hal::native::advanceClock(static_cast<uint32_t>(options.stepMs));
+  }
+  return worst;
+}
+
+void scenario(const char* name, const char* window, const Options& options,
+              uint64_t commandEveryMs) {
+  // Let the previous scenario's queue and link drain first
+  runLoop(options, 10000, 0);
+  broker.resetStats();
+  uint32_t worst = runLoop(options, options.seconds * 1000, commandEveryMs);
+  double answered = broker.commands ? 100.0 * broker.latencies.size() / broker.commands : 0;
+  printf("  %-8s %6s %12.1f %9.0f%% %8.0f %8.0f %8.0f %10" PRIu32 " %9" PRIu64 "\n", name,
+         window, broker.stateMessages / static_cast<double>(options.seconds), answered,
+         percentile(broker.latencies, 0.5), percentile(broker.latencies, 0.99),
+         percentile(broker.latencies, 1.0), worst, broker.refused);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  options.seconds = bench::argValue(argc, argv, "seconds", 60);
+  options.latencyMs = bench::argValue(argc, argv, "latency-ms", 40);
+  options.bandwidth = bench::argValue(argc, argv, "bandwidth", 20000);
+  options.sndbuf = bench::argValue(argc, argv, "sndbuf", 1072);
+  options.floodEveryMs = bench::argValue(argc, argv, "flood-every-ms", 5);
+  options.commandEveryMs = bench::argValue(argc, argv, "command-every-ms", 250);
+  options.stepMs = bench::argValue(argc, argv, "step-ms", 1);
+  if (options.seconds == 0 || options.bandwidth == 0 || options.stepMs == 0) {
+    fprintf(stderr, "--seconds, --bandwidth and --step-ms must be positive\n");
+    return 2;
+  }
+
+  hal::native::console.enabled = false;
+  hal::native::useVirtualClock(RECONNECT_INTERVAL + 1000);
+  broker.configure(options);
+  hal::native::device().mqtt.link = &broker;
+  setup();
+  while (!continueMqttConnect()) {
+    hal::native::advanceClock(static_cast<uint32_t>(options.stepMs));
+  }
+
+#if MQTT_BACKEND == MQTT_BACKEND_ASYNC
+  printf("MQTT backend: AsyncMqttClient (QoS %d, in-flight window up to %d)\n",
+         MQTT_PUBLISH_QOS, MQTT_INFLIGHT_WINDOW);
+#else
+  printf("MQTT backend: PubSubClient (QoS 0, blocking writes)\n");
+#endif
+  printf("Link: %" PRIu64 " ms one way, %" PRIu64 " bytes/s, %" PRIu64
+         " byte send buffer; %" PRIu64 " s per scenario\n"
+         "Zone commands every %" PRIu64 " ms (flood), %" PRIu64 " ms (paced)\n\n",
+         options.latencyMs, options.bandwidth, options.sndbuf, options.seconds,
+         options.floodEveryMs, options.commandEveryMs);
+  printf("  %-8s %6s %12s %10s %8s %8s %8s %10s %9s\n", "scenario", "window", "state msg/s",
+         "answered", "p50 ms", "p99 ms", "max ms", "worst loop", "refused");
+
+#if MQTT_BACKEND == MQTT_BACKEND_ASYNC
+  std::vector<int> windows;
+  for (int window = 1; MQTT_PUBLISH_QOS > 0 && window < MQTT_INFLIGHT_WINDOW; window *= 2) {
+    windows.push_back(window);
+  }
+  windows.push_back(MQTT_INFLIGHT_WINDOW);
+  for (const char* name : {"flood", "paced"}) {
+    for (int window : windows) {
+      char label[8];
+      snprintf(label, sizeof(label), "%d", window);
+      mqtt.setInflightWindow(static_cast<uint8_t>(window));
+      scenario(name, label, options,
+               strcmp(name, "flood") == 0 ? options.floodEveryMs : options.commandEveryMs);
+    }
+  }
+#else
+  scenario("flood", "-", options, options.floodEveryMs);
+  scenario("paced", "-", options, options.commandEveryMs);
+#endif
+
+  printf("\nanswered: commands whose new state reached the broker before the next\n"
+         "command for that zone (the others were coalesced into the later state).\n"
+         "Latency of those: command delivered -> new zone state at the broker (ms).\n"
+         "worst loop: longest loop() iteration (ms); refused: publishes the TCP stack\n"
+         "had no room for (asynchronous backend; the publish queue retries them).\n");
+  return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Benchmark: status report encodings, JSON vs MessagePack
+ * =======================================================
+ * Runs the real publishStatus() (built with both encodings,
+ * STATUS_ENCODING=3) against a broker stand-in that keeps the payloads, for
+ * a full report and for the delta reports that follow typical changes. For
+ * each captured report it then reports the bytes on the wire of both
+ * encodings and the time ArduinoJson takes to measure and to serialize the
+ * document in each (the streaming publish does both), per call.
+ *
+ * The MessagePack payload is checked against a re-encoding of the JSON one;
+ * a difference means the two topics disagree and exits with status 1.
+ *
+ *   pio run -e bench_status && .pio/build/bench_status/program [--iterations=N]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <ArduinoJson.h>
+#include "bench_common.h"
+#include "config.h"
+#include "controller.h"
+#include "mqtt_handler.h"
+#include "status_report.h"
+
+static_assert(STATUS_ENCODING == (STATUS_ENCODING_JSON | STATUS_ENCODING_MSGPACK),
+              "bench_status needs both encodings (-DSTATUS_ENCODING=3)");
+
+void setup();
+void loop();
+
+namespace {
+
+const size_t kMaxPayload = MQTT_PAYLOAD_BUFFER_SIZE;
+
+// Keeps the last status payload of each encoding
+class CaptureBroker : public hal::native::BrokerLink {
+ public:
+  uint8_t json[kMaxPayload];
+  size_t jsonLength = 0;
+  uint8_t msgpack[kMaxPayload];
+  size_t msgpackLength = 0;
+
+  bool connect(const hal::native::ConnectOptions& options) override {
+    (void)options;
+    return true;
+  }
+
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) override {
+    (void)retained;
+    if (length > kMaxPayload) {
+      return true;
+    }
+    if (strcmp(topic, MQTT_STATUS) == 0 && length > 0 && payload[0] == '{') {
+      memcpy(json, payload, length);
+      jsonLength = length;
+    } else if (strcmp(topic, MQTT_STATUS_MSGPACK) == 0) {
+      memcpy(msgpack, payload, length);
+      msgpackLength = length;
+    }
+    return true;
+  }
+};
+
+CaptureBroker broker;
+DynamicJsonDocument document(4096);
+volatile size_t sink;
+
+template <typename F>
+double nsPerCall(uint64_t iterations, F f) {
+  for (uint64_t i = 0; i < iterations / 10; i++) {
+    sink = f();
+  }
+  bench::BenchTimer timer;
+  timer.start();
+  for (uint64_t i = 0; i < iterations; i++) {
+    sink = f();
+  }
+  return static_cast<double>(timer.elapsedNs()) / iterations;
+}
+
+int report(const char* name, uint64_t iterations) {
+  broker.jsonLength = 0;
+  broker.msgpackLength = 0;
+  publishStatus();
+  if (broker.jsonLength == 0 || broker.msgpackLength == 0) {
+    printf("  %-22s no payload captured\n", name);
+    return 1;
+  }
+  if (deserializeJson(document, broker.json, broker.jsonLength)) {
+    printf("  %-22s JSON payload does not parse\n", name);
+    return 1;
+  }
+
+  uint8_t encoded[kMaxPayload];
+  size_t length = serializeMsgPack(document, encoded, sizeof(encoded));
+  int mismatch = length != broker.msgpackLength || memcmp(encoded, broker.msgpack, length) != 0;
+
+  char text[kMaxPayload + 1];
+  double jsonNs = nsPerCall(iterations, [&] {
+    return measureJson(document) + serializeJson(document, text, sizeof(text));
+  });
+  double msgpackNs = nsPerCall(iterations, [&] {
+    return measureMsgPack(document) + serializeMsgPack(document, encoded, sizeof(encoded));
+  });
+
+  printf("  %-22s %6zu %8zu %7.0f%% %9.0f %9.0f%s\n", name, broker.jsonLength,
+         broker.msgpackLength, 100.0 * broker.msgpackLength / broker.jsonLength, jsonNs,
+         msgpackNs, mismatch ? "  MISMATCH" : "");
+  return mismatch;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t iterations = bench::argValue(argc, argv, "iterations", 100000);
+
+  hal::native::console.enabled = false;
+  hal::native::useVirtualClock(RECONNECT_INTERVAL + 1000);
+  hal::native::device().mqtt.link = &broker;
+  setup();
+  while (!continueMqttConnect()) {
+  }
+
+  printf("Status report encodings (%" PRIu64 " iterations, ns per measure + serialize)\n",
+         iterations);
+  printf("  %-22s %6s %8s %8s %9s %9s\n", "report", "json", "msgpack", "ratio", "json ns",
+         "msgpack ns");
+
+  int failures = 0;
+  failures += report("full", iterations);
+
+  hal::native::advanceClock(STATUS_INTERVAL);
+  failures += report("delta, uptime only", iterations);
+
+  hal::native::advanceClock(STATUS_INTERVAL);
+  hal::native::device().rssi -= STATUS_DELTA_RSSI;
+  hal::native::device().freeHeap -= 2 * STATUS_DELTA_HEAP;
+  failures += report("delta, rssi + heap", iterations);
+
+  hal::native::advanceClock(STATUS_INTERVAL);
+  for (int i = 0; i < NUM_ZONES; i++) {
+    hal::gpioWrite(ZONE_PINS[i], true);
+  }
+  failures += report("delta, all zones", iterations);
+
+  printf("\nJSON bytes are what home/sprinkler/status carries today; msgpack is\n"
+         "home/sprinkler/status/msgpack (decode with tools/status_decode.py).\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * Fleet simulator: many virtual controllers against one broker stand-in
+ * ======================================================================
+ * Instantiates N independent controllers (default 10000) in one process. Each
+ * has its own simulated board (hal::native::Device: pins, chip id, MQTT
+ * session) and its own ControllerState (zone timers, reconnect and status
+ * timers); both are swapped in before its loop() runs. An event loop ticks the
+ * controllers on a shared virtual clock, each with its own boot offset so
+ * millis() differs per device like it does in the field.
+ *
+ * The broker stand-in counts connects and publishes per simulated second and
+ * can be restarted mid-run to reproduce a reconnect storm. While it is down it
+ * does not answer the TCP connect, which blocks the controller for
+ * --connect-timeout-ms or the firmware's MQTT_TCP_TIMEOUT, if shorter. It keeps
+ * each controller's retained discovery record (see discovery.h) and hands it
+ * back on subscribe; --retained-survives=0 models a broker that loses its
+ * retained messages in the restart, so every config is published again.
+ * --reconnect-window-ms makes it hold a retained MQTT_RECONNECT_WINDOW for
+ * every controller, spreading their first attempt after the restart over that
+ * window (mqtt_connect.h).
+ *
+ * The reconnect schedule is the firmware's: backoff with jitter by default,
+ * fixed RECONNECT_INTERVAL attempts in [env:fleet_sim_fixed_interval]
+ * (MQTT_RECONNECT_BACKOFF=false), to compare the two storms.
+ *
+ * Reports:
+ * - broker message rate (mean/peak per second) and connection attempt rate
+ * - discovery burst size from publishHomeAssistantConfig() per connection and
+ *   how many connections had to publish configs at all
+ * - reconnect storm: attempts while down, peak rates after recovery and the
+ *   time until 50/90/100% of the fleet is connected again
+ * - distinct MQTT client ids, and connects that took over another
+ *   controller's session by reusing its id (MQTT_CLIENT_ID_FORMAT)
+ *
+ *   pio run -e fleet_sim && .pio/build/fleet_sim/program --devices=10000
+ *
+ * Options (--name=value, times in ms): --devices, --minutes, --tick-ms,
+ * --boot-spread-ms, --restart-at-ms, --restart-down-ms, --connect-ms,
+ * --connect-timeout-ms, --retained-survives, --reconnect-window-ms, --seed,
+ * --timeline-bucket-ms, --csv=FILE
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_common.h"
+#include "config.h"
+#include "controller.h"
+#include "mqtt_handler.h"
+
+// Devices are swapped under the one global MqttClient; the asynchronous
+// backend keeps connection state in it, PubSubClient's stand-in does not
+static_assert(MQTT_BACKEND == MQTT_BACKEND_PUBSUBCLIENT,
+              "fleet_sim needs the PubSubClient backend");
+
+void setup();
+void loop();
+
+namespace {
+
+const char* kDiscoveryPrefix = "homeassistant/";
+
+uint64_t simNow = 0;  // shared virtual time, ms since simulation start
+
+struct SecondBucket {
+  uint32_t attempts = 0;
+  uint32_t connects = 0;
+  uint32_t messages = 0;
+  uint32_t discovery = 0;
+  uint64_t bytes = 0;
+};
+
+class FleetBroker;
+
+// Per-device BrokerLink so the broker knows which controller is talking
+class DeviceLink : public hal::native::BrokerLink {
+ public:
+  FleetBroker* broker = nullptr;
+  uint32_t index = 0;
+
+  bool open(uint32_t timeoutMs) override;
+  bool connect(const hal::native::ConnectOptions& options) override;
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) override;
+  bool subscribe(const char* topic, uint8_t qos) override;
+};
+
+struct VirtualController {
+  hal::native::Device device;
+  ControllerState state;
+  DeviceLink link;
+  uint64_t bootAt = 0;
+  // Retained MQTT_DISCOVERY_FINGERPRINT on the broker ("" if none)
+  std::string discoveryRecord;
+  // Discovery burst accounting for the current connection
+  uint32_t burstMessages = 0;
+  uint64_t burstBytes = 0;
+};
+
+std::vector<VirtualController> fleet;
+
+class FleetBroker {
+ public:
+  bool up = true;
+  bool retainedSurvives = true;
+  std::string reconnectWindow;  // retained MQTT_RECONNECT_WINDOW ("" if none)
+  uint32_t connectMs = 20;
+  uint32_t connectTimeoutMs = 5000;
+  std::vector<SecondBucket> seconds;
+  uint64_t attempts = 0;
+  uint64_t failedAttempts = 0;
+  uint64_t connected = 0;       // devices currently connected
+  uint64_t discoveryMessages = 0;
+  uint64_t discoveryBytes = 0;
+  uint64_t burstCount = 0;
+  uint32_t maxBurstMessages = 0;
+  uint64_t maxBurstBytes = 0;
+  std::vector<uint64_t> reconnectedAt;  // per device, after the restart
+  std::map<std::string, uint32_t> sessions;  // client id -> device that holds the session
+  uint64_t takeovers = 0;       // connects with a client id another device's session had
+
+  SecondBucket& bucket() {
+    size_t s = static_cast<size_t>(simNow / 1000);
+    if (s >= seconds.size()) {
+      seconds.resize(s + 1);
+    }
+    return seconds[s];
+  }
+
+  bool open(uint32_t timeoutMs) {
+    attempts++;
+    bucket().attempts++;
+    if (!up) {
+      failedAttempts++;
+      hal::native::advanceClock(std::min(connectTimeoutMs, timeoutMs));
+      return false;
+    }
+    hal::native::advanceClock(connectMs);
+    return true;
+  }
+
+  bool connect(uint32_t index, const char* clientId) {
+    if (!up) {
+      failedAttempts++;
+      return false;
+    }
+    hal::native::advanceClock(connectMs);
+    auto session = sessions.insert(std::make_pair(std::string(clientId), index)).first;
+    if (session->second != index) {
+      takeovers++;
+      session->second = index;
+    }
+    bucket().connects++;
+    connected++;
+    VirtualController& vc = fleet[index];
+    closeBurst(vc);
+    if (restarted && reconnectedAt[index] == 0) {
+      reconnectedAt[index] = simNow;
+    }
+    return true;
+  }
+
+  bool publish(uint32_t index, const char* topic, size_t length) {
+    SecondBucket& b = bucket();
+    b.messages++;
+    b.bytes += length;
+    if (strncmp(topic, kDiscoveryPrefix, strlen(kDiscoveryPrefix)) == 0) {
+      b.discovery++;
+      discoveryMessages++;
+      discoveryBytes += length;
+      fleet[index].burstMessages++;
+      fleet[index].burstBytes += length;
+    }
+    return true;
+  }
+
+  void closeBurst(VirtualController& vc) {
+    if (vc.burstMessages > 0) {
+      burstCount++;
+      maxBurstMessages = std::max(maxBurstMessages, vc.burstMessages);
+      maxBurstBytes = std::max(maxBurstBytes, vc.burstBytes);
+    }
+    vc.burstMessages = 0;
+    vc.burstBytes = 0;
+  }
+
+  void goDown() {
+    up = false;
+    restarted = true;
+    reconnectedAt.assign(fleet.size(), 0);
+    for (VirtualController& vc : fleet) {
+      vc.device.mqtt.tcpOpen = false;
+      if (vc.device.mqtt.connected) {
+        vc.device.mqtt.connected = false;
+        vc.device.mqtt.state = MQTT_CONNECTION_LOST;
+        vc.device.mqtt.inbox.clear();
+      }
+    }
+    connected = 0;
+    if (!retainedSurvives) {
+      for (VirtualController& vc : fleet) {
+        vc.discoveryRecord.clear();
+      }
+    }
+  }
+
+  bool restarted = false;
+};
+
+FleetBroker broker;
+
+bool DeviceLink::open(uint32_t timeoutMs) {
+  return broker->open(timeoutMs);
+}
+
+bool DeviceLink::connect(const hal::native::ConnectOptions& options) {
+  return broker->connect(index, options.clientId);
+}
+
+bool DeviceLink::publish(const char* topic, const uint8_t* payload, size_t length,
+                         bool retained) {
+  if (retained && strcmp(topic, MQTT_DISCOVERY_FINGERPRINT) == 0) {
+    fleet[index].discoveryRecord.assign(reinterpret_cast<const char*>(payload), length);
+  }
+  return broker->publish(index, topic, length);
+}
+
+bool DeviceLink::subscribe(const char* topic, uint8_t qos) {
+  (void)qos;
+  // Retained messages go out on subscribe
+  const std::string& record = fleet[index].discoveryRecord;
+  if (!record.empty() && strcmp(topic, MQTT_DISCOVERY_FINGERPRINT) == 0) {
+    hal::native::deliver(topic, record.data(), record.size());
+  }
+  const std::string& window = broker->reconnectWindow;
+  if (!window.empty() && strcmp(topic, MQTT_RECONNECT_WINDOW) == 0) {
+    hal::native::deliver(topic, window.data(), window.size());
+  }
+  return true;
+}
+
+// Run one loop() iteration of a controller at the current simulated time and
+// return how long it took in virtual time (blocking connects included)
+uint64_t tick(VirtualController& vc) {
+  hal::native::selectDevice(&vc.device);
+  controller = vc.state;
+  uint32_t localNow = static_cast<uint32_t>(simNow - vc.bootAt);
+  hal::native::setClock(localNow);
+  loop();
+  vc.state = controller;
+  return static_cast<uint32_t>(hal::millis() - localNow);
+}
+
+uint64_t percentileTime(std::vector<uint64_t> times, double fraction, uint64_t since) {
+  std::sort(times.begin(), times.end());
+  size_t needed = static_cast<size_t>(fraction * times.size());
+  if (needed == 0) {
+    needed = 1;
+  }
+  if (needed > times.size() || times[needed - 1] == 0) {
+    return UINT64_MAX;
+  }
+  return times[needed - 1] - since;
+}
+
+const char* csvArg(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--csv=", 6) == 0) {
+      return argv[i] + 6;
+    }
+  }
+  return nullptr;
+}
+
+void printRate(const char* label, uint64_t total, uint64_t peak, double seconds) {
+  printf("  %-32s total=%-10" PRIu64 " mean=%-9.1f peak=%" PRIu64 "/s\n", label, total,
+         total / seconds, peak);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32_t devices = static_cast<uint32_t>(bench::argValue(argc, argv, "devices", 10000));
+  uint64_t minutes = bench::argValue(argc, argv, "minutes", 20);
+  uint64_t tickMs = std::max<uint64_t>(1, bench::argValue(argc, argv, "tick-ms", 500));
+  uint64_t bootSpread = bench::argValue(argc, argv, "boot-spread-ms", 60000);
+  uint64_t restartAt = bench::argValue(argc, argv, "restart-at-ms", 10ULL * 60 * 1000);
+  uint64_t restartDown = bench::argValue(argc, argv, "restart-down-ms", 30000);
+  uint64_t seed = bench::argValue(argc, argv, "seed", 1);
+  uint64_t bucketMs = std::max<uint64_t>(1000, bench::argValue(argc, argv, "timeline-bucket-ms", 5000));
+  broker.connectMs = static_cast<uint32_t>(bench::argValue(argc, argv, "connect-ms", 20));
+  broker.connectTimeoutMs =
+      static_cast<uint32_t>(bench::argValue(argc, argv, "connect-timeout-ms", 5000));
+  broker.retainedSurvives = bench::argValue(argc, argv, "retained-survives", 1) != 0;
+  uint64_t reconnectWindow = bench::argValue(argc, argv, "reconnect-window-ms", 0);
+  if (reconnectWindow > 0) {
+    broker.reconnectWindow = std::to_string(reconnectWindow);
+  }
+  uint64_t endMs = minutes * 60 * 1000;
+
+  hal::native::console.enabled = false;
+  hal::native::useVirtualClock();
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<uint64_t> bootPick(0, bootSpread);
+  std::uniform_int_distribution<uint64_t> phasePick(0, tickMs - 1);
+
+  typedef std::pair<uint64_t, uint32_t> Wakeup;  // (time, controller index)
+  std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup> > wakeups;
+
+  fleet.resize(devices);
+  for (uint32_t i = 0; i < devices; i++) {
+    VirtualController& vc = fleet[i];
+    vc.device.chipId = 0x00100000 + i;
+    vc.link.broker = &broker;
+    vc.link.index = i;
+    vc.device.mqtt.link = &vc.link;
+    vc.bootAt = bootPick(rng);
+    wakeups.push(Wakeup(vc.bootAt, i));
+  }
+
+  std::vector<bool> booted(devices, false);
+  bool restartDone = false;
+  bool recovered = false;
+  auto wallStart = std::chrono::steady_clock::now();
+  uint64_t ticks = 0;
+
+  while (!wakeups.empty() && wakeups.top().first < endMs) {
+    Wakeup w = wakeups.top();
+    wakeups.pop();
+    simNow = w.first;
+    if (!restartDone && restartDown > 0 && simNow >= restartAt) {
+      broker.goDown();
+      restartDone = true;
+    }
+    if (restartDone && !recovered && simNow >= restartAt + restartDown) {
+      broker.up = true;
+      recovered = true;
+    }
+
+    VirtualController& vc = fleet[w.second];
+    uint64_t busy = 0;
+    if (!booted[w.second]) {
+      hal::native::selectDevice(&vc.device);
+      controller = ControllerState();
+      hal::native::setClock(0);
+      setup();
+      vc.state = controller;
+      booted[w.second] = true;
+      busy = phasePick(rng);
+    } else {
+      busy = tick(vc);
+    }
+    ticks++;
+    wakeups.push(Wakeup(simNow + busy + tickMs, w.second));
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  for (VirtualController& vc : fleet) {
+    broker.closeBurst(vc);
+  }
+  hal::native::selectDevice(nullptr);
+
+  // Aggregate per-second series
+  uint64_t totalMessages = 0, totalConnects = 0, totalBytes = 0;
+  uint64_t peakMessages = 0, peakAttempts = 0, peakConnects = 0, peakDiscovery = 0;
+  uint64_t peakAfterRestart = 0;
+  // Steady state = one full status interval after boot or recovery has settled
+  uint64_t steadyBefore = 0, steadyAfter = 0;
+  uint64_t settleMs = bootSpread + STATUS_INTERVAL;
+  uint64_t recoverySettleMs = restartAt + restartDown + 2 * STATUS_INTERVAL;
+  for (size_t s = 0; s < broker.seconds.size(); s++) {
+    const SecondBucket& b = broker.seconds[s];
+    totalMessages += b.messages;
+    totalConnects += b.connects;
+    totalBytes += b.bytes;
+    peakMessages = std::max<uint64_t>(peakMessages, b.messages);
+    peakAttempts = std::max<uint64_t>(peakAttempts, b.attempts);
+    peakConnects = std::max<uint64_t>(peakConnects, b.connects);
+    peakDiscovery = std::max<uint64_t>(peakDiscovery, b.discovery);
+    if (restartDone && s * 1000 >= restartAt) {
+      peakAfterRestart = std::max<uint64_t>(peakAfterRestart, b.messages);
+    }
+    uint64_t at = s * 1000;
+    if (at >= settleMs && (!restartDone || at < restartAt)) {
+      steadyBefore = std::max<uint64_t>(steadyBefore, b.messages);
+    }
+    if (restartDone && at >= recoverySettleMs) {
+      steadyAfter = std::max<uint64_t>(steadyAfter, b.messages);
+    }
+  }
+  double seconds = static_cast<double>(endMs) / 1000.0;
+
+  printf("Fleet of %u controllers, %" PRIu64 " simulated minutes, tick %" PRIu64
+         " ms: %.2f s wall, %" PRIu64 " loop() calls\n",
+         devices, minutes, tickMs, wall, ticks);
+#if MQTT_RECONNECT_BACKOFF
+  printf("Reconnect backoff with jitter up to %lu ms, window %s ms%s\n",
+         (unsigned long)MQTT_RECONNECT_MAX_MS,
+         reconnectWindow > 0 ? broker.reconnectWindow.c_str()
+                             : std::to_string(MQTT_RECONNECT_WINDOW_MS).c_str(),
+         reconnectWindow > 0 ? " (advertised)" : "");
+#else
+  printf("Reconnect every %d ms, lost connections retried at once\n", RECONNECT_INTERVAL);
+#endif
+  printf("\nBroker load\n");
+  printRate("messages", totalMessages, peakMessages, seconds);
+  printRate("connection attempts", broker.attempts, peakAttempts, seconds);
+  printRate("accepted connects", totalConnects, peakConnects, seconds);
+  printf("  %-32s %.1f KiB/s mean\n", "inbound payload", totalBytes / seconds / 1024.0);
+
+  printf("\nDiscovery (publishHomeAssistantConfig)\n");
+  printf("  %-32s %" PRIu64 " of %" PRIu64 " connections\n", "bursts", broker.burstCount,
+         totalConnects);
+  if (broker.burstCount > 0) {
+    printf("  %-32s %.1f messages, %.0f bytes (max %u / %" PRIu64 ")\n", "per connection",
+           static_cast<double>(broker.discoveryMessages) / broker.burstCount,
+           static_cast<double>(broker.discoveryBytes) / broker.burstCount,
+           broker.maxBurstMessages, broker.maxBurstBytes);
+  }
+  printf("  %-32s %" PRIu64 "/s\n", "peak discovery messages", peakDiscovery);
+
+  if (restartDone) {
+    printf("\nBroker restart at %" PRIu64 " ms, down for %" PRIu64 " ms, retained messages %s\n",
+           restartAt, restartDown, broker.retainedSurvives ? "kept" : "lost");
+    printf("  %-32s %" PRIu64 "\n", "failed attempts while down", broker.failedAttempts);
+    printf("  %-32s %" PRIu64 "/s\n", "peak messages after restart", peakAfterRestart);
+    // Controllers that reconnect together keep publishing status together
+    printf("  %-32s %" PRIu64 "/s before, %" PRIu64 "/s after\n", "steady-state peak",
+           steadyBefore, steadyAfter);
+    const double fractions[] = {0.5, 0.9, 1.0};
+    for (double f : fractions) {
+      uint64_t t = percentileTime(broker.reconnectedAt, f, restartAt + restartDown);
+      char label[48];
+      snprintf(label, sizeof(label), "%.0f%% reconnected after", f * 100);
+      if (t == UINT64_MAX) {
+        printf("  %-32s not reached\n", label);
+      } else {
+        printf("  %-32s %" PRIu64 " ms\n", label, t);
+      }
+    }
+    printf("\n  Timeline around the restart (%" PRIu64 " ms buckets)\n", bucketMs);
+    printf("  %10s %10s %10s %10s %10s\n", "t (s)", "attempts", "connects", "messages", "discovery");
+    uint64_t from = restartAt >= 2 * bucketMs ? restartAt - 2 * bucketMs : 0;
+    uint64_t to = std::min(endMs, restartAt + restartDown + 12 * bucketMs);
+    for (uint64_t t = from; t < to; t += bucketMs) {
+      SecondBucket sum;
+      for (uint64_t s = t / 1000; s < (t + bucketMs) / 1000 && s < broker.seconds.size(); s++) {
+        const SecondBucket& b = broker.seconds[s];
+        sum.attempts += b.attempts;
+        sum.connects += b.connects;
+        sum.messages += b.messages;
+        sum.discovery += b.discovery;
+      }
+      printf("  %10.0f %10u %10u %10u %10u\n", t / 1000.0, sum.attempts, sum.connects,
+             sum.messages, sum.discovery);
+    }
+  }
+
+  printf("\nClient ids: %zu distinct for %u controllers, %" PRIu64 " session takeovers\n",
+         broker.sessions.size(), devices, broker.takeovers);
+
+  const char* csv = csvArg(argc, argv);
+  if (csv) {
+    FILE* f = fopen(csv, "w");
+    if (f) {
+      fprintf(f, "second,attempts,connects,messages,discovery,bytes\n");
+      for (size_t s = 0; s < broker.seconds.size(); s++) {
+        const SecondBucket& b = broker.seconds[s];
+        fprintf(f, "%zu,%u,%u,%u,%u,%" PRIu64 "\n", s, b.attempts, b.connects, b.messages,
+                b.discovery, b.bytes);
+      }
+      fclose(f);
+    }
+  }
+  return 0;
+}
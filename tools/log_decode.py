@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+"""Decode tokenized log records (see include/token_log.h).
+
+Format strings are looked up in the firmware ELF the capture was made with:
+each record carries the offset of its format string from the logTokenBase
+symbol. Bytes that are not part of a record (plain Serial output such as the
+boot messages) are passed through unchanged.
+
+    python3 tools/log_decode.py .pio/build/production/firmware.elf capture.bin
+    pio device monitor --raw | python3 tools/log_decode.py firmware.elf -
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+TOKEN_DROPPED = 0x7FFFFFFF
+HEADER_AFTER_LENGTH = 8  # token + millis
+BASE_SYMBOL = b"logTokenBase"
+
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+
+class Elf:
+    """Just enough ELF32/ELF64 parsing to read strings by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        self.is64 = self.data[4] == 2
+        self.endian = "<" if self.data[5] == 1 else ">"
+        self.sections = self._read_sections()
+
+    def _unpack(self, fmt, offset):
+        return struct.unpack_from(self.endian + fmt, self.data, offset)
+
+    def _read_sections(self):
+        if self.is64:
+            shoff, = self._unpack("Q", 0x28)
+            shentsize, shnum = self._unpack("HH", 0x3A)
+            fmt = "IIQQQQIIQQ"
+        else:
+            shoff, = self._unpack("I", 0x20)
+            shentsize, shnum = self._unpack("HH", 0x2E)
+            fmt = "IIIIIIIIII"
+        sections = []
+        for i in range(shnum):
+            (name, stype, flags, addr, offset, size,
+             link, info, align, entsize) = self._unpack(fmt, shoff + i * shentsize)
+            sections.append({"type": stype, "flags": flags, "addr": addr, "offset": offset,
+                             "size": size, "link": link, "entsize": entsize})
+        return sections
+
+    def symbol(self, wanted):
+        for sec in self.sections:
+            if sec["type"] != SHT_SYMTAB:
+                continue
+            strtab = self.sections[sec["link"]]
+            count = sec["size"] // sec["entsize"]
+            for i in range(count):
+                off = sec["offset"] + i * sec["entsize"]
+                if self.is64:
+                    name, info, other, shndx, value, size = self._unpack("IBBHQQ", off)
+                else:
+                    name, value, size, info, other, shndx = self._unpack("IIIBBH", off)
+                start = strtab["offset"] + name
+                end = self.data.index(b"\0", start)
+                if self.data[start:end] == wanted:
+                    return value
+        return None
+
+    def string_at(self, address):
+        for sec in self.sections:
+            if not sec["flags"] & SHF_ALLOC or sec["type"] == SHT_NOBITS:
+                continue
+            if sec["addr"] <= address < sec["addr"] + sec["size"]:
+                start = sec["offset"] + address - sec["addr"]
+                end = self.data.find(b"\0", start, sec["offset"] + sec["size"])
+                if end < 0:
+                    return None
+                return self.data[start:end].decode("utf-8", "replace")
+        return None
+
+
+PRINTF_SPEC = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|j|t)?([diouxXeEfgGcs%])")
+
+
+def format_c(fmt, values):
+    """printf-style formatting of decoded values, tolerant of mismatches."""
+    out = []
+    pos = 0
+    it = iter(values)
+    for m in PRINTF_SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        value = next(it, "<missing>")
+        if conv == "u":
+            conv = "d"
+        elif conv == "i":
+            conv = "d"
+        try:
+            if conv == "c" and isinstance(value, int):
+                value = chr(value & 0xFF)
+            elif conv == "s" and not isinstance(value, str):
+                value = str(value)
+            elif conv in "dxXo" and isinstance(value, float):
+                value = int(value)
+            out.append(("%" + flags + conv) % value)
+        except (TypeError, ValueError):
+            out.append(str(value))
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+class Decoder:
+    def __init__(self, elf):
+        self.elf = elf
+        self.base = elf.symbol(BASE_SYMBOL)
+        if self.base is None:
+            raise ValueError("symbol logTokenBase not found; was the ELF built with token_log.cpp?")
+        self.buffer = bytearray()
+
+    def _args(self, body):
+        values = []
+        i = 0
+        while i < len(body):
+            tag = chr(body[i])
+            if tag in "iuf":
+                if i + 5 > len(body):
+                    return None
+                raw = body[i + 1:i + 5]
+                if tag == "i":
+                    values.append(struct.unpack("<i", raw)[0])
+                elif tag == "u":
+                    values.append(struct.unpack("<I", raw)[0])
+                else:
+                    values.append(struct.unpack("<f", raw)[0])
+                i += 5
+            elif tag == "s":
+                if i + 2 > len(body):
+                    return None
+                n = body[i + 1]
+                if i + 2 + n > len(body):
+                    return None
+                values.append(bytes(body[i + 2:i + 2 + n]).decode("utf-8", "replace"))
+                i += 2 + n
+            else:
+                return None
+        return values
+
+    def _record(self, frame):
+        """Decode one framed record; returns text or None if it is not valid."""
+        token, millis = struct.unpack_from("<iI", frame, 0)
+        values = self._args(frame[HEADER_AFTER_LENGTH:])
+        if values is None:
+            return None
+        if token == TOKEN_DROPPED:
+            return "[%10.3f] <%s log records dropped>\n" % (millis / 1000.0, values[0] if values else "?")
+        fmt = self.elf.string_at(self.base + token)
+        if fmt is None:
+            return None
+        return "[%10.3f] %s" % (millis / 1000.0, format_c(fmt, values))
+
+    def feed(self, chunk, out):
+        self.buffer.extend(chunk)
+        buf = self.buffer
+        i = 0
+        text_start = 0
+        while i < len(buf):
+            if buf[i] != SYNC:
+                i += 1
+                continue
+            if i + 2 > len(buf):
+                break
+            length = buf[i + 1]
+            if length < HEADER_AFTER_LENGTH:
+                i += 1
+                continue
+            if i + 2 + length > len(buf):
+                break
+            text = self._record(bytes(buf[i + 2:i + 2 + length]))
+            if text is None:
+                i += 1
+                continue
+            out.write(buf[text_start:i].decode("utf-8", "replace"))
+            out.write(text)
+            i += 2 + length
+            text_start = i
+        # Keep a possibly incomplete record for the next chunk
+        keep_from = i if i < len(buf) else len(buf)
+        out.write(buf[text_start:keep_from].decode("utf-8", "replace"))
+        del buf[:keep_from]
+
+    def finish(self, out):
+        out.write(self.buffer.decode("utf-8", "replace"))
+        self.buffer.clear()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("elf", help="firmware ELF the capture was produced with")
+    parser.add_argument("capture", help="raw serial capture, or - for stdin")
+    args = parser.parse_args()
+
+    decoder = Decoder(Elf(args.elf))
+    stream = sys.stdin.buffer if args.capture == "-" else open(args.capture, "rb")
+    with stream:
+        while True:
+            chunk = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+            if not chunk:
+                break
+            decoder.feed(chunk, sys.stdout)
+            sys.stdout.flush()
+    decoder.finish(sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
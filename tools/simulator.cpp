@@ -0,0 +1,491 @@
+/*
+ * Deterministic virtual-clock simulator for setup()/loop()
+ * ========================================================
+ * Runs the real firmware on the host against a virtual millis() that advances
+ * in fixed steps, with scripted or randomly generated broker outages, dropped
+ * connections and zone commands. Simulated weeks take seconds of wall time.
+ *
+ * Reports:
+ * - zone runs: how long zones actually stay on versus MAX_ZONE_RUNTIME, and
+ *              the safety_off events that reached the broker, with their age
+ *              on arrival (replayed from the offline log after an outage)
+ * - status:    interval between publishStatus() calls versus STATUS_INTERVAL
+ * - reconnect: spacing of connect attempts versus RECONNECT_INTERVAL, time
+ *              from broker recovery to reconnection, and zone commands lost
+ *              while the controller was offline or held for it by its
+ *              persistent session (MQTT_PERSISTENT_SESSION), and zone state
+ *              publishes (a reconnect republishes every zone unless the
+ *              offline log can bring the broker up to date)
+ * - loop:      virtual time per loop() call, overall and for the calls that
+ *              ran a connect step, against MQTT_CONNECT_MAX_BLOCK_MS (the
+ *              only blocking calls are the TCP and CONNECT steps)
+ *
+ *   pio run -e simulator && .pio/build/simulator/program --days=14 --step-ms=50
+ *
+ * Options (all --name=value, times in ms):
+ *   --days, --step-ms, --seed, --start-ms (e.g. 4294000000 to cross the
+ *   millis() wrap), --command-every-ms, --forget-off-pct, --outage-every-ms,
+ *   --outage-ms, --drop-every-ms, --drop-ms (how long the controller's
+ *   Wi-Fi stays gone after a drop; the broker stays up), --connect-timeout-ms
+ *   (how long a TCP connect to the down broker hangs), --connect-ms (per
+ *   round trip: TCP handshake, CONNECT/CONNACK), --script=FILE
+ *
+ * Script lines: "<time_ms> <action> [zone]" with actions on, off,
+ * broker-down, broker-up and drop; '#' starts a comment. A script replaces
+ * the random generator.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_common.h"
+#include "config.h"
+#include "controller.h"
+#include "mqtt_handler.h"
+
+void setup();
+void loop();
+
+namespace {
+
+enum EventType { kZoneOn, kZoneOff, kBrokerDown, kBrokerUp, kDrop };
+
+struct Event {
+  uint64_t at;   // simulated ms since start (64-bit, independent of millis() wrap)
+  EventType type;
+  int zone;
+  bool operator>(const Event& other) const { return at > other.at; }
+};
+
+typedef std::priority_queue<Event, std::vector<Event>, std::greater<Event> > EventQueue;
+
+struct Summary {
+  uint64_t count = 0;
+  uint64_t total = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+
+  void add(uint64_t v) {
+    count++;
+    total += v;
+    min = std::min(min, v);
+    max = std::max(max, v);
+  }
+  void print(const char* label) const {
+    if (count == 0) {
+      printf("  %-34s none\n", label);
+      return;
+    }
+    printf("  %-34s n=%-8" PRIu64 " min=%-10" PRIu64 " mean=%-10" PRIu64 " max=%" PRIu64 "\n",
+           label, count, min, total / count, max);
+  }
+};
+
+// Simulated time in 64 bits; the firmware only sees the low 32 bits
+uint64_t simNow = 0;
+uint32_t startMs = 0;
+
+void setClock(uint64_t t) {
+  simNow = t;
+  hal::native::setClock(static_cast<uint32_t>(startMs + t));
+}
+
+// Broker stand-in: does not answer the TCP connect while down, so the
+// firmware's connect step waits out its timeout (or connectTimeoutMs, if that
+// is shorter) on the virtual clock, like a blocking WiFiClient::connect().
+// A persistent session outlives disconnects and outages (broker persistence
+// on) and holds zone commands while the controller is offline once it has
+// subscribed to them at QoS 1.
+class SimBroker : public hal::native::BrokerLink {
+ public:
+  struct Message {
+    std::string topic;
+    std::string payload;
+  };
+
+  bool up = true;
+  uint32_t connectTimeoutMs = 5000;
+  uint32_t connectMs = 20;
+
+  uint64_t attempts = 0;
+  uint64_t failedAttempts = 0;
+  uint64_t lastAttemptAt = 0;
+  bool haveAttempt = false;
+  bool waitingSinceUp = false;
+  uint64_t upAt = 0;
+  uint64_t lastStatusAt = 0;
+  bool haveStatus = false;
+  uint64_t publishes = 0;
+  uint64_t zoneStatePublishes = 0;
+  Summary safetyEventAge;          // s, "age_s" of home/sprinkler/event
+  uint64_t unreachableUntil = 0;  // the controller's Wi-Fi is down (drop)
+
+  bool sessionExists = false;
+  bool sessionWasPresent = false;  // CONNACK flag of the last connect
+  uint8_t commandQos = 0;          // zone command subscription in the session
+  std::vector<Message> held;       // commands for the offline controller
+
+  Summary attemptSpacing;
+  Summary recoveryTime;
+  Summary statusInterval;
+  Summary statusIntervalAcrossOutage;
+  bool outageSinceStatus = false;
+
+  bool open(uint32_t timeoutMs) override {
+    attempts++;
+    if (haveAttempt) {
+      attemptSpacing.add(simNow - lastAttemptAt);
+    }
+    haveAttempt = true;
+    lastAttemptAt = simNow;
+    if (!up || simNow < unreachableUntil) {
+      failedAttempts++;
+      setClock(simNow + std::min(connectTimeoutMs, timeoutMs));
+      return false;
+    }
+    setClock(simNow + connectMs);
+    return true;
+  }
+
+  bool connect(const hal::native::ConnectOptions& options) override {
+    if (!up) {
+      failedAttempts++;
+      return false;
+    }
+    if (options.cleanSession) {
+      sessionExists = false;
+      commandQos = 0;
+      held.clear();
+    }
+    sessionWasPresent = sessionExists;
+    sessionExists = !options.cleanSession;
+    setClock(simNow + connectMs);
+    if (waitingSinceUp) {
+      recoveryTime.add(simNow - upAt);
+      waitingSinceUp = false;
+    }
+    haveAttempt = false;  // spacing is only measured while disconnected
+    return true;
+  }
+
+  bool sessionPresent() override {
+    return sessionWasPresent;
+  }
+
+  bool subscribe(const char* topic, uint8_t qos) override {
+    if (strcmp(topic, MQTT_ZONE_COMMAND) == 0) {
+      commandQos = qos;
+    }
+    return true;
+  }
+
+  // Whether a command the controller cannot take now waits in its session
+  bool holds() const {
+    return up && sessionExists && commandQos > 0;
+  }
+
+  bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained) override {
+    (void)retained;
+    publishes++;
+    if (strncmp(topic, MQTT_TOPIC_PREFIX "zone/", strlen(MQTT_TOPIC_PREFIX "zone/")) == 0) {
+      zoneStatePublishes++;
+    }
+    std::string text(reinterpret_cast<const char*>(payload), length);
+    size_t age = text.find("\"age_s\":");
+    if (strcmp(topic, MQTT_EVENT) == 0 && age != std::string::npos) {
+      safetyEventAge.add(strtoull(text.c_str() + age + 8, nullptr, 10));
+    }
+    if (strcmp(topic, MQTT_STATUS) == 0 && length > 0 && payload[0] == '{') {
+      if (haveStatus) {
+        (outageSinceStatus ? statusIntervalAcrossOutage : statusInterval).add(simNow - lastStatusAt);
+      }
+      haveStatus = true;
+      lastStatusAt = simNow;
+      outageSinceStatus = false;
+    }
+    return true;
+  }
+
+  void setUp(bool isUp, uint64_t at) {
+    if (isUp && !up) {
+      upAt = at;
+      waitingSinceUp = true;
+    }
+    up = isUp;
+  }
+};
+
+struct ZoneTracker {
+  bool on = false;
+  uint64_t onSince = 0;
+};
+
+SimBroker broker;
+ZoneTracker zones[NUM_ZONES];
+Summary zoneRuns;
+Summary overshoot;
+Summary loopStall;
+Summary connectStall;
+uint64_t runsOverLimit = 0;
+uint64_t dropMs = 0;
+uint64_t commandsSent = 0;
+uint64_t commandsLost = 0;
+uint64_t commandsHeld = 0;
+
+void sendCommand(int zone, const char* payload) {
+  char topic[MQTT_TOPIC_BUFFER_SIZE];
+  snprintf(topic, sizeof(topic), "%szone/%d/command", MQTT_TOPIC_PREFIX, zone);
+  commandsSent++;
+  if (hal::native::deliver(topic, payload, strlen(payload))) {
+    return;
+  }
+  if (broker.holds()) {
+    broker.held.push_back(SimBroker::Message{topic, payload});
+    commandsHeld++;
+  } else {
+    commandsLost++;
+  }
+}
+
+// Hand the commands the session held to the controller once it is back
+void deliverHeld() {
+  if (broker.held.empty() || !hal::native::device().mqtt.connected) {
+    return;
+  }
+  for (const SimBroker::Message& m : broker.held) {
+    hal::native::deliver(m.topic.c_str(), m.payload.data(), m.payload.size());
+  }
+  broker.held.clear();
+}
+
+void applyEvent(const Event& e) {
+  switch (e.type) {
+    case kZoneOn:
+      sendCommand(e.zone, "ON");
+      break;
+    case kZoneOff:
+      sendCommand(e.zone, "OFF");
+      break;
+    case kBrokerDown:
+      broker.setUp(false, e.at);
+      broker.outageSinceStatus = true;
+      if (hal::native::device().mqtt.connected) {
+        hal::native::dropConnection();
+      }
+      break;
+    case kBrokerUp:
+      broker.setUp(true, e.at);
+      break;
+    case kDrop:
+      broker.unreachableUntil = simNow + dropMs;
+      if (hal::native::device().mqtt.connected) {
+        hal::native::dropConnection();
+        broker.outageSinceStatus = true;
+      }
+      break;
+  }
+}
+
+void trackZones() {
+  for (int i = 0; i < NUM_ZONES; i++) {
+    bool on = hal::gpioRead(ZONE_PINS[i]);
+    if (on && !zones[i].on) {
+      zones[i].onSince = simNow;
+    } else if (!on && zones[i].on) {
+      uint64_t duration = simNow - zones[i].onSince;
+      zoneRuns.add(duration);
+      if (duration > MAX_ZONE_RUNTIME) {
+        runsOverLimit++;
+        overshoot.add(duration - MAX_ZONE_RUNTIME);
+      }
+    }
+    zones[i].on = on;
+  }
+}
+
+void generateRandom(EventQueue& events, uint64_t endMs, uint64_t seed, int argc, char** argv) {
+  std::mt19937_64 rng(seed);
+  uint64_t commandEvery = bench::argValue(argc, argv, "command-every-ms", 6ULL * 3600 * 1000);
+  uint64_t forgetOffPct = bench::argValue(argc, argv, "forget-off-pct", 10);
+  uint64_t outageEvery = bench::argValue(argc, argv, "outage-every-ms", 24ULL * 3600 * 1000);
+  uint64_t outageMs = bench::argValue(argc, argv, "outage-ms", 10ULL * 60 * 1000);
+  uint64_t dropEvery = bench::argValue(argc, argv, "drop-every-ms", 8ULL * 3600 * 1000);
+
+  std::exponential_distribution<double> commandGap(1.0 / commandEvery);
+  std::uniform_int_distribution<int> zonePick(1, NUM_ZONES);
+  std::uniform_int_distribution<uint64_t> runLength(60 * 1000, 3ULL * 3600 * 1000);
+  std::uniform_int_distribution<uint64_t> pct(0, 99);
+  for (uint64_t t = static_cast<uint64_t>(commandGap(rng)); t < endMs;
+       t += 1 + static_cast<uint64_t>(commandGap(rng))) {
+    int zone = zonePick(rng);
+    events.push(Event{t, kZoneOn, zone});
+    if (pct(rng) >= forgetOffPct) {
+      events.push(Event{t + runLength(rng), kZoneOff, zone});
+    }
+  }
+
+  if (outageEvery > 0) {
+    std::exponential_distribution<double> outageGap(1.0 / outageEvery);
+    std::exponential_distribution<double> outageLength(1.0 / std::max<uint64_t>(outageMs, 1));
+    for (uint64_t t = static_cast<uint64_t>(outageGap(rng)); t < endMs;
+         t += static_cast<uint64_t>(outageGap(rng))) {
+      uint64_t length = 1 + static_cast<uint64_t>(outageLength(rng));
+      events.push(Event{t, kBrokerDown, 0});
+      events.push(Event{t + length, kBrokerUp, 0});
+      t += length;
+    }
+  }
+
+  if (dropEvery > 0) {
+    std::exponential_distribution<double> dropGap(1.0 / dropEvery);
+    for (uint64_t t = static_cast<uint64_t>(dropGap(rng)); t < endMs;
+         t += 1 + static_cast<uint64_t>(dropGap(rng))) {
+      events.push(Event{t, kDrop, 0});
+    }
+  }
+}
+
+bool loadScript(const char* path, EventQueue& events) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "cannot open script %s\n", path);
+    return false;
+  }
+  char line[128];
+  int lineNo = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    char* hash = strchr(line, '#');
+    if (hash) {
+      *hash = '\0';
+    }
+    unsigned long long at;
+    char action[32];
+    int zone = 0;
+    int fields = sscanf(line, "%llu %31s %d", &at, action, &zone);
+    if (fields < 2) {
+      continue;
+    }
+    Event e = {at, kDrop, zone};
+    if (strcmp(action, "on") == 0) {
+      e.type = kZoneOn;
+    } else if (strcmp(action, "off") == 0) {
+      e.type = kZoneOff;
+    } else if (strcmp(action, "broker-down") == 0) {
+      e.type = kBrokerDown;
+    } else if (strcmp(action, "broker-up") == 0) {
+      e.type = kBrokerUp;
+    } else if (strcmp(action, "drop") != 0) {
+      fprintf(stderr, "%s:%d: unknown action '%s'\n", path, lineNo, action);
+      fclose(f);
+      return false;
+    }
+    events.push(e);
+  }
+  fclose(f);
+  return true;
+}
+
+const char* scriptArg(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--script=", 9) == 0) {
+      return argv[i] + 9;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t days = bench::argValue(argc, argv, "days", 14);
+  uint64_t stepMs = std::max<uint64_t>(1, bench::argValue(argc, argv, "step-ms", 50));
+  uint64_t seed = bench::argValue(argc, argv, "seed", 1);
+  startMs = static_cast<uint32_t>(bench::argValue(argc, argv, "start-ms", 0));
+  broker.connectTimeoutMs = static_cast<uint32_t>(bench::argValue(argc, argv, "connect-timeout-ms", 5000));
+  broker.connectMs = static_cast<uint32_t>(bench::argValue(argc, argv, "connect-ms", 20));
+  dropMs = bench::argValue(argc, argv, "drop-ms", 0);
+  uint64_t endMs = days * 24 * 3600 * 1000;
+
+  EventQueue events;
+  const char* script = scriptArg(argc, argv);
+  if (script) {
+    if (!loadScript(script, events)) {
+      return 1;
+    }
+  } else {
+    generateRandom(events, endMs, seed, argc, argv);
+  }
+
+  hal::native::console.enabled = false;
+  hal::native::useVirtualClock(startMs);
+  hal::native::device().mqtt.link = &broker;
+  setClock(0);
+
+  auto wallStart = std::chrono::steady_clock::now();
+  setup();
+  uint64_t iterations = 0;
+  while (simNow < endMs) {
+    while (!events.empty() && events.top().at <= simNow) {
+      applyEvent(events.top());
+      events.pop();
+    }
+    uint64_t before = simNow;
+    bool connecting = controller.connect.stage != CONNECT_UP || !hal::native::device().mqtt.connected;
+    loop();
+    deliverHeld();
+    // Blocking calls inside loop() advance the clock through the broker
+    simNow = before + static_cast<uint32_t>(hal::millis() - static_cast<uint32_t>(startMs + before));
+    loopStall.add(simNow - before);
+    if (connecting) {
+      connectStall.add(simNow - before);
+    }
+    iterations++;
+    trackZones();
+    uint64_t next = simNow + stepMs;
+    if (!events.empty() && events.top().at < next && events.top().at > simNow) {
+      next = events.top().at;
+    }
+    setClock(next);
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printf("Simulated %" PRIu64 " days in %.2f s wall (%" PRIu64 " loop iterations, step %" PRIu64 " ms)\n",
+         days, wall, iterations, stepMs);
+  printf("\nZones (MAX_ZONE_RUNTIME = %d ms)\n", MAX_ZONE_RUNTIME);
+  zoneRuns.print("run length (ms)");
+  printf("  %-34s %" PRIu64 "\n", "runs longer than limit", runsOverLimit);
+  overshoot.print("time past limit (ms)");
+  broker.safetyEventAge.print("safety_off event age (s)");
+  for (int i = 0; i < NUM_ZONES; i++) {
+    if (zones[i].on) {
+      printf("  zone %d still on at end, for %" PRIu64 " ms\n", i + 1, simNow - zones[i].onSince);
+    }
+  }
+  printf("\nStatus (STATUS_INTERVAL = %d ms)\n", STATUS_INTERVAL);
+  broker.statusInterval.print("interval while connected (ms)");
+  broker.statusIntervalAcrossOutage.print("interval across outage (ms)");
+  if (broker.statusInterval.count > 0) {
+    printf("  %-34s %" PRIu64 " ms\n", "worst lateness", broker.statusInterval.max - STATUS_INTERVAL);
+  }
+  printf("\nReconnect (RECONNECT_INTERVAL = %d ms)\n", RECONNECT_INTERVAL);
+  printf("  %-34s %" PRIu64 " (%" PRIu64 " failed)\n", "connect attempts", broker.attempts,
+         broker.failedAttempts);
+  broker.attemptSpacing.print("attempt spacing (ms)");
+  broker.recoveryTime.print("broker up -> connected (ms)");
+  printf("  %-34s %" PRIu64 " sent, %" PRIu64 " lost while offline, %" PRIu64
+         " held by the session\n", "commands", commandsSent, commandsLost, commandsHeld);
+  printf("  %-34s %" PRIu64 "\n", "zone state publishes", broker.zoneStatePublishes);
+  printf("\nLoop (MQTT_CONNECT_MAX_BLOCK_MS = %" PRIu32 " ms)\n", MQTT_CONNECT_MAX_BLOCK_MS);
+  loopStall.print("virtual time per loop() (ms)");
+  connectStall.print("... while connecting (ms)");
+  printf("  %-34s %" PRIu64 " ms\n", "worst stall", loopStall.max);
+  return 0;
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""Decode MessagePack status reports (see include/status_report.h).
+
+Reads the payloads published on home/sprinkler/status/msgpack and prints each
+as one line of JSON, the same document home/sprinkler/status carries. Input is
+either hex, one payload per line (mosquitto_sub -F %x), or raw bytes of one or
+more payloads back to back (MessagePack needs no framing).
+
+    mosquitto_sub -h broker -t home/sprinkler/status/msgpack -F %x | \\
+        python3 tools/status_decode.py --hex -
+    python3 tools/status_decode.py --merge capture.bin
+
+--merge applies each delta report to the last full one and prints the
+resulting complete status instead of the delta.
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import binascii
+import json
+import struct
+import sys
+
+
+class Truncated(Exception):
+    pass
+
+
+class Unpacker:
+    """The MessagePack subset ArduinoJson writes, plus the rest of the format."""
+
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def _take(self, n):
+        if self.pos + n > len(self.data):
+            raise Truncated()
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def _unpack(self, fmt):
+        return struct.unpack(">" + fmt, self._take(struct.calcsize(">" + fmt)))[0]
+
+    def _str(self, n):
+        return self._take(n).decode("utf-8", "replace")
+
+    def _array(self, n):
+        return [self.value() for _ in range(n)]
+
+    def _map(self, n):
+        out = {}
+        for _ in range(n):
+            key = self.value()
+            out[key if isinstance(key, str) else str(key)] = self.value()
+        return out
+
+    def value(self):
+        tag = self._take(1)[0]
+        if tag <= 0x7F:
+            return tag
+        if tag >= 0xE0:
+            return tag - 0x100
+        if 0x80 <= tag <= 0x8F:
+            return self._map(tag & 0x0F)
+        if 0x90 <= tag <= 0x9F:
+            return self._array(tag & 0x0F)
+        if 0xA0 <= tag <= 0xBF:
+            return self._str(tag & 0x1F)
+        simple = {0xC0: None, 0xC2: False, 0xC3: True}
+        if tag in simple:
+            return simple[tag]
+        numbers = {0xCA: "f", 0xCB: "d", 0xCC: "B", 0xCD: "H", 0xCE: "I", 0xCF: "Q",
+                   0xD0: "b", 0xD1: "h", 0xD2: "i", 0xD3: "q"}
+        if tag in numbers:
+            return self._unpack(numbers[tag])
+        lengths = {0xD9: "B", 0xDA: "H", 0xDB: "I", 0xC4: "B", 0xC5: "H", 0xC6: "I",
+                   0xDC: "H", 0xDD: "I", 0xDE: "H", 0xDF: "I"}
+        if tag in lengths:
+            n = self._unpack(lengths[tag])
+            if tag in (0xD9, 0xDA, 0xDB):
+                return self._str(n)
+            if tag in (0xC4, 0xC5, 0xC6):
+                return binascii.hexlify(self._take(n)).decode()
+            if tag in (0xDC, 0xDD):
+                return self._array(n)
+            return self._map(n)
+        raise ValueError("unsupported MessagePack type 0x%02x at byte %d" % (tag, self.pos - 1))
+
+    def values(self):
+        while self.pos < len(self.data):
+            yield self.value()
+
+
+def merge(state, report):
+    """Apply a report to the last full status; returns the complete status."""
+    if "status" in report or state is None:
+        return json.loads(json.dumps(report))  # full report: start over
+    for key, value in report.items():
+        if key == "since_boot":
+            state.setdefault("since_boot", {}).update(value)
+        elif key == "zones":
+            zones = {z.get("zone"): z for z in state.setdefault("zones", [])}
+            for change in value:
+                zones.setdefault(change.get("zone"), {"zone": change.get("zone")}).update(change)
+            state["zones"] = sorted(zones.values(), key=lambda z: z.get("zone") or 0)
+        else:
+            state[key] = value
+    return state
+
+
+def payloads(args):
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    with stream:
+        if not args.hex:
+            yield stream.read()
+            return
+        for line in stream:
+            line = line.strip()
+            if line:
+                yield binascii.unhexlify(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input", help="payload capture, or - for stdin")
+    parser.add_argument("--hex", action="store_true", help="one hex-encoded payload per line")
+    parser.add_argument("--merge", action="store_true", help="print complete status after each delta")
+    args = parser.parse_args()
+
+    state = None
+    status = 0
+    for data in payloads(args):
+        unpacker = Unpacker(data)
+        try:
+            for report in unpacker.values():
+                if args.merge and isinstance(report, dict):
+                    state = merge(state, report)
+                    report = state
+                print(json.dumps(report, separators=(",", ":")))
+        except (Truncated, ValueError) as error:
+            print("error: %s" % (str(error) or "truncated payload"), file=sys.stderr)
+            status = 1
+        sys.stdout.flush()
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())